@@ -119,29 +119,49 @@ PYBIND11_MODULE(flashlight_lib_audio_feature, m) {
       .def("apply_in_place", &Ceplifter::applyInPlace, "input"_a);
   py::class_<Dct>(m, "Dct")
       .def(py::init<int64_t, int64_t>(), "num_filters"_a, "num_ceps"_a)
-      .def("apply", &Dct::apply, "input"_a);
+      .def(
+          "apply",
+          static_cast<std::vector<float> (Dct::*)(const std::vector<float>&)
+                          const>(&Dct::apply),
+          "input"_a);
   py::class_<Derivatives>(m, "Derivatives")
       .def(py::init<int64_t, int64_t>(), "delta_window"_a, "acc_window"_a)
       .def("apply", &Derivatives::apply, "input"_a, "num_feat"_a);
   py::class_<Dither>(m, "Dither")
       .def(py::init<float>(), "dither_val"_a)
       .def("apply", &Dither::apply, "input"_a)
-      .def("apply_in_place", &Dither::applyInPlace, "input"_a);
+      .def(
+          "apply_in_place",
+          static_cast<void (Dither::*)(std::vector<float>&)>(
+              &Dither::applyInPlace),
+          "input"_a);
   py::class_<Mfcc>(m, "Mfcc")
       .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &Mfcc::apply, "input"_a)
+      .def(
+          "apply",
+          static_cast<std::vector<float> (Mfcc::*)(const std::vector<float>&)>(
+              &Mfcc::apply),
+          "input"_a)
       .def("batch_apply", &Mfcc::batchApply, "input"_a, "batch_sz"_a)
       .def("output_size", &Mfcc::outputSize, "input_sz"_a)
       .def("get_feature_params", &Mfcc::getFeatureParams);
   py::class_<Mfsc>(m, "Mfsc")
       .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &Mfsc::apply, "input"_a)
+      .def(
+          "apply",
+          static_cast<std::vector<float> (Mfsc::*)(const std::vector<float>&)>(
+              &Mfsc::apply),
+          "input"_a)
       .def("batch_apply", &Mfsc::batchApply, "input"_a, "batch_sz"_a)
       .def("output_size", &Mfsc::outputSize, "input_sz"_a)
       .def("get_feature_params", &Mfsc::getFeatureParams);
   py::class_<PowerSpectrum>(m, "PowerSpectrum")
       .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &PowerSpectrum::apply, "input"_a)
+      .def(
+          "apply",
+          static_cast<std::vector<float> (PowerSpectrum::*)(
+              const std::vector<float>&)>(&PowerSpectrum::apply),
+          "input"_a)
       .def("batch_apply", &PowerSpectrum::batchApply, "input"_a, "batch_sz"_a)
       .def("output_size", &PowerSpectrum::outputSize, "input_sz"_a)
       .def("get_feature_params", &PowerSpectrum::getFeatureParams);
@@ -164,13 +184,32 @@ PYBIND11_MODULE(flashlight_lib_audio_feature, m) {
           "low_freq"_a = 0,
           "high_freq"_a = -1,
           "freq_scale"_a = FrequencyScale::MEL)
-      .def("apply", &TriFilterbank::apply, "input"_a, "mel_floor"_a = 0.0)
+      .def(
+          "apply",
+          static_cast<std::vector<float> (TriFilterbank::*)(
+              const std::vector<float>&, float) const>(&TriFilterbank::apply),
+          "input"_a,
+          "mel_floor"_a = 0.0)
       .def("filterbank", &TriFilterbank::filterbank);
   py::class_<Windowing>(m, "Windowing")
       .def(py::init<int64_t, WindowType>(), "N"_a, "window"_a)
       .def("apply", &Windowing::apply, "input"_a)
       .def("apply_in_place", &Windowing::applyInPlace, "input"_a);
 
-  m.def("frame_signal", fl::lib::audio::frameSignal, "input"_a, "params"_a);
-  m.def("cblas_gemm", fl::lib::audio::cblasGemm, "A"_a, "B"_a, "n"_a, "k"_a);
+  m.def(
+      "frame_signal",
+      static_cast<std::vector<float> (*)(
+          const std::vector<float>&, const FeatureParams&)>(
+          fl::lib::audio::frameSignal),
+      "input"_a,
+      "params"_a);
+  m.def(
+      "cblas_gemm",
+      static_cast<std::vector<float> (*)(
+          const std::vector<float>&, const std::vector<float>&, int, int)>(
+          fl::lib::audio::cblasGemm),
+      "A"_a,
+      "B"_a,
+      "n"_a,
+      "k"_a);
 }
@@ -5,11 +5,15 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/StreamingDecoderSession.h"
 
 #ifdef FL_LIBRARIES_USE_KENLM
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
@@ -112,6 +116,18 @@ std::vector<DecodeResult> LexiconDecoder_decode(
   return decoder.decode(reinterpret_cast<const float*>(emissions), T, N);
 }
 
+std::vector<std::vector<DecodeResult>> LexiconDecoder_decodeBatch(
+    LexiconDecoder& decoder,
+    const std::vector<uintptr_t>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  std::vector<const float*> emissionPtrs;
+  for (auto emission : emissions) {
+    emissionPtrs.push_back(reinterpret_cast<const float*>(emission));
+  }
+  return decoder.decodeBatch(emissionPtrs, T, N);
+}
+
 void LexiconFreeDecoder_decodeStep(
     LexiconFreeDecoder& decoder,
     uintptr_t emissions,
@@ -128,6 +144,14 @@ std::vector<DecodeResult> LexiconFreeDecoder_decode(
   return decoder.decode(reinterpret_cast<const float*>(emissions), T, N);
 }
 
+void StreamingDecoderSession_step(
+    StreamingDecoderSession& session,
+    uintptr_t emissions,
+    int T,
+    int N) {
+  session.step(reinterpret_cast<const float*>(emissions), T, N);
+}
+
 } // namespace
 
 PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
@@ -147,13 +171,30 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
   py::class_<Trie, TriePtr>(m, "Trie")
       .def(py::init<int, int>(), "max_children"_a, "root_idx"_a)
       .def("get_root", &Trie::getRoot)
-      .def("insert", &Trie::insert, "indices"_a, "label"_a, "score"_a)
+      .def(
+          "insert",
+          static_cast<TrieNodePtr (Trie::*)(
+              const std::vector<int>&, int, float)>(&Trie::insert),
+          "indices"_a,
+          "label"_a,
+          "score"_a)
       .def("search", &Trie::search, "indices"_a)
-      .def("smear", &Trie::smear, "smear_mode"_a);
+      .def("smear", &Trie::smear, "smear_mode"_a, "n_threads"_a = 1);
+
+  py::class_<FlatTrie, FlatTriePtr>(m, "FlatTrie")
+      .def(py::init<const Trie&>(), "trie"_a)
+      .def_static("load", &FlatTrie::load, "path"_a, "fingerprint"_a = 0)
+      .def_static("load_fingerprint", &FlatTrie::loadFingerprint, "path"_a)
+      .def("save", &FlatTrie::save, "path"_a, "fingerprint"_a = 0)
+      .def("get_num_nodes", &FlatTrie::getNumNodes)
+      .def("get_max_children", &FlatTrie::getMaxChildren);
 
   py::class_<LM, LMPtr, PyLM>(m, "LM")
       .def(py::init<>())
-      .def("start", &LM::start, "start_with_nothing"_a)
+      .def(
+          "start",
+          static_cast<LMStatePtr (LM::*)(bool)>(&LM::start),
+          "start_with_nothing"_a)
       .def("score", &LM::score, "state"_a, "usr_token_idx"_a)
       .def("finish", &LM::finish, "state"_a);
 
@@ -163,12 +204,31 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def("compare", &LMState::compare, "state"_a)
       .def("child", &LMState::child<LMState>, "usr_index"_a);
 
+  py::class_<LMStatePoolStats>(m, "LMStatePoolStats")
+      .def_readonly("n_live_states", &LMStatePoolStats::nLiveStates)
+      .def_readonly("n_peak_live_states", &LMStatePoolStats::nPeakLiveStates)
+      .def_readonly("n_created_states", &LMStatePoolStats::nCreatedStates)
+      .def_readonly("n_links", &LMStatePoolStats::nLinks)
+      .def_readonly("n_link_hits", &LMStatePoolStats::nLinkHits)
+      .def_readonly("n_link_misses", &LMStatePoolStats::nLinkMisses)
+      .def_readonly("n_evicted_links", &LMStatePoolStats::nEvictedLinks)
+      .def_readonly("n_bytes", &LMStatePoolStats::nBytes);
+
 #ifdef FL_LIBRARIES_USE_KENLM
+  py::class_<KenLMCacheStats>(m, "KenLMCacheStats")
+      .def_readonly("hits", &KenLMCacheStats::hits)
+      .def_readonly("misses", &KenLMCacheStats::misses)
+      .def("hit_rate", &KenLMCacheStats::hitRate);
+
   py::class_<KenLM, KenLMPtr, LM>(m, "KenLM")
       .def(
-          py::init<const std::string&, const Dictionary&>(),
+          py::init<const std::string&, const Dictionary&, size_t, int>(),
           "path"_a,
-          "usr_token_dict"_a);
+          "usr_token_dict"_a,
+          "cache_size"_a = 0,
+          "n_cache_threads"_a = 1)
+      .def("get_cache_stats", &KenLM::getCacheStats)
+      .def("reset_cache_stats", &KenLM::resetCacheStats);
 #endif
 
   py::enum_<CriterionType>(m, "CriterionType")
@@ -186,7 +246,11 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
               const double,
               const double,
               const bool,
-              const CriterionType>(),
+              const CriterionType,
+              const double,
+              const double,
+              const int,
+              const bool>(),
           "beam_size"_a,
           "beam_size_token"_a,
           "beam_threshold"_a,
@@ -195,7 +259,11 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
           "unk_score"_a,
           "sil_score"_a,
           "log_add"_a,
-          "criterion_type"_a)
+          "criterion_type"_a,
+          "beam_threshold_token"_a = 0.0,
+          "blank_skip_threshold"_a = 0.0,
+          "n_expansion_threads"_a = 0,
+          "keep_merged_hyps"_a = false)
       .def_readwrite("beam_size", &LexiconDecoderOptions::beamSize)
       .def_readwrite("beam_size_token", &LexiconDecoderOptions::beamSizeToken)
       .def_readwrite("beam_threshold", &LexiconDecoderOptions::beamThreshold)
@@ -204,7 +272,15 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def_readwrite("unk_score", &LexiconDecoderOptions::unkScore)
       .def_readwrite("sil_score", &LexiconDecoderOptions::silScore)
       .def_readwrite("log_add", &LexiconDecoderOptions::logAdd)
-      .def_readwrite("criterion_type", &LexiconDecoderOptions::criterionType);
+      .def_readwrite("criterion_type", &LexiconDecoderOptions::criterionType)
+      .def_readwrite(
+          "beam_threshold_token", &LexiconDecoderOptions::beamThresholdToken)
+      .def_readwrite(
+          "blank_skip_threshold", &LexiconDecoderOptions::blankSkipThreshold)
+      .def_readwrite(
+          "n_expansion_threads", &LexiconDecoderOptions::nExpansionThreads)
+      .def_readwrite(
+          "keep_merged_hyps", &LexiconDecoderOptions::keepMergedHyps);
 
   py::class_<LexiconFreeDecoderOptions>(m, "LexiconFreeDecoderOptions")
       .def(
@@ -215,21 +291,35 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
               const double,
               const double,
               const bool,
-              const CriterionType>(),
+              const CriterionType,
+              const double,
+              const int,
+              const bool>(),
           "beam_size"_a,
           "beam_size_token"_a,
           "beam_threshold"_a,
           "lm_weight"_a,
           "sil_score"_a,
           "log_add"_a,
-          "criterion_type"_a)
+          "criterion_type"_a,
+          "beam_threshold_token"_a = 0.0,
+          "n_expansion_threads"_a = 0,
+          "keep_merged_hyps"_a = false)
       .def_readwrite("beam_size", &LexiconFreeDecoderOptions::beamSize)
       .def_readwrite("beam_size_token", &LexiconFreeDecoderOptions::beamSizeToken)
       .def_readwrite("beam_threshold", &LexiconFreeDecoderOptions::beamThreshold)
       .def_readwrite("lm_weight", &LexiconFreeDecoderOptions::lmWeight)
       .def_readwrite("sil_score", &LexiconFreeDecoderOptions::silScore)
       .def_readwrite("log_add", &LexiconFreeDecoderOptions::logAdd)
-      .def_readwrite("criterion_type", &LexiconFreeDecoderOptions::criterionType);
+      .def_readwrite("criterion_type", &LexiconFreeDecoderOptions::criterionType)
+      .def_readwrite(
+          "beam_threshold_token",
+          &LexiconFreeDecoderOptions::beamThresholdToken)
+      .def_readwrite(
+          "n_expansion_threads",
+          &LexiconFreeDecoderOptions::nExpansionThreads)
+      .def_readwrite(
+          "keep_merged_hyps", &LexiconFreeDecoderOptions::keepMergedHyps);
 
   py::class_<DecodeResult>(m, "DecodeResult")
       .def(py::init<int>(), "length"_a)
@@ -239,6 +329,25 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def_readwrite("words", &DecodeResult::words)
       .def_readwrite("tokens", &DecodeResult::tokens);
 
+  py::class_<LatticeArc>(m, "LatticeArc")
+      .def_readwrite("from_state", &LatticeArc::from)
+      .def_readwrite("to_state", &LatticeArc::to)
+      .def_readwrite("label", &LatticeArc::label)
+      .def_readwrite("start_frame", &LatticeArc::startFrame)
+      .def_readwrite("end_frame", &LatticeArc::endFrame)
+      .def_readwrite("score", &LatticeArc::score)
+      .def_readwrite("am_score", &LatticeArc::amScore)
+      .def_readwrite("lm_score", &LatticeArc::lmScore);
+
+  py::class_<Lattice>(m, "Lattice")
+      .def(py::init<>())
+      .def("n_states", &Lattice::nStates)
+      .def("get_arcs", &Lattice::getArcs)
+      .def("get_final_states", &Lattice::getFinalStates)
+      .def("save", &Lattice::save, "path"_a)
+      .def_static("load", &Lattice::load, "path"_a)
+      .def("save_text", &Lattice::saveText, "path"_a);
+
   // NB: `decode` and `decodeStep` expect raw emissions pointers.
   py::class_<LexiconDecoder>(m, "LexiconDecoder")
       .def(py::init<
@@ -250,6 +359,15 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
            const int,
            const std::vector<float>&,
            const bool>())
+      .def(py::init<
+           LexiconDecoderOptions,
+           const FlatTriePtr,
+           const LMPtr,
+           const int,
+           const int,
+           const int,
+           const std::vector<float>&,
+           const bool>())
       .def("decode_begin", &LexiconDecoder::decodeBegin)
       .def(
           "decode_step",
@@ -259,12 +377,21 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
           "N"_a)
       .def("decode_end", &LexiconDecoder::decodeEnd)
       .def("decode", &LexiconDecoder_decode, "emissions"_a, "T"_a, "N"_a)
+      .def(
+          "decode_batch",
+          &LexiconDecoder_decodeBatch,
+          "emissions"_a,
+          "T"_a,
+          "N"_a)
       .def("prune", &LexiconDecoder::prune, "look_back"_a = 0)
       .def(
           "get_best_hypothesis",
           &LexiconDecoder::getBestHypothesis,
           "look_back"_a = 0)
-      .def("get_all_final_hypothesis", &LexiconDecoder::getAllFinalHypothesis);
+      .def("get_all_final_hypothesis", &LexiconDecoder::getAllFinalHypothesis)
+      .def("get_lattice", &LexiconDecoder::getLattice)
+      .def("get_lm_state_pool_stats", &LexiconDecoder::getLMStatePoolStats)
+      .def("n_skipped_frames", &LexiconDecoder::nSkippedFrames);
 
   py::class_<LexiconFreeDecoder>(m, "LexiconFreeDecoder")
       .def(py::init<
@@ -289,5 +416,50 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
           "look_back"_a = 0)
       .def(
           "get_all_final_hypothesis",
-          &LexiconFreeDecoder::getAllFinalHypothesis);
+          &LexiconFreeDecoder::getAllFinalHypothesis)
+      .def("get_lattice", &LexiconFreeDecoder::getLattice)
+      .def(
+          "get_lm_state_pool_stats",
+          &LexiconFreeDecoder::getLMStatePoolStats);
+
+  py::class_<StreamingDecoderOptions>(m, "StreamingDecoderOptions")
+      .def(
+          py::init<const int, const int, const int>(),
+          "prune_interval"_a,
+          "look_back"_a,
+          "max_buffered_frames"_a = 0)
+      .def_readwrite("prune_interval", &StreamingDecoderOptions::pruneInterval)
+      .def_readwrite("look_back", &StreamingDecoderOptions::lookBack)
+      .def_readwrite(
+          "max_buffered_frames", &StreamingDecoderOptions::maxBufferedFrames);
+
+  // NB: the session keeps a reference to the decoder, which is kept alive
+  py::class_<StreamingDecoderSession>(m, "StreamingDecoderSession")
+      .def(
+          py::init<LexiconDecoder&, const StreamingDecoderOptions&>(),
+          "decoder"_a,
+          "options"_a,
+          py::keep_alive<1, 2>())
+      .def(
+          py::init<LexiconFreeDecoder&, const StreamingDecoderOptions&>(),
+          "decoder"_a,
+          "options"_a,
+          py::keep_alive<1, 2>())
+      .def(
+          "set_stable_result_callback",
+          &StreamingDecoderSession::setStableResultCallback)
+      .def(
+          "set_partial_result_callback",
+          &StreamingDecoderSession::setPartialResultCallback)
+      .def("begin", &StreamingDecoderSession::begin)
+      .def(
+          "step",
+          &StreamingDecoderSession_step,
+          "emissions"_a,
+          "T"_a,
+          "N"_a)
+      .def("end", &StreamingDecoderSession::end)
+      .def("n_decoded_frames", &StreamingDecoderSession::nDecodedFrames)
+      .def("n_stable_frames", &StreamingDecoderSession::nStableFrames)
+      .def("n_prunes", &StreamingDecoderSession::nPrunes);
 }
@@ -40,7 +40,11 @@ PYBIND11_MODULE(flashlight_lib_text_dictionary, m) {
       .def("add_entry", &Dictionary_addEntry_1, "entry"_a)
       .def("get_entry", &Dictionary::getEntry, "idx"_a)
       .def("set_default_index", &Dictionary::setDefaultIndex, "idx"_a)
-      .def("get_index", &Dictionary::getIndex, "entry"_a)
+      .def(
+          "get_index",
+          static_cast<int (Dictionary::*)(const std::string&) const>(
+              &Dictionary::getIndex),
+          "entry"_a)
       .def("contains", &Dictionary::contains, "entry"_a)
       .def("is_contiguous", &Dictionary::isContiguous)
       .def(
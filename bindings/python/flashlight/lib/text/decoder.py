@@ -10,13 +10,20 @@ from .flashlight_lib_text_decoder import (
     LM,
     CriterionType,
     DecodeResult,
+    FlatTrie,
+    Lattice,
+    LatticeArc,
     LexiconDecoderOptions,
     LexiconFreeDecoderOptions,
     KenLM,
+    KenLMCacheStats,
     LexiconDecoder,
     LexiconFreeDecoder,
     LMState,
+    LMStatePoolStats,
     SmearingMode,
+    StreamingDecoderOptions,
+    StreamingDecoderSession,
     Trie,
     TrieNode,
 )
@@ -33,13 +33,16 @@
 #include "flashlight/ext/common/Serializer.h"
 #include "flashlight/ext/plugin/ModulePlugin.h"
 #include "flashlight/lib/common/ProducerConsumerQueue.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeSeq2SeqDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconSeq2SeqDecoder.h"
 #include "flashlight/lib/text/decoder/lm/ConvLM.h"
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
+#include "flashlight/lib/text/decoder/lm/NGramLM.h"
 #include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
 
 using fl::ext::afToVector;
 using fl::ext::Serializer;
@@ -161,9 +164,22 @@ int main(int argc, char** argv) {
 
   fl::lib::text::Dictionary wordDict;
   fl::lib::text::LexiconMap lexicon;
+  // A binary lexicon is used in place, unless it has to be truncated
+  fl::lib::text::BinaryLexiconPtr binaryLexicon;
   if (!FLAGS_lexicon.empty()) {
-    lexicon = fl::lib::text::loadWords(FLAGS_lexicon, FLAGS_maxword);
-    wordDict = fl::lib::text::createWordDict(lexicon);
+    if (fl::lib::text::BinaryLexicon::isBinaryFile(FLAGS_lexicon)) {
+      binaryLexicon = fl::lib::text::BinaryLexicon::load(FLAGS_lexicon);
+      // The words keep their indices in the binary lexicon when it is
+      // truncated
+      wordDict = fl::lib::text::createWordDict(*binaryLexicon);
+      if (FLAGS_maxword >= 0) {
+        lexicon = binaryLexicon->toLexiconMap(FLAGS_maxword);
+        binaryLexicon.reset();
+      }
+    } else {
+      lexicon = fl::lib::text::loadWords(FLAGS_lexicon, FLAGS_maxword);
+      wordDict = fl::lib::text::createWordDict(lexicon);
+    }
     LOG(INFO) << "Number of words: " << wordDict.indexSize();
   } else {
     if (FLAGS_uselexicon || FLAGS_decodertype == "wrd") {
@@ -219,6 +235,12 @@ int main(int argc, char** argv) {
       LOG(FATAL) << "Error opening log file: " << logPath;
     }
   }
+  if (!FLAGS_lattice.empty()) {
+    if (isSeq2seqCrit) {
+      LOG(FATAL) << "Lattices are not supported for seq2seq criterions";
+    }
+    fl::lib::dirCreateRecursive(FLAGS_lattice);
+  }
 
   auto writeHyp = [&hypMutex, &hypStream](const std::string& hypStr) {
     std::lock_guard<std::mutex> lock(hypMutex);
@@ -246,7 +268,12 @@ int main(int argc, char** argv) {
       std::make_shared<fl::lib::text::ZeroLM>();
   if (!FLAGS_lm.empty()) {
     if (FLAGS_lmtype == "kenlm") {
-      lm = std::make_shared<fl::lib::text::KenLM>(FLAGS_lm, usrDict);
+      // The model is shared by all the decoder threads
+      lm = std::make_shared<fl::lib::text::KenLM>(
+          FLAGS_lm,
+          usrDict,
+          static_cast<size_t>(FLAGS_lm_cache_mb) << 20,
+          FLAGS_nthread_decoder);
       if (!lm) {
         LOG(FATAL) << "[LM constructing] Failed to load LM: " << FLAGS_lm;
       }
@@ -262,13 +289,49 @@ int main(int argc, char** argv) {
       }
       convLmModel->eval();
 
-      auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
+      auto getConvLmScoreFunc = FLAGS_lm_incremental_states > 0
+          ? buildIncrementalGetConvLmScoreFunction(
+                convLmModel, FLAGS_lm_incremental_states)
+          : buildGetConvLmScoreFunction(convLmModel);
       lm = std::make_shared<fl::lib::text::ConvLM>(
           getConvLmScoreFunc,
           FLAGS_lm_vocab,
           usrDict,
           FLAGS_lm_memory,
-          FLAGS_beamsize);
+          FLAGS_lm_cache_histories > 0 ? FLAGS_lm_cache_histories
+                                       : FLAGS_beamsize,
+          fl::lib::text::kConvLMDefaultHistorySize,
+          FLAGS_lm_cache_topk);
+    } else if (FLAGS_lmtype == "ngram") {
+      // The model is shared by all the decoder threads
+      fl::lib::text::NGramModelPtr ngramModel;
+      uint64_t ngramFingerprint = cacheFingerprint(
+          {FLAGS_lm}, {std::to_string(FLAGS_lm_quantization_bits)});
+      bool useNGramBinary = !FLAGS_lm_ngram_binary.empty() &&
+          fl::lib::fileExists(FLAGS_lm_ngram_binary) &&
+          fl::lib::text::NGramModel::loadFingerprint(FLAGS_lm_ngram_binary) ==
+              ngramFingerprint;
+      if (!FLAGS_lm_ngram_binary.empty() &&
+          fl::lib::fileExists(FLAGS_lm_ngram_binary) && !useNGramBinary) {
+        LOG(WARNING) << "[Decoder] Binary n-gram LM " << FLAGS_lm_ngram_binary
+                     << " was built from other inputs, building it again";
+      }
+      if (useNGramBinary) {
+        ngramModel = fl::lib::text::NGramModel::load(
+            FLAGS_lm_ngram_binary, ngramFingerprint);
+        LOG(INFO) << "[Decoder] Binary n-gram LM loaded from: "
+                  << FLAGS_lm_ngram_binary;
+      } else {
+        auto arpaModel = fl::lib::text::NGramModel::fromArpa(
+            FLAGS_lm, FLAGS_lm_quantization_bits, FLAGS_lm_quantization_bits);
+        if (!FLAGS_lm_ngram_binary.empty()) {
+          arpaModel->save(FLAGS_lm_ngram_binary, ngramFingerprint);
+          LOG(INFO) << "[Decoder] Binary n-gram LM saved to: "
+                    << FLAGS_lm_ngram_binary;
+        }
+        ngramModel = std::move(arpaModel);
+      }
+      lm = std::make_shared<fl::lib::text::NGramLM>(ngramModel, usrDict);
     } else {
       LOG(FATAL) << "[LM constructing] Invalid LM Type: " << FLAGS_lmtype;
     }
@@ -282,17 +345,67 @@ int main(int argc, char** argv) {
   if (FLAGS_wordseparator != "") {
     silIdx = tokenDict.getIndex(FLAGS_wordseparator);
   }
-  std::shared_ptr<fl::lib::text::Trie> trie = buildTrie(
-      FLAGS_decodertype,
-      FLAGS_uselexicon,
-      lm,
-      FLAGS_smearing,
-      tokenDict,
-      lexicon,
-      wordDict,
-      silIdx,
-      FLAGS_replabel);
-  LOG(INFO) << "[Decoder] Trie smeared.\n";
+  // The compiled trie depends on the tokens, the lexicon and the LM scores of
+  // the words
+  uint64_t trieFingerprint = cacheFingerprint(
+      {dictPath, FLAGS_lexicon, FLAGS_lm},
+      {FLAGS_criterion,
+       FLAGS_decodertype,
+       std::to_string(FLAGS_uselexicon),
+       FLAGS_smearing,
+       FLAGS_lmtype,
+       std::to_string(FLAGS_lm_quantization_bits),
+       FLAGS_wordseparator,
+       std::to_string(FLAGS_replabel),
+       std::to_string(FLAGS_maxword)});
+  fl::lib::text::FlatTriePtr trie;
+  bool useCompiledTrie = !FLAGS_trie.empty() &&
+      fl::lib::fileExists(FLAGS_trie) &&
+      fl::lib::text::FlatTrie::loadFingerprint(FLAGS_trie) == trieFingerprint;
+  if (!FLAGS_trie.empty() && fl::lib::fileExists(FLAGS_trie) &&
+      !useCompiledTrie) {
+    LOG(WARNING) << "[Decoder] Compiled trie " << FLAGS_trie
+                 << " was built from other inputs, building it again";
+  }
+  if (useCompiledTrie) {
+    trie = fl::lib::text::FlatTrie::load(FLAGS_trie, trieFingerprint);
+    LOG(INFO) << "[Decoder] Compiled trie loaded from: " << FLAGS_trie;
+  } else {
+    std::shared_ptr<fl::lib::text::Trie> builtTrie;
+    if (binaryLexicon) {
+      builtTrie = buildTrie(
+          FLAGS_decodertype,
+          FLAGS_uselexicon,
+          lm,
+          FLAGS_smearing,
+          tokenDict,
+          *binaryLexicon,
+          wordDict,
+          silIdx,
+          FLAGS_replabel,
+          FLAGS_nthread_decoder);
+    } else {
+      builtTrie = buildTrie(
+          FLAGS_decodertype,
+          FLAGS_uselexicon,
+          lm,
+          FLAGS_smearing,
+          tokenDict,
+          lexicon,
+          wordDict,
+          silIdx,
+          FLAGS_replabel,
+          FLAGS_nthread_decoder);
+    }
+    LOG(INFO) << "[Decoder] Trie smeared.\n";
+    if (builtTrie) {
+      trie = std::make_shared<fl::lib::text::FlatTrie>(*builtTrie);
+      if (!FLAGS_trie.empty()) {
+        trie->save(FLAGS_trie, trieFingerprint);
+        LOG(INFO) << "[Decoder] Compiled trie saved to: " << FLAGS_trie;
+      }
+    }
+  }
 
   /* ===================== Create Dataset ===================== */
   fl::lib::audio::FeatureParams featParams(
@@ -321,14 +434,19 @@ int main(int argc, char** argv) {
       FLAGS_replabel,
       true /* skip unk */,
       FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
-      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */);
+      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
+      FLAGS_wordpiece_fallback
+          ? std::make_shared<fl::lib::text::WordPieceSegmenter>(tokenDict)
+          : nullptr);
 
   auto inputTransform = inputFeatures(
       featParams,
       featType,
       {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
       /*sfxConf=*/{});
-  auto targetTransform = targetFeatures(tokenDict, lexicon, targetGenConfig);
+  auto targetTransform = binaryLexicon
+      ? targetFeatures(tokenDict, binaryLexicon, targetGenConfig)
+      : targetFeatures(tokenDict, lexicon, targetGenConfig);
   auto wordTransform = wordFeatures(wordDict);
   int targetpadVal =
       isSeq2seqCrit ? tokenDict.getIndex(fl::lib::text::kPadToken) : kTargetPadValue;
@@ -500,13 +618,19 @@ int main(int argc, char** argv) {
         Serializer::load(FLAGS_lm, convlmVersion, convLmModel);
         convLmModel->eval();
 
-        auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
+        auto getConvLmScoreFunc = FLAGS_lm_incremental_states > 0
+            ? buildIncrementalGetConvLmScoreFunction(
+                  convLmModel, FLAGS_lm_incremental_states)
+            : buildGetConvLmScoreFunction(convLmModel);
         localLm = std::make_shared<fl::lib::text::ConvLM>(
             getConvLmScoreFunc,
             FLAGS_lm_vocab,
             usrDict,
             FLAGS_lm_memory,
-            FLAGS_beamsize);
+            FLAGS_lm_cache_histories > 0 ? FLAGS_lm_cache_histories
+                                         : FLAGS_beamsize,
+            fl::lib::text::kConvLMDefaultHistorySize,
+            FLAGS_lm_cache_topk);
       }
 
       if (criterionType == CriterionType::S2S) {
@@ -586,7 +710,11 @@ int main(int argc, char** argv) {
              .unkScore = FLAGS_unkscore,
              .silScore = FLAGS_silscore,
              .logAdd = FLAGS_logadd,
-             .criterionType = criterionType},
+             .criterionType = criterionType,
+             .beamThresholdToken = FLAGS_beamthresholdtoken,
+             .blankSkipThreshold = FLAGS_blankskipthreshold,
+             .nExpansionThreads = FLAGS_nthread_decoder_beam,
+             .keepMergedHyps = !FLAGS_lattice.empty()},
             trie,
             localLm,
             silIdx,
@@ -604,7 +732,10 @@ int main(int argc, char** argv) {
              .lmWeight = FLAGS_lmweight,
              .silScore = FLAGS_silscore,
              .logAdd = FLAGS_logadd,
-             .criterionType = criterionType},
+             .criterionType = criterionType,
+             .beamThresholdToken = FLAGS_beamthresholdtoken,
+             .nExpansionThreads = FLAGS_nthread_decoder_beam,
+             .keepMergedHyps = !FLAGS_lattice.empty()},
             localLm,
             silIdx,
             blankIdx,
@@ -633,6 +764,25 @@ int main(int argc, char** argv) {
       const auto& results = decoder->decode(emission.data(), nFrames, nTokens);
       meters.timer.stop();
 
+      if (!FLAGS_lattice.empty()) {
+        fl::lib::text::Lattice lattice;
+        if (auto lexiconDecoder =
+                dynamic_cast<fl::lib::text::LexiconDecoder*>(decoder.get())) {
+          lattice = lexiconDecoder->getLattice();
+        } else if (
+            auto lexiconFreeDecoder =
+                dynamic_cast<fl::lib::text::LexiconFreeDecoder*>(
+                    decoder.get())) {
+          lattice = lexiconFreeDecoder->getLattice();
+        }
+        auto latticePath = pathsConcat(FLAGS_lattice, sampleId + ".lat");
+        if (FLAGS_latticetext) {
+          lattice.saveText(latticePath + ".txt");
+        } else {
+          lattice.save(latticePath);
+        }
+      }
+
       int nTopHyps = FLAGS_isbeamdump ? results.size() : 1;
       for (int i = 0; i < nTopHyps; i++) {
         // Cleanup predictions
@@ -699,6 +849,13 @@ int main(int argc, char** argv) {
                    << "\%, slice TER: " << meters.tknDstSlice.errorRate()[0]
                    << "\%, decoded samples (thread " << tid
                    << "): " << sliceNumSamples[tid] + 1 << "]" << std::endl;
+            auto lexiconDecoder =
+                dynamic_cast<fl::lib::text::LexiconDecoder*>(decoder.get());
+            if (lexiconDecoder && FLAGS_blankskipthreshold > 0) {
+              buffer << "[sample: " << sampleId << ", skipped blank frames: "
+                     << lexiconDecoder->nSkippedFrames() << "/" << nFrames
+                     << "]" << std::endl;
+            }
 
             std::cout << buffer.str();
             if (!FLAGS_sclite.empty()) {
@@ -835,6 +992,14 @@ int main(int argc, char** argv) {
          << totalTime / totalSamples
          << "s/sample) -- WER: " << std::setprecision(6) << totalWer
          << "\%, TER: " << totalTkn << "\%]" << std::endl;
+  if (auto kenLm = std::dynamic_pointer_cast<fl::lib::text::KenLM>(lm)) {
+    if (FLAGS_lm_cache_mb > 0) {
+      auto stats = kenLm->getCacheStats();
+      buffer << "[KenLM cache] " << stats.hits << " hits, " << stats.misses
+             << " misses (hit rate " << std::setprecision(3)
+             << stats.hitRate() * 100. << "\%)" << std::endl;
+    }
+  }
   LOG(INFO) << buffer.str();
   if (!FLAGS_sclite.empty()) {
     writeLog(buffer.str());
@@ -173,7 +173,10 @@ int main(int argc, char** argv) {
       FLAGS_replabel,
       true /* skip unk */,
       FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
-      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */);
+      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
+      FLAGS_wordpiece_fallback
+          ? std::make_shared<fl::lib::text::WordPieceSegmenter>(tokenDict)
+          : nullptr);
 
   auto inputTransform = inputFeatures(
       featParams,
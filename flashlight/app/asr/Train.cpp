@@ -308,7 +308,10 @@ int main(int argc, char** argv) {
       FLAGS_replabel,
       true /* skip unk */,
       FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
-      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */);
+      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
+      FLAGS_wordpiece_fallback
+          ? std::make_shared<fl::lib::text::WordPieceSegmenter>(tokenDict)
+          : nullptr);
 
   const auto sfxConf = (FLAGS_sfx_config.empty())
       ? std::vector<sfx::SoundEffectConfig>()
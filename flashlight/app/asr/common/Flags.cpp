@@ -80,6 +80,11 @@ DEFINE_bool(
     "Specify if a word separator can be used inside of a token. "
     "Should be used if the SentencePiece tool is used to "
     "construct a token set containing word-pieces");
+DEFINE_bool(
+    wordpiece_fallback,
+    false,
+    "Split the words which are not in the lexicon into the longest matching "
+    "tokens (word-pieces) of the token set instead of letters");
 DEFINE_int64(
     replabel,
     0,
@@ -405,11 +410,18 @@ DEFINE_string(
 DEFINE_string(
     lmtype,
     "kenlm",
-    "[decode] Language model type used along with acoustic model: 'kenlm', 'convlm'");
+    "[decode] Language model type used along with acoustic model: 'kenlm', 'convlm', 'ngram'");
 DEFINE_string(
     lexicon,
     "",
     "path/to/lexicon.txt which contains on each row space separated mapping of a word into tokens sequence");
+DEFINE_string(
+    trie,
+    "",
+    "[decode] path/to/compiled_trie.bin: loaded (memory mapped) if the file exists "
+    "and was built from the same lexicon, tokens, LM, decodertype and smearing "
+    "(recorded as a fingerprint in the file), "
+    "otherwise the trie built from the lexicon is saved there");
 DEFINE_string(
     lm_vocab,
     "",
@@ -424,6 +436,14 @@ DEFINE_string(
     "",
     "path/to/acoustic_model, used also to continue and fork training");
 DEFINE_string(sclite, "", "[decode] path/to/sclite to be written");
+DEFINE_string(
+    lattice,
+    "",
+    "[decode] path/to/lattice_dir/ where the lattice of each sample is written (lexicon and lexicon-free decoders only)");
+DEFINE_bool(
+    latticetext,
+    false,
+    "[decode] write lattices in OpenFst text format instead of binary format");
 DEFINE_string(
     decodertype,
     "wrd",
@@ -450,6 +470,14 @@ DEFINE_double(
     beamthreshold,
     25,
     "[decode] beam score threshold for early pruning of hypothesis");
+DEFINE_double(
+    beamthresholdtoken,
+    0,
+    "[decode] score threshold (w.r.t. the best token of the frame) for tokens selection, 0 to disable");
+DEFINE_double(
+    blankskipthreshold,
+    0,
+    "[decode] blank posterior above which CTC frames only take the blank transition in lexicon-based decoding, 0 to disable");
 
 DEFINE_int32(
     maxload,
@@ -471,11 +499,39 @@ DEFINE_int32(
 DEFINE_int32(
     nthread_decoder,
     1,
-    "[decode] Number of threads for beam-search decoding");
+    "[decode] Number of threads for beam-search decoding and for building the lexicon trie");
+DEFINE_int32(
+    nthread_decoder_beam,
+    1,
+    "[decode] Number of threads expanding the beam of each utterance in lexicon-based and lexicon-free decoding");
 DEFINE_int32(
     lm_memory,
     5000,
     "[decode] Total memory size for batch forming for 'convlm' LM forward pass");
+DEFINE_int32(
+    lm_cache_mb,
+    0,
+    "[decode] Total size in MB of the query caches of the decoder threads for 'kenlm' LM, shared evenly by the threads, 0 to disable");
+DEFINE_int32(
+    lm_cache_histories,
+    0,
+    "[decode] Number of histories in the score cache of 'convlm' LM, 0 to use the beam size");
+DEFINE_int32(
+    lm_cache_topk,
+    0,
+    "[decode] Number of scores cached per history for 'convlm' LM, the other tokens sharing the remaining probability mass, 0 to cache all of them");
+DEFINE_int32(
+    lm_incremental_states,
+    0,
+    "[decode] Number of network states cached to run 'convlm' LM incrementally on the last token of the histories, 0 to run it on the whole histories");
+DEFINE_string(
+    lm_ngram_binary,
+    "",
+    "[decode] Path to the binary 'ngram' LM, memory mapped if it exists and was compiled from the same 'lm' and 'lm_quantization_bits', otherwise compiled from the ARPA file given by 'lm' and saved");
+DEFINE_int32(
+    lm_quantization_bits,
+    32,
+    "[decode] Number of bits (8, 16 or 32) of the probabilities and backoffs of 'ngram' LM compiled from an ARPA file");
 
 DEFINE_int32(
     emission_queue_size,
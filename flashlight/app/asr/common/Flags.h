@@ -78,6 +78,7 @@ DECLARE_string(tokens);
 DECLARE_string(batching_strategy);
 DECLARE_int64(batching_max_duration);
 DECLARE_bool(usewordpiece);
+DECLARE_bool(wordpiece_fallback);
 DECLARE_int64(replabel);
 DECLARE_string(surround);
 DECLARE_string(wordseparator);
@@ -190,11 +191,14 @@ DECLARE_bool(isbeamdump);
 DECLARE_string(smearing);
 DECLARE_string(lmtype);
 DECLARE_string(lexicon);
+DECLARE_string(trie);
 DECLARE_string(lm_vocab);
 DECLARE_string(emission_dir);
 DECLARE_string(lm);
 DECLARE_string(am);
 DECLARE_string(sclite);
+DECLARE_string(lattice);
+DECLARE_bool(latticetext);
 DECLARE_string(decodertype);
 
 DECLARE_double(lmweight);
@@ -203,6 +207,8 @@ DECLARE_double(silscore);
 DECLARE_double(unkscore);
 DECLARE_double(eosscore);
 DECLARE_double(beamthreshold);
+DECLARE_double(beamthresholdtoken);
+DECLARE_double(blankskipthreshold);
 
 DECLARE_int32(maxload);
 DECLARE_int32(maxword);
@@ -210,7 +216,14 @@ DECLARE_int32(beamsize);
 DECLARE_int32(beamsizetoken);
 DECLARE_int32(nthread_decoder_am_forward);
 DECLARE_int32(nthread_decoder);
+DECLARE_int32(nthread_decoder_beam);
 DECLARE_int32(lm_memory);
+DECLARE_int32(lm_cache_mb);
+DECLARE_int32(lm_cache_histories);
+DECLARE_int32(lm_cache_topk);
+DECLARE_int32(lm_incremental_states);
+DECLARE_string(lm_ngram_binary);
+DECLARE_int32(lm_quantization_bits);
 
 DECLARE_int32(emission_queue_size);
 
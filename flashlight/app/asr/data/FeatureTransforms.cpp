@@ -22,6 +22,7 @@
 
 using namespace fl::lib;
 using namespace fl::lib::audio;
+using fl::lib::text::BinaryLexicon;
 using fl::lib::text::Dictionary;
 using fl::lib::text::LexiconMap;
 using fl::lib::text::packReplabels;
@@ -121,15 +122,31 @@ fl::Dataset::DataTransformFunction inputFeatures(
 }
 
 // target
-fl::Dataset::DataTransformFunction targetFeatures(
+namespace {
+
+template <typename Lexicon>
+af::array transcriptToTarget(
+    void* data,
+    af::dim4 dims,
     const Dictionary& tokenDict,
-    const LexiconMap& lexicon,
+    const Lexicon& lexicon,
     const TargetGenerationConfig& config) {
-  return [tokenDict, lexicon, config](
-             void* data, af::dim4 dims, af::dtype /* unused */) {
-    std::string transcript(
-        static_cast<char*>(data), static_cast<char*>(data) + dims.elements());
-    auto words = splitOnWhitespace(transcript, true);
+  std::string transcript(
+      static_cast<char*>(data), static_cast<char*>(data) + dims.elements());
+  auto words = splitOnWhitespace(transcript, true);
+  std::vector<int> tgtVec;
+  if (config.wordPieceSegmenter_) {
+    tgtVec = wrd2TargetIndices(
+        words,
+        lexicon,
+        tokenDict,
+        *config.wordPieceSegmenter_,
+        config.wordSeparator_,
+        config.targetSamplePct_,
+        config.fallbackToLetterWordSepLeft_,
+        config.fallbackToLetterWordSepRight_,
+        config.skipUnk_);
+  } else {
     auto target = wrd2Target(
         words,
         lexicon,
@@ -139,33 +156,55 @@ fl::Dataset::DataTransformFunction targetFeatures(
         config.fallbackToLetterWordSepLeft_,
         config.fallbackToLetterWordSepRight_,
         config.skipUnk_);
-    auto tgtVec = tokenDict.mapEntriesToIndices(target);
-    if (!config.surround_.empty()) {
-      // add surround token at the beginning and end of target
-      // only if begin/end tokens are not surround
-      auto idx = tokenDict.getIndex(config.surround_);
-      if (tgtVec.empty() || tgtVec.back() != idx) {
-        tgtVec.emplace_back(idx);
-      }
-      if (tgtVec.size() > 1 && tgtVec.front() != idx) {
-        tgtVec.emplace_back(idx);
-        std::rotate(tgtVec.begin(), tgtVec.end() - 1, tgtVec.end());
-      }
-    }
-    if (config.replabel_ > 0) {
-      tgtVec = packReplabels(tgtVec, tokenDict, config.replabel_);
-    }
-    if (config.criterion_ == kAsgCriterion) {
-      dedup(tgtVec);
-    }
-    if (config.eosToken_) {
-      tgtVec.emplace_back(tokenDict.getIndex(kEosToken));
+    tgtVec = tokenDict.mapEntriesToIndices(target);
+  }
+  if (!config.surround_.empty()) {
+    // add surround token at the beginning and end of target
+    // only if begin/end tokens are not surround
+    auto idx = tokenDict.getIndex(config.surround_);
+    if (tgtVec.empty() || tgtVec.back() != idx) {
+      tgtVec.emplace_back(idx);
     }
-    if (tgtVec.empty()) {
-      // support empty target
-      return af::array().as(s32);
+    if (tgtVec.size() > 1 && tgtVec.front() != idx) {
+      tgtVec.emplace_back(idx);
+      std::rotate(tgtVec.begin(), tgtVec.end() - 1, tgtVec.end());
     }
-    return af::array(tgtVec.size(), tgtVec.data());
+  }
+  if (config.replabel_ > 0) {
+    tgtVec = packReplabels(tgtVec, tokenDict, config.replabel_);
+  }
+  if (config.criterion_ == kAsgCriterion) {
+    dedup(tgtVec);
+  }
+  if (config.eosToken_) {
+    tgtVec.emplace_back(tokenDict.getIndex(kEosToken));
+  }
+  if (tgtVec.empty()) {
+    // support empty target
+    return af::array().as(s32);
+  }
+  return af::array(tgtVec.size(), tgtVec.data());
+}
+
+} // namespace
+
+fl::Dataset::DataTransformFunction targetFeatures(
+    const Dictionary& tokenDict,
+    const LexiconMap& lexicon,
+    const TargetGenerationConfig& config) {
+  return [tokenDict, lexicon, config](
+             void* data, af::dim4 dims, af::dtype /* unused */) {
+    return transcriptToTarget(data, dims, tokenDict, lexicon, config);
+  };
+}
+
+fl::Dataset::DataTransformFunction targetFeatures(
+    const Dictionary& tokenDict,
+    std::shared_ptr<const BinaryLexicon> lexicon,
+    const TargetGenerationConfig& config) {
+  return [tokenDict, lexicon, config](
+             void* data, af::dim4 dims, af::dtype /* unused */) {
+    return transcriptToTarget(data, dims, tokenDict, *lexicon, config);
   };
 }
 
@@ -6,14 +6,21 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
 #include <utility>
+#include <vector>
 
 #include "flashlight/app/asr/augmentation/SoundEffectConfig.h"
 #include "flashlight/app/asr/common/Defines.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/lib/audio/feature/FeatureParams.h"
 #include "flashlight/lib/common/String.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
 #include "flashlight/lib/text/dictionary/Utils.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
 
 namespace fl {
 namespace app {
@@ -31,7 +38,9 @@ struct TargetGenerationConfig {
       int replabel,
       bool skipUnk,
       bool fallbackToLetterWordSepLeft,
-      bool fallbackToLetterWordSepRight)
+      bool fallbackToLetterWordSepRight,
+      std::shared_ptr<const lib::text::WordPieceSegmenter> wordPieceSegmenter =
+          nullptr)
       : wordSeparator_(wordSeparator),
         targetSamplePct_(targetSamplePct),
         criterion_(criterion),
@@ -40,7 +49,8 @@ struct TargetGenerationConfig {
         replabel_(replabel),
         skipUnk_(skipUnk),
         fallbackToLetterWordSepLeft_(fallbackToLetterWordSepLeft),
-        fallbackToLetterWordSepRight_(fallbackToLetterWordSepRight) {}
+        fallbackToLetterWordSepRight_(fallbackToLetterWordSepRight),
+        wordPieceSegmenter_(std::move(wordPieceSegmenter)) {}
 
   // token separator between words
   const std::string wordSeparator_;
@@ -62,6 +72,10 @@ struct TargetGenerationConfig {
   // use letters of word as tokens if a word is not present in lexicon
   // + add wordseparator at the end
   const bool fallbackToLetterWordSepRight_;
+  // if set, split the words which are not present in lexicon into the longest
+  // word pieces of the tokens set instead of letters
+  const std::shared_ptr<const lib::text::WordPieceSegmenter>
+      wordPieceSegmenter_;
 };
 
 fl::Dataset::DataTransformFunction inputFeatures(
@@ -76,6 +90,12 @@ fl::Dataset::DataTransformFunction targetFeatures(
     const lib::text::LexiconMap& lexicon,
     const TargetGenerationConfig& config);
 
+// Same, reading the spellings in place from a memory mapped lexicon
+fl::Dataset::DataTransformFunction targetFeatures(
+    const lib::text::Dictionary& tokenDict,
+    std::shared_ptr<const lib::text::BinaryLexicon> lexicon,
+    const TargetGenerationConfig& config);
+
 fl::Dataset::DataTransformFunction wordFeatures(
     const lib::text::Dictionary& wrdDict);
 
@@ -103,6 +123,11 @@ std::vector<T> transpose2d(
   return out;
 }
 
+// Normalizes each frame of `in` (Col Major : FRAMES X FEAT X BATCHSZ, with
+// `frameSz` frames) to zero mean and unit variance, with the mean and variance
+// of the values of the frames from `leftCtxSize` frames before to
+// `rightCtxSize` frames after it. The window sums are differences of prefix
+// sums over the frames, so the cost does not depend on the window sizes.
 template <typename T>
 std::vector<T> localNormalize(
     const std::vector<T>& in,
@@ -117,37 +142,44 @@ std::vector<T> localNormalize(
   int64_t perBatchSz = in.size() / batchSz;
   int64_t perFrameSz = perBatchSz / frameSz;
   auto out(in);
-  for (size_t b = 0; b < batchSz; ++b) {
-    std::vector<T> sum(frameSz, 0.0), sum2(frameSz, 0.0);
-    int64_t curFrame = 0;
-    // accumulate sum, sum^2 for computing mean, stddev
-    for (auto i = b * perBatchSz; i < (b + 1) * perBatchSz; ++i) {
-      auto start = std::max(curFrame - rightCtxSize, 0L);
-      auto end = std::min(curFrame + leftCtxSize, frameSz - 1);
-      for (int64_t j = start; j <= end; ++j) {
-        sum[j] += in[i];
-        sum2[j] += in[i] * in[i];
+  // sum[t], sum2[t]: sums of the values, and of their squares, of the frames
+  // before frame t
+  std::vector<double> sum(frameSz + 1), sum2(frameSz + 1);
+  std::vector<T> mean(frameSz), scale(frameSz);
+  for (int64_t b = 0; b < batchSz; ++b) {
+    T* batch = out.data() + b * perBatchSz;
+    std::fill(sum.begin(), sum.end(), 0.0);
+    std::fill(sum2.begin(), sum2.end(), 0.0);
+    // accumulate sum, sum^2 of each frame, one feature at a time
+    for (int64_t k = 0; k < perFrameSz; ++k) {
+      const T* feat = batch + k * frameSz;
+      for (int64_t t = 0; t < frameSz; ++t) {
+        double x = feat[t];
+        sum[t + 1] += x;
+        sum2[t + 1] += x * x;
       }
-      curFrame = (curFrame + 1) % frameSz;
+    }
+    for (int64_t t = 0; t < frameSz; ++t) {
+      sum[t + 1] += sum[t];
+      sum2[t + 1] += sum2[t];
     }
     // compute mean, stddev
-    for (auto j = 0; j < frameSz; ++j) {
-      int64_t N = (std::min(j + rightCtxSize, frameSz - 1) -
-                   std::max(j - leftCtxSize, 0L) + 1) *
-          perFrameSz;
-      sum[j] /= N;
-      sum2[j] /= N;
-      sum2[j] -= (sum[j] * sum[j]);
-      sum2[j] = std::sqrt(sum2[j]);
+    for (int64_t t = 0; t < frameSz; ++t) {
+      int64_t first = std::max(t - leftCtxSize, int64_t(0));
+      int64_t last = std::min(t + rightCtxSize, frameSz - 1) + 1;
+      double N = (last - first) * perFrameSz;
+      double m = (sum[last] - sum[first]) / N;
+      double variance = (sum2[last] - sum2[first]) / N - m * m;
+      T stddev = std::sqrt(std::max(variance, 0.0));
+      mean[t] = m;
+      scale[t] = stddev > threshold ? 1 / stddev : 1;
     }
     // perform local normalization
-    curFrame = 0;
-    for (auto i = b * perBatchSz; i < (b + 1) * perBatchSz; ++i) {
-      out[i] -= sum[curFrame];
-      if (sum2[curFrame] > threshold) {
-        out[i] /= sum2[curFrame];
+    for (int64_t k = 0; k < perFrameSz; ++k) {
+      T* feat = batch + k * frameSz;
+      for (int64_t t = 0; t < frameSz; ++t) {
+        feat[t] = (feat[t] - mean[t]) * scale[t];
       }
-      curFrame = (curFrame + 1) % frameSz;
     }
   }
   return out;
@@ -167,15 +199,17 @@ std::vector<T> normalize(
     auto start = out.begin() + b * perBatchSz;
     T sum = std::accumulate(start, start + perBatchSz, 0.0);
     T mean = sum / perBatchSz;
-    std::transform(
-        start, start + perBatchSz, start, [mean](T x) { return x - mean; });
-    T sq_sum = std::inner_product(start, start + perBatchSz, start, 0.0);
-    T stddev = std::sqrt(sq_sum / perBatchSz);
-    if (stddev > threshold) {
-      std::transform(start, start + perBatchSz, start, [stddev](T x) {
-        return x / stddev;
-      });
+    // The deviations are written with the scaling only, in the last pass
+    double sq_sum = 0.0;
+    for (auto it = start; it != start + perBatchSz; ++it) {
+      double x = *it - mean;
+      sq_sum += x * x;
     }
+    T stddev = std::sqrt(sq_sum / perBatchSz);
+    T scale = stddev > threshold ? 1 / stddev : 1;
+    std::transform(start, start + perBatchSz, start, [mean, scale](T x) {
+      return (x - mean) * scale;
+    });
   }
   return out;
 }
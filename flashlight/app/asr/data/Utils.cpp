@@ -9,36 +9,26 @@
 
 #include <iostream>
 
+using fl::lib::text::BinaryLexicon;
 using fl::lib::text::Dictionary;
 using fl::lib::text::LexiconMap;
 using fl::lib::text::splitWrd;
+using fl::lib::text::WordPieceSegmenter;
 
 namespace fl {
 namespace app {
 namespace asr {
 
-std::vector<std::string> wrd2Target(
+namespace {
+
+// Letters of a word which is not in the lexicon, if falling back to them
+std::vector<std::string> fallbackTarget(
     const std::string& word,
-    const LexiconMap& lexicon,
     const Dictionary& dict,
-    const std::string& wordSeparator /* = "" */,
-    float targetSamplePct /* = 0 */,
-    bool fallback2LtrWordSepLeft /* = false */,
-    bool fallback2LtrWordSepRight /* = false */,
-    bool skipUnk /* = false */) {
-  // find the word in the lexicon and use its spelling
-  auto lit = lexicon.find(word);
-  if (lit != lexicon.end()) {
-    // sample random spelling if word has different spellings
-    if (lit->second.size() > 1 &&
-        targetSamplePct >
-            static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) {
-      return lit->second[std::rand() % lit->second.size()];
-    } else {
-      return lit->second[0];
-    }
-  }
-
+    const std::string& wordSeparator,
+    bool fallback2LtrWordSepLeft,
+    bool fallback2LtrWordSepRight,
+    bool skipUnk) {
   std::vector<std::string> word2tokens;
   if (fallback2LtrWordSepLeft || fallback2LtrWordSepRight) {
     if (fallback2LtrWordSepLeft && !wordSeparator.empty()) {
@@ -66,15 +56,16 @@ std::vector<std::string> wrd2Target(
   return word2tokens;
 }
 
-std::vector<std::string> wrd2Target(
+template <typename Lexicon>
+std::vector<std::string> wordsToTarget(
     const std::vector<std::string>& words,
-    const LexiconMap& lexicon,
+    const Lexicon& lexicon,
     const Dictionary& dict,
-    const std::string& wordSeparator /* = "" */,
-    float targetSamplePct /* = 0 */,
-    bool fallback2LtrWordSepLeft /* = false */,
-    bool fallback2LtrWordSepRight /* = false */,
-    bool skipUnk /* = false */) {
+    const std::string& wordSeparator,
+    float targetSamplePct,
+    bool fallback2LtrWordSepLeft,
+    bool fallback2LtrWordSepRight,
+    bool skipUnk) {
   std::vector<std::string> res;
   for (auto w : words) {
     auto w2tokens = wrd2Target(
@@ -95,6 +86,240 @@ std::vector<std::string> wrd2Target(
   return res;
 }
 
+// Append the indices of the spelling of a word of the lexicon, if found
+bool appendSpelling(
+    const std::string& word,
+    const LexiconMap& lexicon,
+    const Dictionary& dict,
+    float targetSamplePct,
+    std::vector<int>& indices) {
+  auto lit = lexicon.find(word);
+  if (lit == lexicon.end()) {
+    return false;
+  }
+  const auto& spellings = lit->second;
+  const auto& spelling = spellings.size() > 1 &&
+          targetSamplePct >
+              static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)
+      ? spellings[std::rand() % spellings.size()]
+      : spellings[0];
+  for (const auto& token : spelling) {
+    indices.push_back(dict.getIndex(token));
+  }
+  return true;
+}
+
+bool appendSpelling(
+    const std::string& word,
+    const BinaryLexicon& lexicon,
+    const Dictionary& dict,
+    float targetSamplePct,
+    std::vector<int>& indices) {
+  int wordIdx = lexicon.find(word);
+  if (wordIdx < 0 || lexicon.nSpellings(wordIdx) == 0) {
+    return false;
+  }
+  int nSpellings = lexicon.nSpellings(wordIdx);
+  int spelling = nSpellings > 1 &&
+          targetSamplePct >
+              static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)
+      ? std::rand() % nSpellings
+      : 0;
+  const uint32_t* tokens = lexicon.getSpellingTokens(wordIdx, spelling);
+  const auto& lexiconTokens = lexicon.getTokens();
+  for (size_t i = 0; i < lexicon.spellingSize(wordIdx, spelling); ++i) {
+    indices.push_back(dict.getIndex(lexiconTokens->get(tokens[i])));
+  }
+  return true;
+}
+
+template <typename Lexicon>
+std::vector<int> wordsToTargetIndices(
+    const std::vector<std::string>& words,
+    const Lexicon& lexicon,
+    const Dictionary& dict,
+    const WordPieceSegmenter& segmenter,
+    const std::string& wordSeparator,
+    float targetSamplePct,
+    bool fallback2LtrWordSepLeft,
+    bool fallback2LtrWordSepRight,
+    bool skipUnk) {
+  std::vector<int> indices;
+  std::string affixedWord;
+  for (const auto& word : words) {
+    if (appendSpelling(word, lexicon, dict, targetSamplePct, indices)) {
+      continue;
+    }
+    if (!fallback2LtrWordSepLeft && !fallback2LtrWordSepRight) {
+      if (!skipUnk) {
+        throw std::invalid_argument("Unknown word in the lexicon: " + word);
+      }
+      continue;
+    }
+    affixedWord.clear();
+    if (fallback2LtrWordSepLeft) {
+      affixedWord += wordSeparator;
+    }
+    affixedWord += word;
+    if (fallback2LtrWordSepRight) {
+      affixedWord += wordSeparator;
+    }
+    if (!segmenter.segment(affixedWord, indices) && !skipUnk) {
+      throw std::invalid_argument(
+          "Unknown token when splitting into word pieces the unknown word: " +
+          word);
+    }
+  }
+  return indices;
+}
+
+} // namespace
+
+std::vector<std::string> wrd2Target(
+    const std::string& word,
+    const LexiconMap& lexicon,
+    const Dictionary& dict,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  // find the word in the lexicon and use its spelling
+  auto lit = lexicon.find(word);
+  if (lit != lexicon.end()) {
+    // sample random spelling if word has different spellings
+    if (lit->second.size() > 1 &&
+        targetSamplePct >
+            static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) {
+      return lit->second[std::rand() % lit->second.size()];
+    } else {
+      return lit->second[0];
+    }
+  }
+  return fallbackTarget(
+      word,
+      dict,
+      wordSeparator,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
+std::vector<std::string> wrd2Target(
+    const std::string& word,
+    const BinaryLexicon& lexicon,
+    const Dictionary& dict,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  // find the word in the lexicon and use its spelling
+  int wordIdx = lexicon.find(word);
+  if (wordIdx >= 0 && lexicon.nSpellings(wordIdx) > 0) {
+    int nSpellings = lexicon.nSpellings(wordIdx);
+    // sample random spelling if word has different spellings
+    if (nSpellings > 1 &&
+        targetSamplePct >
+            static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX)) {
+      return lexicon.getSpelling(wordIdx, std::rand() % nSpellings);
+    } else {
+      return lexicon.getSpelling(wordIdx, 0);
+    }
+  }
+  return fallbackTarget(
+      word,
+      dict,
+      wordSeparator,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
+std::vector<std::string> wrd2Target(
+    const std::vector<std::string>& words,
+    const LexiconMap& lexicon,
+    const Dictionary& dict,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  return wordsToTarget(
+      words,
+      lexicon,
+      dict,
+      wordSeparator,
+      targetSamplePct,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
+std::vector<std::string> wrd2Target(
+    const std::vector<std::string>& words,
+    const BinaryLexicon& lexicon,
+    const Dictionary& dict,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  return wordsToTarget(
+      words,
+      lexicon,
+      dict,
+      wordSeparator,
+      targetSamplePct,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
+std::vector<int> wrd2TargetIndices(
+    const std::vector<std::string>& words,
+    const LexiconMap& lexicon,
+    const Dictionary& dict,
+    const WordPieceSegmenter& segmenter,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  return wordsToTargetIndices(
+      words,
+      lexicon,
+      dict,
+      segmenter,
+      wordSeparator,
+      targetSamplePct,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
+std::vector<int> wrd2TargetIndices(
+    const std::vector<std::string>& words,
+    const BinaryLexicon& lexicon,
+    const Dictionary& dict,
+    const WordPieceSegmenter& segmenter,
+    const std::string& wordSeparator /* = "" */,
+    float targetSamplePct /* = 0 */,
+    bool fallback2LtrWordSepLeft /* = false */,
+    bool fallback2LtrWordSepRight /* = false */,
+    bool skipUnk /* = false */) {
+  return wordsToTargetIndices(
+      words,
+      lexicon,
+      dict,
+      segmenter,
+      wordSeparator,
+      targetSamplePct,
+      fallback2LtrWordSepLeft,
+      fallback2LtrWordSepRight,
+      skipUnk);
+}
+
 std::pair<int, FeatureType> getFeatureType(
     const std::string& featuresType,
     int channels,
@@ -12,8 +12,10 @@
 
 #include "flashlight/app/asr/data/FeatureTransforms.h"
 #include "flashlight/lib/audio/feature/FeatureParams.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 #include "flashlight/lib/text/dictionary/Utils.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
 
 namespace fl {
 namespace app {
@@ -39,6 +41,52 @@ std::vector<std::string> wrd2Target(
     bool fallback2LtrWordSepRight = false,
     bool skipUnk = false);
 
+std::vector<std::string> wrd2Target(
+    const std::string& word,
+    const lib::text::BinaryLexicon& lexicon,
+    const lib::text::Dictionary& dict,
+    const std::string& wordSeparator = "",
+    float targetSamplePct = 0,
+    bool fallback2LtrWordSepLeft = false,
+    bool fallback2LtrWordSepRight = false,
+    bool skipUnk = false);
+
+std::vector<std::string> wrd2Target(
+    const std::vector<std::string>& words,
+    const lib::text::BinaryLexicon& lexicon,
+    const lib::text::Dictionary& dict,
+    const std::string& wordSeparator = "",
+    float targetSamplePct = 0,
+    bool fallback2LtrWordSepLeft = false,
+    bool fallback2LtrWordSepRight = false,
+    bool skipUnk = false);
+
+// Same as wrd2Target() followed by mapping the tokens to their indices in
+// `dict`, except that the words missing from the lexicon are split into the
+// word pieces of `segmenter` (with the word separator added as by the
+// fallback options) instead of letters
+std::vector<int> wrd2TargetIndices(
+    const std::vector<std::string>& words,
+    const lib::text::LexiconMap& lexicon,
+    const lib::text::Dictionary& dict,
+    const lib::text::WordPieceSegmenter& segmenter,
+    const std::string& wordSeparator = "",
+    float targetSamplePct = 0,
+    bool fallback2LtrWordSepLeft = false,
+    bool fallback2LtrWordSepRight = false,
+    bool skipUnk = false);
+
+std::vector<int> wrd2TargetIndices(
+    const std::vector<std::string>& words,
+    const lib::text::BinaryLexicon& lexicon,
+    const lib::text::Dictionary& dict,
+    const lib::text::WordPieceSegmenter& segmenter,
+    const std::string& wordSeparator = "",
+    float targetSamplePct = 0,
+    bool fallback2LtrWordSepLeft = false,
+    bool fallback2LtrWordSepRight = false,
+    bool skipUnk = false);
+
 std::pair<int, FeatureType> getFeatureType(
     const std::string& featuresType,
     int channels,
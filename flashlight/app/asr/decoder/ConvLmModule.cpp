@@ -7,7 +7,10 @@
 
 #include "flashlight/app/asr/decoder/ConvLmModule.h"
 
+#include <algorithm>
+#include <list>
 #include <string>
+#include <unordered_map>
 
 #include "flashlight/ext/common/DistributedUtils.h"
 
@@ -15,6 +18,429 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+
+void checkInputs(
+    const std::vector<int>& inputs,
+    const std::vector<int>& lastTokenPositions,
+    int sampleSize,
+    int batchSize) {
+  if (sampleSize * batchSize > inputs.size()) {
+    throw std::invalid_argument(
+        "[ConvLM] Incorrect sample size (" + std::to_string(sampleSize) +
+        ") or batch size (" + std::to_string(batchSize) + ").");
+  }
+  if (batchSize != (int)lastTokenPositions.size()) {
+    throw std::logic_error(
+        "[ConvLM]: incorrect postions for accessing: size should be " +
+        std::to_string(batchSize) + " but it is " +
+        std::to_string(lastTokenPositions.size()));
+  }
+}
+
+// Predictions (c, b) of the network output (c, t, b) at the given frames
+af::array selectFrames(
+    const Variable& output,
+    const std::vector<int>& lastTokenPositions) {
+  if (af::count<int>(af::isNaN(output.array())) != 0) {
+    throw std::runtime_error("[ConvLM] Encountered NaNs in propagation");
+  }
+  int32_t C = output.dims(0), T = output.dims(1), B = output.dims(2);
+  if (B != (int)lastTokenPositions.size()) {
+    throw std::logic_error(
+        "[ConvLM]: incorrect predictions: batch should be " +
+        std::to_string(lastTokenPositions.size()) + " but it is " +
+        std::to_string(B));
+  }
+  // output (c, t, b)
+  // set global indices: offset by channel
+  af::array globalIndices = af::iota(af::dim4(C, 1), af::dim4(1, B), s32);
+  // set global indices: offset by batch
+  globalIndices =
+      globalIndices + af::iota(af::dim4(1, B), af::dim4(C, 1), s32) * T * C;
+  // set global indices: offset by time which we need to take
+  globalIndices = globalIndices +
+      af::tile(af::array(af::dim4(1, B), lastTokenPositions.data()), C, 1) *
+          C;
+  return af::moddims(af::flat(output.array())(af::flat(globalIndices)), C, B);
+}
+
+// The convolution of a module (possibly weight normalized), if any
+std::shared_ptr<AsymmetricConv1D> getConvolution(const ModulePtr& module) {
+  auto weightNorm = std::dynamic_pointer_cast<WeightNorm>(module);
+  return std::dynamic_pointer_cast<AsymmetricConv1D>(
+      weightNorm ? weightNorm->module() : module);
+}
+
+// Whether a module processes each frame independently
+bool isFramewise(const ModulePtr& module) {
+  auto weightNorm = std::dynamic_pointer_cast<WeightNorm>(module);
+  Module* m = weightNorm ? weightNorm->module().get() : module.get();
+  return dynamic_cast<Linear*>(m) || dynamic_cast<Embedding*>(m) ||
+      dynamic_cast<AdaptiveEmbedding*>(m) || dynamic_cast<Dropout*>(m) ||
+      dynamic_cast<Reorder*>(m) || dynamic_cast<View*>(m) ||
+      dynamic_cast<Identity*>(m) || dynamic_cast<PrecisionCast*>(m) ||
+      dynamic_cast<GatedLinearUnit*>(m) || dynamic_cast<LogSoftmax*>(m) ||
+      dynamic_cast<Sigmoid*>(m) || dynamic_cast<Log*>(m) ||
+      dynamic_cast<Tanh*>(m) || dynamic_cast<HardTanh*>(m) ||
+      dynamic_cast<ReLU*>(m) || dynamic_cast<ReLU6*>(m) ||
+      dynamic_cast<LeakyReLU*>(m) || dynamic_cast<PReLU*>(m) ||
+      dynamic_cast<ELU*>(m) || dynamic_cast<ThresholdReLU*>(m) ||
+      dynamic_cast<Swish*>(m);
+}
+
+/**
+ * Runs a convolutional LM on new frames of the histories from their cached
+ * states. The state of a history holds the inputs of each convolution over its
+ * receptive field before the next frame, and only depends on the last
+ * `context_` tokens of the history (on all of them for shorter histories). The
+ * inputs of each convolution are stored in a slab of `maxStates_` states,
+ * indexed by the slot of the state. Slots are evicted in LRU order.
+ */
+class IncrementalConvLm {
+ public:
+  IncrementalConvLm(std::shared_ptr<Module> network, int maxStates)
+      : network_(std::move(network)),
+        maxStates_(maxStates),
+        context_(0),
+        nConvolutions_(0),
+        states_(maxStates) {
+    if (maxStates < 1) {
+      throw std::invalid_argument(
+          "[ConvLM] Invalid number of cached states: " +
+          std::to_string(maxStates));
+    }
+    inspect(network_);
+    slabs_.resize(nConvolutions_);
+    runInputs_.resize(nConvolutions_);
+    for (int slot = 0; slot < maxStates_; slot++) {
+      states_[slot].lruPosition = lru_.insert(lru_.end(), slot);
+    }
+  }
+
+  std::vector<float> operator()(
+      const std::vector<int>& inputs,
+      const std::vector<int>& lastTokenPositions,
+      int sampleSize,
+      int batchSize) {
+    sampleSize = sampleSize > 0 ? sampleSize : inputs.size();
+    checkInputs(inputs, lastTokenPositions, sampleSize, batchSize);
+
+    // The histories whose prefix has a cached state are run on their last
+    // token only, the other ones in full
+    std::vector<int> prefixed, prefixSlots, unprefixed;
+    int longestHistory = 0;
+    for (int b = 0; b < batchSize; b++) {
+      int length = lastTokenPositions[b] + 1;
+      int slot =
+          length > 1 ? findState(&inputs[b * sampleSize], length - 1) : -1;
+      if (slot >= 0) {
+        prefixed.push_back(b);
+        prefixSlots.push_back(slot);
+      } else {
+        unprefixed.push_back(b);
+        longestHistory = std::max(longestHistory, length);
+      }
+    }
+
+    std::vector<float> scores;
+    auto runSamples = [&](const std::vector<int>& samples,
+                          const std::vector<int>& slots,
+                          int nFrames) {
+      if (samples.empty()) {
+        return;
+      }
+      std::vector<int> tokens(nFrames * samples.size());
+      std::vector<int> positions(samples.size());
+      for (int i = 0; i < samples.size(); i++) {
+        int lastTokenPosition = lastTokenPositions[samples[i]];
+        const int* frames = &inputs[samples[i] * sampleSize] +
+            (slots.empty() ? 0 : lastTokenPosition);
+        std::copy(frames, frames + nFrames, &tokens[i * nFrames]);
+        positions[i] = slots.empty() ? lastTokenPosition : 0;
+      }
+      auto preds =
+          ext::afToVector<float>(run(tokens, nFrames, slots, positions));
+      saveStates(inputs, sampleSize, lastTokenPositions, samples, positions);
+
+      int nClasses = preds.size() / samples.size();
+      scores.resize(batchSize * nClasses);
+      for (int i = 0; i < samples.size(); i++) {
+        std::copy(
+            preds.begin() + i * nClasses,
+            preds.begin() + (i + 1) * nClasses,
+            scores.begin() + samples[i] * nClasses);
+      }
+    };
+    runSamples(prefixed, prefixSlots, 1);
+    runSamples(unprefixed, {}, longestHistory);
+    return scores;
+  }
+
+ private:
+  struct State {
+    bool used = false;
+    size_t hash = 0;
+    std::vector<int> tokens; // Tokens the state depends on
+    std::list<int>::iterator lruPosition;
+  };
+
+  std::shared_ptr<Module> network_;
+  int maxStates_;
+  int context_; // Number of past tokens a state depends on
+  int nConvolutions_;
+
+  // Inputs of each convolution over its receptive field for all the states,
+  // of size (receptive field - 1, 1, channels, maxStates_)
+  std::vector<af::array> slabs_;
+  std::vector<State> states_;
+  std::list<int> lru_; // Slots from the most to the least recently used
+  std::unordered_map<size_t, int> stateIndex_; // Hash of the tokens to slot
+
+  // Current run: states of the samples (none to start from the first token),
+  // number of new frames, index of the next convolution and inputs of each
+  // convolution over their receptive field and the new frames
+  af::array runSlots_;
+  int runFrames_;
+  int runConvolution_;
+  std::vector<Variable> runInputs_;
+
+  // Count the convolutions of a module and check it can be run incrementally
+  void inspect(const ModulePtr& module) {
+    if (std::dynamic_pointer_cast<Sequential>(module) ||
+        std::dynamic_pointer_cast<Residual>(module)) {
+      for (const auto& child :
+           std::dynamic_pointer_cast<Container>(module)->modules()) {
+        inspect(child);
+      }
+    } else if (auto convolution = getConvolution(module)) {
+      if (convolution->causalContext() < 0) {
+        throw std::invalid_argument(
+            "[ConvLM] Incremental forward needs causal convolutions: " +
+            module->prettyString());
+      }
+      context_ += convolution->causalContext();
+      ++nConvolutions_;
+    } else if (!isFramewise(module)) {
+      throw std::invalid_argument(
+          "[ConvLM] Incremental forward does not support " +
+          module->prettyString());
+    }
+  }
+
+  // Tokens the state of a history depends on
+  std::pair<const int*, int> stateTokens(const int* history, int length)
+      const {
+    return length >= context_
+        ? std::make_pair(history + length - context_, context_)
+        : std::make_pair(history, length);
+  }
+
+  size_t hashTokens(std::pair<const int*, int> tokens) const {
+    size_t hash = tokens.second;
+    for (int i = 0; i < tokens.second; i++) {
+      hash ^= tokens.first[i] + 0x9e3779b97f4a7c15ULL + (hash << 6) +
+          (hash >> 2);
+    }
+    return hash;
+  }
+
+  // Slot of the state of a history, marked as the most recently used, or -1
+  int findState(const int* history, int length) {
+    auto tokens = stateTokens(history, length);
+    auto slot = stateIndex_.find(hashTokens(tokens));
+    if (slot == stateIndex_.end()) {
+      return -1;
+    }
+    auto& state = states_[slot->second];
+    if (state.tokens.size() != tokens.second ||
+        !std::equal(
+            tokens.first, tokens.first + tokens.second, state.tokens.begin())) {
+      return -1;
+    }
+    lru_.splice(lru_.begin(), lru_, state.lruPosition);
+    return slot->second;
+  }
+
+  // Cache the states of the samples of the last run after their frame at
+  // `positions` (in the frames of the run)
+  void saveStates(
+      const std::vector<int>& inputs,
+      int sampleSize,
+      const std::vector<int>& lastTokenPositions,
+      const std::vector<int>& samples,
+      const std::vector<int>& positions) {
+    // Take the least recently used slots for the new states, without
+    // evicting the ones of this run
+    std::vector<int> runIndices, slots;
+    for (int i = 0; i < samples.size() && slots.size() < maxStates_; i++) {
+      auto tokens = stateTokens(
+          &inputs[samples[i] * sampleSize], lastTokenPositions[samples[i]] + 1);
+      size_t hash = hashTokens(tokens);
+      if (stateIndex_.find(hash) != stateIndex_.end()) {
+        continue;
+      }
+      int slot = lru_.back();
+      auto& state = states_[slot];
+      if (state.used) {
+        stateIndex_.erase(state.hash);
+      }
+      state.used = true;
+      state.hash = hash;
+      state.tokens.assign(tokens.first, tokens.first + tokens.second);
+      lru_.splice(lru_.begin(), lru_, state.lruPosition);
+      stateIndex_[hash] = slot;
+      runIndices.push_back(i);
+      slots.push_back(slot);
+    }
+    if (slots.empty()) {
+      return;
+    }
+
+    bool samePositions = std::all_of(
+        positions.begin(), positions.end(), [&positions](int position) {
+          return position == positions[0];
+        });
+    af::array runIndicesArray(runIndices.size(), runIndices.data());
+    af::array slotsArray(slots.size(), slots.data());
+    for (int c = 0; c < nConvolutions_; c++) {
+      if (runInputs_[c].isempty()) {
+        continue;
+      }
+      const auto& runInputs = runInputs_[c].array();
+      int context = runInputs.dims(0) - runFrames_;
+      if (slabs_[c].isempty()) {
+        slabs_[c] = af::constant(
+            0,
+            af::dim4(context, runInputs.dims(1), runInputs.dims(2), maxStates_),
+            runInputs.type());
+      }
+      // The receptive field of the frame at `position` starts at `position` + 1
+      // in the inputs of the run, which begin with the context
+      if (samePositions) {
+        slabs_[c](af::span, af::span, af::span, slotsArray) = runInputs(
+            af::seq(positions[0] + 1, positions[0] + context),
+            af::span,
+            af::span,
+            runIndicesArray);
+      } else {
+        for (int i = 0; i < slots.size(); i++) {
+          int position = positions[runIndices[i]];
+          slabs_[c](af::span, af::span, af::span, slots[i]) = runInputs(
+              af::seq(position + 1, position + context),
+              af::span,
+              af::span,
+              runIndices[i]);
+        }
+      }
+    }
+  }
+
+  // Run the network on `nFrames` new tokens of each sample from the states in
+  // `slots` (the start of the histories if empty) and return the predictions
+  // at the frames at `positions`
+  af::array run(
+      const std::vector<int>& tokens,
+      int nFrames,
+      const std::vector<int>& slots,
+      const std::vector<int>& positions) {
+    runSlots_ = slots.empty() ? af::array()
+                              : af::array(slots.size(), slots.data());
+    runFrames_ = nFrames;
+    runConvolution_ = 0;
+    af::array inputData(nFrames, positions.size(), tokens.data());
+    auto output = forward(network_, fl::input(inputData));
+    return selectFrames(output, positions);
+  }
+
+  Variable forward(const ModulePtr& module, const Variable& input) {
+    if (auto sequential = std::dynamic_pointer_cast<Sequential>(module)) {
+      Variable output = input;
+      for (const auto& child : sequential->modules()) {
+        output = forward(child, output);
+      }
+      return output;
+    }
+    if (auto residual = std::dynamic_pointer_cast<Residual>(module)) {
+      return forwardResidual(*residual, input);
+    }
+    if (auto convolution = getConvolution(module)) {
+      return forwardConvolution(module, convolution->causalContext(), input);
+    }
+    return module->forward({input}).front();
+  }
+
+  // Same as `Residual::forward()`, running the layers incrementally
+  Variable forwardResidual(const Residual& residual, const Variable& input) {
+    const auto modules = residual.modules();
+    const auto projections = residual.getProjectionsIndices();
+    const auto& shortcuts = residual.getShortcuts();
+    const auto& scales = residual.getScales();
+    int nLayers = modules.size() - projections.size();
+    std::vector<Variable> outputs(nLayers + 1, Variable());
+    outputs[0] = input;
+
+    auto applyScale = [&scales](const Variable& layerInput, int layerIndex) {
+      auto scale = scales.find(layerIndex);
+      float value = scale != scales.end() ? scale->second : 1.;
+      return layerInput * value;
+    };
+    auto addShortcuts = [&](Variable output, int layerIndex) {
+      auto layerShortcuts = shortcuts.find(layerIndex);
+      if (layerShortcuts == shortcuts.end()) {
+        return output;
+      }
+      for (const auto& shortcut : layerShortcuts->second) {
+        Variable connectionOut = outputs[shortcut.first];
+        if (shortcut.second != -1) {
+          connectionOut = forward(modules[shortcut.second], connectionOut);
+        }
+        output = output + connectionOut.as(output.type());
+      }
+      return output;
+    };
+
+    Variable output = input;
+    int moduleIndex = 0;
+    for (int layerIndex = 0; layerIndex < nLayers; layerIndex++) {
+      while (projections.find(moduleIndex) != projections.end()) {
+        moduleIndex++;
+      }
+      output = addShortcuts(output, layerIndex);
+      output = forward(modules[moduleIndex], applyScale(output, layerIndex));
+      outputs[layerIndex + 1] = output;
+      moduleIndex++;
+    }
+    return applyScale(addShortcuts(output, nLayers), nLayers);
+  }
+
+  // Run a causal convolution on the new frames preceded by their receptive
+  // field: the inputs of the cached states, or zeros as the padding of the
+  // convolution at the start of the histories
+  Variable forwardConvolution(
+      const ModulePtr& module,
+      int context,
+      const Variable& input) {
+    int c = runConvolution_++;
+    if (context == 0) {
+      return module->forward({input}).front();
+    }
+    Variable past;
+    if (runSlots_.isempty()) {
+      auto dims = input.dims();
+      dims[0] = context;
+      past = noGrad(af::constant(0, dims, input.type()));
+    } else {
+      past = noGrad(af::lookup(slabs_[c], runSlots_, 3));
+    }
+    runInputs_[c] = concatenate({past, input.as(past.type())}, 0);
+    auto output = module->forward({runInputs_[c]}).front();
+    return output.rows(output.dims(0) - runFrames_, output.dims(0) - 1);
+  }
+};
+
+} // namespace
+
 GetConvLmScoreFunc buildGetConvLmScoreFunction(
     std::shared_ptr<Module> network) {
   auto getConvLmScoreFunc = [network](
@@ -23,47 +449,29 @@ GetConvLmScoreFunc buildGetConvLmScoreFunction(
                                 int sampleSize = -1,
                                 int batchSize = 1) {
     sampleSize = sampleSize > 0 ? sampleSize : inputs.size();
-    if (sampleSize * batchSize > inputs.size()) {
-      throw std::invalid_argument(
-          "[ConvLM] Incorrect sample size (" + std::to_string(sampleSize) +
-          ") or batch size (" + std::to_string(batchSize) + ").");
-    }
+    checkInputs(inputs, lastTokenPositions, sampleSize, batchSize);
     af::array inputData(sampleSize, batchSize, inputs.data());
     fl::Variable output = network->forward({fl::input(inputData)})[0];
-
-    if (af::count<int>(af::isNaN(output.array())) != 0) {
-      throw std::runtime_error("[ConvLM] Encountered NaNs in propagation");
-    }
-    int32_t C = output.dims(0), T = output.dims(1), B = output.dims(2);
-    if (B != batchSize) {
-      throw std::logic_error(
-          "[ConvLM]: incorrect predictions: batch should be " +
-          std::to_string(batchSize) + " but it is " + std::to_string(B));
-    }
-    if (batchSize != (int)lastTokenPositions.size()) {
-      throw std::logic_error(
-          "[ConvLM]: incorrect postions for accessing: size should be " +
-          std::to_string(batchSize) + " but it is " +
-          std::to_string(lastTokenPositions.size()));
-    }
-    // output (c, t, b)
-    // set global indices: offset by channel
-    af::array globalIndices = af::iota(af::dim4(C, 1), af::dim4(1, B), s32);
-    // set global indices: offset by batch
-    globalIndices =
-        globalIndices + af::iota(af::dim4(1, B), af::dim4(C, 1), s32) * T * C;
-    // set global indices: offset by time which we need to take
-    globalIndices = globalIndices +
-        af::tile(af::array(af::dim4(1, B), lastTokenPositions.data()), C, 1) *
-            C;
-    af::array preds =
-        af::moddims(af::flat(output.array())(af::flat(globalIndices)), C, B);
     // vector of B X C predictions
-    return ext::afToVector<float>(preds);
+    return ext::afToVector<float>(selectFrames(output, lastTokenPositions));
   };
 
   return getConvLmScoreFunc;
 }
+
+GetConvLmScoreFunc buildIncrementalGetConvLmScoreFunction(
+    std::shared_ptr<Module> network,
+    int maxCachedStates) {
+  auto incrementalLm =
+      std::make_shared<IncrementalConvLm>(std::move(network), maxCachedStates);
+  return [incrementalLm](
+             const std::vector<int>& inputs,
+             const std::vector<int>& lastTokenPositions,
+             int sampleSize,
+             int batchSize) {
+    return (*incrementalLm)(inputs, lastTokenPositions, sampleSize, batchSize);
+  };
+}
 } // namespace asr
 } // namespace app
 } // namespace fl
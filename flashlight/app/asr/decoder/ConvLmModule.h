@@ -18,6 +18,23 @@ using GetConvLmScoreFunc = std::function<std::vector<
     float>(const std::vector<int>&, const std::vector<int>&, int, int)>;
 
 GetConvLmScoreFunc buildGetConvLmScoreFunction(std::shared_ptr<Module> network);
+
+/**
+ * Builds a score function equivalent to the one of
+ * `buildGetConvLmScoreFunction()`, which runs the network incrementally. The
+ * inputs of the causal convolutions over their receptive field are cached for
+ * the last `maxCachedStates` scored histories, so that a history extending a
+ * cached one by a token is scored by running the network on this token only.
+ * The other histories are run in full.
+ *
+ * The convolutions of the network must be causal `AsymmetricConv1D` (see
+ * `AsymmetricConv1D::causalContext()`), possibly weight normalized, inside
+ * `Sequential` and `Residual` containers. The other modules must process each
+ * frame independently. Throws `std::invalid_argument` for other networks.
+ */
+GetConvLmScoreFunc buildIncrementalGetConvLmScoreFunction(
+    std::shared_ptr<Module> network,
+    int maxCachedStates);
 } // namespace asr
 } // namespace app
 } // namespace fl
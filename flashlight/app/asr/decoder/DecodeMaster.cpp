@@ -112,10 +112,13 @@ DecodeMaster::computeMetrics(const std::shared_ptr<fl::Dataset>& predDataset) {
 
 std::shared_ptr<fl::lib::text::Trie> DecodeMaster::buildTrie(
     const fl::lib::text::LexiconMap& lexicon,
-    fl::lib::text::SmearingMode smearMode) const {
+    fl::lib::text::SmearingMode smearMode,
+    int nThreads) const {
   auto trie = std::make_shared<fl::lib::text::Trie>(
       tokenDict_.indexSize(), tokenDict_.getIndex(trainOpt_.wordSep));
   auto startState = lm_->start(false);
+  // The entries are only kept for a batch insert on several threads
+  std::vector<fl::lib::text::TrieEntry> entries;
   for (auto& it : lexicon) {
     const std::string& word = it.first;
     int usrIdx = wordDict_.getIndex(word);
@@ -125,12 +128,19 @@ std::shared_ptr<fl::lib::text::Trie> DecodeMaster::buildTrie(
       std::tie(dummyState, score) = lm_->score(startState, usrIdx);
     }
     for (auto& tokens : it.second) {
-      auto tokensTensor = tkn2Idx(tokens, tokenDict_, trainOpt_.repLabel);
-      trie->insert(tokensTensor, usrIdx, score);
+      auto indices = tkn2Idx(tokens, tokenDict_, trainOpt_.repLabel);
+      if (nThreads > 1) {
+        entries.push_back({std::move(indices), usrIdx, score});
+      } else {
+        trie->insert(indices, usrIdx, score);
+      }
     }
   }
+  if (nThreads > 1) {
+    trie->insert(entries, nThreads);
+  }
   // Smearing
-  trie->smear(smearMode);
+  trie->smear(smearMode, nThreads);
   return trie;
 }
 
@@ -251,7 +261,7 @@ std::shared_ptr<fl::Dataset> TokenDecodeMaster::decode(
     const std::shared_ptr<fl::Dataset>& emissionDataset,
     const fl::lib::text::LexiconMap& lexicon,
     DecodeMasterLexiconOptions opt) {
-  auto trie = buildTrie(lexicon, opt.smearMode);
+  auto trie = buildTrie(lexicon, opt.smearMode, opt.nTrieThreads);
   fl::lib::text::LexiconDecoderOptions decoderOpt{
       .beamSize = opt.beamSize,
       .beamSizeToken = opt.beamSizeToken,
@@ -311,7 +321,7 @@ std::shared_ptr<fl::Dataset> WordDecodeMaster::decode(
     const std::shared_ptr<fl::Dataset>& emissionDataset,
     const fl::lib::text::LexiconMap& lexicon,
     DecodeMasterLexiconOptions opt) {
-  auto trie = buildTrie(lexicon, opt.smearMode);
+  auto trie = buildTrie(lexicon, opt.smearMode, opt.nTrieThreads);
   fl::lib::text::LexiconDecoderOptions decoderOpt{
       .beamSize = opt.beamSize,
       .beamSizeToken = opt.beamSizeToken,
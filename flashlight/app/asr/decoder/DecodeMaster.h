@@ -44,6 +44,8 @@ struct DecodeMasterLexiconOptions {
   std::string blankToken;
   std::string unkToken;
   fl::lib::text::SmearingMode smearMode;
+  // Number of threads building the lexicon trie
+  int nTrieThreads = 1;
 };
 
 struct DecodeMasterTrainOptions {
@@ -91,7 +93,8 @@ class DecodeMaster {
  protected:
   std::shared_ptr<fl::lib::text::Trie> buildTrie(
       const fl::lib::text::LexiconMap& lexicon,
-      fl::lib::text::SmearingMode smearMode) const;
+      fl::lib::text::SmearingMode smearMode,
+      int nThreads) const;
 
   std::shared_ptr<fl::Module> net_;
   std::shared_ptr<fl::lib::text::LM> lm_;
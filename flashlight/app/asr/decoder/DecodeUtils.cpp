@@ -6,12 +6,77 @@
  */
 
 #include "flashlight/app/asr/decoder/DecodeUtils.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "flashlight/lib/common/ThreadGroup.h"
+
+using fl::lib::text::packReplabels;
 using fl::lib::text::SmearingMode;
+using fl::lib::text::TrieEntry;
 
 namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+
+void smearTrie(
+    const std::shared_ptr<fl::lib::text::Trie>& trie,
+    const std::string& smearing,
+    int nThreads) {
+  SmearingMode smearMode = SmearingMode::NONE;
+  if (smearing == "logadd") {
+    smearMode = SmearingMode::LOGADD;
+  } else if (smearing == "max") {
+    smearMode = SmearingMode::MAX;
+  } else if (smearing != "none") {
+    throw std::runtime_error(
+        "[buildTrie] Invalid smearing option, can be {logadd, max, none}, provided value is " +
+        smearing);
+  }
+  trie->smear(smearMode, nThreads);
+}
+
+// Inserts into `trie` the entries of all the spellings of `nWords` words,
+// where word i has spellings [spellingBegin[i], spellingBegin[i + 1]) and
+// `fillEntries(i, it)` writes its entries to `it`. On one thread, the entries
+// are inserted word by word; otherwise they are made and inserted in batch,
+// with the words split between `nThreads` threads.
+template <typename Fn>
+void insertTrieEntries(
+    const std::shared_ptr<fl::lib::text::Trie>& trie,
+    const std::vector<size_t>& spellingBegin,
+    int nThreads,
+    const Fn& fillEntries) {
+  const int nWords = spellingBegin.size() - 1;
+  if (nThreads <= 1) {
+    std::vector<TrieEntry> wordEntries;
+    for (int i = 0; i < nWords; ++i) {
+      wordEntries.resize(spellingBegin[i + 1] - spellingBegin[i]);
+      fillEntries(i, wordEntries.begin());
+      for (const auto& entry : wordEntries) {
+        trie->insert(entry.indices, entry.label, entry.score);
+      }
+    }
+    return;
+  }
+  std::vector<TrieEntry> entries(spellingBegin.back());
+  fl::lib::ThreadGroup threads(std::min(nThreads, std::max(nWords, 1)));
+  threads.run([&](int threadIdx) {
+    const int64_t first = int64_t(nWords) * threadIdx / threads.size();
+    const int64_t last = int64_t(nWords) * (threadIdx + 1) / threads.size();
+    for (int64_t i = first; i < last; ++i) {
+      fillEntries(i, entries.begin() + spellingBegin[i]);
+    }
+  });
+  trie->insert(entries, nThreads);
+}
+
+} // namespace
+
 std::shared_ptr<fl::lib::text::Trie> buildTrie(
     const std::string& decoderType,
     bool useLexicon,
@@ -21,7 +86,8 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
     const fl::lib::text::LexiconMap& lexicon,
     const fl::lib::text::Dictionary& wordDict,
     const int wordSeparatorIdx,
-    const int repLabel) {
+    const int repLabel,
+    int nThreads /* = 1 */) {
   if (!(decoderType == "wrd" || useLexicon)) {
     return nullptr;
   }
@@ -29,6 +95,11 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
       tokenDict.indexSize(), wordSeparatorIdx);
   auto startState = lm->start(false);
 
+  // The LM is queried on the calling thread only
+  std::vector<const fl::lib::text::LexiconMap::value_type*> words;
+  std::vector<int> usrIndices;
+  std::vector<float> scores;
+  std::vector<size_t> spellingBegin{0};
   for (auto& it : lexicon) {
     const std::string& word = it.first;
     int usrIdx = wordDict.getIndex(word);
@@ -37,26 +108,112 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
       fl::lib::text::LMStatePtr dummyState;
       std::tie(dummyState, score) = lm->score(startState, usrIdx);
     }
-    for (auto& tokens : it.second) {
-      auto tokensTensor = tkn2Idx(tokens, tokenDict, repLabel);
-      trie->insert(tokensTensor, usrIdx, score);
-    }
+    words.push_back(&it);
+    usrIndices.push_back(usrIdx);
+    scores.push_back(score);
+    spellingBegin.push_back(spellingBegin.back() + it.second.size());
   }
+  insertTrieEntries(
+      trie,
+      spellingBegin,
+      nThreads,
+      [&](int i, std::vector<TrieEntry>::iterator entry) {
+        for (auto& tokens : words[i]->second) {
+          entry->indices = tkn2Idx(tokens, tokenDict, repLabel);
+          entry->label = usrIndices[i];
+          entry->score = scores[i];
+          ++entry;
+        }
+      });
   // Smearing
-  SmearingMode smearMode = SmearingMode::NONE;
-  if (smearing == "logadd") {
-    smearMode = SmearingMode::LOGADD;
-  } else if (smearing == "max") {
-    smearMode = SmearingMode::MAX;
-  } else if (smearing != "none") {
-    throw std::runtime_error(
-        "[buildTrie] Invalid smearing option, can be {logadd, max, none}, provided value is " +
-        smearing);
+  smearTrie(trie, smearing, nThreads);
+  return trie;
+}
+
+std::shared_ptr<fl::lib::text::Trie> buildTrie(
+    const std::string& decoderType,
+    bool useLexicon,
+    std::shared_ptr<fl::lib::text::LM> lm,
+    const std::string& smearing,
+    const fl::lib::text::Dictionary& tokenDict,
+    const fl::lib::text::BinaryLexicon& lexicon,
+    const fl::lib::text::Dictionary& wordDict,
+    const int wordSeparatorIdx,
+    const int repLabel,
+    int nThreads /* = 1 */) {
+  if (!(decoderType == "wrd" || useLexicon)) {
+    return nullptr;
   }
-  trie->smear(smearMode);
+  auto trie = std::make_shared<fl::lib::text::Trie>(
+      tokenDict.indexSize(), wordSeparatorIdx);
+  auto startState = lm->start(false);
+
+  // Token indices are looked up once per distinct token of the lexicon
+  const auto& lexiconTokens = lexicon.getTokens();
+  std::vector<int> tokenIndices(lexiconTokens->size());
+  for (int i = 0; i < lexiconTokens->size(); ++i) {
+    tokenIndices[i] = tokenDict.getIndex(lexiconTokens->get(i));
+  }
+  // The LM is queried on the calling thread only
+  const auto& words = lexicon.getWords();
+  std::vector<int> usrIndices(lexicon.size());
+  std::vector<float> scores(lexicon.size(), -1);
+  std::vector<size_t> spellingBegin{0};
+  for (int i = 0; i < lexicon.size(); ++i) {
+    usrIndices[i] = wordDict.getIndex(words->get(i));
+    if (decoderType == "wrd") {
+      fl::lib::text::LMStatePtr dummyState;
+      std::tie(dummyState, scores[i]) = lm->score(startState, usrIndices[i]);
+    }
+    spellingBegin.push_back(spellingBegin.back() + lexicon.nSpellings(i));
+  }
+  insertTrieEntries(
+      trie,
+      spellingBegin,
+      nThreads,
+      [&](int i, std::vector<TrieEntry>::iterator entry) {
+        std::vector<int> tokens;
+        for (int j = 0; j < lexicon.nSpellings(i); ++j, ++entry) {
+          const uint32_t* spelling = lexicon.getSpellingTokens(i, j);
+          tokens.clear();
+          for (size_t k = 0; k < lexicon.spellingSize(i, j); ++k) {
+            tokens.push_back(tokenIndices[spelling[k]]);
+          }
+          entry->indices = packReplabels(tokens, tokenDict, repLabel);
+          entry->label = usrIndices[i];
+          entry->score = scores[i];
+        }
+      });
+  // Smearing
+  smearTrie(trie, smearing, nThreads);
   return trie;
 }
 
+uint64_t cacheFingerprint(
+    const std::vector<std::string>& files,
+    const std::vector<std::string>& options) {
+  // FNV-1a of the fields, each followed by a separator
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const std::string& field) {
+    for (unsigned char c : field) {
+      hash = (hash ^ c) * 1099511628211ULL;
+    }
+    hash = (hash ^ 0xff) * 1099511628211ULL;
+  };
+  for (const auto& file : files) {
+    add(file);
+    struct stat st;
+    if (!file.empty() && stat(file.c_str(), &st) == 0) {
+      add(std::to_string(st.st_size));
+      add(std::to_string(st.st_mtime));
+    }
+  }
+  for (const auto& option : options) {
+    add(option);
+  }
+  return hash;
+}
+
 } // namespace asr
 } // namespace app
 } // namespace fl
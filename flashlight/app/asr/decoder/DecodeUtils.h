@@ -18,6 +18,7 @@
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 
 namespace fl {
@@ -26,6 +27,8 @@ namespace asr {
 
 /* A series of vector to vector mapping operations */
 
+// Build the lexicon trie, preparing its spellings, inserting them and smearing
+// on `nThreads` threads (the LM is only queried by the calling thread)
 std::shared_ptr<fl::lib::text::Trie> buildTrie(
     const std::string& decoderType,
     bool useLexicon,
@@ -35,7 +38,28 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
     const fl::lib::text::LexiconMap& lexicon,
     const fl::lib::text::Dictionary& wordDict,
     const int wordSeparatorIdx,
-    const int repLabel);
+    const int repLabel,
+    int nThreads = 1);
+
+// Same, reading the spellings in place from a memory mapped lexicon
+std::shared_ptr<fl::lib::text::Trie> buildTrie(
+    const std::string& decoderType,
+    bool useLexicon,
+    std::shared_ptr<fl::lib::text::LM> lm,
+    const std::string& smearing,
+    const fl::lib::text::Dictionary& tokenDict,
+    const fl::lib::text::BinaryLexicon& lexicon,
+    const fl::lib::text::Dictionary& wordDict,
+    const int wordSeparatorIdx,
+    const int repLabel,
+    int nThreads = 1);
+
+// Fingerprint of the inputs a cached decoder file (e.g. a compiled trie) is
+// built from: the path, size and modification time of each of `files`, and
+// `options`. A cached file with another fingerprint is stale.
+uint64_t cacheFingerprint(
+    const std::vector<std::string>& files,
+    const std::vector<std::string>& options);
 
 } // namespace asr
 } // namespace app
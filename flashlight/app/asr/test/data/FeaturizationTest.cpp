@@ -17,6 +17,7 @@
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
+#include "flashlight/lib/common/System.h"
 
 using namespace fl;
 using namespace fl::lib::audio;
@@ -322,6 +323,19 @@ TEST(FeaturizationTest, WrdToTarget) {
   // skip unknown
   target4 = wrd2Target(words4, lexicon, dict, "", 0, false, false, true);
   ASSERT_THAT(target4, ::testing::ElementsAreArray({"_7", "89"}));
+
+  // same targets from a binary lexicon
+  auto binPath = fl::lib::getTmpPath("featurization_lexicon.bin");
+  BinaryLexicon::save(lexicon, binPath);
+  auto binLexicon = BinaryLexicon::load(binPath);
+  for (const auto& w : {words, words1, words2, words3, words4}) {
+    ASSERT_EQ(
+        wrd2Target(w, *binLexicon, dict, "_", 0, true, false, true),
+        wrd2Target(w, lexicon, dict, "_", 0, true, false, true));
+    ASSERT_EQ(
+        wrd2Target(w, *binLexicon, dict, "", 0, false, false, true),
+        wrd2Target(w, lexicon, dict, "", 0, false, false, true));
+  }
 }
 
 TEST(FeaturizationTest, TargetToSingleLtr) {
@@ -10,12 +10,15 @@
 #include <arrayfire.h>
 #include "flashlight/fl/flashlight.h"
 
+#include "flashlight/app/asr/decoder/ConvLmModule.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/lib/common/System.h"
 
 using namespace fl;
 using namespace fl::lib;
 using namespace fl::ext;
+using fl::app::asr::buildGetConvLmScoreFunction;
+using fl::app::asr::buildIncrementalGetConvLmScoreFunction;
 
 namespace {
 
@@ -114,6 +117,55 @@ TEST(ConvLmModuleTest, SerializationGCNN14BAdaptiveSoftmax) {
   ASSERT_TRUE(allClose(outputl_criterion, output_criterion));
 }
 
+TEST(ConvLmModuleTest, IncrementalForward) {
+  const std::string archfile = pathsConcat(archDir, "gcnn_tiny_lm_arch.txt");
+  int nclass = 20;
+  auto model = buildSequentialModule(archfile, 1, nclass);
+  model->eval();
+  auto fullForward = buildGetConvLmScoreFunction(model);
+  auto incrementalForward = buildIncrementalGetConvLmScoreFunction(model, 8);
+
+  // Two histories growing by a token at each step: all the steps but the
+  // first one run on the last token only
+  std::vector<std::vector<int>> histories = {{2}, {2}};
+  for (int step = 0; step < 30; step++) {
+    int sampleSize = histories[0].size() + 2;
+    std::vector<int> inputs(2 * sampleSize, 1);
+    std::vector<int> lastTokenPositions;
+    for (int b = 0; b < 2; b++) {
+      std::copy(
+          histories[b].begin(),
+          histories[b].end(),
+          inputs.begin() + b * sampleSize);
+      lastTokenPositions.push_back(histories[b].size() - 1);
+    }
+    auto expected = fullForward(inputs, lastTokenPositions, sampleSize, 2);
+    auto scores = incrementalForward(inputs, lastTokenPositions, sampleSize, 2);
+    ASSERT_EQ(scores.size(), expected.size());
+    for (int i = 0; i < scores.size(); i++) {
+      ASSERT_NEAR(scores[i], expected[i], 1e-4);
+    }
+    histories[0].push_back((step * 7) % nclass);
+    histories[1].push_back((step * 3 + 1) % nclass);
+  }
+
+  // A history truncated to its last tokens shares the states of the full one,
+  // as the receptive field of the network fits in it
+  std::vector<int> truncated(histories[0].end() - 10, histories[0].end());
+  auto expected = fullForward(truncated, {9}, -1, 1);
+  auto scores = incrementalForward(truncated, {9}, -1, 1);
+  for (int i = 0; i < scores.size(); i++) {
+    ASSERT_NEAR(scores[i], expected[i], 1e-4);
+  }
+}
+
+TEST(ConvLmModuleTest, IncrementalForwardUnsupported) {
+  auto model = std::make_shared<Sequential>();
+  model->add(Conv2D(16, 16, 3, 1, 1, 1, -1, 0));
+  ASSERT_THROW(
+      buildIncrementalGetConvLmScoreFunction(model, 8), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
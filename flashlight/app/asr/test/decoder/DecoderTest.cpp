@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <fstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <glog/logging.h>
@@ -50,14 +51,28 @@ std::vector<int> tokens2Tensor(
   return ret;
 }
 
-TEST(DecoderTest, run) {
+struct DecoderTestData {
+  EmissionUnit emissionUnit;
+  std::vector<float> transitions;
+  LexiconMap lexicon;
+  Dictionary tokenDict;
+  Dictionary wordDict;
+};
+
+std::string getDataDir() {
   std::string dataDir = "";
 #ifdef DECODER_TEST_DATADIR
   dataDir = DECODER_TEST_DATADIR;
 #endif
+  return dataDir;
+}
+
+DecoderTestData loadDecoderTestData() {
+  std::string dataDir = getDataDir();
+  DecoderTestData data;
 
   /* ===================== Create Dataset ===================== */
-  EmissionUnit emissionUnit;
+  EmissionUnit& emissionUnit = data.emissionUnit;
 
   // T, N
   std::string tnPath = pathsConcat(dataDir, "TN.bin");
@@ -77,21 +92,71 @@ TEST(DecoderTest, run) {
   em_stream.close();
 
   // Transitions
-  std::vector<float> transitions(N * N);
+  data.transitions.resize(N * N);
   std::string transitionsPath = pathsConcat(dataDir, "transition.bin");
   std::ifstream tr_stream(transitionsPath, std::ios::binary | std::ios::in);
-  tr_stream.read((char*)transitions.data(), N * N * sizeof(float));
+  tr_stream.read((char*)data.transitions.data(), N * N * sizeof(float));
   tr_stream.close();
 
   LOG(INFO) << "[Serialization] Loaded emissions [" << T << " x " << N << ']';
 
   /* ===================== Create Dictionary ===================== */
-  auto lexicon = loadWords(pathsConcat(dataDir, "words.lst"));
-  Dictionary tokenDict(pathsConcat(dataDir, "letters.lst"));
-  tokenDict.addEntry("<1>"); // replabel emulation
-  auto wordDict = createWordDict(lexicon);
+  data.lexicon = loadWords(pathsConcat(dataDir, "words.lst"));
+  data.tokenDict = Dictionary(pathsConcat(dataDir, "letters.lst"));
+  data.tokenDict.addEntry("<1>"); // replabel emulation
+  data.wordDict = createWordDict(data.lexicon);
+
+  LOG(INFO) << "[Dictionary] Number of words: " << data.wordDict.indexSize();
+  return data;
+}
+
+TriePtr buildTrie(const DecoderTestData& data, const LMPtr& lm) {
+  int silIdx = data.tokenDict.getIndex(kSilToken);
+  auto trie = std::make_shared<Trie>(data.tokenDict.indexSize(), silIdx);
+  auto startState = lm->start(false);
+
+  // Insert words
+  for (const auto& it : data.lexicon) {
+    const std::string& word = it.first;
+    int usrIdx = data.wordDict.getIndex(word);
+    float score = -1;
+    LMStatePtr dummyState;
+    std::tie(dummyState, score) = lm->score(startState, usrIdx);
+
+    for (const auto& tokens : it.second) {
+      auto tokensTensor = tkn2Idx(tokens, data.tokenDict, 1);
+      trie->insert(tokensTensor, usrIdx, score);
+    }
+  }
+  LOG(INFO) << "[Decoder] Trie planted.\n";
+
+  // Smearing
+  trie->smear(SmearingMode::MAX);
+  LOG(INFO) << "[Decoder] Trie smeared.\n";
+  return trie;
+}
+
+LexiconDecoderOptions getDecoderOptions() {
+  return LexiconDecoderOptions{
+      .beamSize = 2500, // beamsize
+      .beamSizeToken = 25000, // beamsizetoken
+      .beamThreshold = 100.0, // beamthreshold
+      .lmWeight = 2.0, // lmweight
+      .wordScore = 2.0, // lexiconcore
+      .unkScore = -std::numeric_limits<float>::infinity(), // unkscore
+      .silScore = -1, // silscore
+      .logAdd = false, // logadd
+      .criterionType = CriterionType::ASG};
+}
 
-  LOG(INFO) << "[Dictionary] Number of words: " << wordDict.indexSize();
+TEST(DecoderTest, run) {
+  std::string dataDir = getDataDir();
+  auto data = loadDecoderTestData();
+  const auto& emissionUnit = data.emissionUnit;
+  const auto& transitions = data.transitions;
+  const auto& tokenDict = data.tokenDict;
+  const auto& wordDict = data.wordDict;
+  int T = emissionUnit.nFrames, N = emissionUnit.nTokens;
 
   /* ===================== Decode ===================== */
   /* -------- Build Language Model --------*/
@@ -117,27 +182,7 @@ TEST(DecoderTest, run) {
   int silIdx = tokenDict.getIndex(kSilToken);
   int blankIdx = -1;
   int unkIdx = wordDict.getIndex(kUnkToken);
-  auto trie = std::make_shared<Trie>(tokenDict.indexSize(), silIdx);
-  auto startState = lm->start(false);
-
-  // Insert words
-  for (const auto& it : lexicon) {
-    const std::string& word = it.first;
-    int usrIdx = wordDict.getIndex(word);
-    float score = -1;
-    LMStatePtr dummyState;
-    std::tie(dummyState, score) = lm->score(startState, usrIdx);
-
-    for (const auto& tokens : it.second) {
-      auto tokensTensor = tkn2Idx(tokens, tokenDict, 1);
-      trie->insert(tokensTensor, usrIdx, score);
-    }
-  }
-  LOG(INFO) << "[Decoder] Trie planted.\n";
-
-  // Smearing
-  trie->smear(SmearingMode::MAX);
-  LOG(INFO) << "[Decoder] Trie smeared.\n";
+  auto trie = buildTrie(data, lm);
 
   std::vector<float> trieScoreTarget{
       -1.05971, -2.87742, -2.64553, -3.05081, -1.05971, -3.08968};
@@ -149,16 +194,7 @@ TEST(DecoderTest, run) {
   }
 
   /* -------- Build Decoder --------*/
-  LexiconDecoderOptions decoderOpt{
-      .beamSize = 2500, // beamsize
-      .beamSizeToken = 25000, // beamsizetoken
-      .beamThreshold = 100.0, // beamthreshold
-      .lmWeight = 2.0, // lmweight
-      .wordScore = 2.0, // lexiconcore
-      .unkScore = -std::numeric_limits<float>::infinity(), // unkscore
-      .silScore = -1, // silscore
-      .logAdd = false, // logadd
-      .criterionType = CriterionType::ASG};
+  auto decoderOpt = getDecoderOptions();
 
   LexiconDecoder decoder(
       decoderOpt, trie, lm, silIdx, blankIdx, unkIdx, transitions, false);
@@ -191,6 +227,71 @@ TEST(DecoderTest, run) {
   }
 }
 
+TEST(DecoderTest, kenLMCache) {
+  auto data = loadDecoderTestData();
+  const auto& emissionUnit = data.emissionUnit;
+  int T = emissionUnit.nFrames, N = emissionUnit.nTokens;
+  std::string lmPath = pathsConcat(getDataDir(), "lm.arpa");
+  int silIdx = data.tokenDict.getIndex(kSilToken);
+  int unkIdx = data.wordDict.getIndex(kUnkToken);
+
+  auto decode = [&](const KenLMPtr& lm) {
+    LexiconDecoder decoder(
+        getDecoderOptions(),
+        buildTrie(data, lm),
+        lm,
+        silIdx,
+        -1,
+        unkIdx,
+        data.transitions,
+        false);
+    return decoder.decode(emissionUnit.emission.data(), T, N);
+  };
+
+  auto lm = std::make_shared<KenLM>(lmPath, data.wordDict);
+  auto expected = decode(lm);
+  ASSERT_EQ(lm->getCacheStats().hits + lm->getCacheStats().misses, 0);
+
+  // The caches of 2 threads, each of 1MB
+  auto cachedLm = std::make_shared<KenLM>(lmPath, data.wordDict, 2 << 20, 2);
+  auto checkResults = [&expected](const std::vector<DecodeResult>& results) {
+    ASSERT_EQ(results.size(), expected.size());
+    for (int i = 0; i < results.size(); i++) {
+      ASSERT_EQ(results[i].score, expected[i].score);
+      ASSERT_EQ(results[i].lmScore, expected[i].lmScore);
+      ASSERT_EQ(results[i].words, expected[i].words);
+      ASSERT_EQ(results[i].tokens, expected[i].tokens);
+    }
+  };
+  checkResults(decode(cachedLm));
+  auto stats = cachedLm->getCacheStats();
+  ASSERT_GT(stats.hits, 0);
+  ASSERT_GT(stats.misses, 0);
+
+  // The cache persists across sentences
+  checkResults(decode(cachedLm));
+  auto newStats = cachedLm->getCacheStats();
+  ASSERT_GT(newStats.hits - stats.hits, newStats.misses - stats.misses);
+
+  // The caches of the exited threads are freed, and their counters kept
+  auto oneCacheLm =
+      std::make_shared<KenLM>(lmPath, data.wordDict, 1 << 20, 1);
+  std::thread([&]() { checkResults(decode(oneCacheLm)); }).join();
+  stats = oneCacheLm->getCacheStats();
+  ASSERT_GT(stats.misses, 0);
+  std::thread([&]() { checkResults(decode(oneCacheLm)); }).join();
+  newStats = oneCacheLm->getCacheStats();
+  ASSERT_GT(newStats.misses, stats.misses);
+
+  // Once the budget is used up, the other threads query the model directly
+  checkResults(decode(oneCacheLm));
+  stats = oneCacheLm->getCacheStats();
+  std::thread([&]() { checkResults(decode(oneCacheLm)); }).join();
+  newStats = oneCacheLm->getCacheStats();
+  ASSERT_EQ(newStats.hits, stats.hits);
+  ASSERT_EQ(newStats.misses, stats.misses);
+}
+
 int main(int argc, char** argv) {
   fl::init();
   google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Converts a lexicon and a tokens dictionary into the binary formats which are
+ * memory mapped by the training and decoding binaries:
+ *
+ *  fl_asr_binarize_lexicon \
+ *   --lexicon=lexicon.txt \
+ *   --binary_lexicon=lexicon.bin \
+ *   --tokens=tokens.txt \
+ *   --binary_tokens=tokens.bin
+ *
+ * The binary files are detected from their content, so they are used by
+ * passing them to `--lexicon` and `--tokens` in place of the text files.
+ */
+
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace {
+
+DEFINE_string(binary_lexicon, "", "Output path of the binary lexicon");
+DEFINE_string(binary_tokens, "", "Output path of the binary tokens dictionary");
+
+} // namespace
+
+using namespace fl::app::asr;
+using namespace fl::lib::text;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  gflags::SetUsageMessage(
+      "Usage: " + std::string(argv[0]) +
+      " [--lexicon --binary_lexicon] [--tokens --binary_tokens]");
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  if (FLAGS_binary_lexicon.empty() && FLAGS_binary_tokens.empty()) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+
+  if (!FLAGS_binary_lexicon.empty()) {
+    auto lexicon = loadWords(FLAGS_lexicon, FLAGS_maxword);
+    BinaryLexicon::save(lexicon, FLAGS_binary_lexicon);
+    LOG(INFO) << "Saved " << lexicon.size() << " words to "
+              << FLAGS_binary_lexicon;
+  }
+  if (!FLAGS_binary_tokens.empty()) {
+    Dictionary tokenDict(FLAGS_tokens);
+    tokenDict.saveBinary(FLAGS_binary_tokens);
+    LOG(INFO) << "Saved " << tokenDict.entrySize() << " tokens to "
+              << FLAGS_binary_tokens;
+  }
+  return 0;
+}
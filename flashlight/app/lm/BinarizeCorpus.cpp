@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "flashlight/app/lm/common/Defines.h"
+#include "flashlight/app/lm/common/Helpers.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/Logging.h"
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/tokenizer/Tokenizer.h"
+
+/**
+ * Binarize text corpora for LM training
+ *
+ * Usage:
+ *
+ *  corpus_binarizer \
+ *   --data_dir=/tmp \
+ *   --data_train=test1.txt,test2.txt \
+ *   --n_workers=40 \
+ *   --dictionary=dictionary.txt \
+ *   --dictionary_max_size=200000
+ *
+ * -------------------------------
+ *
+ * Each text file is memory mapped and tokenized by `n_workers` threads, and
+ * its tokens are mapped to their indices in the dictionary (built by the
+ * dictionary builder), tokens which are not in it being mapped to <unk>. The
+ * indices are saved next to the file with suffix `.tokens`, as a flat array
+ * of int32, and the index of the first token of each sentence (i.e. line) is
+ * saved with suffix `.sentences`, as an array of uint64 terminated by the
+ * total number of tokens.
+ *
+ * Files are processed in chunks of about `chunk_size_mb` MB per worker, so
+ * that the memory used does not depend on the size of the files.
+ */
+
+namespace {
+DEFINE_string(
+    data_dir,
+    "",
+    "Prefix for the 'data_train' files.");
+DEFINE_string(
+    data_train,
+    "",
+    "Comma-separated list of text files to binarize; '--data_dir' will be used to add prefix for the files.");
+
+DEFINE_string(
+    dictionary,
+    "",
+    "Path to the dictionary file, which defines tokens set of language model.");
+DEFINE_int64(
+    dictionary_max_size,
+    -1,
+    "Number of rows to use from the dictionary file (top rows), cutting the number of target classes.");
+
+DEFINE_int64(n_workers, 1, "Number of workers for parallel file reading");
+DEFINE_int64(
+    chunk_size_mb,
+    256,
+    "Size in MB of the part of a file tokenized at once by a worker");
+} // namespace
+
+int main(int argc, char** argv) {
+  fl::init();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Binarization of text data for LM training. \n Usage: " + exec +
+      " \n Compulsory: [--data_train] [--dictionary]");
+  LOG(INFO) << "Parsing command line flags";
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  LOG(INFO) << "Gflags after parsing \n" << fl::app::lm::serializeGflags("; ");
+
+  if (argc <= 1 || FLAGS_data_train.empty() || FLAGS_dictionary.empty()) {
+    throw std::invalid_argument(gflags::ProgramUsage());
+  }
+  if (FLAGS_n_workers <= 0 || FLAGS_chunk_size_mb <= 0) {
+    throw std::invalid_argument(
+        "'--n_workers' and '--chunk_size_mb' should be positive");
+  }
+
+  auto dictionary = fl::app::lm::loadDictionary(
+      FLAGS_dictionary, FLAGS_dictionary_max_size);
+  dictionary.setDefaultIndex(dictionary.getIndex(fl::lib::text::kUnkToken));
+  LOG(INFO) << "Loaded dictionary of " << dictionary.entrySize() << " tokens";
+
+  fl::lib::text::Tokenizer tokenizer;
+  auto files = fl::lib::split(',', FLAGS_data_train);
+  for (const auto& file : files) {
+    const auto path = fl::lib::pathsConcat(FLAGS_data_dir, file);
+    LOG(INFO) << "Binarizing " << path;
+    fl::lib::MemoryMappedFile text(path);
+
+    // A whole number of waves of `n_workers` parts
+    const int64_t chunkSize = FLAGS_chunk_size_mb << 20;
+    const int64_t nChunks = (text.size() + chunkSize - 1) / chunkSize;
+    const int64_t nWaves = std::max<int64_t>(
+        (nChunks + FLAGS_n_workers - 1) / FLAGS_n_workers, 1);
+    const int64_t nParts = nWaves * FLAGS_n_workers;
+
+    const auto tokensPath = path + fl::app::lm::kTokensFileExtension;
+    const auto sentencesPath = path + fl::app::lm::kSentencesFileExtension;
+    auto tokensStream = fl::lib::createOutputStream(
+        tokensPath, std::ios::out | std::ios::binary);
+    auto sentencesStream = fl::lib::createOutputStream(
+        sentencesPath, std::ios::out | std::ios::binary);
+    uint64_t nTokens = 0;
+    uint64_t nSentences = 0;
+    for (int64_t wave = 0; wave < nWaves; ++wave) {
+      std::vector<std::future<fl::lib::text::TokenizedText>> futures;
+      for (int64_t i = 0; i < FLAGS_n_workers; ++i) {
+        const int rank = wave * FLAGS_n_workers + i;
+        futures.push_back(std::async(std::launch::async, [&, rank]() {
+          return tokenizer.indexTokens(text, dictionary, rank, nParts);
+        }));
+      }
+      for (auto& future : futures) {
+        auto part = future.get();
+        tokensStream.write(
+            reinterpret_cast<const char*>(part.tokens.data()),
+            part.tokens.size() * sizeof(int));
+        // The offsets of the part, but its last one (its number of tokens)
+        for (size_t i = 0; i + 1 < part.sentenceOffsets.size(); ++i) {
+          uint64_t offset = nTokens + part.sentenceOffsets[i];
+          sentencesStream.write(
+              reinterpret_cast<const char*>(&offset), sizeof(offset));
+        }
+        nTokens += part.tokens.size();
+        nSentences += part.sentenceOffsets.size() - 1;
+      }
+    }
+    sentencesStream.write(
+        reinterpret_cast<const char*>(&nTokens), sizeof(nTokens));
+    if (!tokensStream.good() || !sentencesStream.good()) {
+      throw std::runtime_error("Failed to write binarized data of: " + path);
+    }
+    LOG(INFO) << "  Saved " << nTokens << " tokens and " << nSentences
+              << " sentences to: " << tokensPath << ", " << sentencesPath;
+  }
+
+  return 0;
+}
@@ -102,6 +102,18 @@ DEFINE_bool(
     data_use_dynamic_batching,
     false,
     "if or not use dynamic batching in case of '--data_sample_break_mode=eos'.");
+DEFINE_bool(
+    data_use_binarized,
+    false,
+    "if or not read the '.tokens' and '.sentences' files written by the corpus binarizer next to the data files, which must be binarized with '--dictionary'.");
+DEFINE_bool(
+    data_use_wordpieces,
+    false,
+    "if or not split the words of the text data files into the word pieces of '--dictionary' by greedy longest match; words which cannot be split are mapped to <unk>.");
+DEFINE_string(
+    data_wordpiece_prefix,
+    "_",
+    "Prefix added to each word before splitting it into word pieces, with '--data_use_wordpieces'.");
 
 /* DICTIONARY OPTIONS */
 DEFINE_string(
@@ -444,30 +456,16 @@ void Trainer::initEval() {
 }
 
 void Trainer::createDictionary() {
-  auto stream = createInputStream(FLAGS_dictionary);
-  std::string line;
-  while (std::getline(stream, line)) {
-    if (line.empty()) {
-      continue;
-    }
-    auto tkns = splitOnWhitespace(line, true);
-    if (tkns.empty()) {
-      continue;
-    }
-    dictionary_.addEntry(tkns.front());
-    if (dictionary_.entrySize() == FLAGS_dictionary_max_size &&
-        FLAGS_dictionary_max_size > 0) {
-      break;
-    }
-  }
-  if (!dictionary_.isContiguous()) {
-    throw std::runtime_error("Invalid dictionary_ format - not contiguous");
-  }
+  dictionary_ = loadDictionary(FLAGS_dictionary, FLAGS_dictionary_max_size);
   kPadIdx_ = dictionary_.getIndex(fl::lib::text::kPadToken);
   kEosIdx_ = dictionary_.getIndex(fl::lib::text::kEosToken);
   kUnkIdx_ = dictionary_.getIndex(fl::lib::text::kUnkToken);
   kMaskIdx_ = dictionary_.getIndex(fl::lib::text::kMaskToken);
   dictionary_.setDefaultIndex(dictionary_.getIndex(fl::lib::text::kUnkToken));
+  if (FLAGS_data_use_wordpieces) {
+    wordPieceSegmenter_ =
+        std::make_shared<fl::lib::text::WordPieceSegmenter>(dictionary_);
+  }
 }
 
 void Trainer::createTrainDatasets() {
@@ -483,7 +481,10 @@ void Trainer::createTrainDatasets() {
       FLAGS_data_tokens_per_sample,
       FLAGS_data_batch_size,
       FLAGS_data_sample_break_mode,
-      true);
+      true,
+      FLAGS_data_use_binarized,
+      wordPieceSegmenter_.get(),
+      FLAGS_data_wordpiece_prefix);
   FL_LOG_MASTER(INFO) << "train dataset: " << trainDataset_->size()
                       << " samples";
 }
@@ -502,7 +503,10 @@ void Trainer::createValidDatasets() {
       FLAGS_data_tokens_per_sample,
       FLAGS_data_batch_size,
       "eos",
-      FLAGS_data_use_dynamic_batching);
+      FLAGS_data_use_dynamic_batching,
+      FLAGS_data_use_binarized,
+      wordPieceSegmenter_.get(),
+      FLAGS_data_wordpiece_prefix);
   FL_LOG_MASTER(INFO) << "valid dataset: " << validDataset_->size()
                       << " samples";
 }
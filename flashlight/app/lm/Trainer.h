@@ -27,6 +27,7 @@
 #include "flashlight/lib/text/dictionary/Utils.h"
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
 
 namespace fl {
 namespace app {
@@ -59,6 +60,9 @@ DECLARE_int64(data_batch_size);
 DECLARE_int64(data_tokens_per_sample);
 DECLARE_string(data_sample_break_mode);
 DECLARE_bool(data_use_dynamic_batching);
+DECLARE_bool(data_use_binarized);
+DECLARE_bool(data_use_wordpieces);
+DECLARE_string(data_wordpiece_prefix);
 
 /* DICTIONARY OPTIONS */
 DECLARE_string(dictionary);
@@ -113,6 +117,7 @@ class Trainer {
   std::string version_{FL_APP_LM_VERSION};
 
   fl::lib::text::Dictionary dictionary_;
+  std::shared_ptr<fl::lib::text::WordPieceSegmenter> wordPieceSegmenter_;
   std::shared_ptr<TextDataset> trainDataset_;
   std::shared_ptr<TextDataset> validDataset_;
 
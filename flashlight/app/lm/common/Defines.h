@@ -15,7 +15,11 @@ namespace fl {
 namespace app {
 namespace lm {
 
-/* Place holder */
+// Extensions of the files written next to a text file by the corpus
+// binarizer: the int32 token indices of its sentences, and the uint64 index
+// of the first token of each sentence followed by the number of tokens.
+constexpr const char* kTokensFileExtension = ".tokens";
+constexpr const char* kSentencesFileExtension = ".sentences";
 
 } // namespace lm
 } // namespace app
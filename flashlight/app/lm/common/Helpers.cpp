@@ -8,6 +8,10 @@
 #include "flashlight/app/lm/common/Helpers.h"
 
 #include <sstream>
+#include <stdexcept>
+
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
 
 namespace fl {
 namespace app {
@@ -25,6 +29,31 @@ std::string serializeGflags(const std::string& separator /* = "\n" */) {
   return serialized.str();
 }
 
+fl::lib::text::Dictionary loadDictionary(
+    const std::string& path,
+    int64_t maxSize /* = -1 */) {
+  fl::lib::text::Dictionary dictionary;
+  auto stream = fl::lib::createInputStream(path);
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto tkns = fl::lib::splitOnWhitespace(line, true);
+    if (tkns.empty()) {
+      continue;
+    }
+    dictionary.addEntry(tkns.front());
+    if (dictionary.entrySize() == maxSize && maxSize > 0) {
+      break;
+    }
+  }
+  if (!dictionary.isContiguous()) {
+    throw std::runtime_error("Invalid dictionary format - not contiguous");
+  }
+  return dictionary;
+}
+
 } // namespace lm
 } // namespace app
 } // namespace fl
@@ -7,14 +7,27 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 #include <gflags/gflags.h>
 
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
 namespace fl {
 namespace app {
 namespace lm {
 
 std::string serializeGflags(const std::string& separator = "\n");
 
+/**
+ * Load the first `maxSize` (all if not positive) tokens of a dictionary built
+ * by the dictionary builder, where each line is a token and its count.
+ */
+fl::lib::text::Dictionary loadDictionary(
+    const std::string& path,
+    int64_t maxSize = -1);
+
 } // namespace lm
 } // namespace app
 } // namespace fl
@@ -8,7 +8,6 @@
 #include "flashlight/app/lm/data/TextDataset.h"
 
 #include <algorithm>
-#include <cstring>
 #include <utility>
 
 #include "flashlight/lib/common/String.h"
@@ -18,6 +17,7 @@
 using fl::lib::text::Dictionary;
 using fl::lib::text::PartialFileReader;
 using fl::lib::text::Tokenizer;
+using fl::lib::text::WordPieceSegmenter;
 
 namespace fl {
 namespace app {
@@ -25,9 +25,10 @@ namespace lm {
 
 namespace {
 
-// Maximum number of tokens to keep in memory for each `TextDataset` instance.
-// Setting the default value to 10,000,000,000 which requires 40GB in memory,
-// since indices are stored as int32.
+// Maximum number of tokens to keep in memory for each `TextDataset` instance
+// reading text files. Setting the default value to 10,000,000,000 which
+// requires 40GB in memory, since indices are stored as int32. Binarized data
+// is memory mapped, so it is not limited.
 constexpr size_t kMaxTokenInBuffer = 10000000000;
 
 } // namespace
@@ -41,45 +42,60 @@ TextDataset::TextDataset(
     int64_t tokensPerSample /* = 1024 */,
     int64_t batchSize /* = 1 */,
     const std::string& sampleBreakMode /* = "none" */,
-    bool useDynamicBatching /* = false */)
-    : pad_(dictionary.getIndex(fl::lib::text::kPadToken)) {
+    bool useDynamicBatching /* = false */,
+    bool useBinarizedData /* = false */,
+    const WordPieceSegmenter* wordPieceSegmenter /* = nullptr */,
+    const std::string& wordPiecePrefix /* = "" */)
+    : pad_(dictionary.getIndex(fl::lib::text::kPadToken)),
+      corpus_(dictionary.getIndex(fl::lib::text::kEosToken)) {
   /* 1. Read data */
-  // data_ will have the following layout:
+  const int unk = wordPieceSegmenter
+      ? dictionary.getIndex(fl::lib::text::kUnkToken)
+      : -1;
+  // corpus_ exposes the tokens as the following layout:
   // <eos> sentence <eos> sentence <eos> ... <eos> sentence <eos>
-  data_.clear();
-  data_.reserve(kMaxTokenInBuffer);
-  const auto eos = dictionary.getIndex(fl::lib::text::kEosToken);
-  data_.push_back(eos);
-
-  // Each pair of indices in sentenceRanges indicates the position in data_ of
-  // the 2 <eos> tokens around a given sentence.
-  std::vector<std::pair<int64_t, int64_t>> sentenceRanges;
   auto files = lib::split(',', filenames);
   for (const auto& file : files) {
     const auto path = fl::lib::pathsConcat(dataDirectory, file);
+    if (useBinarizedData) {
+      corpus_.addBinarized(path, reader.getRank(), reader.getTotalReaders());
+      continue;
+    }
     reader.loadFile(path);
 
+    std::vector<int> indices;
+    std::vector<uint64_t> sentenceOffsets{0};
     while (reader.hasNextLine()) {
-      const auto currentEosPosition = data_.size() - 1;
-      if (!sentenceRanges.empty()) {
-        sentenceRanges.back().second = currentEosPosition;
-      }
-
       const auto tokens = tokenizer.tokenize(reader.getLine());
-      const auto indices = dictionary.mapEntriesToIndices(tokens);
-      if (data_.size() + indices.size() > kMaxTokenInBuffer) {
+      if (corpus_.size() + indices.size() + sentenceOffsets.size() +
+              tokens.size() >
+          kMaxTokenInBuffer) {
         FL_LOG(INFO) << "[TextDataset] stop loading at 10,000,000,000 tokens";
         break;
       }
-      sentenceRanges.emplace_back(currentEosPosition, -1);
-      data_.insert(data_.end(), indices.begin(), indices.end());
-      data_.push_back(eos);
-    }
-    if (!sentenceRanges.empty()) {
-      sentenceRanges.back().second = data_.size() - 1;
+      if (wordPieceSegmenter) {
+        // Words which cannot be fully split into word pieces are <unk>
+        for (const auto& token : tokens) {
+          const size_t size = indices.size();
+          if (!wordPieceSegmenter->segment(wordPiecePrefix + token, indices)) {
+            indices.resize(size);
+            indices.push_back(unk);
+          }
+        }
+      } else {
+        for (const auto& token : tokens) {
+          indices.push_back(dictionary.getIndex(token));
+        }
+      }
+      sentenceOffsets.push_back(indices.size());
     }
+    corpus_.add(std::move(indices), std::move(sentenceOffsets));
   }
-  const int64_t nTokens = data_.size();
+  const int64_t nTokens = corpus_.size();
+
+  // Each pair of indices in sentenceRanges indicates the position in corpus_
+  // of the 2 <eos> tokens around a given sentence.
+  auto sentenceRanges = corpus_.sentenceRanges();
 
   /* 2. Batchify */
   if (batchSize <= 0) {
@@ -166,10 +182,7 @@ std::vector<af::array> TextDataset::get(const int64_t idx) const {
   std::vector<int> buffer(batch.size() * maxLength, pad_);
   for (int64_t i = 0; i < batch.size(); ++i) {
     const auto& pos = batch[i];
-    std::memcpy(
-        buffer.data() + i * maxLength,
-        data_.data() + pos.first,
-        sizeof(int) * (pos.last - pos.first + 1));
+    corpus_.copy(pos.first, pos.last, buffer.data() + i * maxLength);
   }
   return {af::array(maxLength, batch.size(), buffer.data())};
 }
@@ -10,10 +10,12 @@
 #include <unordered_map>
 #include <vector>
 
+#include "flashlight/app/lm/data/TokenCorpus.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
 
 namespace fl {
 namespace app {
@@ -46,6 +48,13 @@ namespace lm {
  * included in each batch. All samples are padded with token <pad> to the length
  * of the longest one in a certain batch. To better fit more samples in each
  * batch, samples are sorted by length.
+ * @param useBinarizedData Read the files binarized by the corpus binarizer
+ * (next to the text files, with the same dictionary) instead of the text
+ * files. They are memory mapped, and each reader takes an equal share of
+ * their sentences, so neither `reader` nor `tokenizer` is used.
+ * @param wordPieceSegmenter If set, the words of the text files are prefixed
+ * with `wordPiecePrefix` and split into the word pieces of the dictionary
+ * with it, instead of being looked up in the dictionary.
  */
 
 class TextDataset : public fl::Dataset {
@@ -59,7 +68,10 @@ class TextDataset : public fl::Dataset {
       int64_t tokensPerSample = 1024,
       int64_t batchSize = 1,
       const std::string& sampleBreakMode = "none",
-      bool useDynamicBatching = false);
+      bool useDynamicBatching = false,
+      bool useBinarizedData = false,
+      const fl::lib::text::WordPieceSegmenter* wordPieceSegmenter = nullptr,
+      const std::string& wordPiecePrefix = "");
 
   int64_t size() const override;
 
@@ -75,7 +87,7 @@ class TextDataset : public fl::Dataset {
     int64_t last;
   };
 
-  std::vector<int> data_; // eos prepended, so all indices shifted by 1
+  TokenCorpus corpus_;
   std::vector<std::vector<SamplePosition>> batches_;
 };
 
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/lm/data/TokenCorpus.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "flashlight/app/lm/common/Defines.h"
+
+namespace fl {
+namespace app {
+namespace lm {
+
+void TokenCorpus::add(
+    std::vector<int> tokens,
+    std::vector<uint64_t> sentenceOffsets) {
+  if (sentenceOffsets.empty() || sentenceOffsets.front() != 0 ||
+      sentenceOffsets.back() != tokens.size() ||
+      !std::is_sorted(sentenceOffsets.begin(), sentenceOffsets.end())) {
+    throw std::invalid_argument("[TokenCorpus] Invalid sentence offsets");
+  }
+  Run run;
+  run.tokenBuf = std::move(tokens);
+  run.offsetBuf = std::move(sentenceOffsets);
+  run.tokens = run.tokenBuf.data();
+  run.offsets = run.offsetBuf.data();
+  run.nSentences = run.offsetBuf.size() - 1;
+  addRun(std::move(run));
+}
+
+void TokenCorpus::addBinarized(
+    const std::string& path,
+    int rank /* = 0 */,
+    int totalParts /* = 1 */) {
+  if (totalParts < 1 || rank < 0 || rank >= totalParts) {
+    throw std::invalid_argument(
+        "[TokenCorpus] Invalid part " + std::to_string(rank) + " of " +
+        std::to_string(totalParts));
+  }
+  Run run;
+  run.tokensFile = std::make_shared<fl::lib::MemoryMappedFile>(
+      path + kTokensFileExtension);
+  run.sentencesFile = std::make_shared<fl::lib::MemoryMappedFile>(
+      path + kSentencesFileExtension);
+  const size_t nOffsets = run.sentencesFile->size() / sizeof(uint64_t);
+  if (run.sentencesFile->size() % sizeof(uint64_t) != 0 || nOffsets == 0) {
+    throw std::runtime_error(
+        "[TokenCorpus] Invalid sentences file: " + run.sentencesFile->path());
+  }
+  run.tokens = reinterpret_cast<const int*>(run.tokensFile->data());
+  const auto* offsets =
+      reinterpret_cast<const uint64_t*>(run.sentencesFile->data());
+  const int64_t nSentences = nOffsets - 1;
+  if (offsets[0] != 0 ||
+      offsets[nSentences] * sizeof(int) != run.tokensFile->size()) {
+    throw std::runtime_error(
+        "[TokenCorpus] Sentences file " + run.sentencesFile->path() +
+        " does not match tokens file " + run.tokensFile->path());
+  }
+  if (!std::is_sorted(offsets, offsets + nOffsets)) {
+    throw std::runtime_error(
+        "[TokenCorpus] Sentence offsets are not sorted in sentences file: " +
+        run.sentencesFile->path());
+  }
+
+  // The sentences are split evenly between the parts
+  const int64_t first = nSentences * rank / totalParts;
+  const int64_t last = nSentences * (rank + 1) / totalParts;
+  run.offsets = offsets + first;
+  run.nSentences = last - first;
+  addRun(std::move(run));
+}
+
+void TokenCorpus::addRun(Run run) {
+  if (run.nSentences == 0) {
+    return;
+  }
+  run.firstPosition = size() - 1;
+  runs_.push_back(std::move(run));
+}
+
+int64_t TokenCorpus::size() const {
+  if (runs_.empty()) {
+    return 1;
+  }
+  return runs_.back().firstPosition + runs_.back().size() + 1;
+}
+
+int64_t TokenCorpus::nSentences() const {
+  int64_t nSentences = 0;
+  for (const auto& run : runs_) {
+    nSentences += run.nSentences;
+  }
+  return nSentences;
+}
+
+std::vector<std::pair<int64_t, int64_t>> TokenCorpus::sentenceRanges() const {
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  ranges.reserve(nSentences());
+  for (const auto& run : runs_) {
+    for (int64_t i = 0; i < run.nSentences; ++i) {
+      ranges.emplace_back(run.eosPosition(i), run.eosPosition(i + 1));
+    }
+  }
+  return ranges;
+}
+
+void TokenCorpus::copy(int64_t first, int64_t last, int* out) const {
+  if (first < 0 || last >= size()) {
+    throw std::out_of_range("[TokenCorpus] Invalid range of positions");
+  }
+  // The run and the sentence whose preceding <eos> is the last one before
+  // `first`
+  auto runIt = std::upper_bound(
+      runs_.begin(),
+      runs_.end(),
+      first,
+      [](int64_t pos, const Run& run) { return pos < run.firstPosition; });
+  size_t r = runIt == runs_.begin() ? runs_.size() : runIt - runs_.begin() - 1;
+  int64_t i = 0;
+  if (r < runs_.size()) {
+    int64_t lo = 0;
+    int64_t hi = runs_[r].nSentences;
+    while (hi - lo > 1) {
+      int64_t mid = lo + (hi - lo) / 2;
+      (runs_[r].eosPosition(mid) <= first ? lo : hi) = mid;
+    }
+    i = lo;
+  }
+
+  int64_t pos = first;
+  while (pos <= last) {
+    if (r >= runs_.size()) {
+      // The last <eos>
+      *out++ = eos_;
+      ++pos;
+      continue;
+    }
+    const auto& run = runs_[r];
+    const int64_t eosPos = run.eosPosition(i);
+    if (pos == eosPos) {
+      *out++ = eos_;
+      ++pos;
+    }
+    const uint64_t begin = run.offsets[i] + (pos - eosPos - 1);
+    const int64_t n = std::min<int64_t>(
+        static_cast<int64_t>(run.offsets[i + 1] - begin), last - pos + 1);
+    if (n > 0) {
+      std::memcpy(out, run.tokens + begin, n * sizeof(int));
+      out += n;
+      pos += n;
+    }
+    if (++i == run.nSentences) {
+      ++r;
+      i = 0;
+    }
+  }
+}
+
+} // namespace lm
+} // namespace app
+} // namespace fl
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+
+namespace fl {
+namespace app {
+namespace lm {
+
+/**
+ * TokenCorpus holds the token indices of sentences, read into memory or
+ * memory mapped from the files written by the corpus binarizer, and exposes
+ * them as the stream
+ *
+ *   <eos> sentence <eos> sentence <eos> ... <eos> sentence <eos>
+ *
+ * without storing the <eos> tokens. Positions in the stream are computed from
+ * the sentence offsets only, so a binarized corpus is neither read nor copied
+ * to be batched, and its pages are shared by the processes of a machine.
+ */
+class TokenCorpus {
+ public:
+  explicit TokenCorpus(int eos) : eos_(eos) {}
+
+  /**
+   * Append sentences held in memory: sentence i is made of the tokens
+   * [sentenceOffsets[i], sentenceOffsets[i + 1]).
+   */
+  void add(std::vector<int> tokens, std::vector<uint64_t> sentenceOffsets);
+
+  /**
+   * Append the `rank`th of `totalParts` parts of the sentences of a text file
+   * binarized by the corpus binarizer, i.e. memory map the `.tokens` and
+   * `.sentences` files written next to `path`.
+   */
+  void addBinarized(const std::string& path, int rank = 0, int totalParts = 1);
+
+  /* Length of the stream, including the <eos> tokens */
+  int64_t size() const;
+
+  int64_t nSentences() const;
+
+  /* Positions in the stream of the <eos> tokens around each sentence */
+  std::vector<std::pair<int64_t, int64_t>> sentenceRanges() const;
+
+  /* Copy the tokens of the stream at positions [first, last] to `out` */
+  void copy(int64_t first, int64_t last, int* out) const;
+
+ private:
+  // Consecutive sentences, sentence i being the tokens
+  // [offsets[i], offsets[i + 1]) of `tokens`
+  struct Run {
+    std::vector<int> tokenBuf;
+    std::vector<uint64_t> offsetBuf;
+    std::shared_ptr<const fl::lib::MemoryMappedFile> tokensFile;
+    std::shared_ptr<const fl::lib::MemoryMappedFile> sentencesFile;
+
+    const int* tokens;
+    const uint64_t* offsets;
+    int64_t nSentences;
+    // Position in the stream of the <eos> before the first sentence
+    int64_t firstPosition;
+
+    // Position of the <eos> before sentence i
+    int64_t eosPosition(int64_t i) const {
+      return firstPosition + i + (offsets[i] - offsets[0]);
+    }
+
+    // Number of positions taken by the run, <eos> excluding the last one
+    int64_t size() const {
+      return nSentences + (offsets[nSentences] - offsets[0]);
+    }
+  };
+
+  void addRun(Run run);
+
+  int eos_;
+  std::vector<Run> runs_;
+};
+
+} // namespace lm
+} // namespace app
+} // namespace fl
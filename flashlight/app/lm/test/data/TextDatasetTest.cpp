@@ -10,12 +10,14 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "flashlight/app/lm/common/Defines.h"
 #include "flashlight/app/lm/data/TextDataset.h"
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
 
 using fl::lib::pathsConcat;
 using namespace fl::lib;
@@ -132,6 +134,145 @@ TEST(TextDatasetTest, EosModeWithDynamicBatching) {
   }
 }
 
+TEST(TextDatasetTest, BinarizedData) {
+  fl::lib::text::Tokenizer tokenizer;
+  Dictionary dictionary =
+      createDictionary(pathsConcat(dataDir, "dictionary.txt"));
+
+  // Binarize train.txt as the corpus binarizer does
+  const auto binDir = getTmpPath("TextDatasetTest");
+  dirCreateRecursive(binDir);
+  const auto binPath = pathsConcat(binDir, "train.txt");
+  auto text = tokenizer.indexTokens(
+      pathsConcat(dataDir, "train.txt"), dictionary, 2);
+  std::vector<uint64_t> sentenceOffsets(
+      text.sentenceOffsets.begin(), text.sentenceOffsets.end());
+  {
+    auto tokensStream = createOutputStream(
+        binPath + kTokensFileExtension, std::ios::out | std::ios::binary);
+    tokensStream.write(
+        reinterpret_cast<const char*>(text.tokens.data()),
+        text.tokens.size() * sizeof(int));
+    auto sentencesStream = createOutputStream(
+        binPath + kSentencesFileExtension, std::ios::out | std::ios::binary);
+    sentencesStream.write(
+        reinterpret_cast<const char*>(sentenceOffsets.data()),
+        sentenceOffsets.size() * sizeof(uint64_t));
+  }
+
+  struct Mode {
+    int tokensPerSample;
+    int batchSize;
+    std::string sampleBreakMode;
+    bool useDynamicBatching;
+  };
+  for (const auto& mode : {Mode{5, 2, "none", false},
+                           Mode{5, 2, "eos", false},
+                           Mode{15, 1, "eos", true}}) {
+    fl::lib::text::PartialFileReader textReader(0, 1);
+    TextDataset textDataset(
+        dataDir,
+        "train.txt",
+        textReader,
+        tokenizer,
+        dictionary,
+        mode.tokensPerSample,
+        mode.batchSize,
+        mode.sampleBreakMode,
+        mode.useDynamicBatching);
+    fl::lib::text::PartialFileReader binReader(0, 1);
+    TextDataset binDataset(
+        binDir,
+        "train.txt",
+        binReader,
+        tokenizer,
+        dictionary,
+        mode.tokensPerSample,
+        mode.batchSize,
+        mode.sampleBreakMode,
+        mode.useDynamicBatching,
+        true);
+
+    ASSERT_EQ(binDataset.size(), textDataset.size());
+    for (int i = 0; i < binDataset.size(); i++) {
+      auto textSample = textDataset.get(i);
+      auto binSample = binDataset.get(i);
+      ASSERT_EQ(binSample.size(), 1);
+      ASSERT_EQ(binSample[0].dims(), textSample[0].dims());
+      ASSERT_TRUE(af::allTrue<bool>(binSample[0] == textSample[0]));
+    }
+  }
+}
+
+TEST(TextDatasetTest, WordPieces) {
+  fl::lib::text::Tokenizer tokenizer;
+  // The words of train.txt are split into several pieces, except "just"
+  // which cannot be split and is mapped to <unk>
+  Dictionary dictionary;
+  for (const std::string& token : {kEosToken,
+                                   kPadToken,
+                                   kUnkToken,
+                                   kMaskToken,
+                                   "_th",
+                                   "is",
+                                   "_is",
+                                   "_a",
+                                   "_te",
+                                   "st",
+                                   "_ok",
+                                   "_it",
+                                   "_wo",
+                                   "rks",
+                                   "_fi",
+                                   "ne"}) {
+    dictionary.addEntry(token);
+  }
+  dictionary.setDefaultIndex(dictionary.getIndex(kUnkToken));
+  WordPieceSegmenter segmenter(dictionary);
+
+  // One sentence per batch, between <eos> tokens
+  fl::lib::text::PartialFileReader partialFileReader(0, 1);
+  TextDataset dataset(
+      dataDir,
+      "train.txt",
+      partialFileReader,
+      tokenizer,
+      dictionary,
+      100,
+      1,
+      "eos",
+      false,
+      false,
+      &segmenter,
+      "_");
+
+  std::vector<std::vector<std::string>> expectedPieces = {
+      {"_th", "is", "_is", kUnkToken, "_a", "_te", "st"},
+      {"_th", "is", "_is", "_a", "_te", "st"},
+      {"_th", "is", "_is", "_te", "st"},
+      {"_te", "st", "_th", "is"},
+      {"_ok", "_it", "_wo", "rks"},
+      {"_it", "_wo", "rks", "_fi", "ne"},
+      {"_th", "is", "_te", "st", "_wo", "rks", "_fi", "ne"},
+      {"_th", "is", "_is", "_a", "_fi", "ne", "_te", "st"}};
+  ASSERT_EQ(dataset.size(), expectedPieces.size());
+  for (int i = 0; i < dataset.size(); i++) {
+    std::vector<int> expected{dictionary.getIndex(kEosToken)};
+    for (const auto& piece : expectedPieces[i]) {
+      expected.push_back(dictionary.getIndex(piece));
+    }
+    expected.push_back(dictionary.getIndex(kEosToken));
+
+    auto sample = dataset.get(i);
+    ASSERT_EQ(sample.size(), 1);
+    ASSERT_EQ(sample[0].dims(0), expected.size());
+    ASSERT_EQ(sample[0].dims(1), 1);
+    std::vector<int> indices(expected.size());
+    sample[0].host(indices.data());
+    ASSERT_EQ(indices, expected);
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/app/lm/common/Defines.h"
+#include "flashlight/app/lm/data/TokenCorpus.h"
+#include "flashlight/lib/common/System.h"
+
+using fl::lib::getTmpPath;
+using namespace fl::app::lm;
+
+namespace {
+
+constexpr int kEos = 1;
+
+std::vector<std::vector<int>> randomSentences(int n, std::mt19937& gen) {
+  std::vector<std::vector<int>> sentences(n);
+  for (auto& sentence : sentences) {
+    // Some sentences are empty
+    sentence.resize(gen() % 6);
+    for (auto& token : sentence) {
+      token = 2 + gen() % 100;
+    }
+  }
+  return sentences;
+}
+
+std::pair<std::vector<int>, std::vector<uint64_t>> flatten(
+    const std::vector<std::vector<int>>& sentences) {
+  std::vector<int> tokens;
+  std::vector<uint64_t> offsets{0};
+  for (const auto& sentence : sentences) {
+    tokens.insert(tokens.end(), sentence.begin(), sentence.end());
+    offsets.push_back(tokens.size());
+  }
+  return {tokens, offsets};
+}
+
+// Write the files of the corpus binarizer for `sentences`
+std::string writeBinarized(
+    const std::string& name,
+    const std::vector<std::vector<int>>& sentences) {
+  auto path = getTmpPath(name);
+  auto data = flatten(sentences);
+  std::ofstream(path + kTokensFileExtension, std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(data.first.data()),
+          data.first.size() * sizeof(int));
+  std::ofstream(path + kSentencesFileExtension, std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(data.second.data()),
+          data.second.size() * sizeof(uint64_t));
+  return path;
+}
+
+// The stream <eos> sentence <eos> ... <eos> sentence <eos>
+std::vector<int> referenceStream(
+    const std::vector<std::vector<int>>& sentences) {
+  std::vector<int> stream{kEos};
+  for (const auto& sentence : sentences) {
+    stream.insert(stream.end(), sentence.begin(), sentence.end());
+    stream.push_back(kEos);
+  }
+  return stream;
+}
+
+void checkCorpus(
+    const TokenCorpus& corpus,
+    const std::vector<std::vector<int>>& sentences) {
+  auto stream = referenceStream(sentences);
+  ASSERT_EQ(corpus.size(), stream.size());
+  ASSERT_EQ(corpus.nSentences(), sentences.size());
+
+  auto ranges = corpus.sentenceRanges();
+  ASSERT_EQ(ranges.size(), sentences.size());
+  int64_t eosPosition = 0;
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    ASSERT_EQ(ranges[i].first, eosPosition);
+    eosPosition += sentences[i].size() + 1;
+    ASSERT_EQ(ranges[i].second, eosPosition);
+  }
+
+  // All the ranges of positions, across sentences and runs
+  std::vector<int> out(stream.size());
+  for (int64_t first = 0; first < stream.size(); ++first) {
+    for (int64_t last = first; last < stream.size(); ++last) {
+      corpus.copy(first, last, out.data());
+      for (int64_t pos = first; pos <= last; ++pos) {
+        ASSERT_EQ(out[pos - first], stream[pos])
+            << "copy(" << first << ", " << last << ")";
+      }
+    }
+  }
+  ASSERT_THROW(corpus.copy(0, stream.size(), out.data()), std::out_of_range);
+}
+
+} // namespace
+
+TEST(TokenCorpusTest, InMemory) {
+  std::mt19937 gen(0);
+  auto sentences = randomSentences(20, gen);
+  TokenCorpus corpus(kEos);
+  checkCorpus(corpus, {});
+
+  auto data = flatten(sentences);
+  corpus.add(data.first, data.second);
+  checkCorpus(corpus, sentences);
+
+  ASSERT_THROW(corpus.add({2, 3}, {0, 1}), std::invalid_argument);
+  ASSERT_THROW(corpus.add({2, 3}, {0, 2, 1, 2}), std::invalid_argument);
+}
+
+TEST(TokenCorpusTest, MultipleFiles) {
+  // Sentences held in memory, then binarized files (one of them empty)
+  std::mt19937 gen(1);
+  std::vector<std::vector<int>> allSentences;
+  TokenCorpus corpus(kEos);
+  for (int file = 0; file < 4; ++file) {
+    auto sentences = randomSentences(file == 2 ? 0 : 3 + file, gen);
+    if (file == 0) {
+      auto data = flatten(sentences);
+      corpus.add(data.first, data.second);
+    } else {
+      corpus.addBinarized(writeBinarized(
+          "token_corpus_test_" + std::to_string(file), sentences));
+    }
+    allSentences.insert(
+        allSentences.end(), sentences.begin(), sentences.end());
+  }
+  checkCorpus(corpus, allSentences);
+}
+
+TEST(TokenCorpusTest, SplitBetweenRanks) {
+  std::mt19937 gen(2);
+  auto sentences = randomSentences(23, gen);
+  auto path = writeBinarized("token_corpus_test_split", sentences);
+
+  for (int totalParts : {1, 3, 4, 30}) {
+    // Each rank gets contiguous sentences, and the ranks get them all once
+    std::vector<std::vector<int>> allSentences;
+    for (int rank = 0; rank < totalParts; ++rank) {
+      TokenCorpus corpus(kEos);
+      corpus.addBinarized(path, rank, totalParts);
+      int64_t first = allSentences.size();
+      int64_t nSentences = corpus.nSentences();
+      ASSERT_LE(nSentences, sentences.size() / totalParts + 1);
+      std::vector<std::vector<int>> part(
+          sentences.begin() + first, sentences.begin() + first + nSentences);
+      checkCorpus(corpus, part);
+      allSentences.insert(allSentences.end(), part.begin(), part.end());
+    }
+    ASSERT_EQ(allSentences, sentences);
+  }
+
+  TokenCorpus corpus(kEos);
+  ASSERT_THROW(corpus.addBinarized(path, 2, 2), std::invalid_argument);
+}
+
+TEST(TokenCorpusTest, InvalidBinarized) {
+  auto path = writeBinarized("token_corpus_test_invalid", {{2, 3}, {4}});
+  TokenCorpus corpus(kEos);
+
+  // Offsets which are not sorted
+  std::vector<uint64_t> offsets{0, 3, 1, 3};
+  std::ofstream(path + kSentencesFileExtension, std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(offsets.data()),
+          offsets.size() * sizeof(uint64_t));
+  ASSERT_THROW(corpus.addBinarized(path), std::runtime_error);
+
+  // Offsets which do not match the tokens
+  offsets = {0, 2, 4};
+  std::ofstream(path + kSentencesFileExtension, std::ios::binary)
+      .write(
+          reinterpret_cast<const char*>(offsets.data()),
+          offsets.size() * sizeof(uint64_t));
+  ASSERT_THROW(corpus.addBinarized(path), std::runtime_error);
+  ASSERT_EQ(corpus.nSentences(), 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
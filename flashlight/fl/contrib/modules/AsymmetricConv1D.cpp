@@ -101,6 +101,16 @@ Variable AsymmetricConv1D::forward(const Variable& input) {
   return output;
 }
 
+int AsymmetricConv1D::causalContext() const {
+  int context = (xFilter_ - 1) * xDilation_;
+  // With an odd context, the output is shifted by one frame
+  if (futurePart_ != 0 || xStride_ != 1 ||
+      xPad_ != static_cast<int>(PaddingMode::SAME) || context % 2 != 0) {
+    return -1;
+  }
+  return context;
+}
+
 std::string AsymmetricConv1D::prettyString() const {
   std::ostringstream ss;
   ss << "AsymmetricConv1D";
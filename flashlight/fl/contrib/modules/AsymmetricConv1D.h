@@ -52,6 +52,14 @@ class AsymmetricConv1D : public fl::Conv2D {
 
   fl::Variable forward(const fl::Variable& input) override;
 
+  /**
+   * Returns the number of past frames the output at a frame depends on (in
+   * addition to the frame itself) if the convolution is causal and keeps the
+   * number of frames, that is has no future part, a stride of 1 and 'SAME'
+   * padding, or -1 otherwise.
+   */
+  int causalContext() const;
+
   std::string prettyString() const override;
 
  private:
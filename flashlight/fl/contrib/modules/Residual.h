@@ -70,6 +70,21 @@ class Residual : public Container {
 
   std::unordered_set<int> getProjectionsIndices() const;
 
+  /**
+   * Returns the shortcuts of the block, mapping each layer index (from 0 for
+   * the first layer to \f$ N_{layers} \f$ for the output) to the layer indices
+   * from which a shortcut connects to its input and the index of the module
+   * applied on the shortcut (-1 for none).
+   */
+  const std::unordered_map<int, std::unordered_map<int, int>>& getShortcuts()
+      const;
+
+  /**
+   * Returns the scaling factors applied to the input of the layers, by layer
+   * index (from 0 for the first layer to \f$ N_{layers} \f$ for the output).
+   */
+  const std::unordered_map<int, float>& getScales() const;
+
   /**
    * Adds a scaling factor to all residual connections connecting to a layer
    * given by some index index. Given some scale \f$ \alpha \f$, the input to
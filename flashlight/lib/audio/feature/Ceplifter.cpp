@@ -35,12 +35,14 @@ void Ceplifter::applyInPlace(std::vector<float>& input) const {
     throw std::invalid_argument(
         "Ceplifter: input size is not divisible by numFilters");
   }
-  size_t n = 0;
-  for (auto& in : input) {
-    in *= coefs_[n++];
-    if (n == numFilters_) {
-      n = 0;
-    }
+  for (size_t i = 0; i < input.size(); i += numFilters_) {
+    applyFrameInPlace(input.data() + i);
+  }
+}
+
+void Ceplifter::applyFrameInPlace(float* frame) const {
+  for (size_t n = 0; n < numFilters_; ++n) {
+    frame[n] *= coefs_[n];
   }
 }
 } // namespace audio
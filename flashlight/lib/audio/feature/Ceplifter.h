@@ -25,6 +25,9 @@ class Ceplifter {
 
   void applyInPlace(std::vector<float>& input) const;
 
+  // Re-scale the coefficients of a single frame in place
+  void applyFrameInPlace(float* frame) const;
+
  private:
   int numFilters_; // number of filterbank channels
   int lifterParam_; // liftering parameter
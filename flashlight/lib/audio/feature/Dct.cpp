@@ -32,6 +32,21 @@ Dct::Dct(int numfilters, int numceps)
 std::vector<float> Dct::apply(const std::vector<float>& input) const {
   return cblasGemm(input, dctMat_, numCeps_, numFilters_);
 }
+
+void Dct::apply(
+    const float* input,
+    int numFrames,
+    float* output,
+    int outputStride) const {
+  cblasGemm(
+      input,
+      dctMat_.data(),
+      output,
+      numFrames,
+      numCeps_,
+      numFilters_,
+      outputStride);
+}
 } // namespace audio
 } // namespace lib
 } // namespace fl
@@ -24,6 +24,14 @@ class Dct {
 
   std::vector<float> apply(const std::vector<float>& input) const;
 
+  // Same as apply() on `numFrames` frames of `input`, writing the
+  // coefficients of each frame at `outputStride` values from the previous one
+  void apply(
+      const float* input,
+      int numFrames,
+      float* output,
+      int outputStride) const;
+
  private:
   int numFilters_; // Number of filterbank channels
   int numCeps_; // Number of cepstral coefficients
@@ -7,15 +7,78 @@
 
 #include "flashlight/lib/audio/feature/Derivatives.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FL_DERIVATIVES_X86
+#include <immintrin.h>
+#endif
+
 namespace fl {
 namespace lib {
 namespace audio {
 
+namespace {
+
+// Frames of the deltas computed before the accelerations of the frames they
+// depend on, so that the deltas are still in cache
+constexpr int kFrameBlockSize = 64;
+
+// output[j] += weight * (forward[j] - backward[j]) for j in [0, n)
+void addDiffScalar(
+    float* output,
+    const float* forward,
+    const float* backward,
+    float weight,
+    int n) {
+  for (int j = 0; j < n; ++j) {
+    output[j] += weight * (forward[j] - backward[j]);
+  }
+}
+
+#ifdef FL_DERIVATIVES_X86
+
+// Same operations as the scalar kernel (no FMA), so that the results do not
+// depend on the kernel
+__attribute__((target("avx"))) void addDiffAvx(
+    float* output,
+    const float* forward,
+    const float* backward,
+    float weight,
+    int n) {
+  __m256 vweight = _mm256_set1_ps(weight);
+  int j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m256 diff = _mm256_sub_ps(
+        _mm256_loadu_ps(forward + j), _mm256_loadu_ps(backward + j));
+    _mm256_storeu_ps(
+        output + j,
+        _mm256_add_ps(
+            _mm256_loadu_ps(output + j), _mm256_mul_ps(vweight, diff)));
+  }
+  addDiffScalar(output + j, forward + j, backward + j, weight, n - j);
+}
+
+#endif // FL_DERIVATIVES_X86
+
+using AddDiffFunc = void (*)(float*, const float*, const float*, float, int);
+
+AddDiffFunc addDiffKernel() {
+#ifdef FL_DERIVATIVES_X86
+  static const AddDiffFunc kernel =
+      __builtin_cpu_supports("avx") ? addDiffAvx : addDiffScalar;
+  return kernel;
+#else
+  return addDiffScalar;
+#endif
+}
+
+} // namespace
+
 Derivatives::Derivatives(int deltawindow, int accwindow)
     : deltaWindow_(deltawindow), accWindow_(accwindow) {}
 
@@ -31,14 +94,7 @@ std::vector<float> Derivatives::apply(
     return input;
   }
 
-  auto deltas = computeDerivative(input, deltaWindow_, numfeat);
-  size_t szMul = 2;
-  std::vector<float> doubledeltas;
-  if (accWindow_ > 0) {
-    // Compute double deltas (only if required)
-    szMul = 3;
-    doubledeltas = computeDerivative(deltas, accWindow_, numfeat);
-  }
+  size_t szMul = outputMultiplier();
   std::vector<float> output(input.size() * szMul);
   int numframes = input.size() / numfeat;
   for (size_t i = 0; i < numframes; ++i) {
@@ -49,41 +105,83 @@ std::vector<float> Derivatives::apply(
         input.data() + curInIdx,
         input.data() + curInIdx + numfeat,
         output.data() + curOutIdx);
-    // copy deltas
-    std::copy(
-        deltas.data() + curInIdx,
-        deltas.data() + curInIdx + numfeat,
-        output.data() + curOutIdx + numfeat);
-    // copy double-deltas
+  }
+  applyInPlace(output.data(), numframes, numfeat);
+  return output;
+}
+
+void Derivatives::applyInPlace(float* features, int numframes, int numfeat)
+    const {
+  if (deltaWindow_ <= 0) {
+    return;
+  }
+  int stride = numfeat * outputMultiplier();
+  int accDone = 0;
+  for (int start = 0; start < numframes; start += kFrameBlockSize) {
+    int end = std::min(start + kFrameBlockSize, numframes);
+    computeDerivative(
+        features,
+        features + numfeat,
+        deltaWindow_,
+        numframes,
+        numfeat,
+        stride,
+        start,
+        end);
     if (accWindow_ > 0) {
-      std::copy(
-          doubledeltas.data() + curInIdx,
-          doubledeltas.data() + curInIdx + numfeat,
-          output.data() + curOutIdx + 2 * numfeat);
+      // Compute double deltas (only if required) of the frames whose deltas
+      // window is computed
+      int accEnd = end == numframes ? numframes : end - accWindow_;
+      if (accEnd > accDone) {
+        computeDerivative(
+            features + numfeat,
+            features + 2 * numfeat,
+            accWindow_,
+            numframes,
+            numfeat,
+            stride,
+            accDone,
+            accEnd);
+        accDone = accEnd;
+      }
     }
   }
-  return output;
 }
 
-std::vector<float> Derivatives::computeDerivative(
-    const std::vector<float>& input,
+int Derivatives::outputMultiplier() const {
+  if (deltaWindow_ <= 0) {
+    return 1;
+  }
+  return accWindow_ > 0 ? 3 : 2;
+}
+
+void Derivatives::computeDerivative(
+    const float* input,
+    float* output,
     int windowlen,
-    int numfeat) const {
-  int numframes = input.size() / numfeat;
-  std::vector<float> output(input.size(), 0.0);
+    int numframes,
+    int numfeat,
+    int stride,
+    int firstframe,
+    int lastframe) const {
   float denominator = (windowlen * (windowlen + 1) * (2 * windowlen + 1)) / 3.0;
-  for (size_t i = 0; i < numframes; ++i) {
-    for (size_t j = 0; j < numfeat; ++j) {
-      size_t curIdx = i * numfeat + j;
-      for (size_t d = 1; d <= windowlen; ++d) {
-        output[curIdx] += d *
-            (input[curIdx + std::min((numframes - i - 1), d) * numfeat] -
-             input[curIdx - std::min(i, d) * numfeat]);
-      }
-      output[curIdx] /= denominator;
+  AddDiffFunc addDiff = addDiffKernel();
+  // The features of a frame are accumulated together, one lag at a time
+  for (int i = firstframe; i < lastframe; ++i) {
+    float* out = output + i * stride;
+    std::fill(out, out + numfeat, 0.0);
+    for (int d = 1; d <= windowlen; ++d) {
+      addDiff(
+          out,
+          input + std::min(i + d, numframes - 1) * stride,
+          input + std::max(i - d, 0) * stride,
+          d,
+          numfeat);
+    }
+    for (int j = 0; j < numfeat; ++j) {
+      out[j] /= denominator;
     }
   }
-  return output;
 }
 } // namespace audio
 } // namespace lib
@@ -25,15 +25,31 @@ class Derivatives {
 
   std::vector<float> apply(const std::vector<float>& input, int numfeat) const;
 
+  // Same as apply() in place: `features` holds `numframes` rows of
+  // numfeat * outputMultiplier() values, whose first `numfeat` values are the
+  // input. The derivatives are written after them in each row.
+  void applyInPlace(float* features, int numframes, int numfeat) const;
+
+  // Number of output features per input feature
+  int outputMultiplier() const;
+
  private:
   int deltaWindow_; // delta derivatives lag size
   int accWindow_; // acceleration derivatives lag size
 
-  // Helper function to compute derivatives of single order
-  std::vector<float> computeDerivative(
-      const std::vector<float>& input,
+  // Helper function to compute derivatives of single order, of the `numfeat`
+  // first values of the rows of `input`, to the rows of `output`. Rows are
+  // `stride` values apart. Only the rows from `firstframe` to `lastframe` of
+  // `output` are computed.
+  void computeDerivative(
+      const float* input,
+      float* output,
       int windowlen,
-      int numfeat) const;
+      int numframes,
+      int numfeat,
+      int stride,
+      int firstframe,
+      int lastframe) const;
 };
 } // namespace audio
 } // namespace lib
@@ -23,9 +23,13 @@ std::vector<float> Dither::apply(const std::vector<float>& input) {
 }
 
 void Dither::applyInPlace(std::vector<float>& input) {
+  applyInPlace(input.data(), input.size());
+}
+
+void Dither::applyInPlace(float* input, size_t size) {
   std::uniform_real_distribution<float> distribution(0.0, 1.0);
-  for (auto& i : input) {
-    i += ditherVal_ * distribution(rng_);
+  for (size_t i = 0; i < size; ++i) {
+    input[i] += ditherVal_ * distribution(rng_);
   }
 }
 } // namespace audio
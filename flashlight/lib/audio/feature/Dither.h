@@ -29,6 +29,9 @@ class Dither {
 
   void applyInPlace(std::vector<float>& input);
 
+  // Dither the `size` values starting at `input` in place
+  void applyInPlace(float* input, size_t size);
+
  private:
   float ditherVal_;
   std::mt19937 rng_; // Standard mersenne_twister_engine
@@ -7,7 +7,11 @@
 
 #include "flashlight/lib/audio/feature/Mfcc.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
@@ -24,41 +28,65 @@ Mfcc::Mfcc(const FeatureParams& params)
 }
 
 std::vector<float> Mfcc::apply(const std::vector<float>& input) {
-  auto frames = frameSignal(input, this->featParams_);
-  if (frames.empty()) {
+  int nFrames = this->featParams_.numFrames(input.size());
+  if (nFrames == 0) {
     return {};
   }
+  std::vector<float> output(
+      nFrames * this->featParams_.numCepstralCoeffs *
+      derivatives_.outputMultiplier());
+  apply(input.data(), input.size(), output.data());
+  return output;
+}
 
+void Mfcc::apply(const float* input, int inputSz, float* output) {
+  int nFrames = this->featParams_.numFrames(inputSz);
   int nSamples = this->featParams_.numFrameSizeSamples();
-  int nFrames = frames.size() / nSamples;
+  int nFft = this->featParams_.nFft();
+  int numFilters = this->featParams_.numFilterbankChans;
+  bool useEnergy = this->featParams_.useEnergy;
+  bool rawEnergy = this->featParams_.rawEnergy;
+  auto nFeat = this->featParams_.numCepstralCoeffs;
+  int stride = nFeat * derivatives_.outputMultiplier();
 
-  std::vector<float> energy(nFrames);
-  if (this->featParams_.useEnergy && this->featParams_.rawEnergy) {
-    for (size_t f = 0; f < nFrames; ++f) {
-      auto begin = frames.data() + f * nSamples;
-      energy[f] =
-          std::log(std::inner_product(begin, begin + nSamples, begin, 0.0));
-    }
-  }
-  auto mfscfeat = this->mfscImpl(frames);
-  auto cep = dct_.apply(mfscfeat);
-  ceplifter_.applyInPlace(cep);
+  auto energy = [nSamples](const float* frame) {
+    return std::log(std::inner_product(frame, frame + nSamples, frame, 0.0));
+  };
 
-  auto nFeat = this->featParams_.numCepstralCoeffs;
-  if (this->featParams_.useEnergy) {
-    if (!this->featParams_.rawEnergy) {
-      for (size_t f = 0; f < nFrames; ++f) {
-        auto begin = frames.data() + f * nSamples;
-        energy[f] =
-            std::log(std::inner_product(begin, begin + nSamples, begin, 0.0));
+  FrameBlock block(this->featParams_);
+  std::vector<float> spectrum(
+      kFrameBlockSize * this->featParams_.filterFreqResponseLen());
+  std::vector<float> mfscFeat(kFrameBlockSize * numFilters);
+  std::vector<float> energies(kFrameBlockSize);
+  for (int start = 0; start < nFrames; start += kFrameBlockSize) {
+    int blockSize = std::min(kFrameBlockSize, nFrames - start);
+    float* cep = output + start * stride;
+    frameSignal(
+        input, this->featParams_, start, blockSize, block.frames.get(), nFft);
+    if (useEnergy && rawEnergy) {
+      for (int f = 0; f < blockSize; ++f) {
+        energies[f] = energy(block.frames.get() + f * nFft);
       }
     }
-    // Replace C0 with energy
-    for (size_t f = 0; f < nFrames; ++f) {
-      cep[f * nFeat] = energy[f];
+    this->mfscBlock(
+        block, blockSize, spectrum.data(), mfscFeat.data(), numFilters);
+    dct_.apply(mfscFeat.data(), blockSize, cep, stride);
+    for (int f = 0; f < blockSize; ++f) {
+      ceplifter_.applyFrameInPlace(cep + f * stride);
+    }
+    if (useEnergy) {
+      if (!rawEnergy) {
+        for (int f = 0; f < blockSize; ++f) {
+          energies[f] = energy(block.frames.get() + f * nFft);
+        }
+      }
+      // Replace C0 with energy
+      for (int f = 0; f < blockSize; ++f) {
+        cep[f * stride] = energies[f];
+      }
     }
   }
-  return derivatives_.apply(cep, nFeat);
+  derivatives_.applyInPlace(output, nFrames, nFeat);
 }
 
 int Mfcc::outputSize(int inputSz) {
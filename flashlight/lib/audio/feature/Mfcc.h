@@ -61,6 +61,8 @@ class Mfcc : public Mfsc {
   // Returns - MFCC features (Col Major : FEAT X FRAMESZ)
   std::vector<float> apply(const std::vector<float>& input) override;
 
+  void apply(const float* input, int inputSz, float* output) override;
+
   int outputSize(int inputSz) override;
 
  private:
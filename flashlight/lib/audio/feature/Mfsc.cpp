@@ -8,8 +8,11 @@
 #include "flashlight/lib/audio/feature/Mfsc.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <limits>
 #include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
@@ -31,66 +34,84 @@ Mfsc::Mfsc(const FeatureParams& params)
 }
 
 std::vector<float> Mfsc::apply(const std::vector<float>& input) {
-  auto frames = frameSignal(input, this->featParams_);
-  if (frames.empty()) {
+  int nFrames = this->featParams_.numFrames(input.size());
+  if (nFrames == 0) {
     return {};
   }
+  int numFeat = this->featParams_.numFilterbankChans +
+      (this->featParams_.useEnergy ? 1 : 0);
+  std::vector<float> output(
+      nFrames * numFeat * derivatives_.outputMultiplier());
+  apply(input.data(), input.size(), output.data());
+  return output;
+}
 
+void Mfsc::apply(const float* input, int inputSz, float* output) {
+  int nFrames = this->featParams_.numFrames(inputSz);
   int nSamples = this->featParams_.numFrameSizeSamples();
-  int nFrames = frames.size() / nSamples;
+  int nFft = this->featParams_.nFft();
+  bool useEnergy = this->featParams_.useEnergy;
+  bool rawEnergy = this->featParams_.rawEnergy;
+  // Features of a frame: energy (if used) followed by the filterbank outputs,
+  // then their derivatives
+  int numFeat = this->featParams_.numFilterbankChans + (useEnergy ? 1 : 0);
+  int stride = numFeat * derivatives_.outputMultiplier();
 
-  std::vector<float> energy(nFrames);
-  if (this->featParams_.useEnergy && this->featParams_.rawEnergy) {
-    for (size_t f = 0; f < nFrames; ++f) {
-      auto begin = frames.data() + f * nSamples;
-      energy[f] = std::log(std::max(
-          std::inner_product(
-              begin, begin + nSamples, begin, static_cast<float>(0.0)),
-          std::numeric_limits<float>::lowest()));
-    }
-  }
-  auto mfscFeat = mfscImpl(frames);
-  auto numFeat = this->featParams_.numFilterbankChans;
-  if (this->featParams_.useEnergy) {
-    if (!this->featParams_.rawEnergy) {
-      for (size_t f = 0; f < nFrames; ++f) {
-        auto begin = frames.data() + f * nSamples;
-        energy[f] = std::log(std::max(
-            std::inner_product(
-                begin, begin + nSamples, begin, static_cast<float>(0.0)),
-            std::numeric_limits<float>::lowest()));
+  auto energy = [nSamples](const float* frame) {
+    return std::log(std::max(
+        std::inner_product(
+            frame, frame + nSamples, frame, static_cast<float>(0.0)),
+        std::numeric_limits<float>::lowest()));
+  };
+
+  FrameBlock block(this->featParams_);
+  std::vector<float> spectrum(
+      kFrameBlockSize * this->featParams_.filterFreqResponseLen());
+  for (int start = 0; start < nFrames; start += kFrameBlockSize) {
+    int blockSize = std::min(kFrameBlockSize, nFrames - start);
+    float* feat = output + start * stride;
+    frameSignal(
+        input, this->featParams_, start, blockSize, block.frames.get(), nFft);
+    if (useEnergy && rawEnergy) {
+      for (int f = 0; f < blockSize; ++f) {
+        feat[f * stride] = energy(block.frames.get() + f * nFft);
       }
     }
-    std::vector<float> newMfscFeat(mfscFeat.size() + nFrames);
-    for (size_t f = 0; f < nFrames; ++f) {
-      size_t start = f * numFeat;
-      newMfscFeat[start + f] = energy[f];
-      std::copy(
-          mfscFeat.data() + start,
-          mfscFeat.data() + start + numFeat,
-          newMfscFeat.data() + start + f + 1);
+    mfscBlock(
+        block, blockSize, spectrum.data(), feat + (useEnergy ? 1 : 0), stride);
+    if (useEnergy && !rawEnergy) {
+      for (int f = 0; f < blockSize; ++f) {
+        feat[f * stride] = energy(block.frames.get() + f * nFft);
+      }
     }
-    std::swap(mfscFeat, newMfscFeat);
-    ++numFeat;
   }
   // Derivatives will not be computed if windowsize < 0
-  return derivatives_.apply(mfscFeat, numFeat);
+  derivatives_.applyInPlace(output, nFrames, numFeat);
 }
 
-std::vector<float> Mfsc::mfscImpl(std::vector<float>& frames) {
-  auto powspectrum = this->powSpectrumImpl(frames);
+void Mfsc::mfscBlock(
+    FrameBlock& block,
+    int nFrames,
+    float* spectrum,
+    float* output,
+    int outputStride) {
+  this->powSpectrumBlock(block, nFrames, spectrum);
   if (this->featParams_.usePower) {
+    int size = nFrames * this->featParams_.filterFreqResponseLen();
+    std::transform(spectrum, spectrum + size, spectrum, [](float x) {
+      return x * x;
+    });
+  }
+  triFltBank_.apply(
+      spectrum, nFrames, output, outputStride, this->featParams_.melFloor);
+  for (int f = 0; f < nFrames; ++f) {
+    float* begin = output + f * outputStride;
     std::transform(
-        powspectrum.begin(),
-        powspectrum.end(),
-        powspectrum.begin(),
-        [](float x) { return x * x; });
+        begin,
+        begin + this->featParams_.numFilterbankChans,
+        begin,
+        [](float x) { return std::log(x); });
   }
-  auto triflt = triFltBank_.apply(powspectrum, this->featParams_.melFloor);
-  std::transform(triflt.begin(), triflt.end(), triflt.begin(), [](float x) {
-    return std::log(x);
-  });
-  return triflt;
 }
 
 int Mfsc::outputSize(int inputSz) {
@@ -29,12 +29,22 @@ class Mfsc : public PowerSpectrum {
   // Returns - MFSC feature (Col Major : FEAT X FRAMESZ)
   std::vector<float> apply(const std::vector<float>& input) override;
 
+  void apply(const float* input, int inputSz, float* output) override;
+
   int outputSize(int inputSz) override;
 
  protected:
-  // Helper function which takes input as signal after dividing the signal into
-  // frames. Main purpose of this function is to reuse it in MFCC code
-  std::vector<float> mfscImpl(std::vector<float>& frames);
+  // Helper function which takes as input the first `nFrames` frames of
+  // `block`, as written by frameSignal(), and writes their log filterbank
+  // energies to `output`, `outputStride` values apart. `spectrum` is a buffer
+  // of nFrames x filterFreqResponseLen() values. Main purpose of this function
+  // is to reuse it in MFCC code
+  void mfscBlock(
+      FrameBlock& block,
+      int nFrames,
+      float* spectrum,
+      float* output,
+      int outputStride);
   void validateMfscParams() const;
 
  private:
@@ -10,7 +10,10 @@
 #include <fftw3.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <mutex>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
@@ -19,72 +22,117 @@ namespace fl {
 namespace lib {
 namespace audio {
 
+namespace {
+
+// The FFTW planner is not thread-safe, unlike the execution of plans
+std::mutex& fftwPlannerMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+} // namespace
+
+constexpr int PowerSpectrum::kFrameBlockSize;
+
+PowerSpectrum::FrameBlock::FrameBlock(const FeatureParams& params)
+    : frames(
+          fftwf_alloc_real(params.nFft() * kFrameBlockSize),
+          fftwf_free),
+      fft(reinterpret_cast<float*>(fftwf_alloc_complex(
+              params.filterFreqResponseLen() * kFrameBlockSize)),
+          fftwf_free) {
+  std::fill(
+      frames.get(), frames.get() + params.nFft() * kFrameBlockSize, 0.0f);
+}
+
 PowerSpectrum::PowerSpectrum(const FeatureParams& params)
     : featParams_(params),
       dither_(params.ditherVal),
       preEmphasis_(params.preemCoef, params.numFrameSizeSamples()),
       windowing_(params.numFrameSizeSamples(), params.windowType) {
   validatePowSpecParams();
-  auto nFFt = featParams_.nFft();
-  inFftBuf_.resize(nFFt, 0.0);
-  outFftBuf_.resize(2 * nFFt);
-  fftPlan_ = std::make_unique<fftw_plan>(fftw_plan_dft_r2c_1d(
-      nFFt, inFftBuf_.data(), (fftw_complex*)outFftBuf_.data(), FFTW_MEASURE));
+  int nFft = featParams_.nFft();
+  int K = featParams_.filterFreqResponseLen();
+  // Planning with FFTW_MEASURE overwrites the buffers. The buffers of the
+  // calls are allocated the same way, so they have the same alignment.
+  FrameBlock block(featParams_);
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  fftPlan_ = std::make_unique<fftwf_plan>(fftwf_plan_many_dft_r2c(
+      1,
+      &nFft,
+      kFrameBlockSize,
+      block.frames.get(),
+      nullptr,
+      1,
+      nFft,
+      reinterpret_cast<fftwf_complex*>(block.fft.get()),
+      nullptr,
+      1,
+      K,
+      FFTW_MEASURE));
 }
 
 std::vector<float> PowerSpectrum::apply(const std::vector<float>& input) {
-  auto frames = frameSignal(input, featParams_);
-  if (frames.empty()) {
+  std::vector<float> output(outputSize(input.size()));
+  if (output.empty()) {
     return {};
   }
-  return powSpectrumImpl(frames);
+  apply(input.data(), input.size(), output.data());
+  return output;
 }
 
-std::vector<float> PowerSpectrum::powSpectrumImpl(std::vector<float>& frames) {
+void PowerSpectrum::apply(const float* input, int inputSz, float* output) {
+  int nFrames = featParams_.numFrames(inputSz);
+  int nFft = featParams_.nFft();
+  int K = featParams_.filterFreqResponseLen();
+  FrameBlock block(featParams_);
+  for (int start = 0; start < nFrames; start += kFrameBlockSize) {
+    int blockSize = std::min(kFrameBlockSize, nFrames - start);
+    frameSignal(input, featParams_, start, blockSize, block.frames.get(), nFft);
+    powSpectrumBlock(block, blockSize, output + start * K);
+  }
+}
+
+void PowerSpectrum::powSpectrumBlock(
+    FrameBlock& block,
+    int nFrames,
+    float* dft) {
   int nSamples = featParams_.numFrameSizeSamples();
-  int nFrames = frames.size() / nSamples;
   int nFft = featParams_.nFft();
   int K = featParams_.filterFreqResponseLen();
 
-  if (featParams_.ditherVal != 0.0) {
-    frames = dither_.apply(frames);
-  }
-  if (featParams_.zeroMeanFrame) {
-    for (size_t f = 0; f < nFrames; ++f) {
-      auto begin = frames.data() + f * nSamples;
-      float mean = std::accumulate(begin, begin + nSamples, 0.0);
+  for (int f = 0; f < nFrames; ++f) {
+    float* frame = block.frames.get() + f * nFft;
+    if (featParams_.ditherVal != 0.0) {
+      dither_.applyInPlace(frame, nSamples);
+    }
+    if (featParams_.zeroMeanFrame) {
+      float mean = std::accumulate(frame, frame + nSamples, 0.0);
       mean /= nSamples;
       std::transform(
-          begin, begin + nSamples, begin, [mean](float x) { return x - mean; });
+          frame, frame + nSamples, frame, [mean](float x) { return x - mean; });
     }
+    if (featParams_.preemCoef != 0) {
+      preEmphasis_.applyFrameInPlace(frame);
+    }
+    windowing_.applyFrameInPlace(frame);
   }
-  if (featParams_.preemCoef != 0) {
-    preEmphasis_.applyInPlace(frames);
-  }
-  windowing_.applyInPlace(frames);
-  std::vector<float> dft(K * nFrames);
-  for (size_t f = 0; f < nFrames; ++f) {
-    auto begin = frames.data() + f * nSamples;
-    {
-      std::lock_guard<std::mutex> lock(fftMutex_);
-      std::copy(begin, begin + nSamples, inFftBuf_.data());
-      std::fill(outFftBuf_.begin(), outFftBuf_.end(), 0.0);
-      fftw_execute(*fftPlan_);
-
-      // Copy stuff to the redundant part
-      for (size_t i = K; i < nFft; ++i) {
-        outFftBuf_[2 * i] = outFftBuf_[2 * nFft - 2 * i];
-        outFftBuf_[2 * i + 1] = -outFftBuf_[2 * nFft - 2 * i + 1];
-      }
-
-      for (size_t i = 0; i < K; ++i) {
-        dft[f * K + i] = std::sqrt(
-            outFftBuf_[2 * i] * outFftBuf_[2 * i] +
-            outFftBuf_[2 * i + 1] * outFftBuf_[2 * i + 1]);
-      }
+  // The frames of the block after the first `nFrames` are transformed too, and
+  // their output is ignored
+  fftwf_execute_dft_r2c(
+      *fftPlan_,
+      block.frames.get(),
+      reinterpret_cast<fftwf_complex*>(block.fft.get()));
+
+  for (int f = 0; f < nFrames; ++f) {
+    const float* out = block.fft.get() + 2 * f * K;
+    float* feat = dft + f * K;
+    for (int i = 0; i < K; ++i) {
+      float re = out[2 * i];
+      float im = out[2 * i + 1];
+      feat[i] = std::sqrt(re * re + im * im);
     }
   }
-  return dft;
 }
 
 std::vector<float> PowerSpectrum::batchApply(
@@ -102,14 +150,7 @@ std::vector<float> PowerSpectrum::batchApply(
 
 #pragma omp parallel for num_threads(batchSz)
   for (int b = 0; b < batchSz; ++b) {
-    auto start = input.begin() + b * N;
-    std::vector<float> inputBuf(start, start + N);
-    auto curFeat = apply(inputBuf);
-    if (outputSz != curFeat.size()) {
-      throw std::logic_error("PowerSpectrum: apply() returned wrong size");
-    }
-    std::copy(
-        curFeat.begin(), curFeat.end(), feat.begin() + b * curFeat.size());
+    apply(input.data() + b * N, N, feat.data() + b * outputSz);
   }
   return feat;
 }
@@ -137,7 +178,8 @@ void PowerSpectrum::validatePowSpecParams() const {
 }
 
 PowerSpectrum::~PowerSpectrum() {
-  fftw_destroy_plan(*fftPlan_);
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  fftwf_destroy_plan(*fftPlan_);
 }
 } // namespace audio
 } // namespace lib
@@ -8,7 +8,6 @@
 #pragma once
 
 #include <memory>
-#include <mutex>
 
 #include "flashlight/lib/audio/feature/Dither.h"
 #include "flashlight/lib/audio/feature/FeatureParams.h"
@@ -16,14 +15,20 @@
 #include "flashlight/lib/audio/feature/Windowing.h"
 
 // Fwd decl
-class fftw_plan_s;
-typedef fftw_plan_s* fftw_plan;
+class fftwf_plan_s;
+typedef fftwf_plan_s* fftwf_plan;
 
 namespace fl {
 namespace lib {
 namespace audio {
 
 // Computes Power Spectrum features for a speech signal.
+//
+// The frames are processed in blocks of kFrameBlockSize frames, which go
+// through all the stages before the next block, and are transformed together
+// by a single-precision real-to-complex FFTW plan built once. Each call uses
+// its own buffers, so that several threads (e.g. the channels of batchApply)
+// can apply it concurrently.
 
 class PowerSpectrum {
  public:
@@ -35,6 +40,10 @@ class PowerSpectrum {
   // Returns - Power spectrum (Col Major : FEAT X FRAMESZ)
   virtual std::vector<float> apply(const std::vector<float>& input);
 
+  // Same as apply() on the `inputSz` samples of `input`, writing the
+  // outputSize(inputSz) features to `output`
+  virtual void apply(const float* input, int inputSz, float* output);
+
   // input - input speech signal (Col Major : T X BATCHSZ)
   // Returns - Output features (Col Major : FEAT X FRAMESZ X BATCHSZ)
   std::vector<float> batchApply(const std::vector<float>& input, int batchSz);
@@ -46,9 +55,23 @@ class PowerSpectrum {
  protected:
   FeatureParams featParams_;
 
-  // Helper function which takes input as signal after dividing the signal into
-  // frames. Main purpose of this function is to reuse it in MFSC, MFCC code
-  std::vector<float> powSpectrumImpl(std::vector<float>& frames);
+  static constexpr int kFrameBlockSize = 16;
+
+  // Frames of a block, zero padded to nFft() samples, and their FFT (
+  // filterFreqResponseLen() interleaved complex values per frame)
+  struct FrameBlock {
+    explicit FrameBlock(const FeatureParams& params);
+
+    std::unique_ptr<float, void (*)(void*)> frames;
+    std::unique_ptr<float, void (*)(void*)> fft;
+  };
+
+  // Helper function which takes as input the first `nFrames` frames of
+  // `block`, as written by frameSignal(). They are dithered, zero meaned,
+  // pre-emphasised and windowed in place, then their spectrum is written to
+  // `dft` (nFrames x filterFreqResponseLen()). Main purpose of this function
+  // is to reuse it in MFSC, MFCC code
+  void powSpectrumBlock(FrameBlock& block, int nFrames, float* dft);
 
   void validatePowSpecParams() const;
 
@@ -58,9 +81,9 @@ class PowerSpectrum {
   PreEmphasis preEmphasis_;
   Windowing windowing_;
 
-  std::unique_ptr<fftw_plan> fftPlan_; // fftw_plan is an opque pointer type
-  std::vector<double> inFftBuf_, outFftBuf_;
-  std::mutex fftMutex_;
+  // Plan of the FFT of kFftBatchSize frames, executed on the buffers of
+  // each call. fftwf_plan is an opaque pointer type
+  std::unique_ptr<fftwf_plan> fftPlan_;
 };
 } // namespace audio
 } // namespace lib
@@ -37,14 +37,16 @@ void PreEmphasis::applyInPlace(std::vector<float>& input) const {
   }
   size_t nframes = input.size() / windowLength_;
   for (size_t n = nframes; n > 0; --n) {
-    size_t e = n * windowLength_ - 1; // end of current frame
-    size_t s = (n - 1) * windowLength_; // start of current frame
-    for (size_t i = e; i > s; --i) {
-      input[i] -= (preemCoef_ * input[i - 1]);
-    }
-    input[s] *= (1 - preemCoef_);
+    applyFrameInPlace(input.data() + (n - 1) * windowLength_);
   }
 }
+
+void PreEmphasis::applyFrameInPlace(float* frame) const {
+  for (size_t i = windowLength_ - 1; i > 0; --i) {
+    frame[i] -= (preemCoef_ * frame[i - 1]);
+  }
+  frame[0] *= (1 - preemCoef_);
+}
 } // namespace audio
 } // namespace lib
 } // namespace fl
@@ -25,6 +25,9 @@ class PreEmphasis {
 
   void applyInPlace(std::vector<float>& input) const;
 
+  // Pre-emphasise a single frame of N values in place
+  void applyFrameInPlace(float* frame) const;
+
  private:
   float preemCoef_;
   int windowLength_;
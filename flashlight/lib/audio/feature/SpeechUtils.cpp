@@ -27,18 +27,30 @@ std::vector<float> frameSignal(
     const std::vector<float>& input,
     const FeatureParams& params) {
   auto frameSize = params.numFrameSizeSamples();
-  auto frameStride = params.numFrameStrideSamples();
   int numframes = params.numFrames(input.size());
+  std::vector<float> frames(numframes * frameSize);
+  frameSignal(input.data(), params, 0, numframes, frames.data(), frameSize);
+  return frames;
+}
+
+void frameSignal(
+    const float* input,
+    const FeatureParams& params,
+    int64_t firstFrame,
+    int64_t numFrames,
+    float* output,
+    int64_t outputStride) {
+  auto frameSize = params.numFrameSizeSamples();
+  auto frameStride = params.numFrameStrideSamples();
   // HTK: Values coming out of rasta treat samples as integers,
   // not range -1..1, hence scale up here to match (approx)
   float scale = 32768.0;
-  std::vector<float> frames(numframes * frameSize);
-  for (size_t f = 0; f < numframes; ++f) {
-    for (size_t i = 0; i < frameSize; ++i) {
-      frames[f * frameSize + i] = scale * input[f * frameStride + i];
+  for (int64_t f = 0; f < numFrames; ++f) {
+    const float* frame = input + (firstFrame + f) * frameStride;
+    for (int64_t i = 0; i < frameSize; ++i) {
+      output[f * outputStride + i] = scale * frame[i];
     }
   }
-  return frames;
 }
 
 std::vector<float> cblasGemm(
@@ -54,7 +66,18 @@ std::vector<float> cblasGemm(
   int m = matA.size() / k;
 
   std::vector<float> matC(m * n);
+  cblasGemm(matA.data(), matB.data(), matC.data(), m, n, k, n);
+  return matC;
+};
 
+void cblasGemm(
+    const float* matA,
+    const float* matB,
+    float* matC,
+    int m,
+    int n,
+    int k,
+    int ldc) {
 #if FL_LIBRARIES_USE_MKL
   auto prevMaxThreads = mkl_get_max_threads();
   mkl_set_num_threads_local(1);
@@ -70,22 +93,20 @@ std::vector<float> cblasGemm(
       n,
       k,
       1.0, // alpha
-      matA.data(),
+      matA,
       k,
-      matB.data(),
+      matB,
       n,
       0.0, // beta
-      matC.data(),
-      n);
+      matC,
+      ldc);
 
 #if FL_LIBRARIES_USE_MKL
   mkl_set_num_threads_local(prevMaxThreads);
 #else
 // TODO: to be tested
 #endif
-
-  return matC;
-};
+}
 } // namespace audio
 } // namespace lib
 } // namespace fl
@@ -21,6 +21,18 @@ std::vector<float> frameSignal(
     const std::vector<float>& input,
     const FeatureParams& params);
 
+// Same as frameSignal() for the frames [firstFrame, firstFrame + numFrames) of
+// `input`, which are written to `output` with `outputStride` values between
+// the starts of consecutive frames
+
+void frameSignal(
+    const float* input,
+    const FeatureParams& params,
+    int64_t firstFrame,
+    int64_t numFrames,
+    float* output,
+    int64_t outputStride);
+
 // row major;  matA - m x k , matB - k x n
 
 std::vector<float> cblasGemm(
@@ -28,6 +40,18 @@ std::vector<float> cblasGemm(
     const std::vector<float>& matB,
     int n,
     int k);
+
+// row major;  matA - m x k , matB - k x n, matC - m x n with `ldc` values
+// between the starts of consecutive rows
+
+void cblasGemm(
+    const float* matA,
+    const float* matB,
+    float* matC,
+    int m,
+    int n,
+    int k,
+    int ldc);
 } // namespace audio
 } // namespace lib
 } // namespace fl
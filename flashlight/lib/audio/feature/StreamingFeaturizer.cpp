@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/audio/feature/StreamingFeaturizer.h"
+
+#include <algorithm>
+#include <type_traits>
+
+#include "flashlight/lib/audio/feature/Mfcc.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+#include "flashlight/lib/audio/feature/PowerSpectrum.h"
+
+namespace fl {
+namespace lib {
+namespace audio {
+
+namespace {
+
+// Parameters of the features of each frame, without derivatives
+FeatureParams staticParams(FeatureParams params) {
+  params.deltaWindow = 0;
+  params.accWindow = 0;
+  return params;
+}
+
+} // namespace
+
+template <class Featurizer>
+StreamingFeaturizer<Featurizer>::StreamingFeaturizer(
+    const FeatureParams& params)
+    : featParams_(params),
+      featurizer_(staticParams(params)),
+      // Only MFSC and MFCC features have derivatives
+      derivatives_(
+          std::is_base_of<Mfsc, Featurizer>::value ? params.deltaWindow : 0,
+          params.accWindow),
+      numFeat_(featurizer_.outputSize(params.numFrameSizeSamples())),
+      lookahead_(0) {
+  if (derivatives_.outputMultiplier() > 1) {
+    lookahead_ = params.deltaWindow + std::max<int>(params.accWindow, 0);
+  }
+  reset();
+}
+
+template <class Featurizer>
+std::vector<float> StreamingFeaturizer<Featurizer>::apply(
+    const std::vector<float>& input) {
+  return apply(input.data(), input.size());
+}
+
+template <class Featurizer>
+std::vector<float> StreamingFeaturizer<Featurizer>::apply(
+    const float* input,
+    int inputSz) {
+  samples_.insert(samples_.end(), input, input + inputSz);
+  int64_t nFrames = featParams_.numFrames(samples_.size());
+  if (nFrames > 0) {
+    size_t offset = context_.size();
+    context_.resize(offset + nFrames * numFeat_);
+    featurizer_.apply(
+        samples_.data(), samples_.size(), context_.data() + offset);
+    samples_.erase(
+        samples_.begin(),
+        samples_.begin() + nFrames * featParams_.numFrameStrideSamples());
+    numFrames_ += nFrames;
+  }
+  return emit(numFrames_ - lookahead_);
+}
+
+template <class Featurizer>
+std::vector<float> StreamingFeaturizer<Featurizer>::end() {
+  auto output = emit(numFrames_);
+  reset();
+  return output;
+}
+
+template <class Featurizer>
+int StreamingFeaturizer<Featurizer>::featSz() const {
+  return numFeat_ * derivatives_.outputMultiplier();
+}
+
+template <class Featurizer>
+int64_t StreamingFeaturizer<Featurizer>::numEmittedFrames() const {
+  return numEmitted_;
+}
+
+template <class Featurizer>
+std::vector<float> StreamingFeaturizer<Featurizer>::emit(int64_t end) {
+  if (end <= numEmitted_) {
+    return {};
+  }
+  // The derivatives of the frames to emit only depend on the frames of the
+  // context, and the derivatives are computed as at the edges of the signal
+  // only at the start of the stream, or at its end (when `end` is numFrames_)
+  int featSz = this->featSz();
+  int numContext = numFrames_ - contextStart_;
+  std::vector<float> features(numContext * featSz);
+  for (int f = 0; f < numContext; ++f) {
+    std::copy(
+        context_.begin() + f * numFeat_,
+        context_.begin() + (f + 1) * numFeat_,
+        features.begin() + f * featSz);
+  }
+  derivatives_.applyInPlace(features.data(), numContext, numFeat_);
+  auto first = features.begin() + (numEmitted_ - contextStart_) * featSz;
+  std::vector<float> output(first, first + (end - numEmitted_) * featSz);
+  numEmitted_ = end;
+
+  // Keep the frames the derivatives of the next frames depend on
+  int64_t newContextStart = std::max(contextStart_, end - lookahead_);
+  context_.erase(
+      context_.begin(),
+      context_.begin() + (newContextStart - contextStart_) * numFeat_);
+  contextStart_ = newContextStart;
+  return output;
+}
+
+template <class Featurizer>
+void StreamingFeaturizer<Featurizer>::reset() {
+  samples_.clear();
+  context_.clear();
+  contextStart_ = 0;
+  numFrames_ = 0;
+  numEmitted_ = 0;
+}
+
+template class StreamingFeaturizer<PowerSpectrum>;
+template class StreamingFeaturizer<Mfsc>;
+template class StreamingFeaturizer<Mfcc>;
+} // namespace audio
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "flashlight/lib/audio/feature/Derivatives.h"
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+
+namespace fl {
+namespace lib {
+namespace audio {
+
+// Computes the features of a speech signal received as a stream of chunks of
+// any size, e.g. for online recognition. `Featurizer` is one of
+// PowerSpectrum, Mfsc and Mfcc.
+//
+// The features of a frame are emitted as soon as they are final: when the
+// frame is complete, and so are the frames its derivatives depend on (up to
+// deltaWindow + accWindow frames later). The samples of the incomplete frames
+// and the features of the frames in the derivatives window are kept between
+// the chunks, so that the features of all the chunks of a stream are the
+// features Featurizer::apply() computes on the whole signal.
+//
+// Example usage:
+//   StreamingFeaturizer<Mfcc> featurizer(params);
+//   for (const auto& chunk : chunks) {
+//     auto feat = featurizer.apply(chunk); // features of the new frames
+//   }
+//   auto feat = featurizer.end(); // features of the last frames
+
+template <class Featurizer>
+class StreamingFeaturizer {
+ public:
+  explicit StreamingFeaturizer(const FeatureParams& params);
+
+  // input - next chunk of the speech signal (T)
+  // Returns - features of the frames which are final (Col Major : FEAT X
+  // FRAMESZ), possibly none
+  std::vector<float> apply(const std::vector<float>& input);
+
+  std::vector<float> apply(const float* input, int inputSz);
+
+  // Ends the stream, and starts a new one
+  // Returns - features of the remaining frames, whose derivatives are
+  // computed as at the end of the signal. The samples after the last
+  // complete frame are dropped.
+  std::vector<float> end();
+
+  // Number of features per frame
+  int featSz() const;
+
+  // Number of frames whose features were emitted since the stream started
+  int64_t numEmittedFrames() const;
+
+ private:
+  FeatureParams featParams_;
+  Featurizer featurizer_; // features without derivatives
+  Derivatives derivatives_;
+  int numFeat_; // features per frame, without derivatives
+  int lookahead_; // frames the derivatives of a frame depend on, each side
+
+  // Samples from the start of the first frame not computed yet
+  std::vector<float> samples_;
+  // Features without derivatives of the frames from contextStart_ to
+  // numFrames_: the frames not emitted yet, and the `lookahead_` frames
+  // before them
+  std::vector<float> context_;
+  int64_t contextStart_;
+  int64_t numFrames_; // frames computed since the stream started
+  int64_t numEmitted_; // frames emitted since the stream started
+
+  // Emits the features of the frames up to `end`
+  std::vector<float> emit(int64_t end);
+
+  void reset();
+};
+} // namespace audio
+} // namespace lib
+} // namespace fl
@@ -10,21 +10,86 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FL_TRI_FILTERBANK_X86
+#include <immintrin.h>
+#endif
+
 namespace fl {
 namespace lib {
 namespace audio {
 
+namespace {
+
+// The filters are applied as bands if at most this fraction of H_ is non zero
+constexpr int kMaxBandDensityPct = 25;
+
+float dotScalar(const float* a, const float* b, int n) {
+  float sum = 0.0;
+  for (int i = 0; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+#ifdef FL_TRI_FILTERBANK_X86
+
+__attribute__((target("avx2,fma"))) float
+dotAvx2(const float* a, const float* b, int n) {
+  int i = 0;
+  float sum = 0.0;
+  if (n >= 8) {
+    __m256 vsum = _mm256_mul_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+    for (i = 8; i + 8 <= n; i += 8) {
+      vsum = _mm256_fmadd_ps(
+          _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), vsum);
+    }
+    __m128 v4 = _mm_add_ps(
+        _mm256_castps256_ps128(vsum), _mm256_extractf128_ps(vsum, 1));
+    v4 = _mm_add_ps(v4, _mm_movehl_ps(v4, v4));
+    v4 = _mm_add_ss(v4, _mm_shuffle_ps(v4, v4, 1));
+    sum = _mm_cvtss_f32(v4);
+  }
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+#endif // FL_TRI_FILTERBANK_X86
+
+using DotFunc = float (*)(const float*, const float*, int);
+
+} // namespace
+
+bool isTriFilterbankKernelSupported(TriFilterbankKernel kernel) {
+  switch (kernel) {
+    case TriFilterbankKernel::AUTO:
+    case TriFilterbankKernel::DENSE:
+    case TriFilterbankKernel::SCALAR:
+      return true;
+#ifdef FL_TRI_FILTERBANK_X86
+    case TriFilterbankKernel::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    default:
+      return false;
+  }
+}
+
 TriFilterbank::TriFilterbank(
     int numfilters,
     int filterlen,
     int samplingfreq,
     int lowfreq /* = 0 */,
     int highfreq /* = -1 */,
-    FrequencyScale freqscale /* = FrequencyScale::MEL */)
+    FrequencyScale freqscale /* = FrequencyScale::MEL */,
+    TriFilterbankKernel kernel /* = TriFilterbankKernel::AUTO */)
     : numFilters_(numfilters),
       filterLen_(filterlen),
       samplingFreq_(samplingfreq),
@@ -51,24 +116,107 @@ TriFilterbank::TriFilterbank(
       H_[i * numFilters_ + j] = std::max(std::min(hislope, loslope), minH);
     }
   }
+
+  // Non zero bins of each filter
+  bandStart_.resize(numFilters_);
+  bandOffsets_.assign(1, 0);
+  for (int j = 0; j < numFilters_; ++j) {
+    int first = 0;
+    while (first < filterLen_ && H_[first * numFilters_ + j] == 0) {
+      ++first;
+    }
+    int last = filterLen_;
+    while (last > first && H_[(last - 1) * numFilters_ + j] == 0) {
+      --last;
+    }
+    bandStart_[j] = first;
+    for (int i = first; i < last; ++i) {
+      bandWeights_.push_back(H_[i * numFilters_ + j]);
+    }
+    bandOffsets_.push_back(bandWeights_.size());
+  }
+
+  if (kernel == TriFilterbankKernel::AUTO) {
+    static const TriFilterbankKernel bestBands =
+        isTriFilterbankKernelSupported(TriFilterbankKernel::AVX2)
+        ? TriFilterbankKernel::AVX2
+        : TriFilterbankKernel::SCALAR;
+    bool useBands = static_cast<int64_t>(bandWeights_.size()) * 100 <=
+        static_cast<int64_t>(H_.size()) * kMaxBandDensityPct;
+    kernel_ = useBands ? bestBands : TriFilterbankKernel::DENSE;
+  } else if (isTriFilterbankKernelSupported(kernel)) {
+    kernel_ = kernel;
+  } else {
+    throw std::invalid_argument(
+        "TriFilterbank: kernel is not supported by the CPU");
+  }
 }
 
 std::vector<float> TriFilterbank::apply(
     const std::vector<float>& input,
     float melfloor /* = 0.0 */) const {
-  std::vector<float> output = cblasGemm(input, H_, numFilters_, filterLen_);
-  std::transform(
-      output.begin(),
-      output.end(),
-      output.begin(),
-      [melfloor](float n) -> float { return std::max(n, melfloor); });
+  if (input.empty()) {
+    return {};
+  }
+  if (input.size() % filterLen_ != 0) {
+    throw std::invalid_argument(
+        "TriFilterbank: input size is not divisible by filterLen");
+  }
+  int numFrames = input.size() / filterLen_;
+  std::vector<float> output(numFrames * numFilters_);
+  apply(input.data(), numFrames, output.data(), numFilters_, melfloor);
   return output;
 }
 
+void TriFilterbank::apply(
+    const float* input,
+    int numFrames,
+    float* output,
+    int outputStride,
+    float melfloor /* = 0.0 */) const {
+  if (kernel_ != TriFilterbankKernel::DENSE) {
+    DotFunc dot = dotScalar;
+#ifdef FL_TRI_FILTERBANK_X86
+    if (kernel_ == TriFilterbankKernel::AVX2) {
+      dot = dotAvx2;
+    }
+#endif
+    for (int f = 0; f < numFrames; ++f) {
+      const float* in = input + f * filterLen_;
+      float* out = output + f * outputStride;
+      for (int j = 0; j < numFilters_; ++j) {
+        out[j] = dot(
+            in + bandStart_[j],
+            bandWeights_.data() + bandOffsets_[j],
+            bandOffsets_[j + 1] - bandOffsets_[j]);
+      }
+    }
+  } else {
+    cblasGemm(
+        input,
+        H_.data(),
+        output,
+        numFrames,
+        numFilters_,
+        filterLen_,
+        outputStride);
+  }
+  for (int f = 0; f < numFrames; ++f) {
+    float* begin = output + f * outputStride;
+    std::transform(begin, begin + numFilters_, begin, [melfloor](float n) {
+      return std::max(n, melfloor);
+    });
+  }
+}
+
 std::vector<float> TriFilterbank::filterbank() const {
   return H_;
 }
 
+TriFilterbankKernel TriFilterbank::kernel() const {
+  return kernel_;
+}
+
 float TriFilterbank::hertzToWarpedScale(float hz, FrequencyScale freqscale)
     const {
   switch (freqscale) {
@@ -16,6 +16,20 @@ namespace fl {
 namespace lib {
 namespace audio {
 
+// Implementations of the filterbank: a product with the dense filterbank
+// matrix, or the bands with a scalar or AVX2 dot product. AUTO picks the
+// bands with the fastest dot product supported by the CPU, unless the
+// filters are wide compared to the number of bins.
+enum class TriFilterbankKernel { AUTO = 0, DENSE = 1, SCALAR = 2, AVX2 = 3 };
+
+// Whether the CPU supports a given filterbank kernel
+bool isTriFilterbankKernelSupported(TriFilterbankKernel kernel);
+
+// Triangular filterbank. Each filter is non zero over a few consecutive bins
+// only, so unless the filters are wide compared to the number of bins, they
+// are applied as bands (a dot product over the non zero bins of each filter)
+// rather than as a product with the dense filterbank matrix.
+
 class TriFilterbank {
  public:
   TriFilterbank(
@@ -24,15 +38,28 @@ class TriFilterbank {
       int samplingfreq,
       int lowfreq = 0,
       int highfreq = -1,
-      FrequencyScale freqscale = FrequencyScale::MEL);
+      FrequencyScale freqscale = FrequencyScale::MEL,
+      TriFilterbankKernel kernel = TriFilterbankKernel::AUTO);
 
   std::vector<float> apply(
       const std::vector<float>& input,
       float melfloor = 0.0) const;
 
+  // Same as apply() on `numFrames` frames of `input`, writing the filterbank
+  // outputs of each frame at `outputStride` values from the previous one
+  void apply(
+      const float* input,
+      int numFrames,
+      float* output,
+      int outputStride,
+      float melfloor = 0.0) const;
+
   // Returns triangular filterbank matrix
   std::vector<float> filterbank() const;
 
+  // Returns the kernel applying the filterbank, never AUTO
+  TriFilterbankKernel kernel() const;
+
  private:
   int numFilters_; // Number of filterbank channels
   int filterLen_; // length of each filterbank channel
@@ -42,6 +69,11 @@ class TriFilterbank {
   FrequencyScale freqScale_; // frequency warp type Ex. FrequencyScale::MEL
   std::vector<float>
       H_; // (numFilters_ x filterLen_) triangular filterbank matrix
+  TriFilterbankKernel kernel_;
+  std::vector<int> bandStart_; // first non zero bin of each filter
+  // Offsets of the weights of each filter in bandWeights_ (numFilters_ + 1)
+  std::vector<int> bandOffsets_;
+  std::vector<float> bandWeights_; // non zero weights of the filters
 
   float hertzToWarpedScale(float hz, FrequencyScale freqscale) const;
   float warpedToHertzScale(float wrp, FrequencyScale freqscale) const;
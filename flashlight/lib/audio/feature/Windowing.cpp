@@ -49,12 +49,14 @@ void Windowing::applyInPlace(std::vector<float>& input) const {
     throw std::invalid_argument(
         "Windowing: input size is not divisible by windowLength");
   }
-  size_t n = 0;
-  for (auto& in : input) {
-    in *= coefs_[n++];
-    if (n == windowLength_) {
-      n = 0;
-    }
+  for (size_t i = 0; i < input.size(); i += windowLength_) {
+    applyFrameInPlace(input.data() + i);
+  }
+}
+
+void Windowing::applyFrameInPlace(float* frame) const {
+  for (size_t n = 0; n < windowLength_; ++n) {
+    frame[n] *= coefs_[n];
   }
 }
 } // namespace audio
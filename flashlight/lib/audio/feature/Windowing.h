@@ -27,6 +27,9 @@ class Windowing {
 
   void applyInPlace(std::vector<float>& input) const;
 
+  // Apply the window to a single frame of N values in place
+  void applyFrameInPlace(float* frame) const;
+
  private:
   int windowLength_;
   WindowType windowType_;
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Benchmark of the featurization throughput of PowerSpectrum, Mfsc and Mfcc:
+ * apply() on a single utterance, and batchApply() on `batchSz` channels, which
+ * are featurized concurrently. Throughput is reported in seconds of audio
+ * featurized per second.
+ *
+ * Usage: FeatureBenchmark [seconds of audio per channel] [batchSz]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+#include "flashlight/lib/audio/feature/Mfcc.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+#include "flashlight/lib/audio/feature/PowerSpectrum.h"
+
+using namespace fl::lib::audio;
+
+namespace {
+
+double timeit(const std::function<void()>& fn) {
+  // warmup
+  fn();
+  int numIters = 10;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < numIters; ++i) {
+    fn();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / numIters;
+}
+
+void report(const std::string& name, double seconds, double audioSeconds) {
+  std::cout << std::setw(28) << std::left << name << std::setprecision(5)
+            << seconds * 1000.0 << " msec (" << audioSeconds / seconds
+            << "x real time)" << std::endl;
+}
+
+void benchmark(
+    const std::string& name,
+    PowerSpectrum& featurizer,
+    const std::vector<float>& signal,
+    int batchSz,
+    double audioSeconds) {
+  std::vector<float> channel(
+      signal.begin(), signal.begin() + signal.size() / batchSz);
+  report(
+      name + " apply",
+      timeit([&]() { featurizer.apply(channel); }),
+      audioSeconds);
+  report(
+      name + " batchApply",
+      timeit([&]() { featurizer.batchApply(signal, batchSz); }),
+      audioSeconds * batchSz);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  double audioSeconds = argc > 1 ? std::atof(argv[1]) : 60.0;
+  int batchSz = argc > 2
+      ? std::atoi(argv[2])
+      : std::max<int>(std::thread::hardware_concurrency(), 1);
+  std::cout << "audio = " << audioSeconds << " sec, batchSz = " << batchSz
+            << std::endl;
+
+  FeatureParams params;
+  params.samplingFreq = 16000;
+  params.numFilterbankChans = 80;
+  params.numCepstralCoeffs = 13;
+  const size_t channelSize = audioSeconds * params.samplingFreq;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> sample(-1.0, 1.0);
+  std::vector<float> signal(channelSize * batchSz);
+  for (auto& s : signal) {
+    s = sample(gen);
+  }
+
+  PowerSpectrum powerSpectrum(params);
+  benchmark("PowerSpectrum", powerSpectrum, signal, batchSz, audioSeconds);
+  Mfsc mfsc(params);
+  benchmark("Mfsc", mfsc, signal, batchSz, audioSeconds);
+  Mfcc mfcc(params);
+  benchmark("Mfcc", mfcc, signal, batchSz, audioSeconds);
+  return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Micro-benchmark of the token preselection of the CTC / ASG decoders:
+ * partial_sort over all the tokens of each frame (the previous implementation)
+ * against the kernels of selectTopKTokens().
+ *
+ * Usage: TokenSelectionBenchmark [T] [N] [k]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/TokenSelection.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+double timeit(const std::function<void()>& fn) {
+  // warmup
+  for (int i = 0; i < 3; ++i) {
+    fn();
+  }
+  int numIters = 20;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < numIters; ++i) {
+    fn();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / numIters;
+}
+
+void report(const std::string& name, double seconds, int T) {
+  std::cout << std::setw(24) << std::left << name << std::setprecision(5)
+            << seconds * 1000.0 << " msec (" << seconds * 1e9 / T
+            << " nsec / frame)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int T = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int N = argc > 2 ? std::atoi(argv[2]) : 10000;
+  int k = argc > 3 ? std::atoi(argv[3]) : 50;
+  k = std::min(k, N);
+  std::cout << "T = " << T << ", N = " << N << ", k = " << k << std::endl;
+
+  std::mt19937 gen(0);
+  std::normal_distribution<float> dist(-10, 3);
+  std::vector<float> emissions(static_cast<size_t>(T) * N);
+  for (auto& e : emissions) {
+    e = dist(gen);
+  }
+
+  std::vector<int> tokens(static_cast<size_t>(T) * k);
+  std::vector<int> nTokens(T);
+
+  std::vector<size_t> idx(N);
+  report(
+      "partial_sort",
+      timeit([&]() {
+        for (int t = 0; t < T; ++t) {
+          const float* row = emissions.data() + static_cast<size_t>(t) * N;
+          std::iota(idx.begin(), idx.end(), 0);
+          std::partial_sort(
+              idx.begin(),
+              idx.begin() + k,
+              idx.end(),
+              [row](size_t l, size_t r) { return row[l] > row[r]; });
+          std::copy(idx.begin(), idx.begin() + k, tokens.begin() + t * k);
+        }
+      }),
+      T);
+
+  const std::vector<std::pair<std::string, TokenSelectionKernel>> kernels = {
+      {"scalar", TokenSelectionKernel::SCALAR},
+      {"avx2", TokenSelectionKernel::AVX2},
+      {"avx512", TokenSelectionKernel::AVX512},
+  };
+  for (const auto& kernel : kernels) {
+    if (!isTokenSelectionKernelSupported(kernel.second)) {
+      std::cout << std::setw(24) << std::left << kernel.first
+                << "not supported" << std::endl;
+      continue;
+    }
+    for (double threshold : {0.0, 5.0}) {
+      report(
+          kernel.first + (threshold > 0 ? " (threshold 5)" : ""),
+          timeit([&]() {
+            selectTopKTokens(
+                emissions.data(),
+                T,
+                N,
+                k,
+                threshold,
+                tokens.data(),
+                nTokens.data(),
+                kernel.second);
+          }),
+          T);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Benchmark of the decoder startup with a large lexicon: building and smearing
+ * the lexicon trie serially and on several threads, and compiling it into a
+ * FlatTrie. The lexicon is random, with `nSpellings` spellings of 5 to 14
+ * letters out of 30 for each of `nWords` words. Each configuration runs in
+ * its own process, so that its peak memory is not that of the previous ones.
+ *
+ * Usage: TrieBenchmark [nWords] [nSpellings] [nThreads]
+ */
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+constexpr int kNumLetters = 30;
+
+double timeit(const std::function<void()>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void report(const std::string& name, double seconds) {
+  std::cout << std::setw(24) << std::left << name << std::setprecision(5)
+            << seconds * 1000.0 << " msec" << std::endl;
+}
+
+// Peak resident memory of the process in MB
+double peakMemoryMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int nWords = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  int nSpellings = argc > 2 ? std::atoi(argv[2]) : 3;
+  int nThreads = argc > 3
+      ? std::atoi(argv[3])
+      : std::max<int>(std::thread::hardware_concurrency(), 1);
+  std::cout << "nWords = " << nWords << ", nSpellings = " << nSpellings
+            << ", nThreads = " << nThreads << std::endl;
+
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> length(5, 14);
+  std::uniform_int_distribution<int> letter(0, kNumLetters - 1);
+  std::vector<TrieEntry> entries;
+  entries.reserve(static_cast<size_t>(nWords) * nSpellings);
+  for (int i = 0; i < nWords; ++i) {
+    float score = -0.001f * (i % 10000);
+    for (int j = 0; j < nSpellings; ++j) {
+      TrieEntry entry{std::vector<int>(length(gen)), i, score};
+      for (auto& idx : entry.indices) {
+        idx = letter(gen);
+      }
+      entries.push_back(std::move(entry));
+    }
+  }
+  std::cout << "Lexicon generated, peak memory " << peakMemoryMb() << " MB"
+            << std::endl;
+
+  for (int threads : {1, nThreads}) {
+    for (auto smearMode : {SmearingMode::MAX, SmearingMode::LOGADD}) {
+      std::cout << "-- " << threads << " thread(s), "
+                << (smearMode == SmearingMode::MAX ? "max" : "logadd")
+                << " smearing" << std::endl;
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cerr << "fork failed" << std::endl;
+        return 1;
+      }
+      if (pid > 0) {
+        int status;
+        waitpid(pid, &status, 0);
+        continue;
+      }
+      // The peak memory of the child starts at the memory of the lexicon
+      double lexiconMemory = peakMemoryMb();
+      {
+        Trie trie(kNumLetters, 0);
+        report("build", timeit([&]() { trie.insert(entries, threads); }));
+        report("smear", timeit([&]() { trie.smear(smearMode, threads); }));
+        std::unique_ptr<FlatTrie> flatTrie;
+        report("compile", timeit([&]() {
+                 flatTrie = std::make_unique<FlatTrie>(trie);
+               }));
+      }
+      std::cout << "Peak memory " << peakMemoryMb() - lexiconMemory
+                << " MB over the lexicon" << std::endl;
+      _exit(0);
+    }
+  }
+  return 0;
+}
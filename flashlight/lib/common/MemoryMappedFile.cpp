@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fl {
+namespace lib {
+
+#ifdef _WIN32
+
+MemoryMappedFile::MemoryMappedFile(const std::string& path)
+    : path_(path), data_(nullptr), size_(0) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file for mapping: " + path);
+  }
+  size_ = file.tellg();
+  buffer_.resize(size_);
+  file.seekg(0, std::ios::beg);
+  if (!file.read(buffer_.data(), size_)) {
+    throw std::runtime_error("Failed to read file for mapping: " + path);
+  }
+  data_ = buffer_.data();
+}
+
+MemoryMappedFile::~MemoryMappedFile() {}
+
+#else
+
+MemoryMappedFile::MemoryMappedFile(const std::string& path)
+    : path_(path), data_(nullptr), size_(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file for mapping: " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat file for mapping: " + path);
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to mmap file: " + path);
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  if (data_ && size_ > 0) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+#endif
+} // namespace lib
+} // namespace fl
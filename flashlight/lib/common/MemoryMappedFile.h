@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace fl {
+namespace lib {
+
+/**
+ * MemoryMappedFile maps a whole file read-only into memory. Pages are shared
+ * through the page cache between all the processes which map the same file,
+ * so large immutable resources (compiled tries, binary dictionaries, token
+ * corpora) are loaded once per machine rather than once per process.
+ *
+ * On platforms without mmap support the file is read into an owned buffer.
+ */
+class MemoryMappedFile {
+ public:
+  explicit MemoryMappedFile(const std::string& path);
+
+  ~MemoryMappedFile();
+
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  /* Pointer to the beginning of the mapped file content */
+  const char* data() const {
+    return data_;
+  }
+
+  /* Size of the mapped file in bytes */
+  size_t size() const {
+    return size_;
+  }
+
+  const std::string& path() const {
+    return path_;
+  }
+
+ private:
+  std::string path_;
+  const char* data_;
+  size_t size_;
+  // Only used when the platform has no mmap support
+  std::vector<char> buffer_;
+};
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/common/ThreadGroup.h"
+
+#include <stdexcept>
+
+namespace fl {
+namespace lib {
+
+ThreadGroup::ThreadGroup(int nThreads)
+    : nThreads_(nThreads),
+      fn_(nullptr),
+      generation_(0),
+      nRunning_(0),
+      isStopping_(false) {
+  if (nThreads < 1) {
+    throw std::invalid_argument(
+        "[ThreadGroup] The number of threads must be positive");
+  }
+  try {
+    for (int i = 1; i < nThreads_; ++i) {
+      threads_.emplace_back(&ThreadGroup::work, this, i);
+    }
+  } catch (...) {
+    stop();
+    throw;
+  }
+}
+
+ThreadGroup::~ThreadGroup() {
+  stop();
+}
+
+void ThreadGroup::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    isStopping_ = true;
+  }
+  startCondition_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadGroup::run(const std::function<void(int)>& fn) {
+  if (threads_.empty()) {
+    fn(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fn_ = &fn;
+    nRunning_ = threads_.size();
+    error_ = nullptr;
+    ++generation_;
+  }
+  startCondition_.notify_all();
+
+  std::exception_ptr error;
+  try {
+    fn(0);
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  doneCondition_.wait(lock, [this] { return nRunning_ == 0; });
+  fn_ = nullptr;
+  if (!error) {
+    error = error_;
+  }
+  lock.unlock();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadGroup::work(int threadIdx) {
+  uint64_t generation = 0;
+  while (true) {
+    const std::function<void(int)>* fn;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      startCondition_.wait(lock, [this, generation] {
+        return isStopping_ || generation_ != generation;
+      });
+      if (isStopping_) {
+        return;
+      }
+      generation = generation_;
+      fn = fn_;
+    }
+
+    try {
+      (*fn)(threadIdx);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--nRunning_ == 0) {
+      doneCondition_.notify_one();
+    }
+  }
+}
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fl {
+namespace lib {
+
+/**
+ * ThreadGroup runs the same function on a fixed group of threads and waits for
+ * all of them, e.g. to split each step of an algorithm in a few parts. The
+ * threads are started once, so that `run()` only costs a wake up of the
+ * threads and is suited to short tasks run in a loop.
+ *
+ * Sample usage:
+ *
+ *   ThreadGroup threads(4);
+ *   for (step in steps) {
+ *     threads.run([&](int threadIdx) {
+ *       process(part threadIdx of step);
+ *     });
+ *   }
+ *
+ * The calling thread takes part in the work as thread 0, so that a group of 1
+ * thread does not start any thread. `run()` is not reentrant.
+ */
+class ThreadGroup {
+ public:
+  explicit ThreadGroup(int nThreads);
+
+  ~ThreadGroup();
+
+  ThreadGroup(const ThreadGroup&) = delete;
+  ThreadGroup& operator=(const ThreadGroup&) = delete;
+
+  int size() const {
+    return nThreads_;
+  }
+
+  /**
+   * Call `fn(threadIdx)` on each thread of the group, and return once all the
+   * calls returned. The first exception thrown by `fn` is rethrown.
+   */
+  void run(const std::function<void(int)>& fn);
+
+ private:
+  void work(int threadIdx);
+  void stop();
+
+  int nThreads_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable startCondition_;
+  std::condition_variable doneCondition_;
+  const std::function<void(int)>* fn_;
+  uint64_t generation_; // Number of calls to `run()`
+  int nRunning_; // Number of threads still running the current call
+  bool isStopping_;
+  std::exception_ptr error_;
+};
+} // namespace lib
+} // namespace fl
@@ -6,7 +6,9 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <numeric>
+#include <utility>
 
 #include "flashlight/lib/audio/feature/Derivatives.h"
 #include "flashlight/lib/test/audio/feature/TestUtils.h"
@@ -110,6 +112,44 @@ TEST(DerivativesTest, batchingTest) {
   }
 }
 
+TEST(DerivativesTest, longInputTest) {
+  // The frames are processed in blocks: check windows larger than a block
+  int numFeat = 13, frameSz = 300;
+  auto input = randVec<float>(numFeat * frameSz);
+  // d(i) = SUM_t t * (c(i + t) - c(i - t)) / (2 * SUM_t t^2), with the
+  // frames clamped to the signal
+  auto derivative = [frameSz](const std::vector<float>& c, int window) {
+    std::vector<float> d(frameSz);
+    float denominator = window * (window + 1) * (2 * window + 1) / 3.0;
+    for (int i = 0; i < frameSz; ++i) {
+      for (int t = 1; t <= window; ++t) {
+        d[i] += t *
+            (c[std::min(i + t, frameSz - 1)] - c[std::max(i - t, 0)]);
+      }
+      d[i] /= denominator;
+    }
+    return d;
+  };
+  for (auto windows : {std::make_pair(2, 2), std::make_pair(3, 70)}) {
+    Derivatives dev(windows.first, windows.second);
+    auto output = dev.apply(input, numFeat);
+    ASSERT_EQ(output.size(), input.size() * 3);
+    for (int i = 0; i < numFeat; ++i) {
+      std::vector<float> feat(frameSz);
+      for (int j = 0; j < frameSz; ++j) {
+        feat[j] = input[j * numFeat + i];
+      }
+      auto delta = derivative(feat, windows.first);
+      auto acc = derivative(delta, windows.second);
+      for (int j = 0; j < frameSz; ++j) {
+        ASSERT_NEAR(output[j * numFeat * 3 + i], feat[j], 1E-5);
+        ASSERT_NEAR(output[j * numFeat * 3 + numFeat + i], delta[j], 1E-5);
+        ASSERT_NEAR(output[j * numFeat * 3 + 2 * numFeat + i], acc[j], 1E-5);
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -7,13 +7,27 @@
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <sstream>
 
+#include "flashlight/lib/audio/feature/Ceplifter.h"
+#include "flashlight/lib/audio/feature/Dct.h"
+#include "flashlight/lib/audio/feature/Derivatives.h"
+#include "flashlight/lib/audio/feature/Dither.h"
 #include "flashlight/lib/audio/feature/FeatureParams.h"
 #include "flashlight/lib/audio/feature/Mfcc.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+#include "flashlight/lib/audio/feature/PowerSpectrum.h"
+#include "flashlight/lib/audio/feature/PreEmphasis.h"
+#include "flashlight/lib/audio/feature/SpeechUtils.h"
+#include "flashlight/lib/audio/feature/TriFilterbank.h"
+#include "flashlight/lib/audio/feature/Windowing.h"
 #include "flashlight/lib/common/System.h"
 
 #include "flashlight/lib/test/audio/feature/TestUtils.h"
@@ -32,6 +46,119 @@ auto loadData = [](const std::string& filepath) {
   std::copy(iit, eos, std::back_inserter(data));
   return data;
 };
+
+enum class FeatureType { POW_SPECTRUM, MFSC, MFCC };
+
+// Features of the whole signal computed one stage after the other, as the
+// featurizers did before they processed the frames block by block. The FFT
+// is a DFT in double precision.
+std::vector<float> referenceFeatures(
+    const std::vector<float>& input,
+    const FeatureParams& params,
+    FeatureType type) {
+  auto frames = frameSignal(input, params);
+  int nSamples = params.numFrameSizeSamples();
+  int nFrames = frames.size() / nSamples;
+  // The raw energy is the energy of the frames, and otherwise the energy of
+  // the frames after dithering, pre-emphasis and windowing
+  std::vector<double> energy(nFrames);
+  auto computeEnergy = [&]() {
+    for (int f = 0; f < nFrames; ++f) {
+      auto begin = frames.data() + f * nSamples;
+      energy[f] = std::inner_product(begin, begin + nSamples, begin, 0.0);
+    }
+  };
+  if (params.rawEnergy) {
+    computeEnergy();
+  }
+  if (params.ditherVal != 0.0) {
+    frames = Dither(params.ditherVal).apply(frames);
+  }
+  if (params.zeroMeanFrame) {
+    for (int f = 0; f < nFrames; ++f) {
+      auto begin = frames.data() + f * nSamples;
+      float mean = std::accumulate(begin, begin + nSamples, 0.0);
+      mean /= nSamples;
+      std::transform(
+          begin, begin + nSamples, begin, [mean](float x) { return x - mean; });
+    }
+  }
+  if (params.preemCoef != 0) {
+    PreEmphasis(params.preemCoef, nSamples).applyInPlace(frames);
+  }
+  Windowing(nSamples, params.windowType).applyInPlace(frames);
+  if (!params.rawEnergy) {
+    computeEnergy();
+  }
+
+  int nFft = params.nFft();
+  int K = params.filterFreqResponseLen();
+  std::vector<double> cosines(nFft), sines(nFft);
+  for (int i = 0; i < nFft; ++i) {
+    cosines[i] = std::cos(2 * M_PI * i / nFft);
+    sines[i] = -std::sin(2 * M_PI * i / nFft);
+  }
+  std::vector<float> spectrum(nFrames * K);
+  for (int f = 0; f < nFrames; ++f) {
+    for (int k = 0; k < K; ++k) {
+      double re = 0, im = 0;
+      for (int t = 0; t < nSamples; ++t) {
+        re += frames[f * nSamples + t] * cosines[(k * t) % nFft];
+        im += frames[f * nSamples + t] * sines[(k * t) % nFft];
+      }
+      spectrum[f * K + k] = std::sqrt(re * re + im * im);
+    }
+  }
+  if (type == FeatureType::POW_SPECTRUM) {
+    return spectrum;
+  }
+
+  if (params.usePower) {
+    for (auto& x : spectrum) {
+      x = x * x;
+    }
+  }
+  TriFilterbank filterbank(
+      params.numFilterbankChans,
+      K,
+      params.samplingFreq,
+      params.lowFreqFilterbank,
+      params.highFreqFilterbank,
+      FrequencyScale::MEL);
+  auto feat = filterbank.apply(spectrum, params.melFloor);
+  for (auto& x : feat) {
+    x = std::log(x);
+  }
+  int nFeat = params.numFilterbankChans;
+  if (type == FeatureType::MFSC) {
+    if (params.useEnergy) {
+      std::vector<float> withEnergy;
+      for (int f = 0; f < nFrames; ++f) {
+        withEnergy.push_back(std::log(std::max<float>(
+            energy[f], std::numeric_limits<float>::lowest())));
+        withEnergy.insert(
+            withEnergy.end(),
+            feat.begin() + f * nFeat,
+            feat.begin() + (f + 1) * nFeat);
+      }
+      feat = withEnergy;
+      ++nFeat;
+    }
+  } else {
+    feat = Dct(params.numFilterbankChans, params.numCepstralCoeffs)
+               .apply(feat);
+    Ceplifter(params.numCepstralCoeffs, params.lifterParam)
+        .applyInPlace(feat);
+    nFeat = params.numCepstralCoeffs;
+    if (params.useEnergy) {
+      // Replace C0 with energy
+      for (int f = 0; f < nFrames; ++f) {
+        feat[f * nFeat] = std::log(energy[f]);
+      }
+    }
+  }
+  return Derivatives(params.deltaWindow, params.accWindow).apply(feat, nFeat);
+}
 } // namespace
 
 // HTK Code used -
@@ -200,6 +327,66 @@ TEST(MfccTest, ZeroInputTest) {
   }
 }
 
+TEST(MfccTest, OutputBufferTest) {
+  auto input = randVec<float>(6417);
+  std::vector<FeatureParams> variants;
+  for (bool useEnergy : {true, false}) {
+    for (bool rawEnergy : {true, false}) {
+      FeatureParams params;
+      params.useEnergy = useEnergy;
+      params.rawEnergy = rawEnergy;
+      variants.push_back(params);
+    }
+  }
+  FeatureParams params;
+  params.ditherVal = 0.1;
+  variants.push_back(params);
+  params.preemCoef = 0;
+  params.zeroMeanFrame = false;
+  variants.push_back(params);
+  params.usePower = false;
+  params.deltaWindow = 0;
+  params.accWindow = 0;
+  variants.push_back(params);
+
+  for (const auto& params : variants) {
+    for (auto type :
+         {FeatureType::POW_SPECTRUM, FeatureType::MFSC, FeatureType::MFCC}) {
+      // New featurizers, whose dithering noise starts from the same state as
+      // the reference's
+      auto makeFeaturizer = [&params, type]() {
+        switch (type) {
+          case FeatureType::POW_SPECTRUM:
+            return std::make_shared<PowerSpectrum>(params);
+          case FeatureType::MFSC:
+            return std::shared_ptr<PowerSpectrum>(
+                std::make_shared<Mfsc>(params));
+          default:
+            return std::shared_ptr<PowerSpectrum>(
+                std::make_shared<Mfcc>(params));
+        }
+      };
+      auto expected = referenceFeatures(input, params, type);
+      auto featurizer = makeFeaturizer();
+      int outputSz = featurizer->outputSize(input.size());
+      ASSERT_EQ(expected.size(), outputSz);
+      auto vectorOutput = featurizer->apply(input);
+      ASSERT_EQ(vectorOutput.size(), outputSz);
+      // Features are written to the given part of the buffer only
+      std::vector<float> output(outputSz + 2, -1.0);
+      makeFeaturizer()->apply(input.data(), input.size(), output.data() + 1);
+      ASSERT_EQ(output.front(), -1.0);
+      ASSERT_EQ(output.back(), -1.0);
+      ASSERT_TRUE(
+          std::equal(vectorOutput.begin(), vectorOutput.end(), &output[1]));
+      for (int i = 0; i < outputSz; ++i) {
+        ASSERT_NEAR(
+            vectorOutput[i], expected[i], 1E-3 * (1 + std::abs(expected[i])));
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
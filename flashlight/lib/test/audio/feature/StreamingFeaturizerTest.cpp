@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+#include "flashlight/lib/audio/feature/Mfcc.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+#include "flashlight/lib/audio/feature/PowerSpectrum.h"
+#include "flashlight/lib/audio/feature/StreamingFeaturizer.h"
+#include "flashlight/lib/test/audio/feature/TestUtils.h"
+
+using namespace fl::lib::audio;
+
+namespace {
+
+// Streams `input` in chunks of random sizes (some empty or shorter than a
+// frame), and checks the features against the features of the whole signal
+template <class Featurizer>
+void checkStreaming(
+    const FeatureParams& params,
+    const std::vector<float>& input) {
+  Featurizer featurizer(params);
+  int lookahead = params.deltaWindow > 0
+      ? params.deltaWindow + std::max<int>(params.accWindow, 0)
+      : 0;
+  if (!std::is_base_of<Mfsc, Featurizer>::value) {
+    lookahead = 0;
+  }
+
+  StreamingFeaturizer<Featurizer> streaming(params);
+  // The second stream checks that end() starts a new stream
+  for (int stream = 0; stream < 2; ++stream) {
+    auto expected = featurizer.apply(input);
+    std::vector<float> output;
+    int pos = 0;
+    while (pos < input.size()) {
+      int chunkSz = std::min<int>(rand() % 1500, input.size() - pos);
+      auto feat = streaming.apply(input.data() + pos, chunkSz);
+      pos += chunkSz;
+      ASSERT_EQ(feat.size() % streaming.featSz(), 0);
+      output.insert(output.end(), feat.begin(), feat.end());
+      // The features are emitted as soon as they are final
+      int64_t numFinal =
+          std::max<int64_t>(params.numFrames(pos) - lookahead, 0);
+      ASSERT_EQ(streaming.numEmittedFrames(), numFinal);
+      ASSERT_EQ(output.size(), numFinal * streaming.featSz());
+    }
+    auto feat = streaming.end();
+    output.insert(output.end(), feat.begin(), feat.end());
+    ASSERT_EQ(streaming.numEmittedFrames(), 0);
+
+    ASSERT_EQ(output.size(), expected.size());
+    for (int i = 0; i < output.size(); ++i) {
+      ASSERT_NEAR(output[i], expected[i], 1E-4 * (1 + std::abs(expected[i])));
+    }
+  }
+}
+
+} // namespace
+
+TEST(StreamingFeaturizerTest, PowerSpectrum) {
+  FeatureParams params;
+  for (int size : {0, 300, 400, 16000}) {
+    auto input = randVec<float>(size);
+    checkStreaming<PowerSpectrum>(params, input);
+  }
+}
+
+TEST(StreamingFeaturizerTest, Mfsc) {
+  auto input = randVec<float>(16000);
+  FeatureParams params;
+  params.deltaWindow = 2;
+  params.accWindow = 2;
+  checkStreaming<Mfsc>(params, input);
+  params.useEnergy = false;
+  params.accWindow = 0;
+  params.deltaWindow = 9;
+  checkStreaming<Mfsc>(params, input);
+  // Fewer frames than the derivatives window
+  checkStreaming<Mfsc>(params, randVec<float>(1000));
+}
+
+TEST(StreamingFeaturizerTest, Mfcc) {
+  auto input = randVec<float>(16000);
+  FeatureParams params;
+  for (bool rawEnergy : {true, false}) {
+    params.rawEnergy = rawEnergy;
+    params.deltaWindow = 2;
+    params.accWindow = 3;
+    checkStreaming<Mfcc>(params, input);
+    params.deltaWindow = 0;
+    checkStreaming<Mfcc>(params, input);
+  }
+}
+
+TEST(StreamingFeaturizerTest, Dither) {
+  // With a positive dithering constant, the same noise is added to the frames,
+  // streamed or not
+  auto input = randVec<float>(8000);
+  FeatureParams params;
+  params.ditherVal = 0.1;
+  checkStreaming<Mfcc>(params, input);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
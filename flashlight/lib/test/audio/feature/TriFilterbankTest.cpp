@@ -7,11 +7,17 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
 #include "flashlight/lib/audio/feature/TriFilterbank.h"
 #include "flashlight/lib/test/audio/feature/TestUtils.h"
 
 using fl::lib::audio::FrequencyScale;
+using fl::lib::audio::isTriFilterbankKernelSupported;
 using fl::lib::audio::TriFilterbank;
+using fl::lib::audio::TriFilterbankKernel;
 
 // Matlab code used:
 // H = trifbank( M, K, R, fs, hz2mel, mel2hz ); % size of H is M x K
@@ -75,6 +81,72 @@ TEST(TriFilterbankTest, batchingTest) {
   }
 }
 
+TEST(TriFilterbankTest, kernelTest) {
+  // Narrow filters, applied as bands, and wide ones, applied as a dense matrix
+  const auto bestBands =
+      isTriFilterbankKernelSupported(TriFilterbankKernel::AVX2)
+      ? TriFilterbankKernel::AVX2
+      : TriFilterbankKernel::SCALAR;
+  for (auto dims : {std::make_pair(80, 257), std::make_pair(2, 9)}) {
+    int numFilters = dims.first, filterLen = dims.second, B = 7;
+    auto makeFilterbank = [&](TriFilterbankKernel kernel) {
+      return TriFilterbank(
+          numFilters, filterLen, 16000, 0, -1, FrequencyScale::MEL, kernel);
+    };
+    ASSERT_EQ(
+        makeFilterbank(TriFilterbankKernel::AUTO).kernel(),
+        numFilters > 2 ? bestBands : TriFilterbankKernel::DENSE);
+
+    auto input = randVec<float>(filterLen * B, 0.0, 100.0);
+    for (auto kernel : {TriFilterbankKernel::DENSE,
+                        TriFilterbankKernel::SCALAR,
+                        TriFilterbankKernel::AVX2}) {
+      if (!isTriFilterbankKernelSupported(kernel)) {
+        ASSERT_THROW(makeFilterbank(kernel), std::invalid_argument);
+        continue;
+      }
+      auto triflt = makeFilterbank(kernel);
+      ASSERT_EQ(triflt.kernel(), kernel);
+      auto H = triflt.filterbank();
+      std::vector<float> expOutput(numFilters * B, 0.0);
+      for (int b = 0; b < B; ++b) {
+        for (int i = 0; i < filterLen; ++i) {
+          for (int j = 0; j < numFilters; ++j) {
+            expOutput[b * numFilters + j] +=
+                input[b * filterLen + i] * H[i * numFilters + j];
+          }
+        }
+      }
+      for (auto& o : expOutput) {
+        o = std::max(o, 1.0f);
+      }
+      auto output = triflt.apply(input, 1.0);
+      ASSERT_EQ(output.size(), expOutput.size());
+      for (int i = 0; i < output.size(); ++i) {
+        ASSERT_NEAR(output[i], expOutput[i], 1E-5 * expOutput[i]);
+      }
+
+      // Strided output
+      int stride = numFilters + 3;
+      std::vector<float> strided(stride * B, -1.0);
+      triflt.apply(input.data(), B, strided.data(), stride, 1.0);
+      for (int b = 0; b < B; ++b) {
+        for (int j = 0; j < stride; ++j) {
+          ASSERT_EQ(
+              strided[b * stride + j],
+              j < numFilters ? output[b * numFilters + j] : -1.0);
+        }
+      }
+    }
+  }
+}
+
+TEST(TriFilterbankTest, emptyTest) {
+  TriFilterbank triflt(23, 33, 8000);
+  ASSERT_TRUE(triflt.apply(std::vector<float>()).empty());
+  ASSERT_THROW(triflt.apply(std::vector<float>(32)), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
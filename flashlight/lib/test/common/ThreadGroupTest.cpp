@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/ThreadGroup.h"
+
+using fl::lib::ThreadGroup;
+
+TEST(ThreadGroupTest, Run) {
+  ThreadGroup threads(4);
+  ASSERT_EQ(threads.size(), 4);
+  std::vector<int> counts(threads.size(), 0);
+  for (int i = 0; i < 1000; ++i) {
+    threads.run([&](int threadIdx) { ++counts[threadIdx]; });
+  }
+  for (int count : counts) {
+    ASSERT_EQ(count, 1000);
+  }
+}
+
+TEST(ThreadGroupTest, SingleThread) {
+  ThreadGroup threads(1);
+  int threadIdx = -1;
+  threads.run([&](int idx) { threadIdx = idx; });
+  ASSERT_EQ(threadIdx, 0);
+  ASSERT_THROW(ThreadGroup(0), std::invalid_argument);
+}
+
+TEST(ThreadGroupTest, Exception) {
+  ThreadGroup threads(3);
+  ASSERT_THROW(
+      threads.run([](int threadIdx) {
+        if (threadIdx == 2) {
+          throw std::runtime_error("failure");
+        }
+      }),
+      std::runtime_error);
+
+  // The group can still be used
+  std::atomic<int> sum(0);
+  threads.run([&](int threadIdx) { sum += threadIdx; });
+  ASSERT_EQ(sum, 0 + 1 + 2);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/lm/ConvLM.h"
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+
+using fl::lib::getTmpPath;
+using namespace fl::lib::text;
+
+namespace {
+
+const std::vector<std::string> kVocab =
+    {"<fairseq_style>", "<pad>", "</s>", "<unk>", "a", "b", "c"};
+
+std::string writeVocab() {
+  const std::string path = getTmpPath("convlm_test.vocab");
+  std::ofstream vocab(path);
+  for (const auto& token : kVocab) {
+    vocab << token << "\n";
+  }
+  return path;
+}
+
+// Scores of the tokens given a history, whatever its padding in the batch
+struct FakeConvLm {
+  std::vector<int> batchSizes;
+
+  std::vector<float> operator()(
+      const std::vector<int>& tokens,
+      const std::vector<int>& lastTokenPositions,
+      int sampleSize,
+      int batchSize) {
+    batchSizes.push_back(batchSize);
+    std::vector<float> scores;
+    for (int b = 0; b < batchSize; b++) {
+      int hash = 0;
+      for (int i = 0; i <= lastTokenPositions[b]; i++) {
+        hash = (hash * 7 + tokens[b * sampleSize + i]) % 1000003;
+      }
+      for (int n = 0; n < kVocab.size(); n++) {
+        scores.push_back(-((hash + n * 5) % 11) / 4.f);
+      }
+    }
+    return scores;
+  }
+};
+
+GetConvLmScoreFunc wrap(const std::shared_ptr<FakeConvLm>& fakeLm) {
+  return [fakeLm](
+             const std::vector<int>& tokens,
+             const std::vector<int>& lastTokenPositions,
+             int sampleSize,
+             int batchSize) {
+    return (*fakeLm)(tokens, lastTokenPositions, sampleSize, batchSize);
+  };
+}
+
+Dictionary buildUsrDict() {
+  Dictionary usrDict;
+  for (const auto& token : {"a", "b", "c"}) {
+    usrDict.addEntry(token);
+  }
+  return usrDict;
+}
+
+} // namespace
+
+TEST(ConvLMTest, ScoreBatch) {
+  const auto usrDict = buildUsrDict();
+  const auto vocabPath = writeVocab();
+  auto fakeLm = std::make_shared<FakeConvLm>();
+  ConvLM lm(wrap(fakeLm), vocabPath, usrDict, 1000, 10);
+  ConvLM referenceLm(wrap(fakeLm), vocabPath, usrDict, 1000, 10);
+
+  auto pool = std::make_shared<LMStatePool>();
+  auto start = lm.start(false, pool);
+  auto referenceStart = referenceLm.start(false, pool);
+  std::vector<LMStatePtr> states;
+  std::vector<LMStatePtr> referenceStates;
+  for (int token = 0; token < 3; token++) {
+    states.push_back(lm.score(start, token).first);
+    referenceStates.push_back(referenceLm.score(referenceStart, token).first);
+  }
+
+  // The 3 new states are forwarded together
+  const std::vector<int> queryStates = {0, 0, 1, 2, 2};
+  const std::vector<int> tokens = {0, 2, 1, 0, 1};
+  std::vector<LMStatePtr> inStates;
+  for (int i : queryStates) {
+    inStates.push_back(states[i]);
+  }
+  std::vector<LMStatePtr> outStates(tokens.size());
+  std::vector<float> scores(tokens.size());
+  fakeLm->batchSizes.clear();
+  lm.scoreBatch(
+      inStates.data(),
+      tokens.data(),
+      tokens.size(),
+      outStates.data(),
+      scores.data());
+  ASSERT_EQ(fakeLm->batchSizes, std::vector<int>{3});
+
+  for (int i = 0; i < tokens.size(); i++) {
+    auto reference =
+        referenceLm.score(referenceStates[queryStates[i]], tokens[i]);
+    ASSERT_EQ(scores[i], reference.second);
+    ASSERT_EQ(
+        static_cast<ConvLMState*>(outStates[i].get())->tokens,
+        static_cast<ConvLMState*>(reference.first.get())->tokens);
+  }
+
+  const int invalidToken = 3;
+  ASSERT_THROW(
+      lm.scoreBatch(
+          inStates.data(), &invalidToken, 1, outStates.data(), scores.data()),
+      std::out_of_range);
+}
+
+TEST(ConvLMTest, LruCache) {
+  auto fakeLm = std::make_shared<FakeConvLm>();
+  ConvLM lm(wrap(fakeLm), writeVocab(), buildUsrDict(), 1000, 2);
+  auto pool = std::make_shared<LMStatePool>();
+  auto start = lm.start(false, pool);
+  auto a = lm.score(start, 0).first;
+  auto sameA = lm.score(start, 0).first;
+  auto b = lm.score(start, 1).first;
+  auto c = lm.score(start, 2).first;
+  ASSERT_EQ(fakeLm->batchSizes.size(), 1);
+
+  // The cache is kept for the next utterance
+  lm.score(lm.start(false, pool), 1);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 1);
+
+  auto score = lm.score(a, 0).second;
+  lm.score(b, 0);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 3);
+  // States with the same history share their cache entry
+  lm.score(sameA, 1);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 3);
+
+  // `b` is the least recently used history, evicted by `c`
+  lm.score(c, 0);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 4);
+  ASSERT_EQ(lm.score(a, 0).second, score);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 4);
+  lm.score(b, 0);
+  ASSERT_EQ(fakeLm->batchSizes.size(), 5);
+}
+
+TEST(ConvLMTest, TopKCache) {
+  const auto usrDict = buildUsrDict();
+  const auto vocabPath = writeVocab();
+  auto fakeLm = std::make_shared<FakeConvLm>();
+  const int topK = 3;
+  ConvLM lm(wrap(fakeLm), vocabPath, usrDict, 1000, 10, 49, topK);
+
+  auto pool = std::make_shared<LMStatePool>();
+  auto state = lm.start(false, pool);
+  for (int i = 0; i < 20; i++) {
+    auto history = static_cast<ConvLMState*>(state.get());
+    auto scores = FakeConvLm()(
+        history->tokens, {history->length - 1}, history->length, 1);
+    std::vector<float> sorted = scores;
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+
+    // The scores of the top-K tokens of the vocabulary are exact, and the
+    // other ones are at most the K-th score
+    for (int j = 0; j < usrDict.indexSize(); j++) {
+      const float score = lm.score(state, j).second;
+      const float expected = scores[j + 4]; // "a" is the 5th LM token
+      ASSERT_TRUE(score == expected || score <= sorted[topK - 1]);
+      if (expected > sorted[topK - 1]) {
+        ASSERT_EQ(score, expected);
+      }
+    }
+    ASSERT_EQ(fakeLm->batchSizes.size(), i + 1);
+    state = lm.score(state, (i * 5) % usrDict.indexSize()).first;
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+
+using fl::lib::getTmpPath;
+using namespace fl::lib::text;
+
+namespace {
+
+const std::vector<std::vector<int>> kWords = {{1, 2, 3},
+                                              {1, 2},
+                                              {1, 4, 0},
+                                              {2},
+                                              {3, 3, 3, 3},
+                                              {1, 2}};
+
+TriePtr buildTestTrie(SmearingMode smearMode) {
+  auto trie = std::make_shared<Trie>(5, 0);
+  for (int i = 0; i < kWords.size(); ++i) {
+    trie->insert(kWords[i], i, -0.5 * i);
+  }
+  trie->smear(smearMode);
+  return trie;
+}
+
+void checkSameTrie(Trie& trie, const FlatTrie& flatTrie) {
+  // All the prefixes of all the words
+  for (const auto& word : kWords) {
+    for (int len = 0; len <= word.size(); ++len) {
+      std::vector<int> prefix(word.begin(), word.begin() + len);
+      auto node = trie.search(prefix);
+      auto flatNode = flatTrie.search(prefix);
+      ASSERT_NE(node, nullptr);
+      ASSERT_NE(flatNode, nullptr);
+      ASSERT_EQ(flatNode->idx, node->idx);
+      ASSERT_FLOAT_EQ(flatNode->maxScore, node->maxScore);
+      ASSERT_EQ(flatNode->nChildren, node->children.size());
+      ASSERT_EQ(flatNode->nLabels, node->labels.size());
+      for (int i = 0; i < node->labels.size(); ++i) {
+        ASSERT_EQ(flatTrie.getLabels(flatNode)[i], node->labels[i]);
+        ASSERT_FLOAT_EQ(flatTrie.getScores(flatNode)[i], node->scores[i]);
+      }
+    }
+  }
+  ASSERT_EQ(flatTrie.search({4}), nullptr);
+  ASSERT_EQ(flatTrie.search({1, 2, 3, 4}), nullptr);
+  ASSERT_THROW(flatTrie.search({5}), std::out_of_range);
+}
+
+} // namespace
+
+TEST(FlatTrieTest, Compile) {
+  for (auto smearMode :
+       {SmearingMode::NONE, SmearingMode::MAX, SmearingMode::LOGADD}) {
+    auto trie = buildTestTrie(smearMode);
+    FlatTrie flatTrie(*trie);
+    ASSERT_EQ(flatTrie.getMaxChildren(), 5);
+    // root, 1, 1-2, 1-2-3, 1-4, 1-4-0, 2, 3, 3-3, 3-3-3, 3-3-3-3
+    ASSERT_EQ(flatTrie.getNumNodes(), 11);
+    checkSameTrie(*trie, flatTrie);
+  }
+}
+
+TEST(FlatTrieTest, GetChild) {
+  auto trie = buildTestTrie(SmearingMode::NONE);
+  FlatTrie flatTrie(*trie);
+  auto root = flatTrie.getRoot();
+  ASSERT_EQ(root->nChildren, 3);
+  auto node = flatTrie.getChild(root, 1);
+  ASSERT_NE(node, nullptr);
+  ASSERT_EQ(node->idx, 1);
+  ASSERT_EQ(flatTrie.getChild(node, 2), flatTrie.search({1, 2}));
+  ASSERT_EQ(flatTrie.getChild(node, 3), nullptr);
+  ASSERT_EQ(flatTrie.getChild(root, 0), nullptr);
+}
+
+TEST(FlatTrieTest, SaveLoad) {
+  auto trie = buildTestTrie(SmearingMode::MAX);
+  FlatTrie flatTrie(*trie);
+  const std::string path = getTmpPath("test.trie");
+  flatTrie.save(path);
+
+  auto loaded = FlatTrie::load(path);
+  ASSERT_EQ(loaded->getNumNodes(), flatTrie.getNumNodes());
+  ASSERT_EQ(loaded->getMaxChildren(), flatTrie.getMaxChildren());
+  checkSameTrie(*trie, *loaded);
+  loaded.reset();
+  std::remove(path.c_str());
+}
+
+TEST(FlatTrieTest, LoadInvalid) {
+  const std::string path = getTmpPath("invalid.trie");
+  {
+    auto out = fl::lib::createOutputStream(path);
+    out << "not a trie file";
+  }
+  ASSERT_THROW(FlatTrie::load(path), std::runtime_error);
+  std::remove(path.c_str());
+  ASSERT_THROW(FlatTrie::load(path), std::runtime_error);
+}
+
+TEST(FlatTrieTest, LoadFingerprint) {
+  auto trie = buildTestTrie(SmearingMode::MAX);
+  FlatTrie flatTrie(*trie);
+  const std::string path = getTmpPath("fingerprint.trie");
+  flatTrie.save(path, 42);
+
+  ASSERT_EQ(FlatTrie::loadFingerprint(path), 42);
+  checkSameTrie(*trie, *FlatTrie::load(path, 42));
+  // A trie built from other inputs is not used
+  ASSERT_THROW(FlatTrie::load(path), std::runtime_error);
+  ASSERT_THROW(FlatTrie::load(path, 43), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(FlatTrieTest, LoadOutOfRange) {
+  auto trie = buildTestTrie(SmearingMode::MAX);
+  FlatTrie flatTrie(*trie);
+  const std::string path = getTmpPath("range.trie");
+  flatTrie.save(path);
+  std::string content;
+  {
+    auto in = fl::lib::createInputStream(path);
+    content.assign(
+        std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  // Header, then the nodes: make the children or the labels of the root
+  // point out of the arrays
+  size_t headerSize = content.size() -
+      flatTrie.getNumNodes() * (sizeof(FlatTrieNode) + sizeof(int)) -
+      kWords.size() * (sizeof(int) + sizeof(float));
+  for (size_t offset : {offsetof(FlatTrieNode, childBegin),
+                        offsetof(FlatTrieNode, labelBegin)}) {
+    std::string corrupted = content;
+    int value = 1 << 20;
+    std::memcpy(&corrupted[headerSize + offset], &value, sizeof(value));
+    {
+      auto out = fl::lib::createOutputStream(path);
+      out << corrupted;
+    }
+    ASSERT_THROW(FlatTrie::load(path), std::runtime_error);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(FlatTrieTest, ParallelBuild) {
+  std::mt19937 gen(0);
+  std::vector<TrieEntry> entries;
+  for (int i = 0; i < 2000; ++i) {
+    TrieEntry entry{std::vector<int>(3 + gen() % 4), i / 2, -0.01f * (i % 97)};
+    for (auto& idx : entry.indices) {
+      idx = gen() % 10;
+    }
+    entries.push_back(entry);
+  }
+  entries.push_back(TrieEntry{{}, -1, -1});
+
+  for (auto smearMode :
+       {SmearingMode::NONE, SmearingMode::MAX, SmearingMode::LOGADD}) {
+    Trie serialTrie(10, 0);
+    for (const auto& entry : entries) {
+      serialTrie.insert(entry.indices, entry.label, entry.score);
+    }
+    serialTrie.smear(smearMode);
+    Trie parallelTrie(10, 0);
+    parallelTrie.insert(entries, 4);
+    parallelTrie.smear(smearMode, 4);
+
+    // Same nodes, labels and scores, computed in the same order
+    FlatTrie serial(serialTrie);
+    FlatTrie parallel(parallelTrie);
+    ASSERT_EQ(parallel.getNumNodes(), serial.getNumNodes());
+    for (int i = 0; i < serial.getNumNodes(); ++i) {
+      const auto* node = serial.getRoot() + i;
+      const auto* parallelNode = parallel.getRoot() + i;
+      ASSERT_EQ(parallelNode->idx, node->idx);
+      ASSERT_EQ(parallelNode->nChildren, node->nChildren);
+      ASSERT_EQ(parallelNode->maxScore, node->maxScore);
+      ASSERT_EQ(parallelNode->nLabels, node->nLabels);
+      for (int j = 0; j < node->nLabels; ++j) {
+        ASSERT_EQ(
+            parallel.getLabels(parallelNode)[j], serial.getLabels(node)[j]);
+        ASSERT_EQ(
+            parallel.getScores(parallelNode)[j], serial.getScores(node)[j]);
+      }
+    }
+  }
+
+  Trie trie(10, 0);
+  ASSERT_THROW(trie.insert({TrieEntry{{3, 10}, 0, 0}}, 4), std::out_of_range);
+  ASSERT_THROW(trie.insert({TrieEntry{{-1}, 0, 0}}, 4), std::out_of_range);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
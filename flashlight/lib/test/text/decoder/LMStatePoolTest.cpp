@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+struct TestState : LMState {
+  std::vector<int> history;
+  int value;
+
+  TestState() : value(0) {}
+  explicit TestState(int value) : value(value) {}
+};
+
+} // namespace
+
+TEST(LMStatePoolTest, Make) {
+  auto pool = std::make_shared<LMStatePool>();
+  auto state = pool->make<TestState>(5);
+  ASSERT_EQ(state->value, 5);
+  ASSERT_EQ(state->pool, pool.get());
+  ASSERT_GE(state->handle, 0);
+
+  auto stats = pool->getStats();
+  ASSERT_EQ(stats.nLiveStates, 1);
+  ASSERT_EQ(stats.nCreatedStates, 1);
+  ASSERT_GT(stats.nBytes, 0);
+
+  // Memory and handles of dead states are reused
+  int handle = state->handle;
+  TestState* address = state.get();
+  state.reset();
+  ASSERT_EQ(pool->getStats().nLiveStates, 0);
+  state = pool->make<TestState>(6);
+  ASSERT_EQ(state->handle, handle);
+  ASSERT_EQ(state.get(), address);
+  ASSERT_EQ(pool->getStats().nPeakLiveStates, 1);
+}
+
+TEST(LMStatePoolTest, Child) {
+  auto pool = std::make_shared<LMStatePool>();
+  auto root = pool->make<TestState>();
+  auto child1 = pool->child<TestState>(root.get(), 1);
+  auto child2 = pool->child<TestState>(root.get(), 2);
+  ASSERT_NE(child1, child2);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 1), child1);
+  ASSERT_EQ(pool->child<TestState>(child1.get(), 1)->pool, pool.get());
+
+  auto stats = pool->getStats();
+  ASSERT_EQ(stats.nLinks, 3);
+  ASSERT_EQ(stats.nLinkHits, 1);
+  ASSERT_EQ(stats.nLinkMisses, 3);
+
+  // Links don't keep states alive
+  child2.reset();
+  ASSERT_EQ(pool->getStats().nLiveStates, 2);
+  auto newChild2 = pool->child<TestState>(root.get(), 2);
+  ASSERT_EQ(pool->getStats().nLinks, 3);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 2), newChild2);
+
+  // Reset drops the links only
+  pool->reset();
+  stats = pool->getStats();
+  ASSERT_EQ(stats.nLinks, 0);
+  ASSERT_EQ(stats.nLiveStates, 3);
+  ASSERT_EQ(stats.nCreatedStates, 0);
+  ASSERT_NE(pool->child<TestState>(root.get(), 1), child1);
+}
+
+TEST(LMStatePoolTest, Eviction) {
+  auto pool = std::make_shared<LMStatePool>(2);
+  auto root = pool->make<TestState>();
+  auto child1 = pool->child<TestState>(root.get(), 1);
+  auto child2 = pool->child<TestState>(root.get(), 2);
+  // The links of live children are never evicted: the table grows instead
+  auto child3 = pool->child<TestState>(root.get(), 3);
+  auto stats = pool->getStats();
+  ASSERT_EQ(stats.nLinks, 3);
+  ASSERT_EQ(stats.nEvictedLinks, 0);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 1), child1);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 2), child2);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 3), child3);
+
+  // The link of the child which died first is evicted
+  child3.reset();
+  child1.reset();
+  auto child4 = pool->child<TestState>(root.get(), 4);
+  stats = pool->getStats();
+  ASSERT_EQ(stats.nLinks, 3);
+  ASSERT_EQ(stats.nEvictedLinks, 1);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 2), child2);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 4), child4);
+  // The link of the dead child 1 is still there, and is reused
+  auto newChild1 = pool->child<TestState>(root.get(), 1);
+  stats = pool->getStats();
+  ASSERT_EQ(stats.nLinks, 3);
+  ASSERT_EQ(stats.nEvictedLinks, 1);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 1), newChild1);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 2), child2);
+  ASSERT_EQ(pool->child<TestState>(root.get(), 4), child4);
+
+  // No links at all
+  auto noLinkPool = std::make_shared<LMStatePool>(0);
+  auto noLinkRoot = noLinkPool->make<TestState>();
+  auto noLinkChild = noLinkPool->child<TestState>(noLinkRoot.get(), 1);
+  ASSERT_NE(noLinkPool->child<TestState>(noLinkRoot.get(), 1), noLinkChild);
+  ASSERT_EQ(noLinkPool->getStats().nLinks, 0);
+}
+
+TEST(LMStatePoolTest, LiveChildrenAreUnique) {
+  // Random lookups with a small table: while a child is alive, its parent
+  // returns it, however many links were evicted
+  auto pool = std::make_shared<LMStatePool>(8);
+  std::mt19937 rng(1);
+  std::vector<std::shared_ptr<TestState>> states = {pool->make<TestState>()};
+  std::map<std::pair<int, int>, std::weak_ptr<TestState>> children;
+  for (int i = 0; i < 10000; ++i) {
+    int parent = rng() % states.size();
+    int usrIdx = rng() % 4;
+    auto child = pool->child<TestState>(states[parent].get(), usrIdx);
+    auto& expected = children[{states[parent]->value, usrIdx}];
+    if (auto expectedChild = expected.lock()) {
+      ASSERT_EQ(child, expectedChild);
+    }
+    expected = child;
+    child->value = i + 1;
+    if (states.size() < 32) {
+      states.push_back(child);
+    } else {
+      states[1 + rng() % (states.size() - 1)] = child;
+    }
+  }
+  ASSERT_GT(pool->getStats().nEvictedLinks, 0);
+}
+
+TEST(LMStatePoolTest, ForeignParent) {
+  auto pool = std::make_shared<LMStatePool>();
+  auto otherPool = std::make_shared<LMStatePool>();
+  auto root = otherPool->make<TestState>();
+  ASSERT_THROW(pool->child<TestState>(root.get(), 1), std::invalid_argument);
+  TestState heapState;
+  ASSERT_THROW(pool->child<TestState>(&heapState, 1), std::invalid_argument);
+}
+
+TEST(LMStatePoolTest, StatesOutlivePool) {
+  auto pool = std::make_shared<LMStatePool>();
+  auto root = pool->make<TestState>();
+  auto child = pool->child<TestState>(root.get(), 1);
+  child->history = {1, 2, 3};
+  pool.reset();
+  // The states keep the pool alive
+  auto grandChild = child->pool->child<TestState>(child.get(), 4);
+  ASSERT_EQ(child->pool->child<TestState>(child.get(), 4), grandChild);
+  ASSERT_EQ(child->history.size(), 3);
+}
+
+TEST(LMStatePoolTest, ZeroLM) {
+  ZeroLM lm;
+  auto pool = std::make_shared<LMStatePool>();
+  auto root = lm.start(false, pool);
+  ASSERT_EQ(root->pool, pool.get());
+  auto child = lm.score(root, 3).first;
+  ASSERT_EQ(child->pool, pool.get());
+  ASSERT_EQ(lm.score(root, 3).first, child);
+  ASSERT_NE(lm.score(root, 4).first, child);
+  ASSERT_EQ(lm.finish(child).first, child);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using fl::lib::getTmpPath;
+using namespace fl::lib::text;
+
+namespace {
+
+// Tokens: 0 is the word separator, 1-3 are letters and 4 is the CTC blank
+const int kSil = 0;
+const int kBlank = 4;
+const int kN = 5;
+
+// Frames of a "<1 2> | <3>" utterance, with some ambiguous frames so that the
+// beam keeps several hypothesis
+const std::vector<int> kFrameTokens = {1, 4, 2, 2, 4, 0, 4, 3, 4};
+
+std::vector<float> buildEmissions() {
+  std::vector<float> emissions;
+  for (int token : kFrameTokens) {
+    for (int n = 0; n < kN; ++n) {
+      double p = n == token ? 0.6 : 0.1;
+      emissions.push_back(std::log(p));
+    }
+  }
+  return emissions;
+}
+
+TriePtr buildTrie() {
+  auto trie = std::make_shared<Trie>(kN, kSil);
+  trie->insert({1, 2}, 0, 0);
+  trie->insert({3}, 1, 0);
+  trie->insert({1, 3}, 2, 0);
+  trie->smear(SmearingMode::MAX);
+  return trie;
+}
+
+// Arcs of the lattice sorted by start frame (a topological order), checking
+// that each state has a single frame
+std::vector<const LatticeArc*> sortArcs(const Lattice& lattice, int offset) {
+  std::vector<int> frames(lattice.nStates(), -1);
+  frames[0] = offset;
+  std::vector<const LatticeArc*> arcs;
+  for (const auto& arc : lattice.getArcs()) {
+    EXPECT_LT(arc.startFrame, arc.endFrame);
+    for (auto stateFrame : {std::make_pair(arc.from, arc.startFrame),
+                            std::make_pair(arc.to, arc.endFrame)}) {
+      int& frame = frames[stateFrame.first];
+      EXPECT_TRUE(frame < 0 || frame == stateFrame.second);
+      frame = stateFrame.second;
+    }
+    arcs.push_back(&arc);
+  }
+  std::stable_sort(
+      arcs.begin(), arcs.end(), [](const LatticeArc* a, const LatticeArc* b) {
+        return a->startFrame < b->startFrame;
+      });
+  return arcs;
+}
+
+// Best score of the paths from the start state to `finalState` emitting
+// `labels`, -infinity if there is none
+double getPathScore(
+    const Lattice& lattice,
+    int finalState,
+    const std::vector<int>& labels,
+    int offset = 0) {
+  const double kInf = std::numeric_limits<double>::infinity();
+  // Best score of the paths to each state emitting the first i labels
+  std::vector<std::vector<double>> scores(
+      lattice.nStates(), std::vector<double>(labels.size() + 1, -kInf));
+  scores[0][0] = 0;
+  for (const LatticeArc* arc : sortArcs(lattice, offset)) {
+    for (int i = 0; i <= labels.size(); ++i) {
+      double score = scores[arc->from][i];
+      if (score == -kInf) {
+        continue;
+      }
+      int next = i;
+      if (arc->label >= 0) {
+        if (i == labels.size() || labels[i] != arc->label) {
+          continue;
+        }
+        ++next;
+      }
+      double& nextScore = scores[arc->to][next];
+      nextScore = std::max(nextScore, score + arc->score);
+    }
+  }
+  return scores[finalState][labels.size()];
+}
+
+// Labels and score of the best path of the lattice
+std::pair<std::vector<int>, double> getBestPath(const Lattice& lattice) {
+  std::vector<double> scores(
+      lattice.nStates(), -std::numeric_limits<double>::infinity());
+  std::vector<const LatticeArc*> bestArcs(lattice.nStates(), nullptr);
+  scores[0] = 0;
+  for (const LatticeArc* arc : sortArcs(lattice, 0)) {
+    if (scores[arc->from] + arc->score > scores[arc->to]) {
+      scores[arc->to] = scores[arc->from] + arc->score;
+      bestArcs[arc->to] = arc;
+    }
+  }
+  int bestState = lattice.getFinalStates().front();
+  for (int state : lattice.getFinalStates()) {
+    if (scores[state] > scores[bestState]) {
+      bestState = state;
+    }
+  }
+  std::vector<int> labels;
+  for (const LatticeArc* arc = bestArcs[bestState]; arc;
+       arc = bestArcs[arc->from]) {
+    if (arc->label >= 0) {
+      labels.insert(labels.begin(), arc->label);
+    }
+  }
+  return {labels, scores[bestState]};
+}
+
+LexiconDecoderOptions buildOptions(bool keepMergedHyps) {
+  return {
+      .beamSize = 10,
+      .beamSizeToken = kN,
+      .beamThreshold = 100,
+      .lmWeight = 0,
+      .wordScore = 0,
+      .unkScore = -std::numeric_limits<float>::infinity(),
+      .silScore = 0,
+      .logAdd = false,
+      .criterionType = CriterionType::CTC,
+      .beamThresholdToken = 0,
+      .blankSkipThreshold = 0,
+      .nExpansionThreads = 0,
+      .keepMergedHyps = keepMergedHyps};
+}
+
+std::vector<int> getWords(const DecodeResult& result) {
+  std::vector<int> words;
+  for (int word : result.words) {
+    if (word >= 0) {
+      words.push_back(word);
+    }
+  }
+  return words;
+}
+
+} // namespace
+
+TEST(LatticeTest, LexiconDecoder) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+  for (bool keepMergedHyps : {false, true}) {
+    LexiconDecoder decoder(
+        buildOptions(keepMergedHyps), trie, lm, kSil, kBlank, -1, {}, false);
+    auto results = decoder.decode(emissions.data(), T, kN);
+    ASSERT_GT(results.size(), 1);
+
+    auto lattice = decoder.getLattice();
+    const auto& finalStates = lattice.getFinalStates();
+    ASSERT_EQ(finalStates.size(), results.size());
+    // Hypothesis share their prefixes
+    ASSERT_LT(lattice.nStates(), 1 + results.size() * (T + 1));
+    // Each final hypothesis is a path of the lattice
+    for (int i = 0; i < results.size(); ++i) {
+      double score =
+          getPathScore(lattice, finalStates[i], getWords(results[i]));
+      ASSERT_NEAR(score, results[i].score, 1e-5);
+    }
+    auto bestPath = getBestPath(lattice);
+    const std::vector<int> expectedWords = {0, 1};
+    ASSERT_EQ(bestPath.first, expectedWords);
+    ASSERT_NEAR(bestPath.second, results[0].score, 1e-5);
+  }
+}
+
+TEST(LatticeTest, MergedHypothesis) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+  LexiconDecoder decoder(
+      buildOptions(false), trie, lm, kSil, kBlank, -1, {}, false);
+  decoder.decode(emissions.data(), T, kN);
+  auto lattice = decoder.getLattice();
+  LexiconDecoder mergedDecoder(
+      buildOptions(true), trie, lm, kSil, kBlank, -1, {}, false);
+  auto results = mergedDecoder.decode(emissions.data(), T, kN);
+  auto mergedLattice = mergedDecoder.getLattice();
+
+  // The merged hypothesis add alternative alignments of the words, which
+  // score at most as the best one
+  ASSERT_GT(mergedLattice.getArcs().size(), lattice.getArcs().size());
+  int nAlignments = 0;
+  for (const auto& arc : mergedLattice.getArcs()) {
+    for (const auto& otherArc : mergedLattice.getArcs()) {
+      nAlignments += arc.to == otherArc.to && arc.label == otherArc.label &&
+          arc.label >= 0 && arc.startFrame < otherArc.startFrame;
+    }
+  }
+  ASSERT_GT(nAlignments, 0);
+  auto bestPath = getBestPath(mergedLattice);
+  ASSERT_EQ(bestPath.first, getWords(results[0]));
+  ASSERT_NEAR(bestPath.second, results[0].score, 1e-5);
+
+  // Pruning keeps the alternatives of the frames left, and the scores of the
+  // arcs
+  mergedDecoder.decodeBegin();
+  mergedDecoder.decodeStep(emissions.data(), 7, kN);
+  mergedDecoder.prune();
+  mergedDecoder.decodeStep(emissions.data() + 7 * kN, T - 7, kN);
+  mergedDecoder.decodeEnd();
+  auto prunedResults = mergedDecoder.getAllFinalHypothesis();
+  auto prunedLattice = mergedDecoder.getLattice();
+  const auto& finalStates = prunedLattice.getFinalStates();
+  // The results only cover the frames left
+  int nPrunedFrames = T + 1 - (prunedResults[0].words.size() - 1);
+  ASSERT_GT(nPrunedFrames, 0);
+  for (int i = 0; i < prunedResults.size(); ++i) {
+    std::vector<int> words;
+    for (int t = 1; t < prunedResults[i].words.size(); ++t) {
+      if (prunedResults[i].words[t] >= 0) {
+        words.push_back(prunedResults[i].words[t]);
+      }
+    }
+    double score =
+        getPathScore(prunedLattice, finalStates[i], words, nPrunedFrames);
+    ASSERT_NEAR(score, prunedResults[i].score, 1e-5);
+  }
+}
+
+TEST(LatticeTest, LexiconFreeDecoder) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  for (bool keepMergedHyps : {false, true}) {
+    LexiconFreeDecoderOptions opt = {
+        .beamSize = 10,
+        .beamSizeToken = kN,
+        .beamThreshold = 100,
+        .lmWeight = 0,
+        .silScore = 0,
+        .logAdd = false,
+        .criterionType = CriterionType::CTC,
+        .beamThresholdToken = 0,
+        .nExpansionThreads = 0,
+        .keepMergedHyps = keepMergedHyps};
+    LexiconFreeDecoder decoder(
+        opt, std::make_shared<ZeroLM>(), kSil, kBlank, {});
+    auto results = decoder.decode(emissions.data(), T, kN);
+    ASSERT_FALSE(results.empty());
+
+    auto lattice = decoder.getLattice();
+    auto path = getBestPath(lattice);
+    // The final silence is added by `decodeEnd()`
+    const std::vector<int> expectedTokens = {1, 2, 0, 3, 0};
+    ASSERT_EQ(path.first, expectedTokens);
+    ASSERT_NEAR(path.second, results[0].score, 1e-5);
+  }
+}
+
+TEST(LatticeTest, SaveLoad) {
+  Lattice lattice;
+  int s1 = lattice.addState();
+  int s2 = lattice.addState();
+  lattice.addArc({0, s1, 3, 0, 4, -1.5, -1.0, -0.5});
+  lattice.addArc({s1, s2, -1, 4, 6, -0.25, -0.25, 0});
+  lattice.addFinalState(s2);
+
+  const std::string path = getTmpPath("test.lattice");
+  lattice.save(path);
+  auto loaded = Lattice::load(path);
+  ASSERT_EQ(loaded.nStates(), 3);
+  ASSERT_EQ(loaded.getFinalStates(), std::vector<int>{s2});
+  ASSERT_EQ(loaded.getArcs().size(), 2);
+  const auto& arc = loaded.getArcs()[0];
+  ASSERT_EQ(arc.to, s1);
+  ASSERT_EQ(arc.label, 3);
+  ASSERT_EQ(arc.endFrame, 4);
+  ASSERT_EQ(arc.score, -1.5);
+  ASSERT_EQ(arc.lmScore, -0.5);
+
+  std::ostringstream text;
+  lattice.writeText(text);
+  ASSERT_EQ(text.str(), "0\t1\t4\t4\t1.5\n1\t2\t0\t0\t0.25\n2\t0\n");
+
+  ASSERT_THROW(Lattice::load(getTmpPath("missing.lattice")), std::exception);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
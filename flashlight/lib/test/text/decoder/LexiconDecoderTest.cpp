@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+// Tokens: 0 is the word separator, 1-3 are letters and 4 is the CTC blank
+const int kSil = 0;
+const int kBlank = 4;
+const int kN = 5;
+
+// Frames of a "<1 2> | <3>" utterance, where most frames are blank
+const std::vector<int> kFrameTokens =
+    {1, 4, 4, 4, 2, 4, 4, 4, 0, 4, 4, 4, 3, 4, 4};
+
+std::vector<float> buildEmissions() {
+  std::vector<float> emissions;
+  for (int token : kFrameTokens) {
+    for (int n = 0; n < kN; ++n) {
+      emissions.push_back(std::log(n == token ? 0.96 : 0.01));
+    }
+  }
+  return emissions;
+}
+
+TriePtr buildTrie() {
+  auto trie = std::make_shared<Trie>(kN, kSil);
+  trie->insert({1, 2}, 0, 0);
+  trie->insert({3}, 1, 0);
+  trie->insert({1, 3}, 2, 0);
+  trie->smear(SmearingMode::MAX);
+  return trie;
+}
+
+LexiconDecoderOptions buildOptions(
+    double blankSkipThreshold,
+    CriterionType criterionType = CriterionType::CTC) {
+  return {
+      .beamSize = 20,
+      .beamSizeToken = kN,
+      .beamThreshold = 100,
+      .lmWeight = 0,
+      .wordScore = 0,
+      .unkScore = -std::numeric_limits<float>::infinity(),
+      .silScore = 0,
+      .logAdd = false,
+      .criterionType = criterionType,
+      .beamThresholdToken = 0,
+      .blankSkipThreshold = blankSkipThreshold};
+}
+
+std::vector<int> getWords(const DecodeResult& result) {
+  std::vector<int> words;
+  for (int word : result.words) {
+    if (word >= 0) {
+      words.push_back(word);
+    }
+  }
+  return words;
+}
+
+} // namespace
+
+TEST(LexiconDecoderTest, DecodeBatch) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+  LexiconDecoder decoder(
+      buildOptions(0), trie, lm, kSil, kBlank, -1, {}, false);
+
+  // Each utterance of the batch is decoded as on its own, including the
+  // empty one
+  const std::vector<int> lengths = {T, 9, 0, T};
+  std::vector<const float*> batch(lengths.size(), emissions.data());
+  auto batchResults = decoder.decodeBatch(batch, lengths, kN);
+  ASSERT_EQ(batchResults.size(), lengths.size());
+  for (int b = 0; b < lengths.size(); ++b) {
+    auto results = decoder.decode(emissions.data(), lengths[b], kN);
+    ASSERT_EQ(batchResults[b].size(), results.size());
+    for (int i = 0; i < results.size(); ++i) {
+      ASSERT_EQ(batchResults[b][i].tokens, results[i].tokens);
+      ASSERT_EQ(batchResults[b][i].words, results[i].words);
+      ASSERT_NEAR(batchResults[b][i].score, results[i].score, 1e-5);
+    }
+  }
+
+  // A batch decoded in the middle of an online decoding does not change it
+  auto results = decoder.decode(emissions.data(), T, kN);
+  decoder.decodeBegin();
+  decoder.decodeStep(emissions.data(), 7, kN);
+  auto poolStats = decoder.getLMStatePoolStats();
+  decoder.decodeBatch(batch, lengths, kN);
+  ASSERT_EQ(
+      decoder.getLMStatePoolStats().nCreatedStates, poolStats.nCreatedStates);
+  ASSERT_EQ(decoder.getLMStatePoolStats().nLinks, poolStats.nLinks);
+  decoder.decodeStep(emissions.data() + 7 * kN, T - 7, kN);
+  decoder.decodeEnd();
+  auto onlineResults = decoder.getAllFinalHypothesis();
+  ASSERT_EQ(onlineResults.size(), results.size());
+  for (int i = 0; i < results.size(); ++i) {
+    ASSERT_EQ(onlineResults[i].tokens, results[i].tokens);
+    ASSERT_NEAR(onlineResults[i].score, results[i].score, 1e-5);
+  }
+
+  ASSERT_THROW(
+      decoder.decodeBatch({emissions.data()}, {T, T}, kN),
+      std::invalid_argument);
+  ASSERT_THROW(
+      decoder.decodeBatch({emissions.data()}, {-1}, kN),
+      std::invalid_argument);
+}
+
+TEST(LexiconDecoderTest, BlankSkipping) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+  const std::vector<int> expectedWords = {0, 1};
+
+  LexiconDecoder decoder(
+      buildOptions(0), trie, lm, kSil, kBlank, -1, {}, false);
+  auto results = decoder.decode(emissions.data(), T, kN);
+  ASSERT_FALSE(results.empty());
+  ASSERT_EQ(getWords(results[0]), expectedWords);
+  ASSERT_EQ(decoder.nSkippedFrames(), 0);
+
+  LexiconDecoder skipDecoder(
+      buildOptions(0.9), trie, lm, kSil, kBlank, -1, {}, false);
+  auto skipResults = skipDecoder.decode(emissions.data(), T, kN);
+  ASSERT_FALSE(skipResults.empty());
+  ASSERT_EQ(getWords(skipResults[0]), expectedWords);
+  ASSERT_EQ(skipResults[0].tokens, results[0].tokens);
+  ASSERT_NEAR(skipResults[0].score, results[0].score, 1e-5);
+  int nBlankFrames = 0;
+  for (int token : kFrameTokens) {
+    nBlankFrames += token == kBlank;
+  }
+  ASSERT_EQ(skipDecoder.nSkippedFrames(), nBlankFrames);
+
+  // The counter is reset by each decoding
+  skipDecoder.decode(emissions.data(), 4, kN);
+  ASSERT_EQ(skipDecoder.nSkippedFrames(), 3);
+
+  // The blank posterior is below the threshold
+  LexiconDecoder highThresholdDecoder(
+      buildOptions(0.99), trie, lm, kSil, kBlank, -1, {}, false);
+  highThresholdDecoder.decode(emissions.data(), T, kN);
+  ASSERT_EQ(highThresholdDecoder.nSkippedFrames(), 0);
+}
+
+TEST(LexiconDecoderTest, BlankSkippingBatch) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+
+  LexiconDecoder decoder(
+      buildOptions(0.9), trie, lm, kSil, kBlank, -1, {}, false);
+  auto results = decoder.decode(emissions.data(), T, kN);
+  auto batchResults = decoder.decodeBatch(
+      {emissions.data(), emissions.data()}, {T, 8}, kN);
+  ASSERT_EQ(batchResults.size(), 2);
+  ASSERT_EQ(batchResults[0][0].tokens, results[0].tokens);
+  ASSERT_NEAR(batchResults[0][0].score, results[0].score, 1e-5);
+  ASSERT_EQ(decoder.nSkippedFrames(), 11 + 6);
+}
+
+TEST(LexiconDecoderTest, BlankSkippingASG) {
+  auto emissions = buildEmissions();
+  const int T = kFrameTokens.size();
+  LexiconDecoder decoder(
+      buildOptions(0.9, CriterionType::ASG),
+      buildTrie(),
+      std::make_shared<ZeroLM>(),
+      kSil,
+      -1,
+      -1,
+      std::vector<float>(kN * kN, 0),
+      false);
+  decoder.decode(emissions.data(), T, kN);
+  ASSERT_EQ(decoder.nSkippedFrames(), 0);
+}
+
+TEST(LexiconDecoderTest, ParallelExpansion) {
+  // Noisy emissions, so that the beam is large enough to be split
+  const int T = 30;
+  std::mt19937 rng(1);
+  std::normal_distribution<float> distribution(0, 1);
+  std::vector<float> emissions(T * kN);
+  for (auto& emission : emissions) {
+    emission = distribution(rng);
+  }
+  auto trie = buildTrie();
+  auto lm = std::make_shared<ZeroLM>();
+  auto opt = buildOptions(0);
+  opt.beamSize = 500;
+
+  LexiconDecoder decoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+  auto results = decoder.decode(emissions.data(), T, kN);
+  ASSERT_GE(decoder.nHypothesis(), 4 * kMinExpansionHypsPerThread);
+
+  // The results do not depend on the number of threads
+  for (int nThreads : {2, 3, 8}) {
+    opt.nExpansionThreads = nThreads;
+    LexiconDecoder parallelDecoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+    auto parallelResults = parallelDecoder.decode(emissions.data(), T, kN);
+    ASSERT_EQ(parallelResults.size(), results.size());
+    for (int i = 0; i < results.size(); ++i) {
+      ASSERT_EQ(parallelResults[i].score, results[i].score);
+      ASSERT_EQ(parallelResults[i].tokens, results[i].tokens);
+      ASSERT_EQ(parallelResults[i].words, results[i].words);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/LexiconFreeSeq2SeqDecoder.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+// Tokens: 0-4 are letters and 5 is the end of sentence
+const int kN = 6;
+const int kEos = 5;
+const int kBeamSize = 8;
+const int kMaxOutputLength = 20;
+
+// Toy AM whose state is a hash of the tokens consumed so far
+int64_t updateState(int64_t state, int token) {
+  return (state * 31 + token + 7) % 1000003;
+}
+
+void scoreState(
+    const float* emissions,
+    int T,
+    int64_t state,
+    int step,
+    float* scores) {
+  for (int n = 0; n < kN; n++) {
+    scores[n] = emissions[(step % T) * kN + n] -
+        (state * 17 + n * 13) % 101 / 50.f;
+  }
+  scores[kEos] += 0.3f * step;
+}
+
+// Per-hypothesis update, with one AM state allocated for each hypothesis
+std::pair<std::vector<std::vector<float>>, std::vector<AMStatePtr>> amUpdate(
+    const float* emissions,
+    const int /* N */,
+    const int T,
+    const std::vector<int>& tokens,
+    const std::vector<AMStatePtr>& prevStates,
+    int& step) {
+  std::vector<std::vector<float>> scores(tokens.size());
+  std::vector<AMStatePtr> states(tokens.size());
+  for (int i = 0; i < tokens.size(); i++) {
+    int64_t state = updateState(
+        prevStates[i] ? *std::static_pointer_cast<int64_t>(prevStates[i]) : 1,
+        tokens[i]);
+    scores[i].resize(kN);
+    scoreState(emissions, T, state, step, scores[i].data());
+    states[i] = std::make_shared<int64_t>(state);
+  }
+  return {scores, states};
+}
+
+// Batched update, with the AM states stored in preallocated slots
+class SlotAM {
+ public:
+  explicit SlotAM(int nSlots) : slots_(nSlots), newSlots_(nSlots) {}
+
+  int operator()(
+      const std::vector<const float*>& emissions,
+      const int /* N */,
+      const std::vector<int>& T,
+      const std::vector<int>& utterances,
+      const std::vector<int>& tokens,
+      const std::vector<int>& prevSlots,
+      const int step,
+      std::vector<float>& scores) {
+    EXPECT_LE(tokens.size(), slots_.size());
+    ++nCalls;
+    scores.resize(tokens.size() * kN);
+    for (int i = 0; i < tokens.size(); i++) {
+      int64_t prevState = prevSlots[i] >= 0 ? slots_[prevSlots[i]] : 1;
+      newSlots_[i] = updateState(prevState, tokens[i]);
+      int b = utterances[i];
+      scoreState(emissions[b], T[b], newSlots_[i], step, &scores[i * kN]);
+    }
+    std::swap(slots_, newSlots_);
+    return kN;
+  }
+
+  int nCalls = 0;
+
+ private:
+  std::vector<int64_t> slots_;
+  std::vector<int64_t> newSlots_;
+};
+
+} // namespace
+
+TEST(LexiconFreeSeq2SeqDecoderTest, DecodeBatch) {
+  const std::vector<int> T = {12, 5, 30};
+  std::mt19937 rng(1);
+  std::normal_distribution<float> distribution(0, 1);
+  std::vector<std::vector<float>> emissions(T.size());
+  std::vector<const float*> emissionPtrs;
+  for (int b = 0; b < T.size(); b++) {
+    emissions[b].resize(T[b] * kN);
+    for (auto& emission : emissions[b]) {
+      emission = distribution(rng);
+    }
+    emissionPtrs.push_back(emissions[b].data());
+  }
+
+  auto slotAm = std::make_shared<SlotAM>(T.size() * kBeamSize);
+  LexiconFreeSeq2SeqDecoderOptions opt = {
+      .beamSize = kBeamSize,
+      .beamSizeToken = 4,
+      .beamThreshold = 100,
+      .lmWeight = 0,
+      .eosScore = 0,
+      .logAdd = false};
+  LexiconFreeSeq2SeqDecoder decoder(
+      opt,
+      std::make_shared<ZeroLM>(),
+      kEos,
+      amUpdate,
+      kMaxOutputLength,
+      [slotAm](
+          const std::vector<const float*>& emissions,
+          const int N,
+          const std::vector<int>& T,
+          const std::vector<int>& utterances,
+          const std::vector<int>& tokens,
+          const std::vector<int>& prevSlots,
+          const int step,
+          std::vector<float>& scores) {
+        return (*slotAm)(
+            emissions, N, T, utterances, tokens, prevSlots, step, scores);
+      });
+
+  // Decode twice to reuse the buffers
+  for (int i = 0; i < 2; i++) {
+    slotAm->nCalls = 0;
+    auto batchResults = decoder.decodeBatch(emissionPtrs, T, kN);
+    ASSERT_EQ(batchResults.size(), T.size());
+    ASSERT_LE(slotAm->nCalls, kMaxOutputLength);
+    for (int b = 0; b < T.size(); b++) {
+      auto results = decoder.decode(emissionPtrs[b], T[b], kN);
+      ASSERT_FALSE(results.empty());
+      ASSERT_EQ(batchResults[b].size(), results.size());
+      for (int j = 0; j < results.size(); j++) {
+        ASSERT_EQ(batchResults[b][j].score, results[j].score);
+        ASSERT_EQ(batchResults[b][j].tokens, results[j].tokens);
+      }
+    }
+  }
+
+  ASSERT_THROW(
+      decoder.decodeBatch(emissionPtrs, {12, 5}, kN), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
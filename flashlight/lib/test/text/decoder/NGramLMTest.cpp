@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+#include "flashlight/lib/text/decoder/lm/NGramLM.h"
+
+using fl::lib::getTmpPath;
+using namespace fl::lib::text;
+
+namespace {
+
+// The suffix (c b) of the trigram (a c b) and the prefix (b c) of the trigram
+// (b c a) are missing
+const std::string kArpa =
+    "\\data\\\n"
+    "ngram 1=6\n"
+    "ngram 2=5\n"
+    "ngram 3=4\n"
+    "\n"
+    "\\1-grams:\n"
+    "-1.0\t<unk>\t0\n"
+    "-99\t<s>\t-0.5\n"
+    "-0.8\t</s>\n"
+    "-0.6\ta\t-0.3\n"
+    "-0.7\tb\t-0.2\n"
+    "-0.9\tc\t-0.25\n"
+    "\n"
+    "\\2-grams:\n"
+    "-0.4\t<s> a\t-0.1\n"
+    "-0.5\ta b\t-0.15\n"
+    "-0.3\tb </s>\n"
+    "-0.45\ta c\t-0.05\n"
+    "-0.35\tc a\t-0.2\n"
+    "\n"
+    "\\3-grams:\n"
+    "-0.2\t<s> a b\n"
+    "-0.25\ta b </s>\n"
+    "-0.1\tb c a\n"
+    "-0.15\ta c b\n"
+    "\n"
+    "\\end\\\n";
+
+std::string writeFile(const std::string& name, const std::string& content) {
+  auto path = getTmpPath(name);
+  std::ofstream out(path);
+  out << content;
+  return path;
+}
+
+// Reference backoff model over the n-grams of the ARPA file
+struct ReferenceLM {
+  std::map<std::vector<std::string>, std::pair<float, float>> ngrams;
+
+  float prob(std::vector<std::string> context, const std::string& word) const {
+    auto ngram = context;
+    ngram.push_back(word);
+    auto it = ngrams.find(ngram);
+    if (it != ngrams.end()) {
+      return it->second.first;
+    }
+    if (context.empty()) {
+      return ngrams.at({"<unk>"}).first;
+    }
+    float backoff = 0;
+    auto ctx = ngrams.find(context);
+    if (ctx != ngrams.end()) {
+      backoff = ctx->second.second;
+    }
+    context.erase(context.begin());
+    return backoff + prob(context, word);
+  }
+
+  float sentence(const std::vector<std::string>& words, bool bos) const {
+    std::vector<std::string> history;
+    if (bos) {
+      history.push_back("<s>");
+    }
+    float score = 0;
+    auto sentence = words;
+    sentence.push_back("</s>");
+    for (const auto& word : sentence) {
+      std::vector<std::string> context(
+          history.size() > 2 ? history.end() - 2 : history.begin(),
+          history.end());
+      score += prob(context, ngrams.count({word}) ? word : "<unk>");
+      history.push_back(word);
+    }
+    return score;
+  }
+};
+
+ReferenceLM buildReference() {
+  ReferenceLM ref;
+  ref.ngrams = {
+      {{"<unk>"}, {-1.0, 0}},    {{"<s>"}, {-99, -0.5}},
+      {{"</s>"}, {-0.8, 0}},     {{"a"}, {-0.6, -0.3}},
+      {{"b"}, {-0.7, -0.2}},     {{"c"}, {-0.9, -0.25}},
+      {{"<s>", "a"}, {-0.4, -0.1}}, {{"a", "b"}, {-0.5, -0.15}},
+      {{"b", "</s>"}, {-0.3, 0}}, {{"a", "c"}, {-0.45, -0.05}},
+      {{"c", "a"}, {-0.35, -0.2}}, {{"<s>", "a", "b"}, {-0.2, 0}},
+      {{"a", "b", "</s>"}, {-0.25, 0}}, {{"b", "c", "a"}, {-0.1, 0}},
+      {{"a", "c", "b"}, {-0.15, 0}}};
+  return ref;
+}
+
+Dictionary buildDict() {
+  Dictionary dict;
+  for (const char* token : {"a", "b", "c", "x"}) {
+    dict.addEntry(token);
+  }
+  return dict;
+}
+
+// All the sentences of up to `maxLength` tokens of `nTokens` tokens
+std::vector<std::vector<int>> allSentences(int nTokens, int maxLength) {
+  std::vector<std::vector<int>> sentences{{}};
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    if (sentences[i].size() < maxLength) {
+      for (int token = 0; token < nTokens; ++token) {
+        auto sentence = sentences[i];
+        sentence.push_back(token);
+        sentences.push_back(sentence);
+      }
+    }
+  }
+  return sentences;
+}
+
+void checkSentenceScores(NGramLM& lm, const Dictionary& dict, float tol) {
+  auto ref = buildReference();
+  for (bool bos : {true, false}) {
+    for (const auto& sentence : allSentences(dict.indexSize(), 4)) {
+      std::vector<std::string> words;
+      auto state = lm.start(!bos);
+      float score = 0;
+      for (int token : sentence) {
+        words.push_back(dict.getEntry(token));
+        auto stateScore = lm.score(state, token);
+        state = stateScore.first;
+        score += stateScore.second;
+      }
+      score += lm.finish(state).second;
+      ASSERT_NEAR(score, ref.sentence(words, bos), tol);
+    }
+  }
+}
+
+} // namespace
+
+TEST(NGramLMTest, Model) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto model = NGramModel::fromArpa(path);
+  ASSERT_EQ(model->order(), 3);
+  ASSERT_EQ(model->vocabSize(), 6);
+  ASSERT_EQ(model->count(1), 6);
+  ASSERT_EQ(model->count(2), 7); // with (c b) and (b c)
+  ASSERT_EQ(model->count(3), 4);
+  for (int i = 0; i < model->vocabSize(); ++i) {
+    ASSERT_EQ(model->index(model->word(i)), i);
+  }
+  ASSERT_EQ(model->word(model->bos()), "<s>");
+  ASSERT_EQ(model->word(model->eos()), "</s>");
+  ASSERT_EQ(model->word(model->unk()), "<unk>");
+  ASSERT_EQ(model->index("d"), model->unk());
+  ASSERT_THROW(model->word(6), std::out_of_range);
+
+  // <s> a c b
+  NGramContext context, next;
+  model->beginSentence(context);
+  ASSERT_NEAR(model->score(context, model->index("a"), next), -0.4, 1e-6);
+  ASSERT_EQ(next.length, 2);
+  ASSERT_NEAR(model->score(next, model->index("c"), context), -0.55, 1e-6);
+  ASSERT_NEAR(model->score(context, model->index("b"), next), -0.15, 1e-6);
+}
+
+TEST(NGramLMTest, SentenceScores) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto dict = buildDict();
+  for (int bits : {8, 16, 32}) {
+    // Few distinct values, which quantization keeps exact
+    NGramLM lm(NGramModel::fromArpa(path, bits, bits), dict);
+    checkSentenceScores(lm, dict, 1e-5);
+  }
+}
+
+TEST(NGramLMTest, SaveLoad) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto binPath = getTmpPath("ngramlm_test.bin");
+  auto dict = buildDict();
+  for (int bits : {8, 32}) {
+    NGramModel::fromArpa(path, bits, 16)->save(binPath);
+    auto model = NGramModel::load(binPath);
+    ASSERT_EQ(model->count(2), 7);
+    NGramLM lm(model, dict);
+    checkSentenceScores(lm, dict, 1e-5);
+
+    // A loaded model can be saved again
+    auto binPath2 = getTmpPath("ngramlm_test2.bin");
+    model->save(binPath2);
+    NGramLM lm2(NGramModel::load(binPath2), dict);
+    checkSentenceScores(lm2, dict, 1e-5);
+  }
+
+  std::ofstream(binPath, std::ios::app) << "x";
+  ASSERT_THROW(NGramModel::load(binPath), std::runtime_error);
+  ASSERT_THROW(NGramModel::load(path), std::runtime_error);
+}
+
+TEST(NGramLMTest, LoadFingerprint) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto binPath = getTmpPath("ngramlm_test_fingerprint.bin");
+  auto dict = buildDict();
+  NGramModel::fromArpa(path)->save(binPath, 42);
+
+  ASSERT_EQ(NGramModel::loadFingerprint(binPath), 42);
+  NGramLM lm(NGramModel::load(binPath, 42), dict);
+  checkSentenceScores(lm, dict, 1e-5);
+  // A model built from other inputs is not used
+  ASSERT_THROW(NGramModel::load(binPath), std::runtime_error);
+  ASSERT_THROW(NGramModel::load(binPath, 43), std::runtime_error);
+}
+
+TEST(NGramLMTest, LoadOutOfRange) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto binPath = getTmpPath("ngramlm_test_range.bin");
+  auto model = NGramModel::fromArpa(path);
+  model->save(binPath);
+  std::string content;
+  {
+    std::ifstream in(binPath, std::ios::binary);
+    content.assign(
+        std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  // The header is followed by sections padded to 8 bytes: the vocabulary
+  // (offsets, characters and sorted indices), then for each order the first
+  // words of the n-grams (n > 1), their extensions (n < order), their
+  // probabilities and backoffs (n < order)
+  auto padded = [](size_t size) { return (size + 7) / 8 * 8; };
+  size_t vocabSize = model->vocabSize();
+  size_t vocabBytes = 0;
+  for (int i = 0; i < vocabSize; ++i) {
+    vocabBytes += model->word(i).size();
+  }
+  size_t vocabSectionsSize = padded((vocabSize + 1) * sizeof(uint32_t)) +
+      padded(vocabBytes) + padded(vocabSize * sizeof(uint32_t));
+  size_t unigramsSize = padded((vocabSize + 1) * sizeof(uint32_t)) +
+      2 * padded(vocabSize * sizeof(float));
+  size_t dataSize = vocabSectionsSize;
+  for (int n = 1; n <= model->order(); ++n) {
+    size_t count = model->count(n);
+    dataSize += (n > 1 ? padded(count * sizeof(uint32_t)) : 0) +
+        (n < model->order() ? padded((count + 1) * sizeof(uint32_t)) : 0) +
+        padded(count * sizeof(float)) +
+        (n < model->order() ? padded(count * sizeof(float)) : 0);
+  }
+  size_t headerSize = content.size() - dataSize;
+  // Make the extensions of the first unigram, or the first word of a bigram,
+  // point out of the arrays
+  size_t unigramExtensions = headerSize + vocabSectionsSize + sizeof(uint32_t);
+  size_t bigramWords = headerSize + vocabSectionsSize + unigramsSize;
+  for (size_t offset : {unigramExtensions, bigramWords}) {
+    std::string corrupted = content;
+    uint32_t value = 1 << 20;
+    std::memcpy(&corrupted[offset], &value, sizeof(value));
+    std::ofstream(binPath, std::ios::binary) << corrupted;
+    ASSERT_THROW(NGramModel::load(binPath), std::runtime_error);
+  }
+  // The extensions of a unigram must be sorted by first word
+  std::vector<uint32_t> childBegin(vocabSize + 1);
+  std::memcpy(
+      childBegin.data(),
+      &content[headerSize + vocabSectionsSize],
+      childBegin.size() * sizeof(uint32_t));
+  int nSwapped = 0;
+  for (int i = 0; i < vocabSize; ++i) {
+    if (childBegin[i + 1] - childBegin[i] < 2) {
+      continue;
+    }
+    std::string corrupted = content;
+    uint32_t words[2];
+    size_t offset = bigramWords + childBegin[i] * sizeof(uint32_t);
+    std::memcpy(words, &corrupted[offset], sizeof(words));
+    std::swap(words[0], words[1]);
+    std::memcpy(&corrupted[offset], words, sizeof(words));
+    std::ofstream(binPath, std::ios::binary) << corrupted;
+    ASSERT_THROW(NGramModel::load(binPath), std::runtime_error);
+    ++nSwapped;
+  }
+  ASSERT_GT(nSwapped, 0);
+  std::ofstream(binPath, std::ios::binary) << content;
+  NGramModel::load(binPath);
+}
+
+TEST(NGramLMTest, ScoreBatch) {
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  auto dict = buildDict();
+  NGramLM lm(NGramModel::fromArpa(path), dict);
+  auto pool = std::make_shared<LMStatePool>();
+  auto start = lm.start(false, pool);
+  std::vector<LMStatePtr> states;
+  std::vector<int> tokens;
+  for (int i = 0; i < dict.indexSize(); ++i) {
+    auto next = lm.score(start, i).first;
+    for (int j = 0; j < dict.indexSize(); ++j) {
+      states.push_back(next);
+      tokens.push_back(j);
+    }
+  }
+  std::vector<LMStatePtr> outStates(states.size());
+  std::vector<float> scores(states.size());
+  lm.scoreBatch(
+      states.data(),
+      tokens.data(),
+      states.size(),
+      outStates.data(),
+      scores.data());
+  for (int i = 0; i < states.size(); ++i) {
+    auto stateScore = lm.score(states[i], tokens[i]);
+    ASSERT_EQ(outStates[i], stateScore.first);
+    ASSERT_EQ(scores[i], stateScore.second);
+  }
+}
+
+TEST(NGramLMTest, Quantization) {
+  // Unigrams with distinct probabilities, evenly spread over [-6, -1]
+  const int nWords = 2000;
+  std::string arpa = "\\data\\\nngram 1=" + std::to_string(nWords + 2) +
+      "\n\n\\1-grams:\n-99\t<s>\t0\n-1\t</s>\n";
+  std::vector<float> probs;
+  for (int i = 0; i < nWords; ++i) {
+    probs.push_back(-1 - 5.0 * i / nWords);
+    arpa += std::to_string(probs.back()) + "\tw" + std::to_string(i) + "\n";
+  }
+  arpa += "\n\\end\\\n";
+  auto path = writeFile("ngramlm_test_quant.arpa", arpa);
+
+  for (int bits : {8, 16}) {
+    auto model = NGramModel::fromArpa(path, bits, 32);
+    ASSERT_EQ(model->vocabSize(), nWords + 3); // with <unk>
+    NGramContext context, next;
+    context.length = 0;
+    float maxError = 0;
+    for (int i = 0; i < nWords; ++i) {
+      int word = model->index("w" + std::to_string(i));
+      float error = std::abs(model->score(context, word, next) - probs[i]);
+      maxError = std::max(maxError, error);
+    }
+    // 2^bits bins of nearly uniform values
+    ASSERT_LT(maxError, bits == 8 ? 0.02 : 1e-5);
+    ASSERT_NEAR(model->score(context, model->unk(), next), -100, 0.5);
+  }
+
+  auto path8 = getTmpPath("ngramlm_test_quant8.bin");
+  auto path32 = getTmpPath("ngramlm_test_quant32.bin");
+  NGramModel::fromArpa(path, 8, 8)->save(path8);
+  NGramModel::fromArpa(path, 32, 32)->save(path32);
+  std::ifstream in8(path8, std::ios::binary | std::ios::ate);
+  std::ifstream in32(path32, std::ios::binary | std::ios::ate);
+  ASSERT_LT(in8.tellg(), in32.tellg());
+}
+
+TEST(NGramLMTest, InvalidArpa) {
+  auto truncated = writeFile(
+      "ngramlm_test_invalid.arpa", kArpa.substr(0, kArpa.size() / 2));
+  ASSERT_THROW(NGramModel::fromArpa(truncated), std::runtime_error);
+  auto path = writeFile("ngramlm_test.arpa", kArpa);
+  ASSERT_THROW(NGramModel::fromArpa(path, 4, 8), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
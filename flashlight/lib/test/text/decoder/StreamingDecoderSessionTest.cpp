@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/StreamingDecoderSession.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+// Tokens: 0 is the word separator, 1-3 are letters and 4 is the CTC blank
+const int kSil = 0;
+const int kBlank = 4;
+const int kN = 5;
+
+// Frames of a "<1 2> | <3> |" utterance, repeated to build a long stream
+const std::vector<int> kFrameTokens =
+    {1, 4, 4, 2, 4, 4, 0, 4, 4, 3, 4, 4, 0, 4, 4};
+const int kNRepeats = 40;
+
+std::vector<float> buildEmissions() {
+  std::vector<float> emissions;
+  for (int r = 0; r < kNRepeats; ++r) {
+    for (int token : kFrameTokens) {
+      for (int n = 0; n < kN; ++n) {
+        emissions.push_back(std::log(n == token ? 0.96 : 0.01));
+      }
+    }
+  }
+  return emissions;
+}
+
+std::shared_ptr<LexiconDecoder> buildDecoder() {
+  auto trie = std::make_shared<Trie>(kN, kSil);
+  trie->insert({1, 2}, 0, 0);
+  trie->insert({3}, 1, 0);
+  trie->insert({1, 3}, 2, 0);
+  trie->smear(SmearingMode::MAX);
+  LexiconDecoderOptions opt = {
+      .beamSize = 10,
+      .beamSizeToken = kN,
+      .beamThreshold = 100,
+      .lmWeight = 0,
+      .wordScore = 0,
+      .unkScore = -std::numeric_limits<float>::infinity(),
+      .silScore = 0,
+      .logAdd = false,
+      .criterionType = CriterionType::CTC,
+      .beamThresholdToken = 0,
+      .blankSkipThreshold = 0};
+  return std::make_shared<LexiconDecoder>(
+      opt,
+      trie,
+      std::make_shared<ZeroLM>(),
+      kSil,
+      kBlank,
+      -1,
+      std::vector<float>{},
+      false);
+}
+
+void append(DecodeResult& result, const DecodeResult& chunk) {
+  result.words.insert(
+      result.words.end(), chunk.words.begin(), chunk.words.end());
+  result.tokens.insert(
+      result.tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+}
+
+} // namespace
+
+TEST(StreamingDecoderSessionTest, BoundedBuffer) {
+  auto emissions = buildEmissions();
+  const int T = emissions.size() / kN;
+  auto decoder = buildDecoder();
+  auto offline = decoder->decode(emissions.data(), T, kN);
+  ASSERT_FALSE(offline.empty());
+
+  const int maxBufferedFrames = kLookBackLimit + 20;
+  StreamingDecoderSession session(
+      *decoder,
+      {.pruneInterval = 0,
+       .lookBack = 5,
+       .maxBufferedFrames = maxBufferedFrames});
+  DecodeResult stable;
+  int nPartialResults = 0;
+  session.setStableResultCallback([&](const DecodeResult& result) {
+    ASSERT_LE(decoder->nDecodedFramesInBuffer(), maxBufferedFrames);
+    append(stable, result);
+  });
+  session.setPartialResultCallback([&](const DecodeResult& result) {
+    ASSERT_LT(decoder->nDecodedFramesInBuffer(), maxBufferedFrames);
+    ++nPartialResults;
+  });
+
+  session.begin();
+  const int chunkSize = 37;
+  for (int t = 0; t < T; t += chunkSize) {
+    session.step(emissions.data() + t * kN, std::min(chunkSize, T - t), kN);
+  }
+  auto last = session.end();
+  ASSERT_LE(decoder->nDecodedFramesInBuffer(), maxBufferedFrames);
+  ASSERT_GE(session.nPrunes(), T / maxBufferedFrames);
+  ASSERT_EQ(nPartialResults, (T + chunkSize - 1) / chunkSize);
+  ASSERT_EQ(session.nDecodedFrames(), T);
+
+  // The stable results cover the whole stream, with one entry per frame
+  ASSERT_EQ(session.nStableFrames(), T + 2);
+  ASSERT_EQ(stable.words.size(), T + 2);
+  ASSERT_EQ(stable.tokens, offline[0].tokens);
+  ASSERT_EQ(stable.words, offline[0].words);
+  ASSERT_TRUE(std::equal(
+      last.words.begin(),
+      last.words.end(),
+      stable.words.end() - last.words.size()));
+}
+
+TEST(StreamingDecoderSessionTest, PruneInterval) {
+  auto emissions = buildEmissions();
+  const int T = emissions.size() / kN;
+  auto decoder = buildDecoder();
+  auto offline = decoder->decode(emissions.data(), T, kN);
+
+  StreamingDecoderSession session(
+      *decoder, {.pruneInterval = 30, .lookBack = 10, .maxBufferedFrames = 0});
+  DecodeResult stable;
+  session.setStableResultCallback(
+      [&](const DecodeResult& result) { append(stable, result); });
+  session.begin();
+  session.step(emissions.data(), T, kN);
+  session.end();
+  ASSERT_EQ(session.nPrunes(), T / 30);
+  ASSERT_EQ(stable.tokens, offline[0].tokens);
+
+  // The session can be reused for a new stream
+  stable = DecodeResult();
+  session.begin();
+  session.step(emissions.data(), 50, kN);
+  session.end();
+  ASSERT_EQ(session.nDecodedFrames(), 50);
+  ASSERT_EQ(stable.tokens.size(), 52);
+}
+
+TEST(StreamingDecoderSessionTest, LexiconFreeDecoder) {
+  auto emissions = buildEmissions();
+  const int T = emissions.size() / kN;
+  LexiconFreeDecoderOptions opt = {
+      .beamSize = 10,
+      .beamSizeToken = kN,
+      .beamThreshold = 100,
+      .lmWeight = 0,
+      .silScore = 0,
+      .logAdd = false,
+      .criterionType = CriterionType::CTC,
+      .beamThresholdToken = 0};
+  LexiconFreeDecoder decoder(opt, std::make_shared<ZeroLM>(), kSil, kBlank, {});
+  auto offline = decoder.decode(emissions.data(), T, kN);
+
+  StreamingDecoderSession session(
+      decoder, {.pruneInterval = 16, .lookBack = 4, .maxBufferedFrames = 0});
+  DecodeResult stable;
+  session.setStableResultCallback(
+      [&](const DecodeResult& result) { append(stable, result); });
+  session.begin();
+  for (int t = 0; t < T; t += 5) {
+    session.step(emissions.data() + t * kN, std::min(5, T - t), kN);
+  }
+  session.end();
+  ASSERT_LE(decoder.nDecodedFramesInBuffer(), 16 + 4 + 2);
+  ASSERT_EQ(stable.tokens, offline[0].tokens);
+}
+
+TEST(StreamingDecoderSessionTest, InvalidOptions) {
+  auto decoder = buildDecoder();
+  ASSERT_THROW(
+      StreamingDecoderSession(
+          *decoder,
+          {.pruneInterval = -1, .lookBack = 0, .maxBufferedFrames = 0}),
+      std::invalid_argument);
+  // The buffer is too small to prune at a word boundary
+  ASSERT_THROW(
+      StreamingDecoderSession(
+          *decoder,
+          {.pruneInterval = 0, .lookBack = 10, .maxBufferedFrames = 100}),
+      std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/TokenSelection.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+const std::vector<TokenSelectionKernel> kKernels = {
+    TokenSelectionKernel::AUTO,
+    TokenSelectionKernel::SCALAR,
+    TokenSelectionKernel::AVX2,
+    TokenSelectionKernel::AVX512};
+
+// Reference selection of a single frame
+std::vector<int>
+referenceTopK(const float* emissions, int N, int k, double threshold) {
+  std::vector<int> idx(N);
+  std::iota(idx.begin(), idx.end(), 0);
+  std::sort(idx.begin(), idx.end(), [emissions](int l, int r) {
+    return emissions[l] > emissions[r] ||
+        (emissions[l] == emissions[r] && l < r);
+  });
+  idx.resize(std::min(k, N));
+  if (threshold > 0) {
+    float best = *std::max_element(emissions, emissions + N);
+    idx.erase(
+        std::remove_if(
+            idx.begin(),
+            idx.end(),
+            [&](int n) { return emissions[n] < best - threshold; }),
+        idx.end());
+  }
+  return idx;
+}
+
+void checkSelection(
+    const std::vector<float>& emissions,
+    int T,
+    int N,
+    int k,
+    double threshold) {
+  for (auto kernel : kKernels) {
+    if (!isTokenSelectionKernelSupported(kernel)) {
+      continue;
+    }
+    int kk = std::min(k, N);
+    std::vector<int> tokens(T * kk, -1);
+    std::vector<int> nTokens(T, -1);
+    selectTopKTokens(
+        emissions.data(),
+        T,
+        N,
+        k,
+        threshold,
+        tokens.data(),
+        nTokens.data(),
+        kernel);
+    for (int t = 0; t < T; ++t) {
+      auto expected = referenceTopK(emissions.data() + t * N, N, k, threshold);
+      ASSERT_EQ(nTokens[t], expected.size())
+          << "kernel " << static_cast<int>(kernel) << " frame " << t;
+      for (int i = 0; i < nTokens[t]; ++i) {
+        ASSERT_EQ(tokens[t * kk + i], expected[i])
+            << "kernel " << static_cast<int>(kernel) << " frame " << t;
+      }
+    }
+  }
+}
+
+std::vector<float> randomEmissions(int size, int nValues, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(0, nValues - 1);
+  std::vector<float> emissions(size);
+  for (auto& e : emissions) {
+    // Few distinct values, so that there are many ties
+    e = dist(gen) * 0.25 - 10;
+  }
+  return emissions;
+}
+
+} // namespace
+
+TEST(TokenSelectionTest, TopK) {
+  for (int N : {1, 5, 8, 17, 31, 64, 100, 1000}) {
+    for (int k : {1, 3, 16, 50, 2000}) {
+      int T = 7;
+      checkSelection(randomEmissions(T * N, 1000, N * k), T, N, k, 0);
+    }
+  }
+}
+
+TEST(TokenSelectionTest, Ties) {
+  for (int N : {9, 33, 200}) {
+    for (int k : {1, 4, 40}) {
+      int T = 5;
+      checkSelection(randomEmissions(T * N, 3, N + k), T, N, k, 0);
+    }
+  }
+}
+
+TEST(TokenSelectionTest, Threshold) {
+  for (int N : {7, 40, 500}) {
+    for (double threshold : {0.1, 1.0, 5.0, 100.0}) {
+      int T = 6;
+      checkSelection(randomEmissions(T * N, 80, N), T, N, 20, threshold);
+    }
+  }
+}
+
+TEST(TokenSelectionTest, Kernels) {
+  ASSERT_TRUE(isTokenSelectionKernelSupported(TokenSelectionKernel::AUTO));
+  ASSERT_TRUE(isTokenSelectionKernelSupported(TokenSelectionKernel::SCALAR));
+  for (auto kernel : kKernels) {
+    if (isTokenSelectionKernelSupported(kernel)) {
+      continue;
+    }
+    std::vector<float> emissions(10);
+    std::vector<int> tokens(10);
+    int nTokens;
+    ASSERT_THROW(
+        selectTopKTokens(
+            emissions.data(),
+            1,
+            10,
+            10,
+            0,
+            tokens.data(),
+            &nTokens,
+            kernel),
+        std::invalid_argument);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/Utils.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+struct TestState {
+  double score;
+  int key;
+  int payload;
+
+  TestState(double score, int key, int payload)
+      : score(score), key(key), payload(payload) {}
+
+  int compareNoScoreStates(const TestState* node) const {
+    return key == node->key ? 0 : (key > node->key ? 1 : -1);
+  }
+
+  size_t hashNoScoreState() const {
+    // Few distinct hashes, so that the index has to handle collisions
+    return key % 3;
+  }
+};
+
+struct Candidates {
+  std::vector<TestState> candidates;
+  std::vector<TestState*> candidatePtrs;
+  CandidateIndex candidateIndex;
+  double bestScore;
+
+  void reset() {
+    candidatesReset(bestScore, candidates, candidatePtrs, candidateIndex);
+  }
+
+  void add(
+      double score,
+      int key,
+      int payload,
+      bool logAdd,
+      double beamThreshold = 1000.0) {
+    candidatesAdd(
+        candidates,
+        candidateIndex,
+        bestScore,
+        beamThreshold,
+        logAdd,
+        score,
+        key,
+        payload);
+  }
+};
+
+// Candidates merged after they are all added, by sorting them, as the
+// decoders did before merging them through the index
+std::vector<TestState> sortMergeStore(
+    std::vector<TestState> candidates,
+    int beamSize,
+    double threshold,
+    bool logAdd) {
+  std::vector<TestState*> ptrs;
+  for (auto& candidate : candidates) {
+    if (candidate.score >= threshold) {
+      ptrs.push_back(&candidate);
+    }
+  }
+  std::sort(ptrs.begin(), ptrs.end(), [](TestState* lhs, TestState* rhs) {
+    int cmp = lhs->compareNoScoreStates(rhs);
+    return cmp == 0 ? lhs->score > rhs->score : cmp > 0;
+  });
+  std::vector<TestState*> merged;
+  for (auto* ptr : ptrs) {
+    if (merged.empty() || merged.back()->compareNoScoreStates(ptr) != 0) {
+      merged.push_back(ptr);
+      continue;
+    }
+    double maxScore = std::max(merged.back()->score, ptr->score);
+    if (logAdd) {
+      double minScore = std::min(merged.back()->score, ptr->score);
+      merged.back()->score =
+          maxScore + std::log1p(std::exp(minScore - maxScore));
+    } else {
+      merged.back()->score = maxScore;
+    }
+  }
+  std::sort(merged.begin(), merged.end(), [](TestState* lhs, TestState* rhs) {
+    return lhs->score > rhs->score;
+  });
+  std::vector<TestState> outputs;
+  for (int i = 0; i < std::min<int>(beamSize, merged.size()); ++i) {
+    outputs.push_back(*merged[i]);
+  }
+  return outputs;
+}
+
+} // namespace
+
+TEST(UtilsTest, CandidatesMerge) {
+  for (bool logAdd : {false, true}) {
+    Candidates c;
+    // Run several frames to reuse the index
+    for (int frame = 0; frame < 3; ++frame) {
+      c.reset();
+      for (int key = 0; key < 200; ++key) {
+        c.add(-key, key, 0, logAdd);
+      }
+      c.add(-2.0, 5, 1, logAdd); // Better than the existing candidate
+      c.add(-7.0, 5, 2, logAdd); // Worse than both
+      c.add(-1.0, 1, 3, logAdd); // Same score
+      ASSERT_EQ(c.candidates.size(), 200);
+
+      std::vector<TestState> outputs;
+      candidatesStore(
+          c.candidates,
+          c.candidatePtrs,
+          c.candidateIndex,
+          outputs,
+          10,
+          c.bestScore - 1000,
+          true);
+      ASSERT_EQ(outputs.size(), 10);
+      for (int i = 1; i < outputs.size(); ++i) {
+        ASSERT_GE(outputs[i - 1].score, outputs[i].score);
+      }
+
+      auto key5 = std::find_if(
+          outputs.begin(), outputs.end(), [](const TestState& state) {
+            return state.key == 5;
+          });
+      ASSERT_NE(key5, outputs.end());
+      // The fields of the best candidate are kept
+      ASSERT_EQ(key5->payload, 1);
+      double expected = logAdd
+          ? std::log(std::exp(-5.0) + std::exp(-2.0) + std::exp(-7.0))
+          : -2.0;
+      ASSERT_NEAR(key5->score, expected, 1e-9);
+
+      auto key1 = std::find_if(
+          outputs.begin(), outputs.end(), [](const TestState& state) {
+            return state.key == 1;
+          });
+      ASSERT_NE(key1, outputs.end());
+      ASSERT_EQ(key1->payload, 0);
+      ASSERT_NEAR(key1->score, logAdd ? -1.0 + std::log(2.0) : -1.0, 1e-9);
+    }
+  }
+}
+
+TEST(UtilsTest, CandidatesThreshold) {
+  Candidates c;
+  c.reset();
+  c.add(-1, 0, 0, false);
+  c.add(-1500, 1, 0, false); // Below the beam threshold
+  c.add(-50, 2, 0, false);
+  ASSERT_EQ(c.candidates.size(), 2);
+
+  std::vector<TestState> outputs;
+  candidatesStore(
+      c.candidates,
+      c.candidatePtrs,
+      c.candidateIndex,
+      outputs,
+      10,
+      c.bestScore - 20,
+      false);
+  ASSERT_EQ(outputs.size(), 1);
+  ASSERT_EQ(outputs[0].key, 0);
+}
+
+TEST(UtilsTest, CandidatesMergeAsSorted) {
+  // The scores increase over time, so that candidates merged early end up
+  // below the final threshold, while the others of their key are above it
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> noise(0.0, 10.0);
+  Candidates c;
+  for (bool logAdd : {false, true}) {
+    for (int run = 0; run < 20; ++run) {
+      c.reset();
+      std::vector<TestState> added;
+      for (int i = 0; i < 500; ++i) {
+        double score = 0.02 * i + noise(gen);
+        int key = gen() % 40;
+        c.add(score, key, i, logAdd, 8.0);
+        // Candidates below the threshold when added are dropped
+        if (score >= c.bestScore - 8.0) {
+          added.emplace_back(score, key, i);
+        }
+      }
+      double threshold = c.bestScore - 8.0;
+      auto expected = sortMergeStore(added, 10, threshold, logAdd);
+
+      std::vector<TestState> outputs;
+      candidatesStore(
+          c.candidates,
+          c.candidatePtrs,
+          c.candidateIndex,
+          outputs,
+          10,
+          threshold,
+          true);
+      ASSERT_EQ(outputs.size(), expected.size());
+      for (int i = 0; i < outputs.size(); ++i) {
+        ASSERT_EQ(outputs[i].key, expected[i].key);
+        ASSERT_EQ(outputs[i].payload, expected[i].payload);
+        ASSERT_EQ(outputs[i].score, expected[i].score);
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -5,14 +5,21 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <string>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+#include "flashlight/lib/text/dictionary/StringTable.h"
 #include "flashlight/lib/text/dictionary/Utils.h"
 
+using fl::lib::getTmpPath;
 using fl::lib::pathsConcat;
 using namespace fl::lib::text;
 
@@ -80,6 +87,169 @@ TEST(DictionaryTest, Dictionary) {
   ASSERT_EQ(dict.indexSize(), 5);
 }
 
+TEST(DictionaryTest, StringTable) {
+  std::vector<std::string> strings = {"a", "", "bc", "\xc3\xa9", "abc"};
+  StringTable table(strings);
+  ASSERT_EQ(table.size(), strings.size());
+  for (int i = 0; i < strings.size(); ++i) {
+    ASSERT_EQ(table.get(i), strings[i]);
+    ASSERT_EQ(table.find(strings[i]), i);
+  }
+  ASSERT_EQ(table.find("ab"), -1);
+  ASSERT_THROW(table.get(5), std::out_of_range);
+  ASSERT_THROW(StringTable({"a", "b", "a"}), std::invalid_argument);
+}
+
+TEST(DictionaryTest, Binary) {
+  auto path = getTmpPath("dictionary_test.bin");
+  Dictionary dict(pathsConcat(loadPath, "test.dict"));
+  ASSERT_FALSE(Dictionary::isBinaryFile(pathsConcat(loadPath, "test.dict")));
+  dict.saveBinary(path);
+  ASSERT_TRUE(Dictionary::isBinaryFile(path));
+
+  Dictionary binDict(path);
+  ASSERT_EQ(binDict.entrySize(), dict.entrySize());
+  ASSERT_EQ(binDict.indexSize(), dict.indexSize());
+  ASSERT_TRUE(binDict.isContiguous());
+  for (int idx = 0; idx < dict.indexSize(); ++idx) {
+    ASSERT_EQ(binDict.getEntry(idx), dict.getEntry(idx));
+  }
+  for (const char* entry : {"a", "b", "c", "d", "e", "f", "g", "h", "i"}) {
+    ASSERT_EQ(binDict.contains(entry), dict.contains(entry));
+    if (dict.contains(entry)) {
+      ASSERT_EQ(binDict.getIndex(entry), dict.getIndex(entry));
+    }
+  }
+  ASSERT_FALSE(binDict.contains("q"));
+  ASSERT_THROW(binDict.getIndex("q"), std::invalid_argument);
+  ASSERT_THROW(binDict.getEntry(dict.indexSize()), std::invalid_argument);
+  binDict.setDefaultIndex(2);
+  ASSERT_EQ(binDict.getIndex("q"), 2);
+
+  // Adding entries copies the binary dictionary
+  Dictionary copy = binDict;
+  copy.addEntry("q");
+  ASSERT_EQ(copy.getIndex("q"), dict.indexSize());
+  ASSERT_EQ(copy.getIndex("a"), dict.getIndex("a"));
+  ASSERT_EQ(copy.entrySize(), dict.entrySize() + 1);
+  ASSERT_EQ(binDict.entrySize(), dict.entrySize());
+  ASSERT_THROW(copy.addEntry("a"), std::invalid_argument);
+
+  // A binary dictionary can be saved again
+  auto path2 = getTmpPath("dictionary_test2.bin");
+  binDict.saveBinary(path2);
+  Dictionary binDict2(path2);
+  ASSERT_EQ(binDict2.getIndex("e"), dict.getIndex("e"));
+
+  std::ofstream(path, std::ios::app) << "x";
+  ASSERT_THROW(Dictionary{path}, std::runtime_error);
+
+  Dictionary sparse;
+  sparse.addEntry("a", 0);
+  sparse.addEntry("b", 2);
+  ASSERT_THROW(sparse.saveBinary(path), std::runtime_error);
+}
+
+TEST(DictionaryTest, BinaryLexicon) {
+  LexiconMap lexicon = {
+      {"hello", {{"h", "e", "l", "l", "o"}, {"h", "a", "l", "o"}}},
+      {"world", {{"w", "o", "r", "l", "d"}}},
+      {kUnkToken, {}}};
+  auto path = getTmpPath("lexicon_test.bin");
+  BinaryLexicon::save(lexicon, path);
+  ASSERT_TRUE(BinaryLexicon::isBinaryFile(path));
+  ASSERT_FALSE(Dictionary::isBinaryFile(path));
+
+  auto binLexicon = BinaryLexicon::load(path);
+  ASSERT_EQ(binLexicon->size(), lexicon.size());
+  ASSERT_EQ(binLexicon->getTokens()->size(), 8);
+  int hello = binLexicon->find("hello");
+  ASSERT_GE(hello, 0);
+  ASSERT_EQ(binLexicon->find("hallo"), -1);
+  ASSERT_EQ(binLexicon->nSpellings(hello), 2);
+  ASSERT_EQ(binLexicon->spellingSize(hello, 1), 4);
+  ASSERT_EQ(binLexicon->getSpelling(hello, 1), lexicon["hello"][1]);
+  auto tokens = binLexicon->getSpellingTokens(hello, 0);
+  ASSERT_EQ(binLexicon->getTokens()->get(tokens[4]), "o");
+  ASSERT_EQ(binLexicon->nSpellings(binLexicon->find(kUnkToken)), 0);
+  ASSERT_EQ(binLexicon->toLexiconMap(), lexicon);
+  ASSERT_EQ(loadWords(path), lexicon);
+  ASSERT_EQ(loadWords(path, 1).size(), 2); // with <unk>
+
+  // Same word indices as the dictionary of the LexiconMap
+  auto wordDict = createWordDict(lexicon);
+  auto binWordDict = createWordDict(*binLexicon);
+  ASSERT_EQ(binWordDict.indexSize(), wordDict.indexSize());
+  for (const auto& it : lexicon) {
+    ASSERT_EQ(binWordDict.getIndex(it.first), wordDict.getIndex(it.first));
+  }
+  ASSERT_EQ(binWordDict.getIndex("hallo"), wordDict.getIndex(kUnkToken));
+
+  // A truncated lexicon keeps the word indices of the binary lexicon, as with
+  // --maxword in Decode
+  auto truncated = binLexicon->toLexiconMap(1);
+  for (const auto& it : truncated) {
+    ASSERT_EQ(binWordDict.getIndex(it.first), binLexicon->find(it.first));
+  }
+
+  std::ofstream(path, std::ios::app) << "x";
+  ASSERT_THROW(BinaryLexicon::load(path), std::runtime_error);
+}
+
+TEST(DictionaryTest, BinaryLexiconWithoutUnk) {
+  LexiconMap lexicon = {
+      {"hello", {{"h", "e", "l", "l", "o"}}}, {"world", {{"w", "o", "r"}}}};
+  auto path = getTmpPath("lexicon_test_nounk.bin");
+  BinaryLexicon::save(lexicon, path);
+  auto binLexicon = BinaryLexicon::load(path);
+  ASSERT_EQ(binLexicon->find(kUnkToken), -1);
+
+  // The unknown word is added, as by loadWords()
+  auto binWordDict = createWordDict(*binLexicon);
+  ASSERT_EQ(binWordDict.indexSize(), 3);
+  ASSERT_EQ(binWordDict.getIndex(kUnkToken), 2);
+  ASSERT_EQ(binWordDict.getIndex("hallo"), 2);
+  ASSERT_EQ(binWordDict.getIndex("world"), binLexicon->find("world"));
+  ASSERT_EQ(
+      binWordDict.indexSize(), createWordDict(loadWords(path)).indexSize());
+}
+
+TEST(DictionaryTest, BinaryLexiconOutOfRange) {
+  LexiconMap lexicon = {
+      {"hello", {{"h", "e", "l", "l", "o"}, {"h", "a", "l", "o"}}},
+      {"world", {{"w", "o", "r", "l", "d"}}}};
+  auto path = getTmpPath("lexicon_test_range.bin");
+  BinaryLexicon::save(lexicon, path);
+  std::string content;
+  {
+    std::ifstream in(path, std::ios::binary);
+    content.assign(
+        std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  // The file ends with the spelling ranges of the 2 words, the token ranges
+  // of the 3 spellings and the 14 tokens of the spellings (each padded to 8
+  // bytes)
+  size_t spellingTokens = content.size() - 14 * sizeof(uint32_t);
+  size_t tokenBegin = spellingTokens - 4 * sizeof(uint64_t);
+  size_t spellingBegin = tokenBegin - 3 * sizeof(uint64_t);
+  auto corrupt = [&](size_t offset, const void* value, size_t size) {
+    std::string corrupted = content;
+    std::memcpy(&corrupted[offset], value, size);
+    std::ofstream(path, std::ios::binary) << corrupted;
+  };
+  uint64_t large = 1 << 20;
+  uint32_t largeToken = 1 << 20;
+  uint64_t backwards[2] = {2, 1};
+  corrupt(spellingBegin + sizeof(uint64_t), &large, sizeof(large));
+  ASSERT_THROW(BinaryLexicon::load(path), std::runtime_error);
+  corrupt(tokenBegin + sizeof(uint64_t), backwards, sizeof(backwards));
+  ASSERT_THROW(BinaryLexicon::load(path), std::runtime_error);
+  corrupt(spellingTokens, &largeToken, sizeof(largeToken));
+  ASSERT_THROW(BinaryLexicon::load(path), std::runtime_error);
+  std::ofstream(path, std::ios::binary) << content;
+  ASSERT_EQ(BinaryLexicon::load(path)->size(), 2);
+}
+
 TEST(DictionaryTest, PackReplabels) {
   Dictionary dict;
   dict.addEntry("<1>", 1);
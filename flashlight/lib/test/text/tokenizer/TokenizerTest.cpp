@@ -10,6 +10,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/common/System.h"
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
 
@@ -54,6 +56,32 @@ TEST(PartialFileReaderTest, Reading) {
   }
 }
 
+TEST(PartialFileReaderTest, PartRange) {
+  auto path = fl::lib::pathsConcat(loadPath, "test.txt");
+  fl::lib::MemoryMappedFile file(path);
+  for (int totalReaders = 1; totalReaders < 8; ++totalReaders) {
+    size_t begin = 0;
+    for (int rank = 0; rank < totalReaders; ++rank) {
+      auto range = fl::lib::text::PartialFileReader::getPartRange(
+          file.data(), file.size(), rank, totalReaders);
+      ASSERT_EQ(range.first, begin);
+      // Same lines as the reader
+      fl::lib::text::PartialFileReader reader(rank, totalReaders);
+      reader.loadFile(path);
+      if (range.first < range.second) {
+        ASSERT_EQ(reader.getPosition(), range.first);
+      }
+      reader.getLines();
+      begin = range.second;
+      if (begin < file.size()) {
+        ASSERT_EQ(reader.getPosition(), range.second);
+        ASSERT_EQ(file.data()[begin - 1], '\n');
+      }
+    }
+    ASSERT_EQ(begin, file.size());
+  }
+}
+
 TEST(TokenizerTest, Counting) {
   auto tokenizer = fl::lib::text::Tokenizer();
   tokenizer.countTokens(fl::lib::pathsConcat(loadPath, "test.txt"), 2);
@@ -65,6 +93,61 @@ TEST(TokenizerTest, Counting) {
   ASSERT_EQ(dict.size(), 2);
 }
 
+TEST(TokenizerTest, CountingWorkers) {
+  auto path = fl::lib::pathsConcat(loadPath, "test.txt");
+  auto tokenizer = fl::lib::text::Tokenizer();
+  tokenizer.countTokens(path, 1, true);
+  auto metaData = tokenizer.getTextFileMetaData();
+  ASSERT_EQ(metaData.size(), 4);
+  ASSERT_EQ(metaData.back().first, fl::lib::MemoryMappedFile(path).size());
+  for (int numWorkers = 2; numWorkers < 8; ++numWorkers) {
+    auto workersTokenizer = fl::lib::text::Tokenizer();
+    workersTokenizer.countTokens(path, numWorkers, true);
+    ASSERT_EQ(workersTokenizer.totalTokens(), 13);
+    ASSERT_EQ(workersTokenizer.totalSentences(), 4);
+    ASSERT_EQ(workersTokenizer.getDictionary(), tokenizer.getDictionary());
+    ASSERT_EQ(workersTokenizer.getTextFileMetaData(), metaData);
+  }
+}
+
+TEST(TokenizerTest, IndexTokens) {
+  auto path = fl::lib::pathsConcat(loadPath, "test.txt");
+  auto tokenizer = fl::lib::text::Tokenizer();
+  fl::lib::text::Dictionary dict;
+  dict.addEntry("<unk>");
+  for (const char* token : {"a", "test", "this", "is", "just"}) {
+    dict.addEntry(token);
+  }
+  dict.setDefaultIndex(0);
+
+  // Reference from the lines of the file
+  std::vector<int> tokens;
+  std::vector<size_t> sentenceOffsets{0};
+  fl::lib::text::PartialFileReader reader(0, 1);
+  reader.loadFile(path);
+  for (const auto& line : reader.getLines()) {
+    auto indices = dict.mapEntriesToIndices(tokenizer.tokenize(line));
+    tokens.insert(tokens.end(), indices.begin(), indices.end());
+    sentenceOffsets.push_back(tokens.size());
+  }
+  ASSERT_EQ(tokens.size(), 13);
+
+  auto binPath = fl::lib::getTmpPath("tokenizer_test_dict.bin");
+  dict.saveBinary(binPath);
+  fl::lib::text::Dictionary binDict(binPath);
+  binDict.setDefaultIndex(0);
+  for (int numWorkers = 1; numWorkers < 8; ++numWorkers) {
+    for (const auto* d : {&dict, &binDict}) {
+      auto text = tokenizer.indexTokens(path, *d, numWorkers);
+      ASSERT_EQ(text.tokens, tokens);
+      ASSERT_EQ(text.sentenceOffsets, sentenceOffsets);
+    }
+  }
+
+  dict.setDefaultIndex(-1);
+  ASSERT_THROW(tokenizer.indexTokens(path, dict, 2), std::invalid_argument);
+}
+
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <future>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/dictionary/Defines.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+const std::vector<std::string> kTokens =
+    {"_", "_hel", "hel", "lo", "l", "o", "h", "e", "w", "r", "d", "_wor"};
+
+std::string randomWord(std::mt19937& gen, const std::string& letters) {
+  std::string word;
+  for (int i = 1 + gen() % 8; i > 0; --i) {
+    word += letters[gen() % letters.size()];
+  }
+  return word;
+}
+
+} // namespace
+
+TEST(WordPieceSegmenterTest, DoubleArrayTrie) {
+  std::mt19937 gen(0);
+  std::vector<std::string> keys;
+  std::vector<int> values;
+  for (int i = 0; i < 500; ++i) {
+    auto key = randomWord(gen, "abc\xff\x01");
+    if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+      keys.push_back(key);
+      values.push_back(i);
+    }
+  }
+  DoubleArrayTrie trie(keys, values);
+
+  for (int i = 0; i < 1000; ++i) {
+    auto str = randomWord(gen, "abcd\xff\x01");
+    size_t expectedLength = 0;
+    int expectedValue = -1;
+    for (size_t k = 0; k < keys.size(); ++k) {
+      if (keys[k].size() > expectedLength &&
+          str.compare(0, keys[k].size(), keys[k]) == 0) {
+        expectedLength = keys[k].size();
+        expectedValue = values[k];
+      }
+    }
+    int value = -1;
+    ASSERT_EQ(
+        trie.longestPrefix(str.data(), str.size(), &value), expectedLength);
+    ASSERT_EQ(value, expectedValue);
+  }
+
+  ASSERT_THROW(DoubleArrayTrie({"a", "a"}, {0, 1}), std::invalid_argument);
+  ASSERT_THROW(DoubleArrayTrie({""}, {0}), std::invalid_argument);
+}
+
+TEST(WordPieceSegmenterTest, Segment) {
+  std::vector<int> indices(kTokens.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  WordPieceSegmenter segmenter(kTokens, indices);
+
+  std::vector<int> result;
+  ASSERT_TRUE(segmenter.segment("_hello", result));
+  ASSERT_EQ(result, (std::vector<int>{1, 3}));
+  ASSERT_TRUE(segmenter.segment("_world", result));
+  ASSERT_EQ(result, (std::vector<int>{1, 3, 11, 4, 10}));
+
+  // Unknown characters are skipped
+  result.clear();
+  ASSERT_FALSE(segmenter.segment("_hex\xc3\xa9lo", result));
+  ASSERT_EQ(result, (std::vector<int>{0, 6, 7, 3}));
+  // Same from the cache
+  result.clear();
+  ASSERT_FALSE(segmenter.segment("_hex\xc3\xa9lo", result));
+  ASSERT_EQ(result, (std::vector<int>{0, 6, 7, 3}));
+}
+
+TEST(WordPieceSegmenterTest, DictionarySpecialTokens) {
+  Dictionary tokenDict;
+  for (const std::string& token :
+       {kUnkToken, kEosToken, kPadToken, kMaskToken, "<", ">", "unk", "s"}) {
+    tokenDict.addEntry(token);
+  }
+  WordPieceSegmenter segmenter(tokenDict);
+
+  // The special tokens are not word pieces
+  std::vector<int> result;
+  ASSERT_TRUE(segmenter.segment(kUnkToken, result));
+  ASSERT_EQ(result, (std::vector<int>{4, 6, 5}));
+  result.clear();
+  ASSERT_FALSE(segmenter.segment(kEosToken, result));
+  ASSERT_EQ(result, (std::vector<int>{4, 7, 5}));
+}
+
+TEST(WordPieceSegmenterTest, Cache) {
+  std::vector<int> indices(kTokens.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  WordPieceSegmenter uncached(kTokens, indices, 0);
+  WordPieceSegmenter cached(kTokens, indices, 20);
+
+  std::vector<std::future<void>> futures;
+  for (int t = 0; t < 4; ++t) {
+    futures.push_back(std::async(std::launch::async, [&, t]() {
+      std::mt19937 gen(t);
+      for (int i = 0; i < 2000; ++i) {
+        auto word = "_" + randomWord(gen, "helowrdx");
+        std::vector<int> expected;
+        std::vector<int> result;
+        bool isComplete = uncached.segment(word, expected);
+        ASSERT_EQ(cached.segment(word, result), isComplete);
+        ASSERT_EQ(result, expected);
+      }
+    }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "flashlight/lib/text/decoder/Utils.h"
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
 
 namespace fl {
 namespace lib {
@@ -31,11 +32,17 @@ enum class CriterionType { ASG = 0, CTC = 1, S2S = 2 };
  * Note: function decoder.prune() deletes hypothesis up until time when called
  * to supports online decoding. It will also add a offset to the scores in beam
  * to avoid underflow/overflow.
+ * StreamingDecoderSession wraps a decoder to prune it automatically and bound
+ * its memory usage on long streams.
+ *
+ * LM states are allocated from a pool owned by the decoder, which is reset at
+ * the beginning of each utterance. Its memory usage can be inspected with
+ * decoder.getLMStatePoolStats().
  *
  */
 class Decoder {
  public:
-  Decoder() = default;
+  Decoder() : lmStatePool_(std::make_shared<LMStatePool>()) {}
   virtual ~Decoder() = default;
 
   /* Initialize decoder before starting consume emissions */
@@ -71,6 +78,20 @@ class Decoder {
 
   /* Get all the final hypothesis */
   virtual std::vector<DecodeResult> getAllFinalHypothesis() const = 0;
+
+  /* Replace the pool of LM states, e.g. to use a different number of links */
+  void setLMStatePool(const LMStatePoolPtr& pool) {
+    lmStatePool_ = pool;
+  }
+
+  /* Get the memory statistics of the LM states */
+  LMStatePoolStats getLMStatePoolStats() const {
+    return lmStatePool_->getStats();
+  }
+
+ protected:
+  // Pool of the LM states of the current utterance
+  LMStatePoolPtr lmStatePool_;
 };
 } // namespace text
 } // namespace lib
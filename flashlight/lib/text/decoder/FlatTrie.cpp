@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kFlatTrieMagic[8] = {'F', 'L', 'T', 'R', 'I', 'E', '\0', '\0'};
+constexpr int kFlatTrieVersion = 2;
+
+struct FlatTrieHeader {
+  char magic[8];
+  int version;
+  int maxChildren;
+  int nNodes;
+  int nLabels;
+  uint64_t fingerprint;
+};
+
+FlatTrieHeader
+readHeader(const char* data, size_t size, const std::string& path) {
+  FlatTrieHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("[FlatTrie] Invalid trie file: " + path);
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kFlatTrieMagic, sizeof(kFlatTrieMagic)) != 0 ||
+      header.version != kFlatTrieVersion) {
+    throw std::runtime_error(
+        "[FlatTrie] Invalid trie file (wrong magic or version): " + path);
+  }
+  return header;
+}
+
+} // namespace
+
+FlatTrie::FlatTrie(const Trie& trie) : maxChildren_(trie.getMaxChildren()) {
+  // Breadth-first traversal, so that siblings are stored contiguously
+  std::vector<const TrieNode*> queue{trie.getRoot()};
+  std::vector<std::pair<int, const TrieNode*>> children;
+  for (size_t i = 0; i < queue.size(); ++i) {
+    const TrieNode* node = queue[i];
+
+    FlatTrieNode flatNode;
+    flatNode.idx = node->idx;
+    flatNode.maxScore = node->maxScore;
+    flatNode.labelBegin = labelBuf_.size();
+    flatNode.nLabels = node->labels.size();
+    labelBuf_.insert(labelBuf_.end(), node->labels.begin(), node->labels.end());
+    scoreBuf_.insert(scoreBuf_.end(), node->scores.begin(), node->scores.end());
+
+    children.clear();
+    for (const auto& child : node->children) {
+      children.emplace_back(child.first, child.second.get());
+    }
+    std::sort(children.begin(), children.end());
+    flatNode.childBegin = queue.size();
+    flatNode.nChildren = children.size();
+    for (const auto& child : children) {
+      queue.push_back(child.second);
+    }
+
+    nodeBuf_.push_back(flatNode);
+    tokenBuf_.push_back(node->idx);
+  }
+
+  nNodes_ = nodeBuf_.size();
+  nLabels_ = labelBuf_.size();
+  setPointers();
+}
+
+void FlatTrie::setPointers() {
+  nodes_ = nodeBuf_.data();
+  tokens_ = tokenBuf_.data();
+  labels_ = labelBuf_.data();
+  scores_ = scoreBuf_.data();
+}
+
+std::shared_ptr<FlatTrie> FlatTrie::load(
+    const std::string& path,
+    uint64_t fingerprint /* = 0 */) {
+  std::shared_ptr<FlatTrie> trie(new FlatTrie());
+  trie->file_ = std::make_unique<MemoryMappedFile>(path);
+  const char* data = trie->file_->data();
+  size_t size = trie->file_->size();
+
+  auto header = readHeader(data, size, path);
+  if (header.fingerprint != fingerprint) {
+    throw std::runtime_error(
+        "[FlatTrie] Trie file was built from other inputs: " + path);
+  }
+  if (header.nNodes < 1 || header.nLabels < 0 || header.maxChildren < 0) {
+    throw std::runtime_error("[FlatTrie] Invalid trie file: " + path);
+  }
+  size_t nNodes = header.nNodes;
+  size_t nLabels = header.nLabels;
+  size_t expectedSize = sizeof(header) +
+      nNodes * (sizeof(FlatTrieNode) + sizeof(int)) +
+      nLabels * (sizeof(int) + sizeof(float));
+  if (size != expectedSize) {
+    throw std::runtime_error("[FlatTrie] Truncated trie file: " + path);
+  }
+
+  trie->maxChildren_ = header.maxChildren;
+  trie->nNodes_ = header.nNodes;
+  trie->nLabels_ = header.nLabels;
+
+  const char* ptr = data + sizeof(header);
+  trie->nodes_ = reinterpret_cast<const FlatTrieNode*>(ptr);
+  ptr += header.nNodes * sizeof(FlatTrieNode);
+  trie->tokens_ = reinterpret_cast<const int*>(ptr);
+  ptr += header.nNodes * sizeof(int);
+  trie->labels_ = reinterpret_cast<const int*>(ptr);
+  ptr += header.nLabels * sizeof(int);
+  trie->scores_ = reinterpret_cast<const float*>(ptr);
+
+  // The decoders index the arrays without checks: the children of each node
+  // must come after it (as in breadth-first order) and be in range, as well
+  // as its labels
+  for (int64_t i = 0; i < header.nNodes; ++i) {
+    const FlatTrieNode& node = trie->nodes_[i];
+    if (node.idx != trie->tokens_[i] || node.nChildren < 0 ||
+        node.childBegin <= i ||
+        node.childBegin > header.nNodes - node.nChildren ||
+        node.nLabels < 0 || node.labelBegin < 0 ||
+        node.labelBegin > header.nLabels - node.nLabels) {
+      throw std::runtime_error(
+          "[FlatTrie] Invalid node " + std::to_string(i) +
+          " in trie file: " + path);
+    }
+  }
+  return trie;
+}
+
+uint64_t FlatTrie::loadFingerprint(const std::string& path) {
+  FlatTrieHeader header;
+  auto in = createInputStream(path);
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  return readHeader(
+             reinterpret_cast<const char*>(&header), in.gcount(), path)
+      .fingerprint;
+}
+
+void FlatTrie::save(const std::string& path, uint64_t fingerprint /* = 0 */)
+    const {
+  FlatTrieHeader header;
+  std::memcpy(header.magic, kFlatTrieMagic, sizeof(kFlatTrieMagic));
+  header.version = kFlatTrieVersion;
+  header.maxChildren = maxChildren_;
+  header.nNodes = nNodes_;
+  header.nLabels = nLabels_;
+  header.fingerprint = fingerprint;
+
+  auto out = createOutputStream(path, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(
+      reinterpret_cast<const char*>(nodes_), nNodes_ * sizeof(FlatTrieNode));
+  out.write(reinterpret_cast<const char*>(tokens_), nNodes_ * sizeof(int));
+  out.write(reinterpret_cast<const char*>(labels_), nLabels_ * sizeof(int));
+  out.write(reinterpret_cast<const char*>(scores_), nLabels_ * sizeof(float));
+  if (!out.good()) {
+    throw std::runtime_error("[FlatTrie] Failed to write trie to: " + path);
+  }
+}
+
+const FlatTrieNode* FlatTrie::search(const std::vector<int>& indices) const {
+  const FlatTrieNode* node = getRoot();
+  for (auto idx : indices) {
+    if (idx < 0 || idx >= maxChildren_) {
+      throw std::out_of_range(
+          "[FlatTrie] Invalid letter index: " + std::to_string(idx));
+    }
+    node = getChild(node, idx);
+    if (!node) {
+      return nullptr;
+    }
+  }
+  return node;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
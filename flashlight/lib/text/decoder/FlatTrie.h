@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * FlatTrieNode is the node structure in FlatTrie. Nodes are stored in one
+ * contiguous array in breadth-first order, so the children of a node occupy
+ * the consecutive range [childBegin, childBegin + nChildren), sorted by token
+ * index. Labels and scores live in side arrays of FlatTrie.
+ */
+struct FlatTrieNode {
+  // Token index
+  int idx;
+  // Position of the first child in the node array
+  int childBegin;
+  // Number of children
+  int nChildren;
+  // Position of the first label in the label / score arrays
+  int labelBegin;
+  // Number of labels (nonempty only if the node represents a completed token)
+  int nLabels;
+  // Maximum score of all the labels if this node is a leaf,
+  // otherwise it will be the value after trie smearing.
+  float maxScore;
+};
+
+/**
+ * FlatTrie is an immutable, array-backed version of a built (and smeared)
+ * Trie. Child lookup is a search over a small sorted and contiguous range of
+ * token indices instead of a hash map lookup followed by a pointer chase,
+ * which makes it suitable for the inner loop of the lexicon decoders.
+ *
+ * A FlatTrie can be saved to a binary file and loaded back with `load()`,
+ * which memory maps the file without copying it. Decoder processes can then
+ * share one compiled lexicon instead of rebuilding the trie at startup. The
+ * file stores a fingerprint given by the caller, of the lexicon, tokens, LM
+ * and options the trie was built from, so that a stale file can be detected.
+ */
+class FlatTrie {
+ public:
+  /* Compile a trie, which should be already smeared if smearing is needed */
+  explicit FlatTrie(const Trie& trie);
+
+  /* Memory map a trie previously written with `save()`. Throws if the file
+   * is invalid, or if its fingerprint is not `fingerprint`. */
+  static std::shared_ptr<FlatTrie> load(
+      const std::string& path,
+      uint64_t fingerprint = 0);
+
+  /* Read the fingerprint a trie file was saved with */
+  static uint64_t loadFingerprint(const std::string& path);
+
+  /* Serialize the trie into a binary file which can be used with `load()` */
+  void save(const std::string& path, uint64_t fingerprint = 0) const;
+
+  /* Return the root node pointer */
+  const FlatTrieNode* getRoot() const {
+    return nodes_;
+  }
+
+  /* Return the child of `node` with token index `idx` or nullptr if none */
+  const FlatTrieNode* getChild(const FlatTrieNode* node, int idx) const {
+    const int* begin = tokens_ + node->childBegin;
+    const int* end = begin + node->nChildren;
+    const int* it = std::lower_bound(begin, end, idx);
+    if (it == end || *it != idx) {
+      return nullptr;
+    }
+    return nodes_ + (it - tokens_);
+  }
+
+  /* Labels of words ending at `node` (there are `node->nLabels` of them) */
+  const int* getLabels(const FlatTrieNode* node) const {
+    return labels_ + node->labelBegin;
+  }
+
+  /* Scores of words ending at `node` (same size as labels) */
+  const float* getScores(const FlatTrieNode* node) const {
+    return scores_ + node->labelBegin;
+  }
+
+  /* Get the node for a given token sequence, nullptr if it doesn't exist */
+  const FlatTrieNode* search(const std::vector<int>& indices) const;
+
+  int getNumNodes() const {
+    return nNodes_;
+  }
+
+  int getMaxChildren() const {
+    return maxChildren_;
+  }
+
+ private:
+  FlatTrie() = default;
+
+  void setPointers();
+
+  int maxChildren_;
+  int nNodes_;
+  int nLabels_;
+
+  // Owned storage (for a compiled trie)
+  std::vector<FlatTrieNode> nodeBuf_;
+  std::vector<int> tokenBuf_;
+  std::vector<int> labelBuf_;
+  std::vector<float> scoreBuf_;
+  // Mapped storage (for a loaded trie)
+  std::unique_ptr<MemoryMappedFile> file_;
+
+  // Views on either owned or mapped storage
+  const FlatTrieNode* nodes_;
+  const int* tokens_; // tokens_[i] == nodes_[i].idx, dense for fast search
+  const int* labels_;
+  const float* scores_;
+};
+
+using FlatTriePtr = std::shared_ptr<FlatTrie>;
+} // namespace text
+} // namespace lib
+} // namespace fl
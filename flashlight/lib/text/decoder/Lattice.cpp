@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kLatticeMagic[8] = {'F', 'L', 'L', 'A', 'T', '\0', '\0', '\0'};
+constexpr int kLatticeVersion = 1;
+
+struct LatticeHeader {
+  char magic[8];
+  int version;
+  int nStates;
+  int nArcs;
+  int nFinalStates;
+};
+
+} // namespace
+
+void Lattice::save(const std::string& path) const {
+  LatticeHeader header;
+  std::memcpy(header.magic, kLatticeMagic, sizeof(kLatticeMagic));
+  header.version = kLatticeVersion;
+  header.nStates = nStates_;
+  header.nArcs = arcs_.size();
+  header.nFinalStates = finalStates_.size();
+
+  auto out = createOutputStream(path, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(
+      reinterpret_cast<const char*>(arcs_.data()),
+      arcs_.size() * sizeof(LatticeArc));
+  out.write(
+      reinterpret_cast<const char*>(finalStates_.data()),
+      finalStates_.size() * sizeof(int));
+  if (!out.good()) {
+    throw std::runtime_error("[Lattice] Failed to write lattice to: " + path);
+  }
+}
+
+Lattice Lattice::load(const std::string& path) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("[Lattice] Failed to open lattice file: " + path);
+  }
+
+  LatticeHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in.good() ||
+      std::memcmp(header.magic, kLatticeMagic, sizeof(kLatticeMagic)) != 0 ||
+      header.version != kLatticeVersion) {
+    throw std::runtime_error(
+        "[Lattice] Invalid lattice file (wrong magic or version): " + path);
+  }
+  if (header.nStates < 1 || header.nArcs < 0 || header.nFinalStates < 0) {
+    throw std::runtime_error("[Lattice] Invalid lattice file: " + path);
+  }
+
+  Lattice lattice;
+  lattice.nStates_ = header.nStates;
+  lattice.arcs_.resize(header.nArcs);
+  lattice.finalStates_.resize(header.nFinalStates);
+  in.read(
+      reinterpret_cast<char*>(lattice.arcs_.data()),
+      header.nArcs * sizeof(LatticeArc));
+  in.read(
+      reinterpret_cast<char*>(lattice.finalStates_.data()),
+      header.nFinalStates * sizeof(int));
+  if (!in.good()) {
+    throw std::runtime_error("[Lattice] Truncated lattice file: " + path);
+  }
+  return lattice;
+}
+
+void Lattice::writeText(std::ostream& out) const {
+  // OpenFst expects the start state to be the source of the first arc
+  std::vector<const LatticeArc*> arcs;
+  arcs.reserve(arcs_.size());
+  for (const auto& arc : arcs_) {
+    arcs.push_back(&arc);
+  }
+  std::stable_sort(
+      arcs.begin(),
+      arcs.end(),
+      [](const LatticeArc* arc1, const LatticeArc* arc2) {
+        return arc1->from < arc2->from;
+      });
+
+  out.precision(9);
+  if (arcs.empty() || arcs.front()->from != 0) {
+    // No arc leaves the start state: it can only be final
+    for (int state : finalStates_) {
+      if (state == 0) {
+        out << 0 << "\t" << 0 << "\n";
+        break;
+      }
+    }
+  }
+  for (const LatticeArc* arc : arcs) {
+    out << arc->from << "\t" << arc->to << "\t" << arc->label + 1 << "\t"
+        << arc->label + 1 << "\t" << -arc->score << "\n";
+  }
+  std::vector<int> finalStates = finalStates_;
+  std::sort(finalStates.begin(), finalStates.end());
+  finalStates.erase(
+      std::unique(finalStates.begin(), finalStates.end()), finalStates.end());
+  for (int state : finalStates) {
+    if (state != 0 || !arcs.empty()) {
+      out << state << "\t" << 0 << "\n";
+    }
+  }
+}
+
+void Lattice::saveText(const std::string& path) const {
+  auto out = createOutputStream(path);
+  writeText(out);
+  if (!out.good()) {
+    throw std::runtime_error("[Lattice] Failed to write lattice to: " + path);
+  }
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/Utils.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * LatticeArc is a transition of the lattice between two of its states. Frames
+ * are counted as in DecodeResult: the decoder state at frame t has consumed
+ * the first t frames, and the end of sentence step of `decodeEnd()` counts as
+ * one more frame.
+ */
+struct LatticeArc {
+  int from; // Source state
+  int to; // Destination state
+  int label; // Word index (token index for lexicon-free decoding), -1 if none
+  int startFrame; // The arc consumes the frames [startFrame, endFrame)
+  int endFrame;
+  double score; // Decoder score (AM, weighted LM, insertion scores) of the arc
+  double amScore; // AM score of the arc
+  double lmScore; // LM score of the arc (not weighted)
+};
+
+/**
+ * Lattice is a compact representation of the hypothesis kept in the beam of a
+ * decoder, and of the ones merged into them during the search, as an acyclic
+ * graph whose arcs carry the emitted words. State 0 is the start state, and
+ * the score of a path to a final state is the sum of its arc scores. Every
+ * final hypothesis is such a path. Second-pass rescoring can replace the LM
+ * scores of the arcs without decoding the audio again.
+ *
+ * Lattices can be saved in a binary format, or as an OpenFst text acceptor
+ * where labels are shifted by one (0 is epsilon) and weights are the negated
+ * scores (tropical semiring).
+ */
+class Lattice {
+ public:
+  Lattice() : nStates_(1) {}
+
+  int addState() {
+    return nStates_++;
+  }
+
+  void addArc(const LatticeArc& arc) {
+    arcs_.push_back(arc);
+  }
+
+  void addFinalState(int state) {
+    finalStates_.push_back(state);
+  }
+
+  int nStates() const {
+    return nStates_;
+  }
+
+  const std::vector<LatticeArc>& getArcs() const {
+    return arcs_;
+  }
+
+  const std::vector<int>& getFinalStates() const {
+    return finalStates_;
+  }
+
+  /* Save / load the lattice in binary format */
+  void save(const std::string& path) const;
+  static Lattice load(const std::string& path);
+
+  /* Write the lattice in OpenFst text format */
+  void writeText(std::ostream& out) const;
+  void saveText(const std::string& path) const;
+
+ private:
+  int nStates_;
+  std::vector<LatticeArc> arcs_;
+  std::vector<int> finalStates_;
+};
+
+/**
+ * Build the lattice of the hypothesis `finalHyps` of the frame `finalFrame`
+ * (in the buffer of the decoder, whose first `frameOffset` frames were pruned)
+ * by following their back-pointers, and the ones of the candidates `merged`
+ * into the states of each frame during the search (see `MergedCandidate`).
+ *
+ * `labelOf(state)` returns the label emitted by a decoder state, or -1 if there
+ * is none, and `lexOf(state)` its trie node (nullptr for lexicon-free
+ * decoders). The lattice has a state for the decoder states which emit a
+ * label, have merged predecessors or are final. These are merged if they have
+ * the same frame, LM state and trie node, since their futures are the same.
+ * The score of an arc is the score of its path in the decoder (including the
+ * pruned frames for the arcs leaving the start state), so that the path of
+ * each final hypothesis scores as the hypothesis. Final states are listed in
+ * the order of `finalHyps`.
+ */
+template <class DecoderState, class LabelFunc, class LexFunc>
+Lattice buildLattice(
+    const std::vector<DecoderState>& finalHyps,
+    int finalFrame,
+    int frameOffset,
+    const HypothesisBuffer<MergedCandidate<DecoderState>>& merged,
+    const LabelFunc& labelOf,
+    const LexFunc& lexOf) {
+  struct NodeKey {
+    int frame;
+    const LMState* lmState;
+    const void* lex;
+
+    bool operator==(const NodeKey& other) const {
+      return frame == other.frame && lmState == other.lmState &&
+          lex == other.lex;
+    }
+  };
+  struct NodeKeyHash {
+    size_t operator()(const NodeKey& key) const {
+      size_t hash = reinterpret_cast<uintptr_t>(key.lmState);
+      hash = hashCombine(hash, reinterpret_cast<uintptr_t>(key.lex));
+      return hashCombine(hash, key.frame);
+    }
+  };
+  // Arcs between the same states with the same label are merged as well
+  struct ArcKey {
+    int from;
+    int to;
+    int label;
+    int startFrame;
+
+    bool operator==(const ArcKey& other) const {
+      return from == other.from && to == other.to && label == other.label &&
+          startFrame == other.startFrame;
+    }
+  };
+  struct ArcKeyHash {
+    size_t operator()(const ArcKey& key) const {
+      size_t hash = hashCombine(key.from, key.to);
+      return hashCombine(hashCombine(hash, key.label), key.startFrame);
+    }
+  };
+
+  std::unordered_multimap<const DecoderState*, const DecoderState*>
+      predecessors;
+  for (int frame = 1; frame <= finalFrame; frame++) {
+    for (const auto& candidate : merged[frame]) {
+      predecessors.emplace(candidate.target, &candidate.state);
+    }
+  }
+  auto hasNode = [&](const DecoderState* state) {
+    return !state->parent || labelOf(*state) >= 0 ||
+        predecessors.count(state) > 0;
+  };
+
+  Lattice lattice;
+  std::unordered_map<NodeKey, int, NodeKeyHash> nodes;
+  std::unordered_map<const DecoderState*, int> latticeStates;
+  std::vector<std::pair<const DecoderState*, int>> pending;
+  auto nodeOf = [&](const DecoderState* state, int frame) {
+    if (!state->parent) {
+      return 0;
+    }
+    auto it = latticeStates.find(state);
+    if (it != latticeStates.end()) {
+      return it->second;
+    }
+    auto node = nodes.emplace(
+        NodeKey{frame, state->lmState.get(), lexOf(*state)},
+        lattice.nStates());
+    if (node.second) {
+      lattice.addState();
+    }
+    latticeStates.emplace(state, node.first->second);
+    pending.emplace_back(state, frame);
+    return node.first->second;
+  };
+
+  std::unordered_map<ArcKey, int, ArcKeyHash> arcIndex;
+  std::vector<LatticeArc> arcs;
+  // Add the arc ending with the back-pointer of `edge` to `to`
+  auto addArc = [&](const DecoderState& edge, int to, int toFrame) {
+    const DecoderState* fromState = edge.parent;
+    int fromFrame = toFrame - 1;
+    while (!hasNode(fromState)) {
+      fromState = fromState->parent;
+      --fromFrame;
+    }
+    LatticeArc arc{
+        nodeOf(fromState, fromFrame),
+        to,
+        labelOf(edge),
+        fromFrame + frameOffset,
+        toFrame + frameOffset,
+        edge.score,
+        edge.amScore,
+        edge.lmScore};
+    // The arcs leaving the start state carry the scores of the pruned frames
+    if (fromState->parent) {
+      arc.score -= fromState->score;
+      arc.amScore -= fromState->amScore;
+      arc.lmScore -= fromState->lmScore;
+    }
+    auto it = arcIndex.emplace(
+        ArcKey{arc.from, arc.to, arc.label, arc.startFrame}, arcs.size());
+    if (it.second) {
+      arcs.push_back(arc);
+    } else if (arc.score > arcs[it.first->second].score) {
+      arcs[it.first->second] = arc;
+    }
+  };
+
+  for (const DecoderState& hyp : finalHyps) {
+    lattice.addFinalState(nodeOf(&hyp, finalFrame));
+  }
+  while (!pending.empty()) {
+    const DecoderState* state = pending.back().first;
+    int frame = pending.back().second;
+    pending.pop_back();
+    int node = latticeStates[state];
+    addArc(*state, node, frame);
+    auto range = predecessors.equal_range(state);
+    for (auto it = range.first; it != range.second; ++it) {
+      addArc(*it->second, node, frame);
+    }
+  }
+  for (const auto& arc : arcs) {
+    lattice.addArc(arc);
+  }
+  return lattice;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
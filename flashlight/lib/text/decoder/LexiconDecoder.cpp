@@ -10,6 +10,7 @@
 #include <cmath>
 #include <functional>
 #include <numeric>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
@@ -19,227 +20,440 @@ namespace lib {
 namespace text {
 
 void LexiconDecoder::decodeBegin() {
-  hyp_.clear();
-  hyp_.emplace(0, std::vector<LexiconDecoderState>());
+  hyp_.reset();
+  mergedHyp_.reset();
 
   /* note: the lm reset itself with :start() */
+  lmStatePool_->reset();
   hyp_[0].emplace_back(
-      0.0, lm_->start(0), lexicon_->getRoot(), nullptr, sil_, -1);
+      0.0,
+      lm_->start(0, lmStatePool_),
+      lexicon_->getRoot(),
+      nullptr,
+      sil_,
+      -1);
   nDecodedFrames_ = 0;
   nPrunedFrames_ = 0;
+  nSkippedFrames_ = 0;
 }
 
 void LexiconDecoder::decodeStep(const float* emissions, int T, int N) {
   int startFrame = nDecodedFrames_ - nPrunedFrames_;
   // Extend hyp_ buffer
-  if (hyp_.size() < startFrame + T + 2) {
-    for (int i = hyp_.size(); i < startFrame + T + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconDecoderState>());
-    }
+  hyp_.reserve(startFrame + T + 2);
+  mergedHyp_.reserve(startFrame + T + 2);
+
+  const int k = std::min(opt_.beamSizeToken, N);
+  tokens_.resize(static_cast<size_t>(T) * k);
+  nTokens_.resize(T);
+  selectTopKTokens(
+      emissions,
+      T,
+      N,
+      k,
+      opt_.beamThresholdToken,
+      tokens_.data(),
+      nTokens_.data());
+  for (int t = 0; t < T; t++) {
+    decodeFrame(
+        emissions + t * N,
+        N,
+        nDecodedFrames_ + t,
+        tokens_.data() + static_cast<size_t>(t) * k,
+        nTokens_[t],
+        hyp_[startFrame + t],
+        hyp_[startFrame + t + 1],
+        opt_.keepMergedHyps ? &mergedHyp_[startFrame + t + 1] : nullptr);
+    updateLMCache(lm_, hyp_[startFrame + t + 1]);
   }
 
-  std::vector<size_t> idx(N);
-  for (int t = 0; t < T; t++) {
-    std::iota(idx.begin(), idx.end(), 0);
-    if (N > opt_.beamSizeToken) {
-      std::partial_sort(
-          idx.begin(),
-          idx.begin() + opt_.beamSizeToken,
-          idx.end(),
-          [&t, &N, &emissions](const size_t& l, const size_t& r) {
-            return emissions[t * N + l] > emissions[t * N + r];
-          });
-    }
+  nDecodedFrames_ += T;
+}
 
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
-    for (const LexiconDecoderState& prevHyp : hyp_[startFrame + t]) {
-      const TrieNode* prevLex = prevHyp.lex;
-      const int prevIdx = prevHyp.token;
-      const float lexMaxScore =
-          prevLex == lexicon_->getRoot() ? 0 : prevLex->maxScore;
-
-      /* (1) Try children */
-      for (int r = 0; r < std::min(opt_.beamSizeToken, N); ++r) {
-        int n = idx[r];
-        auto iter = prevLex->children.find(n);
-        if (iter == prevLex->children.end()) {
-          continue;
-        }
-        const TrieNodePtr& lex = iter->second;
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + amScore;
-        if (n == sil_) {
-          score += opt_.silScore;
-        }
-
-        LMStatePtr lmState;
-        double lmScore = 0.;
-
-        if (isLmToken_) {
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          lmState = lmStateScorePair.first;
-          lmScore = lmStateScorePair.second;
-        }
-
-        // We eat-up a new token
-        if (opt_.criterionType != CriterionType::CTC || prevHyp.prevBlank ||
-            n != prevIdx) {
-          if (!lex->children.empty()) {
-            if (!isLmToken_) {
-              lmState = prevHyp.lmState;
-              lmScore = lex->maxScore - lexMaxScore;
-            }
-            candidatesAdd(
-                candidates_,
-                candidatesBestScore_,
-                opt_.beamThreshold,
-                score + opt_.lmWeight * lmScore,
-                lmState,
-                lex.get(),
-                &prevHyp,
-                n,
-                -1,
-                false, // prevBlank
-                prevHyp.amScore + amScore,
-                prevHyp.lmScore + lmScore);
-          }
-        }
-
-        // If we got a true word
-        for (auto label : lex->labels) {
-          if (!isLmToken_) {
-            auto lmStateScorePair = lm_->score(prevHyp.lmState, label);
-            lmState = lmStateScorePair.first;
-            lmScore = lmStateScorePair.second - lexMaxScore;
-          }
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore + opt_.wordScore,
-              lmState,
-              lexicon_->getRoot(),
-              &prevHyp,
-              n,
-              label,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        }
-
-        // If we got an unknown word
-        if (lex->labels.empty() && (opt_.unkScore > kNegativeInfinity)) {
-          if (!isLmToken_) {
-            auto lmStateScorePair = lm_->score(prevHyp.lmState, unk_);
-            lmState = lmStateScorePair.first;
-            lmScore = lmStateScorePair.second - lexMaxScore;
-          }
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore + opt_.unkScore,
-              lmState,
-              lexicon_->getRoot(),
-              &prevHyp,
-              n,
-              unk_,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        }
-      }
+void LexiconDecoder::expandHypothesis(
+    const LexiconDecoderState& prevHyp,
+    const float* emissions,
+    int N,
+    int frame,
+    const int* tokens,
+    int nTokens,
+    std::vector<Proposal>& proposals) const {
+  const FlatTrieNode* prevLex = prevHyp.lex;
+  const int prevIdx = prevHyp.token;
+  const float lexMaxScore =
+      prevLex == lexicon_->getRoot() ? 0 : prevLex->maxScore;
+
+  /* (1) Try children */
+  for (int r = 0; r < nTokens; ++r) {
+    int n = tokens[r];
+    const FlatTrieNode* lex = lexicon_->getChild(prevLex, n);
+    if (!lex) {
+      continue;
+    }
+    double amScore = emissions[n];
+    if (frame > 0 && opt_.criterionType == CriterionType::ASG) {
+      amScore += transitions_[n * N + prevIdx];
+    }
+    double score = prevHyp.score + amScore;
+    if (n == sil_) {
+      score += opt_.silScore;
+    }
 
-      /* (2) Try same lexicon node */
-      if (opt_.criterionType != CriterionType::CTC || !prevHyp.prevBlank ||
-          prevLex == lexicon_->getRoot()) {
-        int n = prevLex == lexicon_->getRoot() ? sil_ : prevIdx;
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + amScore;
-        if (n == sil_) {
-          score += opt_.silScore;
-        }
-
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
-            score,
-            prevHyp.lmState,
-            prevLex,
+    // We eat-up a new token
+    if (opt_.criterionType != CriterionType::CTC || prevHyp.prevBlank ||
+        n != prevIdx) {
+      if (lex->nChildren > 0) {
+        proposals.push_back(Proposal{
             &prevHyp,
+            lex,
             n,
             -1,
             false, // prevBlank
-            prevHyp.amScore + amScore,
-            prevHyp.lmScore);
+            score,
+            amScore,
+            0,
+            isLmToken_ ? n : -1,
+            isLmToken_ ? 0 : lex->maxScore - lexMaxScore,
+            -1});
       }
+    }
 
-      /* (3) CTC only, try blank */
-      if (opt_.criterionType == CriterionType::CTC) {
-        int n = blank_;
-        double amScore = emissions[t * N + n];
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
-            prevHyp.score + amScore,
-            prevHyp.lmState,
-            prevLex,
-            &prevHyp,
-            n,
-            -1,
-            true, // prevBlank
-            prevHyp.amScore + amScore,
-            prevHyp.lmScore);
+    // If we got a true word
+    const int* labels = lexicon_->getLabels(lex);
+    for (int i = 0; i < lex->nLabels; i++) {
+      int label = labels[i];
+      proposals.push_back(Proposal{
+          &prevHyp,
+          lexicon_->getRoot(),
+          n,
+          label,
+          false, // prevBlank
+          score,
+          amScore,
+          opt_.wordScore,
+          isLmToken_ ? n : label,
+          isLmToken_ ? 0 : lexMaxScore,
+          -1});
+    }
+
+    // If we got an unknown word
+    if (lex->nLabels == 0 && (opt_.unkScore > kNegativeInfinity)) {
+      proposals.push_back(Proposal{
+          &prevHyp,
+          lexicon_->getRoot(),
+          n,
+          unk_,
+          false, // prevBlank
+          score,
+          amScore,
+          opt_.unkScore,
+          isLmToken_ ? n : unk_,
+          isLmToken_ ? 0 : lexMaxScore,
+          -1});
+    }
+  }
+
+  /* (2) Try same lexicon node */
+  if (opt_.criterionType != CriterionType::CTC || !prevHyp.prevBlank ||
+      prevLex == lexicon_->getRoot()) {
+    int n = prevLex == lexicon_->getRoot() ? sil_ : prevIdx;
+    double amScore = emissions[n];
+    if (frame > 0 && opt_.criterionType == CriterionType::ASG) {
+      amScore += transitions_[n * N + prevIdx];
+    }
+    double score = prevHyp.score + amScore;
+    if (n == sil_) {
+      score += opt_.silScore;
+    }
+
+    proposals.push_back(Proposal{
+        &prevHyp,
+        prevLex,
+        n,
+        -1,
+        false, // prevBlank
+        score,
+        amScore,
+        0,
+        -1,
+        0,
+        -1});
+  }
+
+  /* (3) CTC only, try blank */
+  if (opt_.criterionType == CriterionType::CTC) {
+    int n = blank_;
+    double amScore = emissions[n];
+    proposals.push_back(Proposal{
+        &prevHyp,
+        prevLex,
+        n,
+        -1,
+        true, // prevBlank
+        prevHyp.score + amScore,
+        amScore,
+        0,
+        -1,
+        0,
+        -1});
+  }
+}
+
+void LexiconDecoder::scoreProposals(int nChunks) {
+  lmQueryStates_.clear();
+  lmQueryTokens_.clear();
+  const LexiconDecoderState* lastHyp = nullptr;
+  int lastToken = -1;
+  for (int chunk = 0; chunk < nChunks; chunk++) {
+    for (Proposal& proposal : proposals_[chunk]) {
+      if (proposal.lmToken < 0) {
+        continue;
       }
-      // finish proposing
+      if (proposal.prevHyp != lastHyp || proposal.lmToken != lastToken) {
+        lastHyp = proposal.prevHyp;
+        lastToken = proposal.lmToken;
+        lmQueryStates_.push_back(lastHyp->lmState);
+        lmQueryTokens_.push_back(lastToken);
+      }
+      proposal.lmQuery = lmQueryTokens_.size() - 1;
+    }
+  }
+
+  lmQueryOutStates_.resize(lmQueryTokens_.size());
+  lmQueryScores_.resize(lmQueryTokens_.size());
+  lm_->scoreBatch(
+      lmQueryStates_.data(),
+      lmQueryTokens_.data(),
+      lmQueryTokens_.size(),
+      lmQueryOutStates_.data(),
+      lmQueryScores_.data());
+}
+
+void LexiconDecoder::addProposal(
+    const Proposal& proposal,
+    std::vector<MergedCandidate<LexiconDecoderState>>* merged) {
+  const LexiconDecoderState* prevHyp = proposal.prevHyp;
+  const LMStatePtr* lmState = &prevHyp->lmState;
+  double lmScore = proposal.lmScore;
+  if (proposal.lmToken >= 0) {
+    lmState = &lmQueryOutStates_[proposal.lmQuery];
+    lmScore = lmQueryScores_[proposal.lmQuery] - proposal.lmScore;
+  }
+
+  candidatesAddMerged(
+      candidates_,
+      candidateIndex_,
+      merged,
+      candidatesBestScore_,
+      opt_.beamThreshold,
+      opt_.logAdd,
+      proposal.score + opt_.lmWeight * lmScore + proposal.insertionScore,
+      *lmState,
+      proposal.lex,
+      prevHyp,
+      proposal.token,
+      proposal.word,
+      proposal.prevBlank,
+      prevHyp->amScore + proposal.amScore,
+      prevHyp->lmScore + lmScore);
+}
+
+void LexiconDecoder::decodeFrame(
+    const float* emissions,
+    int N,
+    int frame,
+    const int* tokens,
+    int nTokens,
+    const std::vector<LexiconDecoderState>& prevHyps,
+    std::vector<LexiconDecoderState>& outputs,
+    std::vector<MergedCandidate<LexiconDecoderState>>* merged) {
+  if (isBlankFrame(emissions, N)) {
+    decodeBlankFrame(emissions[blank_], prevHyps, outputs, merged);
+    ++nSkippedFrames_;
+    return;
+  }
+
+  candidatesReset(
+      candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+  if (merged) {
+    merged->clear();
+  }
+  int nChunks = expansionThreads_
+      ? std::min<int>(
+            expansionThreads_->size(),
+            prevHyps.size() / kMinExpansionHypsPerThread)
+      : 1;
+  nChunks = std::max(nChunks, 1);
+  if (proposals_.size() < nChunks) {
+    proposals_.resize(nChunks);
+  }
+  auto expandChunk = [&](int chunk) {
+    if (chunk >= nChunks) {
+      return;
+    }
+    auto& proposals = proposals_[chunk];
+    proposals.clear();
+    size_t begin = prevHyps.size() * chunk / nChunks;
+    size_t end = prevHyps.size() * (chunk + 1) / nChunks;
+    for (size_t i = begin; i < end; i++) {
+      expandHypothesis(
+          prevHyps[i], emissions, N, frame, tokens, nTokens, proposals);
+    }
+  };
+
+  /* (1) Expand the hypothesis, by chunks in parallel for large beams */
+  if (nChunks > 1) {
+    expansionThreads_->run(expandChunk);
+  } else {
+    expandChunk(0);
+  }
+
+  /* (2) Score all the LM queries of the frame at once */
+  scoreProposals(nChunks);
+
+  /* (3) Merge the proposals into the candidates, in the sequential order */
+  for (int chunk = 0; chunk < nChunks; chunk++) {
+    for (const Proposal& proposal : proposals_[chunk]) {
+      addProposal(proposal, merged);
+    }
+  }
+
+  candidatesStore(
+      candidates_,
+      candidatePtrs_,
+      candidateIndex_,
+      outputs,
+      opt_.beamSize,
+      candidatesBestScore_ - opt_.beamThreshold,
+      false);
+  if (merged) {
+    mergedCandidatesStore(candidates_, candidatePtrs_, outputs, *merged);
+  }
+}
+
+bool LexiconDecoder::isBlankFrame(const float* emissions, int N) const {
+  if (opt_.blankSkipThreshold <= 0 ||
+      opt_.criterionType != CriterionType::CTC) {
+    return false;
+  }
+  const double logThreshold = std::log(opt_.blankSkipThreshold);
+  const float maxScore = *std::max_element(emissions, emissions + N);
+  // The log posterior of blank is at most emissions[blank_] - maxScore
+  if (emissions[blank_] - maxScore < logThreshold) {
+    return false;
+  }
+  double sum = 0;
+  for (int n = 0; n < N; n++) {
+    sum += std::exp(emissions[n] - maxScore);
+  }
+  return emissions[blank_] - maxScore - std::log(sum) >= logThreshold;
+}
+
+void LexiconDecoder::decodeBlankFrame(
+    double amScore,
+    const std::vector<LexiconDecoderState>& prevHyps,
+    std::vector<LexiconDecoderState>& outputs,
+    std::vector<MergedCandidate<LexiconDecoderState>>* merged) {
+  if (merged) {
+    merged->clear();
+  }
+  // Hypothesis which all end with a blank stay distinct when blank is
+  // repeated, so that they are only moved forward (runs of blank frames)
+  bool allBlank = std::all_of(
+      prevHyps.begin(),
+      prevHyps.end(),
+      [this](const LexiconDecoderState& prevHyp) {
+        return prevHyp.prevBlank && prevHyp.token == blank_;
+      });
+  if (allBlank) {
+    outputs.clear();
+    for (const LexiconDecoderState& prevHyp : prevHyps) {
+      outputs.emplace_back(
+          prevHyp.score + amScore,
+          prevHyp.lmState,
+          prevHyp.lex,
+          &prevHyp,
+          blank_,
+          -1,
+          true, // prevBlank
+          prevHyp.amScore + amScore,
+          prevHyp.lmScore);
     }
+    return;
+  }
 
-    candidatesStore(
+  candidatesReset(
+      candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+  for (const LexiconDecoderState& prevHyp : prevHyps) {
+    candidatesAddMerged(
         candidates_,
-        candidatePtrs_,
-        hyp_[startFrame + t + 1],
-        opt_.beamSize,
-        candidatesBestScore_ - opt_.beamThreshold,
+        candidateIndex_,
+        merged,
+        candidatesBestScore_,
+        opt_.beamThreshold,
         opt_.logAdd,
-        false);
-    updateLMCache(lm_, hyp_[startFrame + t + 1]);
+        prevHyp.score + amScore,
+        prevHyp.lmState,
+        prevHyp.lex,
+        &prevHyp,
+        blank_,
+        -1,
+        true, // prevBlank
+        prevHyp.amScore + amScore,
+        prevHyp.lmScore);
+  }
+  candidatesStore(
+      candidates_,
+      candidatePtrs_,
+      candidateIndex_,
+      outputs,
+      opt_.beamSize,
+      candidatesBestScore_ - opt_.beamThreshold,
+      false);
+  if (merged) {
+    mergedCandidatesStore(candidates_, candidatePtrs_, outputs, *merged);
   }
-
-  nDecodedFrames_ += T;
 }
 
 void LexiconDecoder::decodeEnd() {
-  candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
+  int frame = nDecodedFrames_ - nPrunedFrames_;
+  decodeFinish(
+      hyp_[frame],
+      hyp_[frame + 1],
+      opt_.keepMergedHyps ? &mergedHyp_[frame + 1] : nullptr);
+  ++nDecodedFrames_;
+}
+
+void LexiconDecoder::decodeFinish(
+    const std::vector<LexiconDecoderState>& prevHyps,
+    std::vector<LexiconDecoderState>& outputs,
+    std::vector<MergedCandidate<LexiconDecoderState>>* merged) {
+  candidatesReset(
+      candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+  if (merged) {
+    merged->clear();
+  }
   bool hasNiceEnding = false;
-  for (const LexiconDecoderState& prevHyp :
-       hyp_[nDecodedFrames_ - nPrunedFrames_]) {
+  for (const LexiconDecoderState& prevHyp : prevHyps) {
     if (prevHyp.lex == lexicon_->getRoot()) {
       hasNiceEnding = true;
       break;
     }
   }
-  for (const LexiconDecoderState& prevHyp :
-       hyp_[nDecodedFrames_ - nPrunedFrames_]) {
-    const TrieNode* prevLex = prevHyp.lex;
+  for (const LexiconDecoderState& prevHyp : prevHyps) {
+    const FlatTrieNode* prevLex = prevHyp.lex;
     const LMStatePtr& prevLmState = prevHyp.lmState;
 
     if (!hasNiceEnding || prevHyp.lex == lexicon_->getRoot()) {
       auto lmStateScorePair = lm_->finish(prevLmState);
       auto lmScore = lmStateScorePair.second;
-      candidatesAdd(
+      candidatesAddMerged(
           candidates_,
+          candidateIndex_,
+          merged,
           candidatesBestScore_,
           opt_.beamThreshold,
+          opt_.logAdd,
           prevHyp.score + opt_.lmWeight * lmScore,
           lmStateScorePair.first,
           prevLex,
@@ -255,12 +469,101 @@ void LexiconDecoder::decodeEnd() {
   candidatesStore(
       candidates_,
       candidatePtrs_,
-      hyp_[nDecodedFrames_ - nPrunedFrames_ + 1],
+      candidateIndex_,
+      outputs,
       opt_.beamSize,
       candidatesBestScore_ - opt_.beamThreshold,
-      opt_.logAdd,
       true);
-  ++nDecodedFrames_;
+  if (merged) {
+    mergedCandidatesStore(candidates_, candidatePtrs_, outputs, *merged);
+  }
+}
+
+std::vector<std::vector<DecodeResult>> LexiconDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  if (emissions.size() != T.size()) {
+    throw std::invalid_argument(
+        "[LexiconDecoder] Number of emissions and lengths should be the same");
+  }
+  const int batchSize = emissions.size();
+  int maxT = 0;
+  for (int b = 0; b < batchSize; b++) {
+    if (T[b] < 0) {
+      throw std::invalid_argument(
+          "[LexiconDecoder] Invalid emissions length: " +
+          std::to_string(T[b]));
+    }
+    maxT = std::max(maxT, T[b]);
+  }
+
+  /* (1) Reset the beams, keeping the memory allocated by previous calls */
+  // Utterances share the start state so that LM states (and cached scores)
+  // of common prefixes are shared as well
+  batchLmStatePool_->reset();
+  LMStatePtr startState = lm_->start(0, batchLmStatePool_);
+  nSkippedFrames_ = 0;
+  if (batchHyp_.size() < batchSize) {
+    batchHyp_.resize(batchSize);
+  }
+  for (int b = 0; b < batchSize; b++) {
+    auto& hyp = batchHyp_[b];
+    for (auto& frameHyp : hyp) {
+      frameHyp.clear();
+    }
+    if (hyp.size() < T[b] + 2) {
+      hyp.resize(T[b] + 2);
+    }
+    hyp[0].emplace_back(
+        0.0, startState, lexicon_->getRoot(), nullptr, sil_, -1);
+  }
+
+  /* (2) Interleave utterances frame by frame */
+  const int k = std::min(opt_.beamSizeToken, N);
+  tokens_.resize(k);
+  nTokens_.resize(1);
+  std::vector<LMStatePtr> lmStates;
+  for (int t = 0; t < maxT; t++) {
+    lmStates.clear();
+    for (int b = 0; b < batchSize; b++) {
+      if (t >= T[b]) {
+        continue;
+      }
+      auto& hyp = batchHyp_[b];
+      const float* frameEmissions = emissions[b] + t * N;
+      selectTopKTokens(
+          frameEmissions,
+          1,
+          N,
+          k,
+          opt_.beamThresholdToken,
+          tokens_.data(),
+          nTokens_.data());
+      decodeFrame(
+          frameEmissions,
+          N,
+          t,
+          tokens_.data(),
+          nTokens_[0],
+          hyp[t],
+          hyp[t + 1],
+          nullptr);
+      for (const auto& state : hyp[t + 1]) {
+        lmStates.emplace_back(state.lmState);
+      }
+    }
+    lm_->updateCache(lmStates);
+  }
+
+  /* (3) Finish all utterances */
+  std::vector<std::vector<DecodeResult>> results(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    auto& hyp = batchHyp_[b];
+    decodeFinish(hyp[T[b]], hyp[T[b] + 1], nullptr);
+    results[b] = getAllHypothesis(hyp[T[b] + 1], T[b] + 1);
+  }
+  return results;
 }
 
 std::vector<DecodeResult> LexiconDecoder::getAllFinalHypothesis() const {
@@ -269,7 +572,18 @@ std::vector<DecodeResult> LexiconDecoder::getAllFinalHypothesis() const {
     return std::vector<DecodeResult>{};
   }
 
-  return getAllHypothesis(hyp_.find(finalFrame)->second, finalFrame);
+  return getAllHypothesis(hyp_[finalFrame], finalFrame);
+}
+
+Lattice LexiconDecoder::getLattice() const {
+  int finalFrame = nDecodedFrames_ - nPrunedFrames_;
+  return buildLattice(
+      hyp_[finalFrame],
+      finalFrame,
+      nPrunedFrames_,
+      mergedHyp_,
+      [](const LexiconDecoderState& state) { return state.word; },
+      [](const LexiconDecoderState& state) { return state.lex; });
 }
 
 DecodeResult LexiconDecoder::getBestHypothesis(int lookBack) const {
@@ -278,13 +592,17 @@ DecodeResult LexiconDecoder::getBestHypothesis(int lookBack) const {
   }
 
   const LexiconDecoderState* bestNode = findBestAncestor(
-      hyp_.find(nDecodedFrames_ - nPrunedFrames_)->second, lookBack);
+      hyp_[nDecodedFrames_ - nPrunedFrames_], lookBack);
   return getHypothesis(bestNode, nDecodedFrames_ - nPrunedFrames_ - lookBack);
 }
 
 int LexiconDecoder::nHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return hyp_.find(finalFrame)->second.size();
+  return hyp_[finalFrame].size();
+}
+
+int LexiconDecoder::nSkippedFrames() const {
+  return nSkippedFrames_;
 }
 
 int LexiconDecoder::nDecodedFramesInBuffer() const {
@@ -298,7 +616,7 @@ void LexiconDecoder::prune(int lookBack) {
 
   /* (1) Find the last emitted word in the best path */
   const LexiconDecoderState* bestNode = findBestAncestor(
-      hyp_.find(nDecodedFrames_ - nPrunedFrames_)->second, lookBack);
+      hyp_[nDecodedFrames_ - nPrunedFrames_], lookBack);
   if (!bestNode) {
     return; // Not enough decoded frames to prune
   }
@@ -309,7 +627,7 @@ void LexiconDecoder::prune(int lookBack) {
   }
 
   /* (2) Move things from back of hyp_ to front and normalize scores */
-  pruneAndNormalize(hyp_, startFrame, lookBack);
+  pruneAndNormalize(hyp_, startFrame, lookBack, &mergedHyp_);
 
   nPrunedFrames_ = nDecodedFrames_ - lookBack;
 }
@@ -7,9 +7,15 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
+#include <utility>
 
+#include "flashlight/lib/common/ThreadGroup.h"
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
+#include "flashlight/lib/text/decoder/TokenSelection.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 
@@ -27,6 +33,16 @@ struct LexiconDecoderOptions {
   double silScore; // Silence insertion score
   bool logAdd; // If or not use logadd when merging hypothesis
   CriterionType criterionType; // CTC or ASG
+  double beamThresholdToken; // Threshold to prune tokens (0 to disable)
+  // Blank posterior above which a frame only takes the blank transition
+  // (CTC only, 0 to disable)
+  double blankSkipThreshold;
+  // Number of threads expanding the hypothesis of each frame (0 or 1 to only
+  // use the calling thread). The results do not depend on it.
+  int nExpansionThreads;
+  // Keep the hypothesis merged into others during the search, so that they
+  // are part of the lattice (see `LexiconDecoder::getLattice()`)
+  bool keepMergedHyps;
 };
 
 /**
@@ -35,7 +51,7 @@ struct LexiconDecoderOptions {
 struct LexiconDecoderState {
   double score; // Accumulated total score so far
   LMStatePtr lmState; // Language model state
-  const TrieNode* lex; // Trie node in the lexicon
+  const FlatTrieNode* lex; // Trie node in the lexicon
   const LexiconDecoderState* parent; // Parent hypothesis
   int token; // Label of token
   int word; // Label of word (-1 if incomplete)
@@ -47,7 +63,7 @@ struct LexiconDecoderState {
   LexiconDecoderState(
       const double score,
       const LMStatePtr& lmState,
-      const TrieNode* lex,
+      const FlatTrieNode* lex,
       const LexiconDecoderState* parent,
       const int token,
       const int word,
@@ -89,6 +105,13 @@ struct LexiconDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreState() const {
+    size_t hash = reinterpret_cast<uintptr_t>(lmState.get());
+    hash = hashCombine(hash, reinterpret_cast<uintptr_t>(lex));
+    hash = hashCombine(hash, token);
+    return hashCombine(hash, prevBlank);
+  }
+
   int getWord() const {
     return word;
   }
@@ -110,6 +133,10 @@ struct LexiconDecoderState {
  * score of the transcription W. Note that the lexicon is used to limit the
  * search space and all candidate words are generated from it if unkScore is
  * -inf, otherwise <UNK> will be generated for OOVs.
+ *
+ * The lexicon trie is compiled into a FlatTrie when given as a Trie. Several
+ * decoders can share one FlatTrie (possibly memory mapped from a file) by using
+ * the constructor taking a FlatTriePtr.
  */
 class LexiconDecoder : public Decoder {
  public:
@@ -122,6 +149,25 @@ class LexiconDecoder : public Decoder {
       const int unk,
       const std::vector<float>& transitions,
       const bool isLmToken)
+      : LexiconDecoder(
+            std::move(opt),
+            std::make_shared<FlatTrie>(*lexicon),
+            lm,
+            sil,
+            blank,
+            unk,
+            transitions,
+            isLmToken) {}
+
+  LexiconDecoder(
+      LexiconDecoderOptions opt,
+      const FlatTriePtr& lexicon,
+      const LMPtr& lm,
+      const int sil,
+      const int blank,
+      const int unk,
+      const std::vector<float>& transitions,
+      const bool isLmToken)
       : opt_(std::move(opt)),
         lexicon_(lexicon),
         lm_(lm),
@@ -129,7 +175,13 @@ class LexiconDecoder : public Decoder {
         blank_(blank),
         unk_(unk),
         transitions_(transitions),
-        isLmToken_(isLmToken) {}
+        isLmToken_(isLmToken),
+        batchLmStatePool_(std::make_shared<LMStatePool>()),
+        nSkippedFrames_(0),
+        expansionThreads_(
+            opt_.nExpansionThreads > 1
+                ? std::make_unique<ThreadGroup>(opt_.nExpansionThreads)
+                : nullptr) {}
 
   void decodeBegin() override;
 
@@ -137,8 +189,30 @@ class LexiconDecoder : public Decoder {
 
   void decodeEnd() override;
 
+  /**
+   * Offline decoding of a batch of utterances. Utterance `b` has emissions of
+   * size T[b] x N stored at emissions[b]. All the utterances are decoded frame
+   * by frame in an interleaved manner sharing the candidate pools, and the LM
+   * cache is updated once per frame with the states of the whole batch.
+   * Returns all the final hypothesis for each utterance. The LM states of
+   * the batch live in their own pool, so that the state of the online
+   * decoding (decodeBegin / decodeStep / decodeEnd) is not changed, except
+   * for the number of skipped frames. Lengths must be non-negative.
+   */
+  std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N);
+
   int nHypothesis() const;
 
+  /**
+   * Number of frames decoded with the blank fast path (see
+   * `LexiconDecoderOptions::blankSkipThreshold`) since the last call to
+   * `decodeBegin()` or `decodeBatch()`.
+   */
+  int nSkippedFrames() const;
+
   void prune(int lookBack = 0) override;
 
   int nDecodedFramesInBuffer() const override;
@@ -147,10 +221,17 @@ class LexiconDecoder : public Decoder {
 
   std::vector<DecodeResult> getAllFinalHypothesis() const override;
 
+  /**
+   * Lattice of the hypothesis of the last decoded frame (see `Lattice`), whose
+   * arcs are labeled with word indices. It includes the hypothesis merged
+   * during the search if `keepMergedHyps` is set.
+   */
+  Lattice getLattice() const;
+
  protected:
   LexiconDecoderOptions opt_;
   // Lexicon trie to restrict beam-search decoder
-  TriePtr lexicon_;
+  FlatTriePtr lexicon_;
   LMPtr lm_;
   // Index of silence label
   int sil_;
@@ -172,15 +253,121 @@ class LexiconDecoder : public Decoder {
   // so instead of moving around objects, we only need to sort pointers
   std::vector<LexiconDecoderState*> candidatePtrs_;
 
+  // Hash index of candidates_, used to merge identical candidates as soon as
+  // they are added
+  CandidateIndex candidateIndex_;
+
   // Best candidate score of current frame
   double candidatesBestScore_;
 
-  // Vector of hypothesis for all the frames so far
-  std::unordered_map<int, std::vector<LexiconDecoderState>> hyp_;
+  // Hypothesis of all the frames in the buffer
+  HypothesisBuffer<LexiconDecoderState> hyp_;
+
+  // Candidates merged into the hypothesis of each frame in the buffer (if
+  // `keepMergedHyps` is set)
+  HypothesisBuffer<MergedCandidate<LexiconDecoderState>> mergedHyp_;
+
+  // Hypothesis of all the frames for each utterance in `decodeBatch()`, kept
+  // between the calls to reuse the allocated memory
+  std::vector<std::vector<std::vector<LexiconDecoderState>>> batchHyp_;
+  // Pool of the LM states of `decodeBatch()`, separate from the one of the
+  // online decoding
+  LMStatePoolPtr batchLmStatePool_;
 
   // These 2 variables are used for online decoding, for hypothesis pruning
   int nDecodedFrames_; // Total number of decoded frames.
   int nPrunedFrames_; // Total number of pruned frames from hyp_.
+  int nSkippedFrames_; // Number of frames decoded with the blank fast path.
+
+  // Tokens selected for expansion in each frame of the current chunk, see
+  // `selectTopKTokens()`
+  std::vector<int> tokens_;
+  std::vector<int> nTokens_;
+
+  // Candidate proposed by the expansion of a hypothesis, before LM scoring
+  struct Proposal {
+    const LexiconDecoderState* prevHyp;
+    const FlatTrieNode* lex;
+    int token;
+    int word;
+    bool prevBlank;
+    double score; // Score without the LM and word insertion scores
+    double amScore; // AM score of the frame
+    double insertionScore; // Word or unknown word insertion score
+    // Token scored by the LM from the state of `prevHyp`, or -1 to keep this
+    // state. `lmScore` is the LM score in the latter case, and is subtracted
+    // from the score of the LM in the former.
+    int lmToken;
+    float lmScore;
+    int lmQuery; // Index of the LM query of the frame scoring `lmToken`
+  };
+
+  // Threads expanding the hypothesis (if `nExpansionThreads` > 1) and the
+  // proposals of each of them. The proposals are scored and merged on the
+  // calling thread, in the same order whatever the number of threads.
+  std::unique_ptr<ThreadGroup> expansionThreads_;
+  std::vector<std::vector<Proposal>> proposals_;
+
+  // LM queries of the proposals of a frame, scored with a single call to
+  // `LM::scoreBatch()`. Consecutive proposals share their queries.
+  std::vector<LMStatePtr> lmQueryStates_;
+  std::vector<int> lmQueryTokens_;
+  std::vector<LMStatePtr> lmQueryOutStates_;
+  std::vector<float> lmQueryScores_;
+
+  // Propose the candidates expanding `prevHyp` with the `nTokens` tokens
+  // selected in the frame with index `frame`
+  void expandHypothesis(
+      const LexiconDecoderState& prevHyp,
+      const float* emissions,
+      int N,
+      int frame,
+      const int* tokens,
+      int nTokens,
+      std::vector<Proposal>& proposals) const;
+
+  // Score the LM queries of all the proposals of the frame
+  void scoreProposals(int nChunks);
+
+  // Add a scored proposal to the candidates, appending the candidate merged
+  // into another one (if any) to `merged` if it is not null
+  void addProposal(
+      const Proposal& proposal,
+      std::vector<MergedCandidate<LexiconDecoderState>>* merged);
+
+  // Expand the hypothesis `prevHyps` of a single frame with index `frame`
+  // given the emissions of this frame (of size N) and the `nTokens` tokens
+  // selected for expansion, and store the new beam into `outputs`. The
+  // candidates merged into the new beam are stored into `merged` if it is
+  // not null.
+  void decodeFrame(
+      const float* emissions,
+      int N,
+      int frame,
+      const int* tokens,
+      int nTokens,
+      const std::vector<LexiconDecoderState>& prevHyps,
+      std::vector<LexiconDecoderState>& outputs,
+      std::vector<MergedCandidate<LexiconDecoderState>>* merged);
+
+  // Whether the blank posterior of a frame is above `blankSkipThreshold`
+  bool isBlankFrame(const float* emissions, int N) const;
+
+  // Expand the hypothesis `prevHyps` with the blank token only, given its
+  // score `amScore` in the current frame, and store the new beam into
+  // `outputs`
+  void decodeBlankFrame(
+      double amScore,
+      const std::vector<LexiconDecoderState>& prevHyps,
+      std::vector<LexiconDecoderState>& outputs,
+      std::vector<MergedCandidate<LexiconDecoderState>>* merged);
+
+  // Finish the hypothesis `prevHyps` of the last frame with the LM and store
+  // the final beam into `outputs`
+  void decodeFinish(
+      const std::vector<LexiconDecoderState>& prevHyps,
+      std::vector<LexiconDecoderState>& outputs,
+      std::vector<MergedCandidate<LexiconDecoderState>>* merged);
 };
 } // namespace text
 } // namespace lib
@@ -18,125 +18,228 @@ namespace lib {
 namespace text {
 
 void LexiconFreeDecoder::decodeBegin() {
-  hyp_.clear();
-  hyp_.emplace(0, std::vector<LexiconFreeDecoderState>());
+  hyp_.reset();
+  mergedHyp_.reset();
 
   /* note: the lm reset itself with :start() */
-  hyp_[0].emplace_back(0.0, lm_->start(0), nullptr, sil_);
+  lmStatePool_->reset();
+  hyp_[0].emplace_back(0.0, lm_->start(0, lmStatePool_), nullptr, sil_);
   nDecodedFrames_ = 0;
   nPrunedFrames_ = 0;
 }
 
+void LexiconFreeDecoder::expandHypothesis(
+    const LexiconFreeDecoderState& prevHyp,
+    const float* emissions,
+    int N,
+    int frame,
+    const int* tokens,
+    int nTokens,
+    std::vector<Proposal>& proposals) const {
+  const int prevIdx = prevHyp.token;
+  for (int r = 0; r < nTokens; ++r) {
+    int n = tokens[r];
+    double amScore = emissions[n];
+    if (frame > 0 && opt_.criterionType == CriterionType::ASG) {
+      amScore += transitions_[n * N + prevIdx];
+    }
+    double score = prevHyp.score + emissions[n];
+    if (n == sil_) {
+      score += opt_.silScore;
+    }
+
+    if ((opt_.criterionType == CriterionType::ASG && n != prevIdx) ||
+        (opt_.criterionType == CriterionType::CTC && n != blank_ &&
+         (n != prevIdx || prevHyp.prevBlank))) {
+      proposals.push_back(Proposal{&prevHyp, n, false, score, amScore, n, -1});
+    } else if (opt_.criterionType == CriterionType::CTC && n == blank_) {
+      proposals.push_back(
+          Proposal{&prevHyp, n, true, score, amScore, -1, -1});
+    } else {
+      proposals.push_back(
+          Proposal{&prevHyp, n, false, score, amScore, -1, -1});
+    }
+  }
+}
+
+void LexiconFreeDecoder::scoreProposals(int nChunks) {
+  lmQueryStates_.clear();
+  lmQueryTokens_.clear();
+  for (int chunk = 0; chunk < nChunks; chunk++) {
+    for (Proposal& proposal : proposals_[chunk]) {
+      if (proposal.lmToken >= 0) {
+        proposal.lmQuery = lmQueryTokens_.size();
+        lmQueryStates_.push_back(proposal.prevHyp->lmState);
+        lmQueryTokens_.push_back(proposal.lmToken);
+      }
+    }
+  }
+
+  lmQueryOutStates_.resize(lmQueryTokens_.size());
+  lmQueryScores_.resize(lmQueryTokens_.size());
+  lm_->scoreBatch(
+      lmQueryStates_.data(),
+      lmQueryTokens_.data(),
+      lmQueryTokens_.size(),
+      lmQueryOutStates_.data(),
+      lmQueryScores_.data());
+}
+
+void LexiconFreeDecoder::addProposal(
+    const Proposal& proposal,
+    std::vector<MergedCandidate<LexiconFreeDecoderState>>* merged) {
+  const LexiconFreeDecoderState* prevHyp = proposal.prevHyp;
+  if (proposal.lmToken >= 0) {
+    auto lmScore = lmQueryScores_[proposal.lmQuery];
+
+    candidatesAddMerged(
+        candidates_,
+        candidateIndex_,
+        merged,
+        candidatesBestScore_,
+        opt_.beamThreshold,
+        opt_.logAdd,
+        proposal.score + opt_.lmWeight * lmScore,
+        lmQueryOutStates_[proposal.lmQuery],
+        prevHyp,
+        proposal.token,
+        proposal.prevBlank,
+        prevHyp->amScore + proposal.amScore,
+        prevHyp->lmScore + lmScore);
+  } else {
+    candidatesAddMerged(
+        candidates_,
+        candidateIndex_,
+        merged,
+        candidatesBestScore_,
+        opt_.beamThreshold,
+        opt_.logAdd,
+        proposal.score,
+        prevHyp->lmState,
+        prevHyp,
+        proposal.token,
+        proposal.prevBlank,
+        prevHyp->amScore + proposal.amScore,
+        prevHyp->lmScore);
+  }
+}
+
 void LexiconFreeDecoder::decodeStep(const float* emissions, int T, int N) {
   int startFrame = nDecodedFrames_ - nPrunedFrames_;
   // Extend hyp_ buffer
-  if (hyp_.size() < startFrame + T + 2) {
-    for (int i = hyp_.size(); i < startFrame + T + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconFreeDecoderState>());
-    }
-  }
+  hyp_.reserve(startFrame + T + 2);
+  mergedHyp_.reserve(startFrame + T + 2);
+
+  const int k = std::min(opt_.beamSizeToken, N);
+  tokens_.resize(static_cast<size_t>(T) * k);
+  nTokens_.resize(T);
+  selectTopKTokens(
+      emissions,
+      T,
+      N,
+      k,
+      opt_.beamThresholdToken,
+      tokens_.data(),
+      nTokens_.data());
 
-  std::vector<size_t> idx(N);
   // Looping over all the frames
   for (int t = 0; t < T; t++) {
-    std::iota(idx.begin(), idx.end(), 0);
-    if (N > opt_.beamSizeToken) {
-      std::partial_sort(
-          idx.begin(),
-          idx.begin() + opt_.beamSizeToken,
-          idx.end(),
-          [&t, &N, &emissions](const size_t& l, const size_t& r) {
-            return emissions[t * N + l] > emissions[t * N + r];
-          });
+    const int* tokens = tokens_.data() + static_cast<size_t>(t) * k;
+
+    candidatesReset(
+        candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+    auto* merged =
+        opt_.keepMergedHyps ? &mergedHyp_[startFrame + t + 1] : nullptr;
+    if (merged) {
+      merged->clear();
+    }
+    const float* frameEmissions = emissions + static_cast<size_t>(t) * N;
+    const int frame = nDecodedFrames_ + t;
+    const auto& prevHyps = hyp_[startFrame + t];
+    int nChunks = expansionThreads_
+        ? std::min<int>(
+              expansionThreads_->size(),
+              prevHyps.size() / kMinExpansionHypsPerThread)
+        : 1;
+    nChunks = std::max(nChunks, 1);
+    if (proposals_.size() < nChunks) {
+      proposals_.resize(nChunks);
     }
+    auto expandChunk = [&](int chunk) {
+      if (chunk >= nChunks) {
+        return;
+      }
+      auto& proposals = proposals_[chunk];
+      proposals.clear();
+      size_t begin = prevHyps.size() * chunk / nChunks;
+      size_t end = prevHyps.size() * (chunk + 1) / nChunks;
+      for (size_t i = begin; i < end; i++) {
+        expandHypothesis(
+            prevHyps[i],
+            frameEmissions,
+            N,
+            frame,
+            tokens,
+            nTokens_[t],
+            proposals);
+      }
+    };
 
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
-    for (const LexiconFreeDecoderState& prevHyp : hyp_[startFrame + t]) {
-      const int prevIdx = prevHyp.token;
-
-      for (int r = 0; r < std::min(opt_.beamSizeToken, N); ++r) {
-        int n = idx[r];
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + emissions[t * N + n];
-        if (n == sil_) {
-          score += opt_.silScore;
-        }
-
-        if ((opt_.criterionType == CriterionType::ASG && n != prevIdx) ||
-            (opt_.criterionType == CriterionType::CTC && n != blank_ &&
-             (n != prevIdx || prevHyp.prevBlank))) {
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          auto lmScore = lmStateScorePair.second;
-
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore,
-              lmStateScorePair.first,
-              &prevHyp,
-              n,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        } else if (opt_.criterionType == CriterionType::CTC && n == blank_) {
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score,
-              prevHyp.lmState,
-              &prevHyp,
-              n,
-              true, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore);
-        } else {
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score,
-              prevHyp.lmState,
-              &prevHyp,
-              n,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore);
-        }
+    /* (1) Expand the hypothesis, by chunks in parallel for large beams */
+    if (nChunks > 1) {
+      expansionThreads_->run(expandChunk);
+    } else {
+      expandChunk(0);
+    }
+
+    /* (2) Score all the LM queries of the frame at once */
+    scoreProposals(nChunks);
+
+    /* (3) Merge the proposals into the candidates, in the sequential order */
+    for (int chunk = 0; chunk < nChunks; chunk++) {
+      for (const Proposal& proposal : proposals_[chunk]) {
+        addProposal(proposal, merged);
       }
     }
 
     candidatesStore(
         candidates_,
         candidatePtrs_,
+        candidateIndex_,
         hyp_[startFrame + t + 1],
         opt_.beamSize,
         candidatesBestScore_ - opt_.beamThreshold,
-        opt_.logAdd,
         false);
+    if (merged) {
+      mergedCandidatesStore(
+          candidates_, candidatePtrs_, hyp_[startFrame + t + 1], *merged);
+    }
     updateLMCache(lm_, hyp_[startFrame + t + 1]);
   }
   nDecodedFrames_ += T;
 }
 
 void LexiconFreeDecoder::decodeEnd() {
-  candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
-  for (const LexiconFreeDecoderState& prevHyp :
-       hyp_[nDecodedFrames_ - nPrunedFrames_]) {
+  int frame = nDecodedFrames_ - nPrunedFrames_;
+  candidatesReset(
+      candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+  auto* merged = opt_.keepMergedHyps ? &mergedHyp_[frame + 1] : nullptr;
+  if (merged) {
+    merged->clear();
+  }
+  for (const LexiconFreeDecoderState& prevHyp : hyp_[frame]) {
     const LMStatePtr& prevLmState = prevHyp.lmState;
 
     auto lmStateScorePair = lm_->finish(prevLmState);
     auto lmScore = lmStateScorePair.second;
 
-    candidatesAdd(
+    candidatesAddMerged(
         candidates_,
+        candidateIndex_,
+        merged,
         candidatesBestScore_,
         opt_.beamThreshold,
+        opt_.logAdd,
         prevHyp.score + opt_.lmWeight * lmScore,
         lmStateScorePair.first,
         &prevHyp,
@@ -149,30 +252,54 @@ void LexiconFreeDecoder::decodeEnd() {
   candidatesStore(
       candidates_,
       candidatePtrs_,
-      hyp_[nDecodedFrames_ - nPrunedFrames_ + 1],
+      candidateIndex_,
+      hyp_[frame + 1],
       opt_.beamSize,
       candidatesBestScore_ - opt_.beamThreshold,
-      opt_.logAdd,
       true);
+  if (merged) {
+    mergedCandidatesStore(
+        candidates_, candidatePtrs_, hyp_[frame + 1], *merged);
+  }
   ++nDecodedFrames_;
 }
 
 std::vector<DecodeResult> LexiconFreeDecoder::getAllFinalHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return getAllHypothesis(hyp_.find(finalFrame)->second, finalFrame);
+  return getAllHypothesis(hyp_[finalFrame], finalFrame);
+}
+
+Lattice LexiconFreeDecoder::getLattice() const {
+  int finalFrame = nDecodedFrames_ - nPrunedFrames_;
+  bool isCtc = opt_.criterionType == CriterionType::CTC;
+  int blank = blank_;
+  return buildLattice(
+      hyp_[finalFrame],
+      finalFrame,
+      nPrunedFrames_,
+      mergedHyp_,
+      [isCtc, blank](const LexiconFreeDecoderState& state) {
+        const LexiconFreeDecoderState* parent = state.parent;
+        bool isNewToken = isCtc
+            ? state.token != blank &&
+                (state.token != parent->token || parent->prevBlank)
+            : state.token != parent->token;
+        return isNewToken ? state.token : -1;
+      },
+      [](const LexiconFreeDecoderState&) { return nullptr; });
 }
 
 DecodeResult LexiconFreeDecoder::getBestHypothesis(int lookBack) const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
   const LexiconFreeDecoderState* bestNode =
-      findBestAncestor(hyp_.find(finalFrame)->second, lookBack);
+      findBestAncestor(hyp_[finalFrame], lookBack);
 
   return getHypothesis(bestNode, nDecodedFrames_ - nPrunedFrames_ - lookBack);
 }
 
 int LexiconFreeDecoder::nHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return hyp_.find(finalFrame)->second.size();
+  return hyp_[finalFrame].size();
 }
 
 int LexiconFreeDecoder::nDecodedFramesInBuffer() const {
@@ -187,7 +314,7 @@ void LexiconFreeDecoder::prune(int lookBack) {
   /* (1) Find the last emitted word in the best path */
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
   const LexiconFreeDecoderState* bestNode =
-      findBestAncestor(hyp_.find(finalFrame)->second, lookBack);
+      findBestAncestor(hyp_[finalFrame], lookBack);
   if (!bestNode) {
     return; // Not enough decoded frames to prune
   }
@@ -198,7 +325,7 @@ void LexiconFreeDecoder::prune(int lookBack) {
   }
 
   /* (2) Move things from back of hyp_ to front and normalize scores */
-  pruneAndNormalize(hyp_, startFrame, lookBack);
+  pruneAndNormalize(hyp_, startFrame, lookBack, &mergedHyp_);
 
   nPrunedFrames_ = nDecodedFrames_ - lookBack;
 }
@@ -7,9 +7,13 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 
+#include "flashlight/lib/common/ThreadGroup.h"
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
+#include "flashlight/lib/text/decoder/TokenSelection.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 
 namespace fl {
@@ -24,6 +28,13 @@ struct LexiconFreeDecoderOptions {
   double silScore; // Silence insertion score
   bool logAdd;
   CriterionType criterionType; // CTC or ASG
+  double beamThresholdToken; // Threshold to prune tokens (0 to disable)
+  // Number of threads expanding the hypothesis of each frame (0 or 1 to only
+  // use the calling thread). The results do not depend on it.
+  int nExpansionThreads;
+  // Keep the hypothesis merged into others during the search, so that they
+  // are part of the lattice (see `LexiconFreeDecoder::getLattice()`)
+  bool keepMergedHyps;
 };
 
 /**
@@ -76,6 +87,12 @@ struct LexiconFreeDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreState() const {
+    size_t hash = reinterpret_cast<uintptr_t>(lmState.get());
+    hash = hashCombine(hash, token);
+    return hashCombine(hash, prevBlank);
+  }
+
   int getWord() const {
     return -1;
   }
@@ -108,7 +125,11 @@ class LexiconFreeDecoder : public Decoder {
         lm_(lm),
         transitions_(transitions),
         sil_(sil),
-        blank_(blank) {}
+        blank_(blank),
+        expansionThreads_(
+            opt_.nExpansionThreads > 1
+                ? std::make_unique<ThreadGroup>(opt_.nExpansionThreads)
+                : nullptr) {}
 
   void decodeBegin() override;
 
@@ -126,6 +147,13 @@ class LexiconFreeDecoder : public Decoder {
 
   std::vector<DecodeResult> getAllFinalHypothesis() const override;
 
+  /**
+   * Lattice of the hypothesis of the last decoded frame (see `Lattice`), whose
+   * arcs are labeled with the emitted tokens. It includes the hypothesis
+   * merged during the search if `keepMergedHyps` is set.
+   */
+  Lattice getLattice() const;
+
  protected:
   LexiconFreeDecoderOptions opt_;
   LMPtr lm_;
@@ -139,6 +167,10 @@ class LexiconFreeDecoder : public Decoder {
   // so instead of moving around objects, we only need to sort pointers
   std::vector<LexiconFreeDecoderState*> candidatePtrs_;
 
+  // Hash index of candidates_, used to merge identical candidates as soon as
+  // they are added
+  CandidateIndex candidateIndex_;
+
   // Best candidate score of current frame
   double candidatesBestScore_;
 
@@ -148,12 +180,65 @@ class LexiconFreeDecoder : public Decoder {
   // Index of blank label (for CTC)
   int blank_;
 
-  // Vector of hypothesis for all the frames so far
-  std::unordered_map<int, std::vector<LexiconFreeDecoderState>> hyp_;
+  // Hypothesis of all the frames in the buffer
+  HypothesisBuffer<LexiconFreeDecoderState> hyp_;
+
+  // Candidates merged into the hypothesis of each frame in the buffer (if
+  // `keepMergedHyps` is set)
+  HypothesisBuffer<MergedCandidate<LexiconFreeDecoderState>> mergedHyp_;
 
   // These 2 variables are used for online decoding, for hypothesis pruning
   int nDecodedFrames_; // Total number of decoded frames.
   int nPrunedFrames_; // Total number of pruned frames from hyp_.
+
+  // Tokens selected for expansion in each frame of the current chunk, see
+  // `selectTopKTokens()`
+  std::vector<int> tokens_;
+  std::vector<int> nTokens_;
+
+  // Candidate proposed by the expansion of a hypothesis, before LM scoring
+  struct Proposal {
+    const LexiconFreeDecoderState* prevHyp;
+    int token;
+    bool prevBlank;
+    double score; // Score without the LM score
+    double amScore; // AM score of the frame
+    int lmToken; // Token scored by the LM, or -1 to keep the LM state
+    int lmQuery; // Index of the LM query of the frame scoring `lmToken`
+  };
+
+  // Threads expanding the hypothesis (if `nExpansionThreads` > 1) and the
+  // proposals of each of them. The proposals are scored and merged on the
+  // calling thread, in the same order whatever the number of threads.
+  std::unique_ptr<ThreadGroup> expansionThreads_;
+  std::vector<std::vector<Proposal>> proposals_;
+
+  // LM queries of the proposals of a frame, scored with a single call to
+  // `LM::scoreBatch()`
+  std::vector<LMStatePtr> lmQueryStates_;
+  std::vector<int> lmQueryTokens_;
+  std::vector<LMStatePtr> lmQueryOutStates_;
+  std::vector<float> lmQueryScores_;
+
+  // Propose the candidates expanding `prevHyp` with the `nTokens` tokens
+  // selected in the frame with index `frame`
+  void expandHypothesis(
+      const LexiconFreeDecoderState& prevHyp,
+      const float* emissions,
+      int N,
+      int frame,
+      const int* tokens,
+      int nTokens,
+      std::vector<Proposal>& proposals) const;
+
+  // Score the LM queries of all the proposals of the frame
+  void scoreProposals(int nChunks);
+
+  // Add a scored proposal to the candidates, appending the candidate merged
+  // into another one (if any) to `merged` if it is not null
+  void addProposal(
+      const Proposal& proposal,
+      std::vector<MergedCandidate<LexiconFreeDecoderState>>* merged);
 };
 } // namespace text
 } // namespace lib
@@ -10,6 +10,7 @@
 #include <cmath>
 #include <functional>
 #include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/text/decoder/LexiconFreeSeq2SeqDecoder.h"
 
@@ -17,6 +18,65 @@ namespace fl {
 namespace lib {
 namespace text {
 
+void LexiconFreeSeq2SeqDecoder::expandHypothesis(
+    const LexiconFreeSeq2SeqDecoderState& prevHyp,
+    const float* amScores,
+    int nClasses,
+    const AMStatePtr& outState) {
+  const int nTokens = std::min(nClasses, opt_.beamSizeToken);
+  tokenIdx_.resize(nClasses);
+  std::iota(tokenIdx_.begin(), tokenIdx_.end(), 0);
+  if (nClasses > opt_.beamSizeToken) {
+    std::partial_sort(
+        tokenIdx_.begin(),
+        tokenIdx_.begin() + nTokens,
+        tokenIdx_.end(),
+        [amScores](const size_t& l, const size_t& r) {
+          return amScores[l] > amScores[r];
+        });
+  }
+
+  for (int r = 0; r < nTokens; r++) {
+    int n = tokenIdx_[r];
+    double amScore = amScores[n];
+
+    if (n == eos_) { /* (1) Try eos */
+      auto lmStateScorePair = lm_->finish(prevHyp.lmState);
+      auto lmScore = lmStateScorePair.second;
+
+      candidatesAdd(
+          candidates_,
+          candidateIndex_,
+          candidatesBestScore_,
+          opt_.beamThreshold,
+          opt_.logAdd,
+          prevHyp.score + amScore + opt_.eosScore + opt_.lmWeight * lmScore,
+          lmStateScorePair.first,
+          &prevHyp,
+          n,
+          nullptr,
+          prevHyp.amScore + amScore,
+          prevHyp.lmScore + lmScore);
+    } else { /* (2) Try normal token */
+      auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
+      auto lmScore = lmStateScorePair.second;
+      candidatesAdd(
+          candidates_,
+          candidateIndex_,
+          candidatesBestScore_,
+          opt_.beamThreshold,
+          opt_.logAdd,
+          prevHyp.score + amScore + opt_.lmWeight * lmScore,
+          lmStateScorePair.first,
+          &prevHyp,
+          n,
+          outState,
+          prevHyp.amScore + amScore,
+          prevHyp.lmScore + lmScore);
+    }
+  }
+}
+
 void LexiconFreeSeq2SeqDecoder::decodeStep(
     const float* emissions,
     int T,
@@ -30,12 +90,14 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
 
   // Start from here.
   hyp_[0].clear();
-  hyp_[0].emplace_back(0.0, lm_->start(0), nullptr, -1, nullptr);
+  lmStatePool_->reset();
+  hyp_[0].emplace_back(0.0, lm_->start(0, lmStatePool_), nullptr, -1, nullptr);
 
   // Decode frame by frame
   int t = 0;
   for (; t < maxOutputLength_; t++) {
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
+    candidatesReset(
+        candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
 
     // Batch forwarding
     rawY_.clear();
@@ -58,8 +120,6 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
     std::tie(amScores, outStates) =
         amUpdateFunc_(emissions, N, T, rawY_, rawPrevStates_, t);
 
-    std::vector<size_t> idx(amScores.back().size());
-
     // Generate new hypothesis
     for (int hypo = 0, validHypo = 0; hypo < hyp_[t].size(); hypo++) {
       const LexiconFreeSeq2SeqDecoderState& prevHyp = hyp_[t][hypo];
@@ -67,8 +127,10 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
       if (prevHyp.token == eos_) {
         candidatesAdd(
             candidates_,
+            candidateIndex_,
             candidatesBestScore_,
             opt_.beamThreshold,
+            opt_.logAdd,
             prevHyp.score,
             prevHyp.lmState,
             &prevHyp,
@@ -80,68 +142,22 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
       }
 
       const AMStatePtr& outState = outStates[validHypo];
-      if (!outState) {
-        validHypo++;
-        continue;
-      }
-
-      std::iota(idx.begin(), idx.end(), 0);
-      if (amScores[validHypo].size() > opt_.beamSizeToken) {
-        std::partial_sort(
-            idx.begin(),
-            idx.begin() + opt_.beamSizeToken,
-            idx.end(),
-            [&amScores, &validHypo](const size_t& l, const size_t& r) {
-              return amScores[validHypo][l] > amScores[validHypo][r];
-            });
-      }
-
-      for (int r = 0;
-           r < std::min(amScores[validHypo].size(), (size_t)opt_.beamSizeToken);
-           r++) {
-        int n = idx[r];
-        double amScore = amScores[validHypo][n];
-
-        if (n == eos_) { /* (1) Try eos */
-          auto lmStateScorePair = lm_->finish(prevHyp.lmState);
-          auto lmScore = lmStateScorePair.second;
-
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              prevHyp.score + amScore + opt_.eosScore + opt_.lmWeight * lmScore,
-              lmStateScorePair.first,
-              &prevHyp,
-              n,
-              nullptr,
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        } else { /* (2) Try normal token */
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          auto lmScore = lmStateScorePair.second;
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              prevHyp.score + amScore + opt_.lmWeight * lmScore,
-              lmStateScorePair.first,
-              &prevHyp,
-              n,
-              outState,
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        }
+      if (outState) {
+        expandHypothesis(
+            prevHyp,
+            amScores[validHypo].data(),
+            amScores[validHypo].size(),
+            outState);
       }
       validHypo++;
     }
     candidatesStore(
         candidates_,
         candidatePtrs_,
+        candidateIndex_,
         hyp_[t + 1],
         opt_.beamSize,
         candidatesBestScore_ - opt_.beamThreshold,
-        opt_.logAdd,
         true);
     updateLMCache(lm_, hyp_[t + 1]);
   } // End of decoding
@@ -155,6 +171,152 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
   }
 }
 
+std::vector<std::vector<DecodeResult>> LexiconFreeSeq2SeqDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  if (!amBatchUpdateFunc_) {
+    throw std::invalid_argument(
+        "[LexiconFreeSeq2SeqDecoder] No batched AM update function given");
+  }
+  if (emissions.size() != T.size()) {
+    throw std::invalid_argument(
+        "[LexiconFreeSeq2SeqDecoder] Number of emissions and lengths should "
+        "be the same");
+  }
+  const int batchSize = emissions.size();
+
+  /* (1) Reset the beams, keeping the memory allocated by previous calls */
+  lmStatePool_->reset();
+  LMStatePtr startState = lm_->start(0, lmStatePool_);
+  if (batchHyp_.size() < batchSize) {
+    batchHyp_.resize(batchSize);
+    batchRows_.resize(batchSize);
+    batchPrevRows_.resize(batchSize);
+  }
+  std::vector<int> finalStep(batchSize, -1);
+  for (int b = 0; b < batchSize; b++) {
+    auto& hyp = batchHyp_[b];
+    for (auto& stepHyp : hyp) {
+      stepHyp.clear();
+    }
+    if (hyp.size() < maxOutputLength_ + 1) {
+      hyp.resize(maxOutputLength_ + 1);
+    }
+    hyp[0].emplace_back(0.0, startState, nullptr, -1, nullptr);
+  }
+
+  /* (2) Score the hypothesis of all the utterances step by step */
+  std::vector<LMStatePtr> lmStates;
+  int t = 0;
+  for (; t < maxOutputLength_; t++) {
+    // Gather the hypothesis to score, whose AM states are in the slots given
+    // by the rows of their parents in the previous step
+    batchUtterances_.clear();
+    batchTokens_.clear();
+    batchSlots_.clear();
+    for (int b = 0; b < batchSize; b++) {
+      if (finalStep[b] >= 0) {
+        continue;
+      }
+      const auto& prevHyps = batchHyp_[b][t];
+      auto& rows = batchRows_[b];
+      rows.assign(prevHyps.size(), -1);
+      for (int i = 0; i < prevHyps.size(); i++) {
+        const LexiconFreeSeq2SeqDecoderState& prevHyp = prevHyps[i];
+        if (prevHyp.token == eos_) {
+          continue;
+        }
+        rows[i] = batchTokens_.size();
+        batchUtterances_.push_back(b);
+        batchTokens_.push_back(prevHyp.token);
+        batchSlots_.push_back(
+            prevHyp.parent
+                ? batchPrevRows_[b][prevHyp.parent - batchHyp_[b][t - 1].data()]
+                : -1);
+      }
+      if (batchTokens_.empty() || batchUtterances_.back() != b) {
+        finalStep[b] = t;
+      }
+    }
+    if (batchTokens_.empty()) {
+      break;
+    }
+
+    const int nClasses = amBatchUpdateFunc_(
+        emissions,
+        N,
+        T,
+        batchUtterances_,
+        batchTokens_,
+        batchSlots_,
+        t,
+        batchAmScores_);
+
+    // Generate new hypothesis for each utterance
+    lmStates.clear();
+    for (int b = 0; b < batchSize; b++) {
+      if (finalStep[b] >= 0) {
+        continue;
+      }
+      const auto& prevHyps = batchHyp_[b][t];
+      const auto& rows = batchRows_[b];
+      candidatesReset(
+          candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
+      for (int i = 0; i < prevHyps.size(); i++) {
+        const LexiconFreeSeq2SeqDecoderState& prevHyp = prevHyps[i];
+        // Change nothing for completed hypothesis
+        if (rows[i] < 0) {
+          candidatesAdd(
+              candidates_,
+              candidateIndex_,
+              candidatesBestScore_,
+              opt_.beamThreshold,
+              opt_.logAdd,
+              prevHyp.score,
+              prevHyp.lmState,
+              &prevHyp,
+              eos_,
+              nullptr,
+              prevHyp.amScore,
+              prevHyp.lmScore);
+          continue;
+        }
+        expandHypothesis(
+            prevHyp,
+            batchAmScores_.data() + static_cast<size_t>(rows[i]) * nClasses,
+            nClasses,
+            nullptr);
+      }
+      candidatesStore(
+          candidates_,
+          candidatePtrs_,
+          candidateIndex_,
+          batchHyp_[b][t + 1],
+          opt_.beamSize,
+          candidatesBestScore_ - opt_.beamThreshold,
+          true);
+      for (const auto& state : batchHyp_[b][t + 1]) {
+        lmStates.emplace_back(state.lmState);
+      }
+      std::swap(batchRows_[b], batchPrevRows_[b]);
+    }
+    lm_->updateCache(lmStates);
+  }
+
+  /* (3) Collect the final hypothesis of each utterance */
+  std::vector<std::vector<DecodeResult>> results(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    const auto& hyp = batchHyp_[b];
+    int step = finalStep[b] >= 0 ? finalStep[b] : t;
+    while (step > 0 && hyp[step].empty()) {
+      --step;
+    }
+    results[b] = getAllHypothesis(hyp[step], maxOutputLength_ + 2);
+  }
+  return results;
+}
+
 std::vector<DecodeResult> LexiconFreeSeq2SeqDecoder::getAllFinalHypothesis()
     const {
   return getAllHypothesis(hyp_.find(maxOutputLength_ + 1)->second, hyp_.size());
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <unordered_map>
 
@@ -27,6 +28,32 @@ using AMUpdateFunc = std::function<
         const std::vector<AMStatePtr>&,
         int&)>;
 
+/**
+ * Batched AM update, scoring the hypothesis of several utterances in one call
+ * (see `LexiconFreeSeq2SeqDecoder::decodeBatch()`). Its arguments are:
+ *  - the emissions of each utterance, their size N and the lengths T;
+ *  - for each hypothesis to score: its utterance, its last token and the slot
+ *    of its AM state (both -1 at the first step);
+ *  - the index of the step, and the output scores.
+ * The scores of hypothesis i are stored at row i of the output (resized as
+ * needed), and the size of the rows is returned.
+ *
+ * The AM states are kept by the AM in preallocated slots indexed by the
+ * position of the hypothesis in the call: the state of hypothesis i after the
+ * step must be stored in slot i, typically by gathering the previous states
+ * from their slots and updating them in place. At most `batchSize * beamSize`
+ * slots are used.
+ */
+using AMBatchUpdateFunc = std::function<int(
+    const std::vector<const float*>&,
+    const int,
+    const std::vector<int>&,
+    const std::vector<int>&,
+    const std::vector<int>&,
+    const std::vector<int>&,
+    const int,
+    std::vector<float>&)>;
+
 struct LexiconFreeSeq2SeqDecoderOptions {
   int beamSize; // Maximum number of hypothesis we hold after each step
   int beamSizeToken; // Maximum number of tokens we consider at each step
@@ -79,6 +106,10 @@ struct LexiconFreeSeq2SeqDecoderState {
     return lmState->compare(node->lmState);
   }
 
+  size_t hashNoScoreState() const {
+    return reinterpret_cast<uintptr_t>(lmState.get());
+  }
+
   int getWord() const {
     return -1;
   }
@@ -104,15 +135,31 @@ class LexiconFreeSeq2SeqDecoder : public Decoder {
       const LMPtr& lm,
       const int eos,
       AMUpdateFunc amUpdateFunc,
-      const int maxOutputLength)
+      const int maxOutputLength,
+      AMBatchUpdateFunc amBatchUpdateFunc = nullptr)
       : opt_(std::move(opt)),
         lm_(lm),
         eos_(eos),
         amUpdateFunc_(amUpdateFunc),
-        maxOutputLength_(maxOutputLength) {}
+        maxOutputLength_(maxOutputLength),
+        amBatchUpdateFunc_(amBatchUpdateFunc) {}
 
   void decodeStep(const float* emissions, int T, int N) override;
 
+  /**
+   * Decoding of a batch of utterances with the batched AM update given to the
+   * constructor. Utterance `b` has emissions of size T[b] x N stored at
+   * emissions[b]. At each step, the hypothesis of all the utterances are
+   * scored in a single call to the AM, and the LM cache is updated once with
+   * the states of the whole batch. The results are the same as decoding each
+   * utterance with `decode()`, given an equivalent AM. Returns all the final
+   * hypothesis for each utterance.
+   */
+  std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N);
+
   void prune(int lookBack = 0) override;
 
   int nDecodedFramesInBuffer() const override;
@@ -132,9 +179,36 @@ class LexiconFreeSeq2SeqDecoder : public Decoder {
 
   std::vector<LexiconFreeSeq2SeqDecoderState> candidates_;
   std::vector<LexiconFreeSeq2SeqDecoderState*> candidatePtrs_;
+  CandidateIndex candidateIndex_;
   double candidatesBestScore_;
 
   std::unordered_map<int, std::vector<LexiconFreeSeq2SeqDecoderState>> hyp_;
+
+  // Indices of the tokens sorted by AM score, see `expandHypothesis()`
+  std::vector<size_t> tokenIdx_;
+
+  // Batched AM update and the buffers of `decodeBatch()`, kept between the
+  // calls to reuse the allocated memory
+  AMBatchUpdateFunc amBatchUpdateFunc_;
+  std::vector<std::vector<std::vector<LexiconFreeSeq2SeqDecoderState>>>
+      batchHyp_;
+  // Utterance, last token and AM state slot of each hypothesis scored
+  std::vector<int> batchUtterances_;
+  std::vector<int> batchTokens_;
+  std::vector<int> batchSlots_;
+  std::vector<float> batchAmScores_;
+  // Row of each hypothesis of the current and previous steps in the call to
+  // the AM (-1 if not scored), for each utterance
+  std::vector<std::vector<int>> batchRows_;
+  std::vector<std::vector<int>> batchPrevRows_;
+
+  // Add the candidates expanding `prevHyp` with its `beamSizeToken` best
+  // tokens, given the AM scores of all the tokens and the new AM state
+  void expandHypothesis(
+      const LexiconFreeSeq2SeqDecoderState& prevHyp,
+      const float* amScores,
+      int nClasses,
+      const AMStatePtr& outState);
 };
 } // namespace text
 } // namespace lib
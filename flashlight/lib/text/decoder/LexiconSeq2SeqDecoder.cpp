@@ -29,8 +29,15 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 
   // Start from here.
   hyp_[0].clear();
+  lmStatePool_->reset();
   hyp_[0].emplace_back(
-      0.0, lm_->start(0), lexicon_->getRoot(), nullptr, -1, -1, nullptr);
+      0.0,
+      lm_->start(0, lmStatePool_),
+      lexicon_->getRoot(),
+      nullptr,
+      -1,
+      -1,
+      nullptr);
 
   auto compare = [](const LexiconSeq2SeqDecoderState& n1,
                     const LexiconSeq2SeqDecoderState& n2) {
@@ -40,7 +47,8 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
   // Decode frame by frame
   int t = 0;
   for (; t < maxOutputLength_; t++) {
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
+    candidatesReset(
+        candidatesBestScore_, candidates_, candidatePtrs_, candidateIndex_);
 
     // Batch forwarding
     rawY_.clear();
@@ -72,8 +80,10 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
       if (prevHyp.token == eos_) {
         candidatesAdd(
             candidates_,
+            candidateIndex_,
             candidatesBestScore_,
             opt_.beamThreshold,
+            opt_.logAdd,
             prevHyp.score,
             prevHyp.lmState,
             prevHyp.lex,
@@ -92,7 +102,7 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
         continue;
       }
 
-      const TrieNode* prevLex = prevHyp.lex;
+      const FlatTrieNode* prevLex = prevHyp.lex;
       const float lexMaxScore =
           prevLex == lexicon_->getRoot() ? 0 : prevLex->maxScore;
 
@@ -126,8 +136,10 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 
           candidatesAdd(
               candidates_,
+              candidateIndex_,
               candidatesBestScore_,
               opt_.beamThreshold,
+              opt_.logAdd,
               prevHyp.score + amScore + opt_.eosScore + opt_.lmWeight * lmScore,
               lmState,
               lexicon_->getRoot(),
@@ -141,9 +153,8 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 
         /* (2) Try normal token */
         if (n != eos_) {
-          auto searchLex = prevLex->children.find(n);
-          if (searchLex != prevLex->children.end()) {
-            auto lex = searchLex->second;
+          const FlatTrieNode* lex = lexicon_->getChild(prevLex, n);
+          if (lex) {
             LMStatePtr lmState;
             double lmScore;
             if (isLmToken_) {
@@ -157,11 +168,13 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
             }
             candidatesAdd(
                 candidates_,
+                candidateIndex_,
                 candidatesBestScore_,
                 opt_.beamThreshold,
+                opt_.logAdd,
                 prevHyp.score + amScore + opt_.lmWeight * lmScore,
                 lmState,
-                lex.get(),
+                lex,
                 &prevHyp,
                 n,
                 -1,
@@ -170,8 +183,10 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
                 prevHyp.lmScore + lmScore);
 
             // If we got a true word
-            if (lex->labels.size() > 0) {
-              for (auto word : lex->labels) {
+            if (lex->nLabels > 0) {
+              const int* labels = lexicon_->getLabels(lex);
+              for (int i = 0; i < lex->nLabels; i++) {
+                int word = labels[i];
                 if (!isLmToken_) {
                   auto lmStateScorePair = lm_->score(prevHyp.lmState, word);
                   lmState = lmStateScorePair.first;
@@ -179,8 +194,10 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
                 }
                 candidatesAdd(
                     candidates_,
+                    candidateIndex_,
                     candidatesBestScore_,
                     opt_.beamThreshold,
+                    opt_.logAdd,
                     prevHyp.score + amScore + opt_.wordScore +
                         opt_.lmWeight * lmScore,
                     lmState,
@@ -204,10 +221,10 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
     candidatesStore(
         candidates_,
         candidatePtrs_,
+        candidateIndex_,
         hyp_[t + 1],
         opt_.beamSize,
         candidatesBestScore_ - opt_.beamThreshold,
-        opt_.logAdd,
         true);
     updateLMCache(lm_, hyp_[t + 1]);
   } // End of decoding
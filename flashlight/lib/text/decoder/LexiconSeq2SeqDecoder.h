@@ -11,6 +11,7 @@
 #include <unordered_map>
 
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 
@@ -45,7 +46,7 @@ struct LexiconSeq2SeqDecoderOptions {
 struct LexiconSeq2SeqDecoderState {
   double score; // Accumulated total score so far
   LMStatePtr lmState; // Language model state
-  const TrieNode* lex;
+  const FlatTrieNode* lex;
   const LexiconSeq2SeqDecoderState* parent; // Parent hypothesis
   int token; // Label of token
   int word;
@@ -57,7 +58,7 @@ struct LexiconSeq2SeqDecoderState {
   LexiconSeq2SeqDecoderState(
       const double score,
       const LMStatePtr& lmState,
-      const TrieNode* lex,
+      const FlatTrieNode* lex,
       const LexiconSeq2SeqDecoderState* parent,
       const int token,
       const int word,
@@ -97,6 +98,12 @@ struct LexiconSeq2SeqDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreState() const {
+    size_t hash = reinterpret_cast<uintptr_t>(lmState.get());
+    hash = hashCombine(hash, reinterpret_cast<uintptr_t>(lex));
+    return hashCombine(hash, token);
+  }
+
   int getWord() const {
     return word;
   }
@@ -125,6 +132,23 @@ class LexiconSeq2SeqDecoder : public Decoder {
       AMUpdateFunc amUpdateFunc,
       const int maxOutputLength,
       const bool isLmToken)
+      : LexiconSeq2SeqDecoder(
+            std::move(opt),
+            std::make_shared<FlatTrie>(*lexicon),
+            lm,
+            eos,
+            std::move(amUpdateFunc),
+            maxOutputLength,
+            isLmToken) {}
+
+  LexiconSeq2SeqDecoder(
+      LexiconSeq2SeqDecoderOptions opt,
+      const FlatTriePtr& lexicon,
+      const LMPtr& lm,
+      const int eos,
+      AMUpdateFunc amUpdateFunc,
+      const int maxOutputLength,
+      const bool isLmToken)
       : opt_(std::move(opt)),
         lm_(lm),
         lexicon_(lexicon),
@@ -146,7 +170,7 @@ class LexiconSeq2SeqDecoder : public Decoder {
  protected:
   LexiconSeq2SeqDecoderOptions opt_;
   LMPtr lm_;
-  TriePtr lexicon_;
+  FlatTriePtr lexicon_;
   int eos_;
   AMUpdateFunc amUpdateFunc_;
   std::vector<int> rawY_;
@@ -156,6 +180,7 @@ class LexiconSeq2SeqDecoder : public Decoder {
 
   std::vector<LexiconSeq2SeqDecoderState> candidates_;
   std::vector<LexiconSeq2SeqDecoderState*> candidatePtrs_;
+  CandidateIndex candidateIndex_;
   double candidatesBestScore_;
 
   std::unordered_map<int, std::vector<LexiconSeq2SeqDecoderState>> hyp_;
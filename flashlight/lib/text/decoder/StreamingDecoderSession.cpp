@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "flashlight/lib/text/decoder/StreamingDecoderSession.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+StreamingDecoderSession::StreamingDecoderSession(
+    Decoder& decoder,
+    const StreamingDecoderOptions& opt)
+    : decoder_(decoder),
+      opt_(opt),
+      nDecodedFrames_(0),
+      nFramesSincePrune_(0),
+      nStableFrames_(0),
+      nPrunes_(0) {
+  if (opt_.pruneInterval < 0 || opt_.lookBack < 0 ||
+      opt_.maxBufferedFrames < 0) {
+    throw std::invalid_argument(
+        "[StreamingDecoderSession] Options must be non-negative");
+  }
+  // Pruning may keep up to lookBack + kLookBackLimit frames, and one frame is
+  // needed to make progress and one for the end of sentence
+  int minBufferedFrames = opt_.lookBack + kLookBackLimit + 3;
+  if (opt_.maxBufferedFrames > 0 &&
+      opt_.maxBufferedFrames < minBufferedFrames) {
+    throw std::invalid_argument(
+        "[StreamingDecoderSession] maxBufferedFrames must be at least " +
+        std::to_string(minBufferedFrames) + " with lookBack " +
+        std::to_string(opt_.lookBack));
+  }
+}
+
+void StreamingDecoderSession::begin() {
+  decoder_.decodeBegin();
+  nDecodedFrames_ = 0;
+  nFramesSincePrune_ = 0;
+  nStableFrames_ = 0;
+  nPrunes_ = 0;
+}
+
+void StreamingDecoderSession::step(const float* emissions, int T, int N) {
+  int t = 0;
+  while (t < T) {
+    /* (1) Decode frames until the next pruning */
+    int nFrames = T - t;
+    if (opt_.pruneInterval > 0) {
+      nFrames = std::min(nFrames, opt_.pruneInterval - nFramesSincePrune_);
+    }
+    if (opt_.maxBufferedFrames > 0) {
+      // Keep one frame for `decodeEnd()`
+      nFrames = std::min(
+          nFrames,
+          opt_.maxBufferedFrames - 1 - decoder_.nDecodedFramesInBuffer());
+    }
+    decoder_.decodeStep(emissions + static_cast<size_t>(t) * N, nFrames, N);
+    t += nFrames;
+    nDecodedFrames_ += nFrames;
+    nFramesSincePrune_ += nFrames;
+
+    /* (2) Prune */
+    bool isBufferFull = opt_.maxBufferedFrames > 0 &&
+        decoder_.nDecodedFramesInBuffer() >= opt_.maxBufferedFrames - 1;
+    if (isBufferFull ||
+        (opt_.pruneInterval > 0 && nFramesSincePrune_ >= opt_.pruneInterval)) {
+      commit();
+    }
+    if (opt_.maxBufferedFrames > 0 &&
+        decoder_.nDecodedFramesInBuffer() >= opt_.maxBufferedFrames - 1) {
+      throw std::runtime_error(
+          "[StreamingDecoderSession] Failed to prune the decoder buffer");
+    }
+  }
+
+  if (partialResultCallback_) {
+    partialResultCallback_(trimResult(decoder_.getBestHypothesis()));
+  }
+}
+
+DecodeResult StreamingDecoderSession::end() {
+  decoder_.decodeEnd();
+  auto results = decoder_.getAllFinalHypothesis();
+  auto best = std::max_element(
+      results.begin(),
+      results.end(),
+      [](const DecodeResult& result1, const DecodeResult& result2) {
+        return result1.score < result2.score;
+      });
+  DecodeResult result =
+      best == results.end() ? DecodeResult() : trimResult(std::move(*best));
+  nStableFrames_ += result.words.size();
+  if (stableResultCallback_) {
+    stableResultCallback_(result);
+  }
+  return result;
+}
+
+void StreamingDecoderSession::commit() {
+  nFramesSincePrune_ = 0;
+  int nBufferedFrames = decoder_.nDecodedFramesInBuffer();
+  DecodeResult result = decoder_.getBestHypothesis(opt_.lookBack);
+  decoder_.prune(opt_.lookBack);
+  if (decoder_.nDecodedFramesInBuffer() == nBufferedFrames) {
+    return; // Not enough decoded frames to prune
+  }
+
+  ++nPrunes_;
+  result = trimResult(std::move(result));
+  nStableFrames_ += result.words.size();
+  if (stableResultCallback_) {
+    stableResultCallback_(result);
+  }
+}
+
+DecodeResult StreamingDecoderSession::trimResult(DecodeResult result) const {
+  // Frame 0 of the buffer is the last frame of the previous stable result
+  if (nStableFrames_ > 0 && !result.words.empty()) {
+    result.words.erase(result.words.begin());
+    result.tokens.erase(result.tokens.begin());
+  }
+  return result;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <utility>
+
+#include "flashlight/lib/text/decoder/Decoder.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+struct StreamingDecoderOptions {
+  int pruneInterval; // Prune the decoder every `pruneInterval` frames (0 to
+                     // only prune when the buffer is full)
+  int lookBack; // Frames kept in the buffer by pruning, see `Decoder::prune()`
+  int maxBufferedFrames; // Maximum number of frames in the buffer of the
+                         // decoder, including the end of sentence (0 for no
+                         // limit). Must be larger than lookBack +
+                         // kLookBackLimit + 2.
+};
+
+/**
+ * StreamingDecoderSession runs a decoder on an unbounded stream of emissions
+ * with a bounded memory usage:
+ *
+ *  session.begin()
+ *  while (stream)
+ *    session.step(someData) [calls the partial result callback]
+ *  session.end() [calls the stable result callback with the last frames]
+ *
+ * The decoder is pruned every `pruneInterval` frames and whenever its buffer
+ * holds `maxBufferedFrames` frames, chunks of emissions being split as needed.
+ * Before each pruning, the best path up to the pruned frame is committed and
+ * sent to the stable result callback: these results are never revised, even
+ * if a hypothesis which does not extend them becomes the best one later.
+ *
+ * The results given to the callbacks only cover the frames which were not
+ * covered by a previous stable result, so that concatenating the stable
+ * results gives the transcription of the whole stream (in the format of
+ * `DecodeResult`, with one entry per frame). Scores are relative to the
+ * last pruning.
+ */
+class StreamingDecoderSession {
+ public:
+  using ResultCallback = std::function<void(const DecodeResult&)>;
+
+  StreamingDecoderSession(Decoder& decoder, const StreamingDecoderOptions& opt);
+
+  /* Called with the committed best path before each pruning, and at the end */
+  void setStableResultCallback(ResultCallback callback) {
+    stableResultCallback_ = std::move(callback);
+  }
+
+  /* Called after each step with the current best hypothesis */
+  void setPartialResultCallback(ResultCallback callback) {
+    partialResultCallback_ = std::move(callback);
+  }
+
+  /* Start a new stream */
+  void begin();
+
+  /* Consume emissions in T x N chunks */
+  void step(const float* emissions, int T, int N);
+
+  /* Finish the stream and return its last stable result */
+  DecodeResult end();
+
+  /* Number of frames consumed since `begin()` */
+  int nDecodedFrames() const {
+    return nDecodedFrames_;
+  }
+
+  /* Number of frames covered by the stable results so far */
+  int nStableFrames() const {
+    return nStableFrames_;
+  }
+
+  /* Number of times the decoder was pruned since `begin()` */
+  int nPrunes() const {
+    return nPrunes_;
+  }
+
+ private:
+  Decoder& decoder_;
+  StreamingDecoderOptions opt_;
+  ResultCallback stableResultCallback_;
+  ResultCallback partialResultCallback_;
+
+  int nDecodedFrames_;
+  int nFramesSincePrune_;
+  int nStableFrames_;
+  int nPrunes_;
+
+  // Commit the best path and prune the decoder
+  void commit();
+
+  // Remove from `result` the frame already covered by the last stable result
+  DecodeResult trimResult(DecodeResult result) const;
+};
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/TokenSelection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FL_TOKEN_SELECTION_X86
+#include <immintrin.h>
+#endif
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+struct Candidate {
+  float score;
+  int token;
+};
+
+// Order by decreasing score, then by increasing token index
+struct IsBetter {
+  bool operator()(const Candidate& a, const Candidate& b) const {
+    return a.score > b.score || (a.score == b.score && a.token < b.token);
+  }
+};
+
+/**
+ * Buffer of the best tokens of a frame. Tokens scoring at least `cutoff()` are
+ * appended to the buffer; when it holds 2k tokens, only the k best ones are
+ * kept and the cutoff is raised above the k-th best score. Tokens are pushed
+ * by increasing index, so a token with the same score as the k-th best one
+ * cannot enter the k best anymore.
+ */
+class TopKBuffer {
+ public:
+  void reset(int k, float floor) {
+    k_ = k;
+    cutoff_ = floor;
+    candidates_.clear();
+    candidates_.reserve(2 * k);
+  }
+
+  float cutoff() const {
+    return cutoff_;
+  }
+
+  void push(float score, int token) {
+    candidates_.push_back({score, token});
+    if (candidates_.size() == 2 * k_) {
+      shrink();
+      cutoff_ = std::nextafter(
+          candidates_.back().score, std::numeric_limits<float>::infinity());
+    }
+  }
+
+  int store(int* tokens) {
+    if (candidates_.size() > k_) {
+      shrink();
+    }
+    std::sort(candidates_.begin(), candidates_.end(), IsBetter());
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+      tokens[i] = candidates_[i].token;
+    }
+    return candidates_.size();
+  }
+
+ private:
+  // Keep the k best candidates, with the k-th best one at the end
+  void shrink() {
+    std::nth_element(
+        candidates_.begin(),
+        candidates_.begin() + k_ - 1,
+        candidates_.end(),
+        IsBetter());
+    candidates_.resize(k_);
+  }
+
+  size_t k_;
+  float cutoff_;
+  std::vector<Candidate> candidates_;
+};
+
+/* ===================== Scalar kernel ===================== */
+
+float frameMaxScalar(const float* row, int N) {
+  float best = -std::numeric_limits<float>::infinity();
+  for (int n = 0; n < N; ++n) {
+    best = std::max(best, row[n]);
+  }
+  return best;
+}
+
+void selectFrameScalar(const float* row, int N, TopKBuffer& buffer) {
+  float cutoff = buffer.cutoff();
+  for (int n = 0; n < N; ++n) {
+    if (row[n] >= cutoff) {
+      buffer.push(row[n], n);
+      cutoff = buffer.cutoff();
+    }
+  }
+}
+
+#ifdef FL_TOKEN_SELECTION_X86
+
+/* ===================== AVX2 kernel ===================== */
+
+__attribute__((target("avx2"))) float frameMaxAvx2(const float* row, int N) {
+  int n = 0;
+  float best = -std::numeric_limits<float>::infinity();
+  if (N >= 8) {
+    __m256 vbest = _mm256_loadu_ps(row);
+    for (n = 8; n + 8 <= N; n += 8) {
+      vbest = _mm256_max_ps(vbest, _mm256_loadu_ps(row + n));
+    }
+    __m128 v4 = _mm_max_ps(
+        _mm256_castps256_ps128(vbest), _mm256_extractf128_ps(vbest, 1));
+    v4 = _mm_max_ps(v4, _mm_movehl_ps(v4, v4));
+    v4 = _mm_max_ss(v4, _mm_shuffle_ps(v4, v4, 1));
+    best = _mm_cvtss_f32(v4);
+  }
+  for (; n < N; ++n) {
+    best = std::max(best, row[n]);
+  }
+  return best;
+}
+
+__attribute__((target("avx2"))) void
+selectFrameAvx2(const float* row, int N, TopKBuffer& buffer) {
+  int n = 0;
+  __m256 vcutoff = _mm256_set1_ps(buffer.cutoff());
+  for (; n + 8 <= N; n += 8) {
+    __m256 v = _mm256_loadu_ps(row + n);
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, vcutoff, _CMP_GE_OQ));
+    if (mask == 0) {
+      continue;
+    }
+    while (mask) {
+      int j = __builtin_ctz(mask);
+      mask &= mask - 1;
+      buffer.push(row[n + j], n + j);
+    }
+    vcutoff = _mm256_set1_ps(buffer.cutoff());
+  }
+  float cutoff = buffer.cutoff();
+  for (; n < N; ++n) {
+    if (row[n] >= cutoff) {
+      buffer.push(row[n], n);
+      cutoff = buffer.cutoff();
+    }
+  }
+}
+
+/* ===================== AVX-512 kernel ===================== */
+
+__attribute__((target("avx512f"))) float frameMaxAvx512(
+    const float* row,
+    int N) {
+  int n = 0;
+  float best = -std::numeric_limits<float>::infinity();
+  if (N >= 16) {
+    __m512 vbest = _mm512_loadu_ps(row);
+    for (n = 16; n + 16 <= N; n += 16) {
+      vbest = _mm512_max_ps(vbest, _mm512_loadu_ps(row + n));
+    }
+    best = _mm512_reduce_max_ps(vbest);
+  }
+  for (; n < N; ++n) {
+    best = std::max(best, row[n]);
+  }
+  return best;
+}
+
+__attribute__((target("avx512f"))) void
+selectFrameAvx512(const float* row, int N, TopKBuffer& buffer) {
+  int n = 0;
+  __m512 vcutoff = _mm512_set1_ps(buffer.cutoff());
+  for (; n + 16 <= N; n += 16) {
+    __m512 v = _mm512_loadu_ps(row + n);
+    unsigned mask = _mm512_cmp_ps_mask(v, vcutoff, _CMP_GE_OQ);
+    if (mask == 0) {
+      continue;
+    }
+    while (mask) {
+      int j = __builtin_ctz(mask);
+      mask &= mask - 1;
+      buffer.push(row[n + j], n + j);
+    }
+    vcutoff = _mm512_set1_ps(buffer.cutoff());
+  }
+  float cutoff = buffer.cutoff();
+  for (; n < N; ++n) {
+    if (row[n] >= cutoff) {
+      buffer.push(row[n], n);
+      cutoff = buffer.cutoff();
+    }
+  }
+}
+
+#endif // FL_TOKEN_SELECTION_X86
+
+using FrameMaxFunc = float (*)(const float*, int);
+using SelectFrameFunc = void (*)(const float*, int, TopKBuffer&);
+
+TokenSelectionKernel resolveKernel(TokenSelectionKernel kernel) {
+  if (kernel == TokenSelectionKernel::AUTO) {
+    static const TokenSelectionKernel best =
+        isTokenSelectionKernelSupported(TokenSelectionKernel::AVX512)
+        ? TokenSelectionKernel::AVX512
+        : isTokenSelectionKernelSupported(TokenSelectionKernel::AVX2)
+            ? TokenSelectionKernel::AVX2
+            : TokenSelectionKernel::SCALAR;
+    return best;
+  }
+  if (!isTokenSelectionKernelSupported(kernel)) {
+    throw std::invalid_argument(
+        "[selectTopKTokens] Kernel is not supported by the CPU");
+  }
+  return kernel;
+}
+
+} // namespace
+
+bool isTokenSelectionKernelSupported(TokenSelectionKernel kernel) {
+  switch (kernel) {
+    case TokenSelectionKernel::AUTO:
+    case TokenSelectionKernel::SCALAR:
+      return true;
+#ifdef FL_TOKEN_SELECTION_X86
+    case TokenSelectionKernel::AVX2:
+      return __builtin_cpu_supports("avx2");
+    case TokenSelectionKernel::AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+void selectTopKTokens(
+    const float* emissions,
+    int T,
+    int N,
+    int k,
+    double threshold,
+    int* tokens,
+    int* nTokens,
+    TokenSelectionKernel kernel) {
+  FrameMaxFunc frameMax = frameMaxScalar;
+  SelectFrameFunc selectFrame = selectFrameScalar;
+  switch (resolveKernel(kernel)) {
+#ifdef FL_TOKEN_SELECTION_X86
+    case TokenSelectionKernel::AVX2:
+      frameMax = frameMaxAvx2;
+      selectFrame = selectFrameAvx2;
+      break;
+    case TokenSelectionKernel::AVX512:
+      frameMax = frameMaxAvx512;
+      selectFrame = selectFrameAvx512;
+      break;
+#endif
+    default:
+      break;
+  }
+
+  k = std::max(0, std::min(k, N));
+  TopKBuffer buffer;
+  for (int t = 0; t < T; ++t) {
+    const float* row = emissions + static_cast<size_t>(t) * N;
+    float floor = -std::numeric_limits<float>::infinity();
+    if (threshold > 0) {
+      floor = frameMax(row, N) - threshold;
+    }
+    buffer.reset(k, floor);
+    if (k > 0) {
+      selectFrame(row, N, buffer);
+    }
+    nTokens[t] = buffer.store(tokens + static_cast<size_t>(t) * k);
+  }
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * Implementations of the token selection. AUTO picks the fastest one supported
+ * by the CPU.
+ */
+enum class TokenSelectionKernel { AUTO = 0, SCALAR = 1, AVX2 = 2, AVX512 = 3 };
+
+/* Whether the CPU supports a given token selection kernel */
+bool isTokenSelectionKernelSupported(TokenSelectionKernel kernel);
+
+/**
+ * Select for each frame of `emissions` (T x N, row major) the `k` tokens with
+ * the highest scores, which are the tokens CTC / ASG decoders try to expand.
+ *
+ * The selected tokens of frame t are stored in `tokens[t * k + i]` for
+ * i < nTokens[t], sorted by decreasing score (ties are sorted by index).
+ * If `threshold` is positive, the tokens scoring more than `threshold` below
+ * the best token of the frame are dropped, so fewer than k tokens may be
+ * selected.
+ *
+ * Each frame is scanned once: blocks of 8 (AVX2) or 16 (AVX-512) scores are
+ * compared at once with a cutoff, and only the few tokens above it are added
+ * to a buffer of size 2k. The cutoff is raised to the k-th best score each
+ * time the buffer is full.
+ */
+void selectTopKTokens(
+    const float* emissions,
+    int T,
+    int N,
+    int k,
+    double threshold,
+    int* tokens,
+    int* nTokens,
+    TokenSelectionKernel kernel = TokenSelectionKernel::AUTO);
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -7,9 +7,13 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <limits>
+#include <numeric>
 
+#include "flashlight/lib/common/ThreadGroup.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 
 namespace fl {
@@ -24,17 +28,26 @@ const TrieNode* Trie::getRoot() const {
 
 TrieNodePtr
 Trie::insert(const std::vector<int>& indices, int label, float score) {
-  TrieNodePtr node = root_;
-  for (int i = 0; i < indices.size(); i++) {
+  return insertFrom(root_, indices, 0, label, score);
+}
+
+TrieNodePtr Trie::insertFrom(
+    TrieNodePtr node,
+    const std::vector<int>& indices,
+    size_t begin,
+    int label,
+    float score) {
+  for (size_t i = begin; i < indices.size(); i++) {
     int idx = indices[i];
     if (idx < 0 || idx >= maxChildren_) {
       throw std::out_of_range(
           "[Trie] Invalid letter index: " + std::to_string(idx));
     }
-    if (node->children.find(idx) == node->children.end()) {
-      node->children[idx] = std::make_shared<TrieNode>(idx);
+    auto& child = node->children[idx];
+    if (!child) {
+      child = std::make_shared<TrieNode>(idx);
     }
-    node = node->children[idx];
+    node = child;
   }
   if (node->labels.size() < kTrieMaxLabel) {
     node->labels.push_back(label);
@@ -46,6 +59,63 @@ Trie::insert(const std::vector<int>& indices, int label, float score) {
   return node;
 }
 
+void Trie::insert(const std::vector<TrieEntry>& entries, int nThreads) {
+  if (nThreads <= 1) {
+    for (const auto& entry : entries) {
+      insertFrom(root_, entry.indices, 0, entry.label, entry.score);
+    }
+    return;
+  }
+
+  // Group the entries by first letter, creating the children of the root in
+  // the same order as the serial insertion does
+  std::vector<int> groupOfLetter(maxChildren_, -1);
+  std::vector<std::vector<const TrieEntry*>> groups;
+  std::vector<TrieNodePtr> subtries;
+  for (const auto& entry : entries) {
+    if (entry.indices.empty()) {
+      insertFrom(root_, entry.indices, 0, entry.label, entry.score);
+      continue;
+    }
+    int idx = entry.indices[0];
+    if (idx < 0 || idx >= maxChildren_) {
+      throw std::out_of_range(
+          "[Trie] Invalid letter index: " + std::to_string(idx));
+    }
+    if (groupOfLetter[idx] < 0) {
+      groupOfLetter[idx] = groups.size();
+      groups.emplace_back();
+      auto& child = root_->children[idx];
+      if (!child) {
+        child = std::make_shared<TrieNode>(idx);
+      }
+      subtries.push_back(child);
+    }
+    groups[groupOfLetter[idx]].push_back(&entry);
+  }
+
+  // Each subtrie is built by one thread, the largest ones first
+  if (groups.empty()) {
+    return;
+  }
+  std::vector<int> order(groups.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&groups](int lhs, int rhs) {
+    return groups[lhs].size() > groups[rhs].size();
+  });
+  std::atomic<size_t> next(0);
+  ThreadGroup threads(std::min<int>(nThreads, groups.size()));
+  threads.run([&](int /* threadIdx */) {
+    for (size_t i = next++; i < order.size(); i = next++) {
+      const int group = order[i];
+      for (const auto* entry : groups[group]) {
+        insertFrom(
+            subtries[group], entry->indices, 1, entry->label, entry->score);
+      }
+    }
+  });
+}
+
 TrieNodePtr Trie::search(const std::vector<int>& indices) {
   TrieNodePtr node = root_;
   for (auto idx : indices) {
@@ -75,14 +145,16 @@ double TrieLogAdd(double log_a, double log_b) {
   }
 }
 
-void smearNode(TrieNodePtr node, SmearingMode smearMode) {
+namespace {
+
+// Score a node from its labels and its already smeared children
+void smearFromChildren(TrieNode* node, SmearingMode smearMode) {
   node->maxScore = -std::numeric_limits<float>::infinity();
   for (auto score : node->scores) {
     node->maxScore = TrieLogAdd(node->maxScore, score);
   }
-  for (auto child : node->children) {
-    auto childNode = child.second;
-    smearNode(childNode, smearMode);
+  for (const auto& child : node->children) {
+    const TrieNode* childNode = child.second.get();
     if (smearMode == SmearingMode::LOGADD) {
       node->maxScore = TrieLogAdd(node->maxScore, childNode->maxScore);
     } else if (
@@ -93,10 +165,40 @@ void smearNode(TrieNodePtr node, SmearingMode smearMode) {
   }
 }
 
-void Trie::smear(SmearingMode smearMode) {
-  if (smearMode != SmearingMode::NONE) {
-    smearNode(root_, smearMode);
+void smearNode(TrieNode* node, SmearingMode smearMode) {
+  for (const auto& child : node->children) {
+    smearNode(child.second.get(), smearMode);
   }
+  smearFromChildren(node, smearMode);
+}
+
+} // namespace
+
+void Trie::smear(SmearingMode smearMode, int nThreads) {
+  if (smearMode == SmearingMode::NONE) {
+    return;
+  }
+  if (nThreads <= 1) {
+    smearNode(root_.get(), smearMode);
+    return;
+  }
+
+  std::vector<TrieNode*> subtries;
+  for (const auto& child : root_->children) {
+    subtries.push_back(child.second.get());
+  }
+  if (subtries.empty()) {
+    smearFromChildren(root_.get(), smearMode);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  ThreadGroup threads(std::min<int>(nThreads, subtries.size()));
+  threads.run([&](int /* threadIdx */) {
+    for (size_t i = next++; i < subtries.size(); i = next++) {
+      smearNode(subtries[i], smearMode);
+    }
+  });
+  smearFromChildren(root_.get(), smearMode);
 }
 } // namespace text
 } // namespace lib
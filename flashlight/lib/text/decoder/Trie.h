@@ -29,10 +29,7 @@ struct TrieNode {
   explicit TrieNode(int idx)
       : children(std::unordered_map<int, std::shared_ptr<TrieNode>>()),
         idx(idx),
-        maxScore(0) {
-    labels.reserve(kTrieMaxLabel);
-    scores.reserve(kTrieMaxLabel);
-  }
+        maxScore(0) {}
 
   // Pointers to the children of a node
   std::unordered_map<int, std::shared_ptr<TrieNode>> children;
@@ -54,6 +51,16 @@ struct TrieNode {
 
 using TrieNodePtr = std::shared_ptr<TrieNode>;
 
+/**
+ * TrieEntry is a token (a sequence of letter indices) to insert into a Trie
+ * with its label and score.
+ */
+struct TrieEntry {
+  std::vector<int> indices;
+  int label;
+  float score;
+};
+
 /**
  * Trie is used to store the lexicon in langiage model. We use it to limit
  * the search space in deocder and quickly look up scores for a given token
@@ -67,9 +74,21 @@ class Trie {
   /* Return the root node pointer */
   const TrieNode* getRoot() const;
 
+  /* Return the maximum number of children for each node */
+  int getMaxChildren() const {
+    return maxChildren_;
+  }
+
   /* Insert a token into trie with label */
   TrieNodePtr insert(const std::vector<int>& indices, int label, float score);
 
+  /**
+   * Insert tokens into trie, which gives the same trie as inserting them one
+   * by one in order. The entries are grouped by their first letter, and the
+   * subtries of the root built from the groups on `nThreads` threads.
+   */
+  void insert(const std::vector<TrieEntry>& entries, int nThreads = 1);
+
   /* Get the labels for a given token */
   TrieNodePtr search(const std::vector<int>& indices);
 
@@ -80,10 +99,18 @@ class Trie {
    * will select the maximum score from all its children like "c"->"a"->"t",
    * "c"->"a"->"n", "c"->"a"->"r"->"e" and so on.
    * This process will be carry out recusively on all the nodes.
+   * The subtries of the root are smeared on `nThreads` threads.
    */
-  void smear(const SmearingMode smear_mode);
+  void smear(const SmearingMode smear_mode, int nThreads = 1);
 
  private:
+  TrieNodePtr insertFrom(
+      TrieNodePtr node,
+      const std::vector<int>& indices,
+      size_t begin,
+      int label,
+      float score);
+
   TrieNodePtr root_;
   int maxChildren_; // The maximum number of childern for each node. It is
   // usually the size of letters or phonmes.
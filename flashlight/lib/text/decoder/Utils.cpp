@@ -5,11 +5,36 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "flashlight/lib/text/decoder/Utils.h"
+
 namespace fl {
 namespace lib {
 namespace text {
 
-// Place holder
+void CandidateIndex::reset() {
+  if (size_ > 0) {
+    std::fill(entries_.begin(), entries_.end(), Entry{0, -1});
+    size_ = 0;
+  }
+  mergedScores_.clear();
+}
+
+void CandidateIndex::grow() {
+  std::vector<Entry> entries(
+      std::max<size_t>(2 * entries_.size(), 64), Entry{0, -1});
+  size_t mask = entries.size() - 1;
+  for (const Entry& entry : entries_) {
+    if (entry.position < 0) {
+      continue;
+    }
+    size_t i = slotOf(entry.hash, mask);
+    while (entries[i].position >= 0) {
+      i = (i + 1) & mask;
+    }
+    entries[i] = entry;
+  }
+  entries_.swap(entries);
+}
 } // namespace text
 } // namespace lib
 } // namespace fl
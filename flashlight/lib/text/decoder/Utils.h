@@ -9,7 +9,10 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "flashlight/lib/text/decoder/lm/LM.h"
@@ -22,6 +25,8 @@ namespace text {
 
 const double kNegativeInfinity = -std::numeric_limits<double>::infinity();
 const int kLookBackLimit = 100;
+// Minimum number of hypothesis expanded by each thread of a decoder
+const int kMinExpansionHypsPerThread = 32;
 
 struct DecodeResult {
   double score;
@@ -36,84 +41,230 @@ struct DecodeResult {
 
 /* ===================== Candidate-related operations ===================== */
 
+/* Combine `value` into the hash `seed` */
+inline size_t hashCombine(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * CandidateIndex is an open-addressing hash table mapping the state of a
+ * candidate (everything but its score) to its position in the candidate
+ * vector, so that identical candidates are merged as soon as they are added.
+ * It also records the scores of the candidates merged into another one when
+ * scores are log-added, as the log-add is only done once the candidates below
+ * the final threshold are known. The table keeps its memory between frames.
+ */
+class CandidateIndex {
+ public:
+  CandidateIndex() : size_(0) {}
+
+  void reset();
+
+  /* Record the score of a candidate merged into the one at `position` */
+  void addMergedScore(int position, double score) {
+    mergedScores_.emplace_back(position, score);
+  }
+
+  /* (position, score) of the candidates merged since the last reset */
+  std::vector<std::pair<int, double>>& mergedScores() {
+    return mergedScores_;
+  }
+
+  /**
+   * Return the position of the candidate with hash `hash` for which
+   * `equal(position)` is true, or insert `position` and return -1 if there is
+   * no such candidate.
+   */
+  template <class Equal>
+  int findOrInsert(size_t hash, int position, const Equal& equal) {
+    if (2 * (size_ + 1) > entries_.size()) {
+      grow();
+    }
+    size_t mask = entries_.size() - 1;
+    for (size_t i = slotOf(hash, mask);; i = (i + 1) & mask) {
+      Entry& entry = entries_[i];
+      if (entry.position < 0) {
+        entry.hash = hash;
+        entry.position = position;
+        ++size_;
+        return -1;
+      }
+      if (entry.hash == hash && equal(entry.position)) {
+        return entry.position;
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    size_t hash;
+    int position; // -1 for empty entries
+  };
+
+  static size_t slotOf(size_t hash, size_t mask) {
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & mask;
+  }
+
+  void grow();
+
+  std::vector<Entry> entries_;
+  size_t size_;
+  std::vector<std::pair<int, double>> mergedScores_;
+};
+
 template <class DecoderState>
 void candidatesReset(
     double& candidatesBestScore,
     std::vector<DecoderState>& candidates,
-    std::vector<DecoderState*>& candidatePtrs) {
+    std::vector<DecoderState*>& candidatePtrs,
+    CandidateIndex& candidateIndex) {
   candidatesBestScore = kNegativeInfinity;
   candidates.clear();
   candidatePtrs.clear();
+  candidateIndex.reset();
 }
 
+/**
+ * MergedCandidate is a candidate merged into an identical one with a higher
+ * score, i.e. an alternative path to the state `target` of the beam. Decoders
+ * keep them to build lattices (see `buildLattice()`). The LM state of `state`
+ * is dropped, and its score is the score of its own path.
+ */
+template <class DecoderState>
+struct MergedCandidate {
+  int position; // Position of the target in the candidate vector
+  const DecoderState* target; // Target in the beam, once stored
+  DecoderState state;
+};
+
+/**
+ * Add a new candidate constructed from (score, args...). If an identical
+ * candidate (see `compareNoScoreStates()`) was already added, they are merged
+ * into the one with the highest score, which keeps its score. With `logAdd`,
+ * the score of the other one is recorded in `candidateIndex`, and log-added
+ * by `candidatesStore()`. The other one is appended to `merged` if it is not
+ * null.
+ */
 template <class DecoderState, class... Args>
-void candidatesAdd(
+void candidatesAddMerged(
     std::vector<DecoderState>& candidates,
+    CandidateIndex& candidateIndex,
+    std::vector<MergedCandidate<DecoderState>>* merged,
     double& candidatesBestScore,
     const double beamThreshold,
+    const bool logAdd,
     const double score,
     const Args&... args) {
   if (score >= candidatesBestScore) {
     candidatesBestScore = score;
   }
-  if (score >= candidatesBestScore - beamThreshold) {
-    candidates.emplace_back(score, args...);
+  if (score < candidatesBestScore - beamThreshold) {
+    return;
   }
+
+  candidates.emplace_back(score, args...);
+  const DecoderState& candidate = candidates.back();
+  int position = candidateIndex.findOrInsert(
+      candidate.hashNoScoreState(),
+      candidates.size() - 1,
+      [&candidates, &candidate](int other) {
+        return candidates[other].compareNoScoreStates(&candidate) == 0;
+      });
+  if (position < 0) {
+    return;
+  }
+
+  // Same candidate
+  DecoderState& survivor = candidates[position];
+  if (score > survivor.score) {
+    if (logAdd) {
+      candidateIndex.addMergedScore(position, survivor.score);
+    }
+    if (merged) {
+      merged->push_back({position, nullptr, std::move(survivor)});
+    }
+    survivor = std::move(candidates.back());
+  } else {
+    if (logAdd) {
+      candidateIndex.addMergedScore(position, score);
+    }
+    if (merged) {
+      merged->push_back({position, nullptr, std::move(candidates.back())});
+    }
+  }
+  candidates.pop_back();
+}
+
+template <class DecoderState, class... Args>
+void candidatesAdd(
+    std::vector<DecoderState>& candidates,
+    CandidateIndex& candidateIndex,
+    double& candidatesBestScore,
+    const double beamThreshold,
+    const bool logAdd,
+    const double score,
+    const Args&... args) {
+  candidatesAddMerged<DecoderState>(
+      candidates,
+      candidateIndex,
+      nullptr,
+      candidatesBestScore,
+      beamThreshold,
+      logAdd,
+      score,
+      args...);
 }
 
+/**
+ * Store into `outputs` the (at most) `beamSize` best candidates scoring at
+ * least `threshold`. Candidates are already merged by `candidatesAdd()`: the
+ * scores of the merged candidates recorded in `candidateIndex` which are at
+ * least `threshold` are log-added to the score of their candidate first.
+ */
 template <class DecoderState>
 void candidatesStore(
     std::vector<DecoderState>& candidates,
     std::vector<DecoderState*>& candidatePtrs,
+    CandidateIndex& candidateIndex,
     std::vector<DecoderState>& outputs,
     const int beamSize,
     const double threshold,
-    const bool logAdd,
     const bool returnSorted) {
   outputs.clear();
   if (candidates.empty()) {
     return;
   }
 
-  /* 1. Select valid candidates */
-  for (auto& candidate : candidates) {
-    if (candidate.score >= threshold) {
-      candidatePtrs.emplace_back(&candidate);
-    }
-  }
-
-  /* 2. Merge candidates */
+  /* 1. Log-add the merged scores, in decreasing order as when merging sorted
+   * candidates */
+  auto& mergedScores = candidateIndex.mergedScores();
   std::sort(
-      candidatePtrs.begin(),
-      candidatePtrs.end(),
-      [](const DecoderState* node1, const DecoderState* node2) {
-        int cmp = node1->compareNoScoreStates(node2);
-        return cmp == 0 ? node1->score > node2->score : cmp > 0;
+      mergedScores.begin(),
+      mergedScores.end(),
+      [](const std::pair<int, double>& lhs,
+         const std::pair<int, double>& rhs) {
+        return lhs.first == rhs.first ? lhs.second > rhs.second
+                                      : lhs.first < rhs.first;
       });
+  for (size_t i = 0; i < mergedScores.size(); ++i) {
+    double& score = candidates[mergedScores[i].first].score;
+    double mergedScore = mergedScores[i].second;
+    if (mergedScore >= threshold) {
+      // `score` is the highest score of the candidates merged
+      score += std::log1p(std::exp(mergedScore - score));
+    }
+  }
 
-  int nHypAfterMerging = 1;
-  for (int i = 1; i < candidatePtrs.size(); i++) {
-    if (candidatePtrs[i]->compareNoScoreStates(
-            candidatePtrs[nHypAfterMerging - 1]) != 0) {
-      // Distinct candidate
-      candidatePtrs[nHypAfterMerging] = candidatePtrs[i];
-      nHypAfterMerging++;
-    } else {
-      // Same candidate
-      double maxScore = std::max(
-          candidatePtrs[nHypAfterMerging - 1]->score, candidatePtrs[i]->score);
-      if (logAdd) {
-        double minScore = std::min(
-            candidatePtrs[nHypAfterMerging - 1]->score,
-            candidatePtrs[i]->score);
-        candidatePtrs[nHypAfterMerging - 1]->score =
-            maxScore + std::log1p(std::exp(minScore - maxScore));
-      } else {
-        candidatePtrs[nHypAfterMerging - 1]->score = maxScore;
-      }
+  /* 2. Select valid candidates */
+  for (auto& candidate : candidates) {
+    if (candidate.score >= threshold) {
+      candidatePtrs.emplace_back(&candidate);
     }
   }
-  candidatePtrs.resize(nHypAfterMerging);
 
   /* 3. Sort and prune */
   auto compareNodeScore = [](const DecoderState* node1,
@@ -142,6 +293,103 @@ void candidatesStore(
   }
 }
 
+/**
+ * Keep the candidates merged into the ones stored in `outputs` by
+ * `candidatesStore()`, setting their target, and drop the others.
+ */
+template <class DecoderState>
+void mergedCandidatesStore(
+    const std::vector<DecoderState>& candidates,
+    const std::vector<DecoderState*>& candidatePtrs,
+    const std::vector<DecoderState>& outputs,
+    std::vector<MergedCandidate<DecoderState>>& merged) {
+  std::vector<const DecoderState*> targets(candidates.size(), nullptr);
+  for (size_t i = 0; i < outputs.size(); i++) {
+    targets[candidatePtrs[i] - candidates.data()] = &outputs[i];
+  }
+  size_t nKept = 0;
+  for (size_t i = 0; i < merged.size(); i++) {
+    const DecoderState* target = targets[merged[i].position];
+    if (!target) {
+      continue;
+    }
+    if (nKept != i) {
+      merged[nKept] = std::move(merged[i]);
+    }
+    // Only the target is a lattice node: don't keep the LM state alive
+    merged[nKept].state.lmState = nullptr;
+    merged[nKept++].target = target;
+  }
+  merged.erase(merged.begin() + nKept, merged.end());
+}
+
+/* ===================== Hypothesis buffer ===================== */
+
+/**
+ * HypothesisBuffer stores the beam of each frame in the buffer of a decoder,
+ * frame 0 being the first frame which is not pruned. The frames are kept in a
+ * ring: pruning the first frames moves the start of the ring instead of the
+ * frames, and their vectors are reused (with their memory) by the next frames.
+ * A streaming decoder which is pruned regularly thus runs in constant memory.
+ * The states never move when the ring grows, so that back-pointers to the
+ * states of the previous frames stay valid.
+ */
+template <class DecoderState>
+class HypothesisBuffer {
+ public:
+  HypothesisBuffer() : frames_(1), start_(0) {}
+
+  /* Drop all the frames and go back to frame 0 */
+  void reset() {
+    for (auto& frame : frames_) {
+      frame.clear();
+    }
+    start_ = 0;
+  }
+
+  /* Make room for the frames [0, nFrames) */
+  void reserve(int nFrames) {
+    if (nFrames <= frames_.size()) {
+      return;
+    }
+    size_t capacity = frames_.size();
+    while (capacity < nFrames) {
+      capacity *= 2;
+    }
+    std::vector<std::vector<DecoderState>> frames(capacity);
+    for (size_t i = 0; i < frames_.size(); i++) {
+      frames[i] = std::move((*this)[i]);
+    }
+    frames_.swap(frames);
+    start_ = 0;
+  }
+
+  /* Drop the frames [0, nFrames), frame `nFrames` becoming frame 0 */
+  void popFront(int nFrames) {
+    for (int i = 0; i < nFrames; i++) {
+      (*this)[i].clear();
+    }
+    start_ = (start_ + nFrames) & (frames_.size() - 1);
+  }
+
+  int capacity() const {
+    return frames_.size();
+  }
+
+  std::vector<DecoderState>& operator[](int frame) {
+    return frames_[(start_ + frame) & (frames_.size() - 1)];
+  }
+
+  const std::vector<DecoderState>& operator[](int frame) const {
+    return frames_[(start_ + frame) & (frames_.size() - 1)];
+  }
+
+ private:
+  // The number of frames is a power of 2
+  std::vector<std::vector<DecoderState>> frames_;
+  size_t start_;
+};
+
 /* ===================== Result-related operations ===================== */
 
 template <class DecoderState>
@@ -227,17 +475,26 @@ const DecoderState* findBestAncestor(
   return bestNode;
 }
 
+/**
+ * Drop the frames before `startFrame` from `hypothesis` (and from `merged`,
+ * the candidates merged into them, if it is not null), and normalize the
+ * scores of the `lookBack` + 1 frames left.
+ */
 template <class DecoderState>
 void pruneAndNormalize(
-    std::unordered_map<int, std::vector<DecoderState>>& hypothesis,
+    HypothesisBuffer<DecoderState>& hypothesis,
     const int startFrame,
-    const int lookBack) {
-  /* 1. Move things from back of hypothesis to front. */
-  for (int i = 0; i < hypothesis.size(); i++) {
-    if (i <= lookBack) {
-      hypothesis[i].swap(hypothesis[i + startFrame]);
-    } else {
-      hypothesis[i].clear();
+    const int lookBack,
+    HypothesisBuffer<MergedCandidate<DecoderState>>* merged = nullptr) {
+  /* 1. Drop the frames before `startFrame` and the stale ones after. */
+  hypothesis.popFront(startFrame);
+  for (int i = lookBack + 1; i < hypothesis.capacity(); i++) {
+    hypothesis[i].clear();
+  }
+  if (merged) {
+    merged->popFront(startFrame);
+    for (int i = lookBack + 1; i < merged->capacity(); i++) {
+      (*merged)[i].clear();
     }
   }
 
@@ -245,6 +502,9 @@ void pruneAndNormalize(
   for (DecoderState& hyp : hypothesis[0]) {
     hyp.parent = nullptr;
   }
+  if (merged) {
+    (*merged)[0].clear();
+  }
 
   /* 3. Avoid score underflow/overflow. */
   double largestScore = hypothesis[lookBack].front().score;
@@ -254,8 +514,17 @@ void pruneAndNormalize(
     }
   }
 
-  for (int i = 0; i < hypothesis[lookBack].size(); i++) {
-    hypothesis[lookBack][i].score -= largestScore;
+  // All the frames left are normalized, so that the score differences along
+  // the paths (e.g. lattice arcs) are kept
+  for (int frame = 0; frame <= lookBack; frame++) {
+    for (DecoderState& hyp : hypothesis[frame]) {
+      hyp.score -= largestScore;
+    }
+    if (merged) {
+      for (auto& candidate : (*merged)[frame]) {
+        candidate.state.score -= largestScore;
+      }
+    }
   }
 }
 
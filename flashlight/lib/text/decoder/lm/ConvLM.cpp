@@ -6,11 +6,15 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
 #include <cmath>
-#include <cstring>
 #include <iostream>
+#include <limits>
+#include <numeric>
 
+#include "flashlight/lib/text/decoder/Utils.h"
 #include "flashlight/lib/text/decoder/lm/ConvLM.h"
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
 
 namespace fl {
 namespace lib {
@@ -22,7 +26,8 @@ ConvLM::ConvLM(
     const Dictionary& usrTknDict,
     int lmMemory,
     int beamSize,
-    int historySize)
+    int historySize,
+    int cacheTopK)
     : lmMemory_(lmMemory),
       beamSize_(beamSize),
       getConvLmScoreFunc_(getConvLmScoreFunc),
@@ -30,6 +35,9 @@ ConvLM::ConvLM(
   if (historySize < 1) {
     throw std::invalid_argument("[ConvLM] History size is too small.");
   }
+  if (beamSize < 1) {
+    throw std::invalid_argument("[ConvLM] Cache size is too small.");
+  }
 
   /* Load token vocabulary */
   // Note: fairseq vocab should start with:
@@ -48,16 +56,32 @@ ConvLM::ConvLM(
     usrToLmIdxMap_[i] = lmIdx;
   }
 
-  /* Refresh cache */
-  cacheIndices_.reserve(beamSize_);
-  cache_.resize(beamSize_, std::vector<float>(vocabSize_));
-  slot_.reserve(beamSize_);
+  /* Allocate cache */
+  topK_ = cacheTopK < vocabSize_ ? std::max(cacheTopK, 0) : 0;
+  rowSize_ = topK_ > 0 ? topK_ : vocabSize_;
+  cacheEntries_.resize(beamSize_);
+  cacheHistories_.resize(static_cast<size_t>(beamSize_) * maxHistorySize_);
+  cacheScores_.resize(static_cast<size_t>(beamSize_) * rowSize_);
+  if (topK_ > 0) {
+    cacheTokens_.resize(static_cast<size_t>(beamSize_) * topK_);
+    topKIndices_.resize(vocabSize_);
+  }
+  cacheIndex_.reserve(beamSize_);
+  // All the entries are free, and evicted in order
+  for (int i = 0; i < beamSize_; i++) {
+    cacheEntries_[i] = {0, -1, i - 1, i + 1 < beamSize_ ? i + 1 : -1, 0};
+  }
+  cacheHead_ = 0;
+  cacheTail_ = beamSize_ - 1;
   batchedTokens_.resize(beamSize_ * maxHistorySize_);
 }
 
 LMStatePtr ConvLM::start(bool startWithNothing) {
-  cacheIndices_.clear();
-  auto outState = std::make_shared<ConvLMState>(1);
+  return start(startWithNothing, std::make_shared<LMStatePool>());
+}
+
+LMStatePtr ConvLM::start(bool startWithNothing, const LMStatePoolPtr& pool) {
+  auto outState = pool->make<ConvLMState>(1);
   if (!startWithNothing) {
     outState->length = 1;
     outState->tokens[0] = vocab_.getIndex(kEosToken);
@@ -76,15 +100,19 @@ std::pair<LMStatePtr, float> ConvLM::scoreWithLmIdx(
   std::shared_ptr<ConvLMState> outState;
 
   // Prepare output state
+  auto makeState = [rawInState](int size) {
+    return rawInState->pool ? rawInState->pool->make<ConvLMState>(size)
+                            : std::make_shared<ConvLMState>(size);
+  };
   if (inStateLength == maxHistorySize_) {
-    outState = std::make_shared<ConvLMState>(maxHistorySize_);
+    outState = makeState(maxHistorySize_);
     std::copy(
         rawInState->tokens.begin() + 1,
         rawInState->tokens.end(),
         outState->tokens.begin());
     outState->tokens[maxHistorySize_ - 1] = tokenIdx;
   } else {
-    outState = std::make_shared<ConvLMState>(inStateLength + 1);
+    outState = makeState(inStateLength + 1);
     std::copy(
         rawInState->tokens.begin(),
         rawInState->tokens.end(),
@@ -99,27 +127,21 @@ std::pair<LMStatePtr, float> ConvLM::scoreWithLmIdx(
         "[ConvLM] Invalid query word: " + std::to_string(tokenIdx));
   }
 
-  if (cacheIndices_.find(rawInState) != cacheIndices_.end()) {
-    // Cache hit
-    auto cacheInd = cacheIndices_[rawInState];
-    if (cacheInd < 0 || cacheInd >= beamSize_) {
-      throw std::logic_error(
-          "[ConvLM] Invalid cache access: " + std::to_string(cacheInd));
-    }
-    score = cache_[cacheInd][tokenIdx];
-  } else {
+  int row = findCache(rawInState);
+  if (row < 0) {
     // Cache miss
-    if (cacheIndices_.size() == beamSize_) {
-      cacheIndices_.clear();
-    }
-    int newIdx = cacheIndices_.size();
-    cacheIndices_[rawInState] = newIdx;
-
     std::vector<int> lastTokenPositions = {rawInState->length - 1};
-    cache_[newIdx] =
+    auto prob =
         getConvLmScoreFunc_(rawInState->tokens, lastTokenPositions, -1, 1);
-    score = cache_[newIdx][tokenIdx];
+    if (prob.size() != vocabSize_) {
+      throw std::logic_error(
+          "[ConvLM] Vocab size " + std::to_string(prob.size()) +
+          " mismatch with " + std::to_string(vocabSize_));
+    }
+    row = insertCache(rawInState);
+    storeCache(row, prob.data());
   }
+  score = cachedScore(row, tokenIdx);
   if (std::isnan(score) || !std::isfinite(score)) {
     throw std::runtime_error(
         "[ConvLM] Bad scoring from ConvLM: " + std::to_string(score));
@@ -137,6 +159,42 @@ std::pair<LMStatePtr, float> ConvLM::score(
   return scoreWithLmIdx(state, usrToLmIdxMap_[usrTokenIdx]);
 }
 
+void ConvLM::scoreBatch(
+    const LMStatePtr* states,
+    const int* usrTokenIdx,
+    int n,
+    LMStatePtr* outStates,
+    float* scores) {
+  // Forward the input states missing from the cache together, if they fit in
+  // it, instead of one by one when they are scored
+  int longestHistory = -1;
+  ConvLMState* prevState = nullptr;
+  rawStates_.clear();
+  for (int i = 0; i < n; i++) {
+    auto rawState = static_cast<ConvLMState*>(states[i].get());
+    if (rawState != prevState && findCache(rawState) < 0) {
+      rawStates_.push_back(rawState);
+      longestHistory = std::max(longestHistory, rawState->length);
+    }
+    prevState = rawState;
+  }
+  if (!rawStates_.empty() && rawStates_.size() <= beamSize_) {
+    forward(rawStates_, longestHistory);
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (usrTokenIdx[i] < 0 || usrTokenIdx[i] >= usrToLmIdxMap_.size()) {
+      throw std::out_of_range(
+          "[ConvLM] Invalid user token index: " +
+          std::to_string(usrTokenIdx[i]));
+    }
+    auto stateScore =
+        scoreWithLmIdx(states[i], usrToLmIdxMap_[usrTokenIdx[i]]);
+    outStates[i] = std::move(stateScore.first);
+    scores[i] = stateScore.second;
+  }
+}
+
 std::pair<LMStatePtr, float> ConvLM::finish(const LMStatePtr& state) {
   return scoreWithLmIdx(state, vocab_.getIndex(kEosToken));
 }
@@ -148,33 +206,27 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
         "[ConvLM] Cache size too small (consider larger than beam size).");
   }
 
-  // Refresh cache, store LM states that did not changed
-  slot_.clear();
-  slot_.resize(beamSize_, nullptr);
+  // Mark the cached histories as recently used, so that they are not evicted
+  // by the new ones, and prepare the others to be predicted
+  rawStates_.clear();
   for (const auto& state : states) {
-    auto rawState = std::static_pointer_cast<ConvLMState>(state).get();
-    if (cacheIndices_.find(rawState) != cacheIndices_.end()) {
-      slot_[cacheIndices_[rawState]] = rawState;
-    } else if (rawState->length > longestHistory) {
-      // prepare intest history only for those which should be predicted
-      longestHistory = rawState->length;
-    }
-  }
-  cacheIndices_.clear();
-  int cacheSize = 0;
-  for (int i = 0; i < beamSize_; i++) {
-    if (!slot_[i]) {
-      continue;
+    auto rawState = static_cast<ConvLMState*>(state.get());
+    if (findCache(rawState) < 0) {
+      rawStates_.push_back(rawState);
+      longestHistory = std::max(longestHistory, rawState->length);
     }
-    cache_[cacheSize] = cache_[i];
-    cacheIndices_[slot_[i]] = cacheSize;
-    ++cacheSize;
   }
-
-  // Determine batchsize
   if (longestHistory <= 0) {
     return;
   }
+  forward(rawStates_, longestHistory);
+}
+
+void ConvLM::forward(
+    const std::vector<ConvLMState*>& states,
+    int longestHistory) {
+  int nStates = states.size();
+  // Determine batchsize
   // batchSize * longestHistory = cacheSize;
   int maxBatchSize = lmMemory_ / longestHistory;
   if (maxBatchSize > nStates) {
@@ -187,13 +239,14 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
     // Select batch
     int nBatchStates = 0;
     std::vector<int> lastTokenPositions;
+    batchRows_.clear();
     for (int i = batchStart; (nBatchStates < maxBatchSize) && (i < nStates);
          i++, batchStart++) {
-      auto rawState = std::static_pointer_cast<ConvLMState>(states[i]).get();
-      if (cacheIndices_.find(rawState) != cacheIndices_.end()) {
+      auto rawState = states[i];
+      if (findCache(rawState) >= 0) {
         continue;
       }
-      cacheIndices_[rawState] = cacheSize + nBatchStates;
+      batchRows_.push_back(insertCache(rawState));
       int start = nBatchStates * longestHistory;
 
       for (int j = 0; j < rawState->length; j++) {
@@ -226,14 +279,125 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
           " mismatch with " + std::to_string(vocabSize_ * nBatchStates));
     }
     // Place probabilities in cache
-    for (int i = 0; i < nBatchStates; i++, cacheSize++) {
-      std::memcpy(
-          cache_[cacheSize].data(),
-          batchedProb.data() + vocabSize_ * i,
-          vocabSize_ * sizeof(float));
+    for (int i = 0; i < nBatchStates; i++) {
+      storeCache(batchRows_[i], batchedProb.data() + vocabSize_ * i);
     }
   }
 }
+
+size_t ConvLM::hashHistory(const ConvLMState* state) const {
+  size_t hash = state->length;
+  for (int i = 0; i < state->length; i++) {
+    hash = hashCombine(hash, state->tokens[i]);
+  }
+  return hash;
+}
+
+void ConvLM::moveToFront(int row) {
+  if (row == cacheHead_) {
+    return;
+  }
+  auto& entry = cacheEntries_[row];
+  cacheEntries_[entry.prev].next = entry.next;
+  if (entry.next >= 0) {
+    cacheEntries_[entry.next].prev = entry.prev;
+  } else {
+    cacheTail_ = entry.prev;
+  }
+  entry.prev = -1;
+  entry.next = cacheHead_;
+  cacheEntries_[cacheHead_].prev = row;
+  cacheHead_ = row;
+}
+
+int ConvLM::findCache(const ConvLMState* state) {
+  auto it = cacheIndex_.find(hashHistory(state));
+  if (it == cacheIndex_.end()) {
+    return -1;
+  }
+  int row = it->second;
+  // Different histories can have the same hash
+  const auto& entry = cacheEntries_[row];
+  if (entry.length != state->length ||
+      !std::equal(
+          state->tokens.begin(),
+          state->tokens.begin() + state->length,
+          cacheHistories_.begin() + row * maxHistorySize_)) {
+    return -1;
+  }
+  moveToFront(row);
+  return row;
+}
+
+int ConvLM::insertCache(const ConvLMState* state) {
+  size_t hash = hashHistory(state);
+  auto it = cacheIndex_.find(hash);
+  int row;
+  if (it != cacheIndex_.end()) {
+    // Replace the history with the same hash
+    row = it->second;
+  } else {
+    row = cacheTail_;
+    if (cacheEntries_[row].length >= 0) {
+      cacheIndex_.erase(cacheEntries_[row].hash);
+    }
+    cacheIndex_[hash] = row;
+  }
+  auto& entry = cacheEntries_[row];
+  entry.hash = hash;
+  entry.length = state->length;
+  std::copy(
+      state->tokens.begin(),
+      state->tokens.begin() + state->length,
+      cacheHistories_.begin() + row * maxHistorySize_);
+  moveToFront(row);
+  return row;
+}
+
+void ConvLM::storeCache(int row, const float* scores) {
+  float* rowScores = cacheScores_.data() + static_cast<size_t>(row) * rowSize_;
+  if (topK_ == 0) {
+    std::copy(scores, scores + vocabSize_, rowScores);
+    return;
+  }
+
+  // Keep the top-K scores sorted by token, and spread the remaining
+  // probability mass over the other tokens
+  std::iota(topKIndices_.begin(), topKIndices_.end(), 0);
+  std::nth_element(
+      topKIndices_.begin(),
+      topKIndices_.begin() + topK_ - 1,
+      topKIndices_.end(),
+      [scores](int a, int b) { return scores[a] > scores[b]; });
+  std::sort(topKIndices_.begin(), topKIndices_.begin() + topK_);
+  int* rowTokens = cacheTokens_.data() + static_cast<size_t>(row) * topK_;
+  double mass = 0;
+  float minScore = std::numeric_limits<float>::max();
+  for (int i = 0; i < topK_; i++) {
+    rowTokens[i] = topKIndices_[i];
+    rowScores[i] = scores[topKIndices_[i]];
+    mass += std::exp(static_cast<double>(rowScores[i]));
+    minScore = std::min(minScore, rowScores[i]);
+  }
+  double rest = std::max(
+      1. - mass, static_cast<double>(std::numeric_limits<float>::min()));
+  cacheEntries_[row].backoff = std::min(
+      minScore, static_cast<float>(std::log(rest / (vocabSize_ - topK_))));
+}
+
+float ConvLM::cachedScore(int row, int tokenIdx) const {
+  const float* rowScores =
+      cacheScores_.data() + static_cast<size_t>(row) * rowSize_;
+  if (topK_ == 0) {
+    return rowScores[tokenIdx];
+  }
+  const int* rowTokens = cacheTokens_.data() + static_cast<size_t>(row) * topK_;
+  const int* token = std::lower_bound(rowTokens, rowTokens + topK_, tokenIdx);
+  if (token != rowTokens + topK_ && *token == tokenIdx) {
+    return rowScores[token - rowTokens];
+  }
+  return cacheEntries_[row].backoff;
+}
 } // namespace text
 } // namespace lib
 } // namespace fl
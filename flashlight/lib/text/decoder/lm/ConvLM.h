@@ -8,6 +8,8 @@
 #pragma once
 
 #include <functional>
+#include <unordered_map>
+#include <vector>
 
 #include "flashlight/lib/text/decoder/lm/LM.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
@@ -20,6 +22,9 @@ namespace text {
 using GetConvLmScoreFunc = std::function<std::vector<
     float>(const std::vector<int>&, const std::vector<int>&, int, int)>;
 
+// Default number of tokens of the histories given to the network
+constexpr int kConvLMDefaultHistorySize = 49;
+
 struct ConvLMState : LMState {
   std::vector<int> tokens;
   int length;
@@ -29,6 +34,15 @@ struct ConvLMState : LMState {
       : tokens(std::vector<int>(size)), length(size) {}
 };
 
+/**
+ * ConvLM scores the tokens with a convolutional network, run in batches over
+ * the histories of the hypothesis. The scores of the whole vocabulary given
+ * a history are kept in an LRU cache of `beamSize` histories, which should be
+ * larger than the beam size. With `cacheTopK` > 0, only the `cacheTopK`
+ * largest log-probabilities of each history are cached, the remaining mass
+ * being spread uniformly over the other tokens. The cache is keyed by the
+ * history, and is kept between the utterances.
+ */
 class ConvLM : public LM {
  public:
   ConvLM(
@@ -37,26 +51,59 @@ class ConvLM : public LM {
       const Dictionary& usrTknDict,
       int lmMemory = 10000,
       int beamSize = 2500,
-      int historySize = 49);
+      int historySize = kConvLMDefaultHistorySize,
+      int cacheTopK = 0);
 
   LMStatePtr start(bool startWithNothing) override;
 
+  LMStatePtr start(bool startWithNothing, const LMStatePoolPtr& pool)
+      override;
+
   std::pair<LMStatePtr, float> score(
       const LMStatePtr& state,
       const int usrTokenIdx) override;
 
+  void scoreBatch(
+      const LMStatePtr* states,
+      const int* usrTokenIdx,
+      int n,
+      LMStatePtr* outStates,
+      float* scores) override;
+
   std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
 
   void updateCache(std::vector<LMStatePtr> states) override;
 
  private:
-  // This cache is also not thread-safe!
+  // Entry of the score cache, in a doubly linked list from the most to the
+  // least recently used
+  struct CacheEntry {
+    size_t hash; // Hash of the history
+    int length; // Length of the history (-1 if the entry is free)
+    int prev;
+    int next;
+    float backoff; // Score of the tokens out of the top-K
+  };
+
   int lmMemory_;
   int beamSize_;
-  std::unordered_map<ConvLMState*, int> cacheIndices_;
-  std::vector<std::vector<float>> cache_;
-  std::vector<ConvLMState*> slot_;
+  int topK_; // Number of scores cached per history (0 for all of them)
+  int rowSize_; // Size of the rows of `cacheScores_`
+
+  // This cache is also not thread-safe! All the arrays are slabs of
+  // `beamSize_` rows, indexed by the position of the entry.
+  std::vector<CacheEntry> cacheEntries_;
+  std::vector<int> cacheHistories_; // maxHistorySize_ tokens per row
+  std::vector<float> cacheScores_; // rowSize_ scores per row
+  std::vector<int> cacheTokens_; // Token of each score for top-K rows
+  std::unordered_map<size_t, int> cacheIndex_; // History hash to row
+  int cacheHead_; // Most recently used entry
+  int cacheTail_; // Least recently used entry
+
   std::vector<int> batchedTokens_;
+  std::vector<int> batchRows_;
+  std::vector<int> topKIndices_;
+  std::vector<ConvLMState*> rawStates_;
 
   Dictionary vocab_;
   GetConvLmScoreFunc getConvLmScoreFunc_;
@@ -67,6 +114,28 @@ class ConvLM : public LM {
   std::pair<LMStatePtr, float> scoreWithLmIdx(
       const LMStatePtr& state,
       const int tokenIdx);
+
+  // Run the forward pass for the `states` which are not in the cache, in
+  // batches of at most `lmMemory_` tokens, and store their scores in the cache
+  void forward(const std::vector<ConvLMState*>& states, int longestHistory);
+
+  // Row of the cache holding the scores given the history of `state`, marked
+  // as the most recently used, or -1 if it is not cached
+  int findCache(const ConvLMState* state);
+
+  // Row for the history of `state`, evicting the least recently used one
+  int insertCache(const ConvLMState* state);
+
+  // Store the scores of the whole vocabulary in a row of the cache
+  void storeCache(int row, const float* scores);
+
+  // Cached score of a token in a row of the cache
+  float cachedScore(int row, int tokenIdx) const;
+
+  // Mark a row of the cache as the most recently used
+  void moveToFront(int row);
+
+  size_t hashHistory(const ConvLMState* state) const;
 };
 } // namespace text
 } // namespace lib
@@ -7,17 +7,105 @@
 
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <new>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 #include <kenlm/lm/model.hh>
 
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+
 namespace fl {
 namespace lib {
 namespace text {
 
-KenLMState::KenLMState() : ken_(std::make_unique<lm::ngram::State>()) {}
+static_assert(
+    sizeof(lm::ngram::State) <= sizeof(KenLMState::ken_) &&
+        alignof(lm::ngram::State) <= 4,
+    "[KenLM] KenLMState storage is too small for lm::ngram::State");
+
+KenLMState::KenLMState() {
+  new (ken_) lm::ngram::State();
+}
+
+namespace {
+
+std::atomic<uint64_t> nextKenLMId(1);
+
+// Counter only incremented by its thread, and read by any thread
+void increment(std::atomic<uint64_t>& counter) {
+  counter.store(
+      counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+/**
+ * Memory budget of the caches of a KenLM, and the counters of the caches
+ * already freed. It is shared by the LM and its caches.
+ */
+struct KenLM::CacheBudget {
+  explicit CacheBudget(size_t size) : available(size) {}
+
+  std::mutex mutex;
+  size_t available; // bytes not used by the caches
+  std::unordered_set<QueryCache*> caches; // caches of the live threads
+  KenLMCacheStats freedStats;
+};
 
-KenLM::KenLM(const std::string& path, const Dictionary& usrTknDict) {
+/**
+ * Direct-mapped cache of the queries of one thread: a query is stored in the
+ * entry indexed by the hash of its input state and word, replacing the
+ * previous query with the same index. The cache is owned by its thread, and
+ * returns its memory to the budget when the thread exits.
+ */
+struct KenLM::QueryCache {
+  struct Entry {
+    lm::ngram::State inState;
+    lm::ngram::State outState;
+    lm::WordIndex word = std::numeric_limits<lm::WordIndex>::max();
+    float score = 0;
+  };
+
+  QueryCache(std::shared_ptr<CacheBudget> budget, size_t nEntries)
+      : budget(std::move(budget)),
+        entries(nEntries),
+        size(nEntries * sizeof(Entry)) {}
+
+  ~QueryCache() {
+    std::lock_guard<std::mutex> lock(budget->mutex);
+    budget->caches.erase(this);
+    budget->available += size;
+    budget->freedStats.hits += hits.load(std::memory_order_relaxed);
+    budget->freedStats.misses += misses.load(std::memory_order_relaxed);
+  }
+
+  std::shared_ptr<CacheBudget> budget;
+  std::vector<Entry> entries; // The size is a power of 2
+  size_t size; // bytes taken from the budget
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
+
+KenLM::KenLM(
+    const std::string& path,
+    const Dictionary& usrTknDict,
+    size_t cacheSize,
+    int nCacheThreads)
+    : id_(nextKenLMId++),
+      threadCacheSize_(cacheSize / std::max(nCacheThreads, 1)),
+      cacheBudget_(std::make_shared<CacheBudget>(cacheSize)) {
+  if (nCacheThreads < 1) {
+    throw std::invalid_argument(
+        "[KenLM] Invalid number of cache threads: " +
+        std::to_string(nCacheThreads));
+  }
   // Load LM
   model_.reset(lm::ngram::LoadVirtual(path.c_str()));
   if (!model_) {
@@ -37,8 +125,21 @@ KenLM::KenLM(const std::string& path, const Dictionary& usrTknDict) {
   }
 }
 
+KenLM::~KenLM() {
+  // The caches of the live threads are not queried anymore: free their entries
+  // now rather than when their thread exits
+  std::lock_guard<std::mutex> lock(cacheBudget_->mutex);
+  for (auto* cache : cacheBudget_->caches) {
+    std::vector<QueryCache::Entry>().swap(cache->entries);
+  }
+}
+
 LMStatePtr KenLM::start(bool startWithNothing) {
-  auto outState = std::make_shared<KenLMState>();
+  return start(startWithNothing, std::make_shared<LMStatePool>());
+}
+
+LMStatePtr KenLM::start(bool startWithNothing, const LMStatePoolPtr& pool) {
+  auto outState = pool->make<KenLMState>();
   if (startWithNothing) {
     model_->NullContextWrite(outState->ken());
   } else {
@@ -55,20 +156,126 @@ std::pair<LMStatePtr, float> KenLM::score(
     throw std::runtime_error(
         "[KenLM] Invalid user token index: " + std::to_string(usrTokenIdx));
   }
-  auto inState = std::static_pointer_cast<KenLMState>(state);
-  auto outState = inState->child<KenLMState>(usrTokenIdx);
-  float score = model_->BaseScore(
-      inState->ken(), usrToLmIdxMap_[usrTokenIdx], outState->ken());
+  auto inState = static_cast<KenLMState*>(state.get());
+  auto outState = inState->pool
+      ? inState->pool->child<KenLMState>(inState, usrTokenIdx)
+      : inState->child<KenLMState>(usrTokenIdx);
+  float score = cachedScore(
+      *inState->ken(), usrToLmIdxMap_[usrTokenIdx], *outState->ken());
   return std::make_pair(std::move(outState), score);
 }
 
+void KenLM::scoreBatch(
+    const LMStatePtr* states,
+    const int* usrTokenIdx,
+    int n,
+    LMStatePtr* outStates,
+    float* scores) {
+  for (int i = 0; i < n; i++) {
+    if (usrTokenIdx[i] < 0 || usrTokenIdx[i] >= usrToLmIdxMap_.size()) {
+      throw std::runtime_error(
+          "[KenLM] Invalid user token index: " +
+          std::to_string(usrTokenIdx[i]));
+    }
+    auto inState = static_cast<KenLMState*>(states[i].get());
+    auto outState = inState->pool
+        ? inState->pool->child<KenLMState>(inState, usrTokenIdx[i])
+        : inState->child<KenLMState>(usrTokenIdx[i]);
+    scores[i] = cachedScore(
+        *inState->ken(), usrToLmIdxMap_[usrTokenIdx[i]], *outState->ken());
+    outStates[i] = std::move(outState);
+  }
+}
+
 std::pair<LMStatePtr, float> KenLM::finish(const LMStatePtr& state) {
-  auto inState = std::static_pointer_cast<KenLMState>(state);
-  auto outState = inState->child<KenLMState>(-1);
+  auto inState = static_cast<KenLMState*>(state.get());
+  auto outState = inState->pool
+      ? inState->pool->child<KenLMState>(inState, -1)
+      : inState->child<KenLMState>(-1);
   float score =
-      model_->BaseScore(inState->ken(), vocab_->EndSentence(), outState->ken());
+      cachedScore(*inState->ken(), vocab_->EndSentence(), *outState->ken());
   return std::make_pair(std::move(outState), score);
 }
+
+KenLM::QueryCache* KenLM::getCache() {
+  // Caches of the LMs queried by the thread, by id of LM, freed when the
+  // thread exits. Ids are never reused, so that the entries of destroyed LMs
+  // are never looked up.
+  static thread_local std::unordered_map<uint64_t, std::unique_ptr<QueryCache>>
+      threadCaches;
+  static thread_local uint64_t lastId = 0;
+  static thread_local QueryCache* lastCache = nullptr;
+  if (lastId == id_) {
+    return lastCache;
+  }
+
+  auto it = threadCaches.find(id_);
+  if (it == threadCaches.end()) {
+    size_t nEntries = 1;
+    while (nEntries * 2 * sizeof(QueryCache::Entry) <= threadCacheSize_) {
+      nEntries *= 2;
+    }
+    size_t size = nEntries * sizeof(QueryCache::Entry);
+    std::unique_ptr<QueryCache> cache;
+    {
+      std::lock_guard<std::mutex> lock(cacheBudget_->mutex);
+      if (size <= threadCacheSize_ && size <= cacheBudget_->available) {
+        cacheBudget_->available -= size;
+        cache = std::make_unique<QueryCache>(cacheBudget_, nEntries);
+        cacheBudget_->caches.insert(cache.get());
+      }
+    }
+    // Without a cache, the thread queries the model directly
+    it = threadCaches.emplace(id_, std::move(cache)).first;
+  }
+  lastId = id_;
+  lastCache = it->second.get();
+  return lastCache;
+}
+
+float KenLM::cachedScore(
+    const lm::ngram::State& inState,
+    unsigned word,
+    lm::ngram::State& outState) {
+  QueryCache* cache = getCache();
+  if (!cache) {
+    return model_->BaseScore(&inState, word, &outState);
+  }
+
+  auto& entry = cache->entries
+      [lm::ngram::hash_value(inState, word) & (cache->entries.size() - 1)];
+  if (entry.word == word && entry.inState == inState) {
+    increment(cache->hits);
+    outState = entry.outState;
+    return entry.score;
+  }
+  increment(cache->misses);
+  float score = model_->BaseScore(&inState, word, &outState);
+  entry.inState = inState;
+  entry.outState = outState;
+  entry.word = word;
+  entry.score = score;
+  return score;
+}
+
+KenLMCacheStats KenLM::getCacheStats() const {
+  std::lock_guard<std::mutex> lock(cacheBudget_->mutex);
+  KenLMCacheStats stats = cacheBudget_->freedStats;
+  for (const auto* cache : cacheBudget_->caches) {
+    stats.hits += cache->hits.load(std::memory_order_relaxed);
+    stats.misses += cache->misses.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void KenLM::resetCacheStats() {
+  std::lock_guard<std::mutex> lock(cacheBudget_->mutex);
+  cacheBudget_->freedStats = KenLMCacheStats();
+  for (auto* cache : cacheBudget_->caches) {
+    cache->hits.store(0, std::memory_order_relaxed);
+    cache->misses.store(0, std::memory_order_relaxed);
+  }
+}
 } // namespace text
 } // namespace lib
 } // namespace fl
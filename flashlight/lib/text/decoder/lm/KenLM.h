@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "flashlight/lib/text/decoder/lm/LM.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
@@ -31,37 +33,111 @@ namespace fl {
 namespace lib {
 namespace text {
 
+#ifdef KENLM_MAX_ORDER
+constexpr int kKenLMMaxOrder = KENLM_MAX_ORDER;
+#else
+constexpr int kKenLMMaxOrder = 6;
+#endif
+
 /**
  * KenLMState is a state object from KenLM, which  contains context length,
  * indicies and compare functions
  * https://github.com/kpu/kenlm/blob/master/lm/state.hh.
+ *
+ * The KenLM state is stored inline (its size is checked in KenLM.cpp), so that
+ * a pooled KenLMState does not need any heap allocation.
  */
 struct KenLMState : LMState {
   KenLMState();
-  std::unique_ptr<lm::ngram::State> ken_;
+  // Storage for lm::ngram::State: (kKenLMMaxOrder - 1) words and backoffs and
+  // the context length
+  alignas(4) unsigned char ken_[(kKenLMMaxOrder - 1) * 8 + 4];
   lm::ngram::State* ken() {
-    return ken_.get();
+    return reinterpret_cast<lm::ngram::State*>(ken_);
+  }
+};
+
+/* Counters of the query caches of a KenLM */
+struct KenLMCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+  double hitRate() const {
+    return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0;
   }
 };
 
 /**
  * KenLM extends LM by using the toolkit https://kheafield.com/code/kenlm/.
+ *
+ * The model is read-only once loaded (binary models are memory mapped), so a
+ * single KenLM can be shared by the decoders of several threads, as long as
+ * each decoder uses its own LM state pool. Each thread then queries the model
+ * through its own cache of (state, token) -> (state, score), which needs no
+ * locking and persists across sentences.
+ *
+ * The caches of all the threads take at most `cacheSize` bytes (0 to disable
+ * them): each cache takes `cacheSize / nCacheThreads` bytes, and a thread
+ * which finds the budget used up by `nCacheThreads` other threads queries the
+ * model directly. The cache of a thread is freed when the thread exits, or
+ * when the LM is destroyed.
  */
 class KenLM : public LM {
  public:
-  KenLM(const std::string& path, const Dictionary& usrTknDict);
+  KenLM(
+      const std::string& path,
+      const Dictionary& usrTknDict,
+      size_t cacheSize = 0,
+      int nCacheThreads = 1);
+
+  ~KenLM() override;
 
   LMStatePtr start(bool startWithNothing) override;
 
+  LMStatePtr start(bool startWithNothing, const LMStatePoolPtr& pool)
+      override;
+
   std::pair<LMStatePtr, float> score(
       const LMStatePtr& state,
       const int usrTokenIdx) override;
 
+  void scoreBatch(
+      const LMStatePtr* states,
+      const int* usrTokenIdx,
+      int n,
+      LMStatePtr* outStates,
+      float* scores) override;
+
   std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
 
+  /* Counters summed over the caches of all the threads */
+  KenLMCacheStats getCacheStats() const;
+
+  /* Reset the counters of the caches of all the threads */
+  void resetCacheStats();
+
  private:
+  struct QueryCache;
+  struct CacheBudget;
+
   std::shared_ptr<lm::base::Model> model_;
   const lm::base::Vocabulary* vocab_;
+
+  // Unique id of the LM, identifying its caches in each thread
+  uint64_t id_;
+  size_t threadCacheSize_; // bytes of the cache of each thread
+  // Shared with the caches, which outlive the LM until their thread exits
+  std::shared_ptr<CacheBudget> cacheBudget_;
+
+  // Cache of the calling thread, created by its first query. nullptr if the
+  // caches are disabled or if the budget was used up.
+  QueryCache* getCache();
+
+  // Score `word` from `inState` through the cache of the calling thread
+  float cachedScore(
+      const lm::ngram::State& inState,
+      unsigned word,
+      lm::ngram::State& outState);
 };
 
 using KenLMPtr = std::shared_ptr<KenLM>;
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <cstring>
 #include <memory>
 #include <stdexcept>
@@ -18,9 +19,20 @@ namespace fl {
 namespace lib {
 namespace text {
 
+class LMStatePool;
+
 struct LMState {
   std::unordered_map<int, std::shared_ptr<LMState>> children;
 
+  // Pool the state is allocated from, nullptr if it is allocated on the heap.
+  // Children of pooled states are obtained with `pool->child()` instead of
+  // being stored in `children`.
+  LMStatePool* pool = nullptr;
+  // Integer handle of the state in its pool
+  int handle = -1;
+  // Unique id of the state in its pool
+  uint64_t id = 0;
+
   template <typename T>
   std::shared_ptr<T> child(int usrIdx) {
     auto s = children.find(usrIdx);
@@ -53,6 +65,7 @@ struct LMState {
  * LMStatePtr is a shared LMState* tracking LM states generated during decoding.
  */
 using LMStatePtr = std::shared_ptr<LMState>;
+using LMStatePoolPtr = std::shared_ptr<LMStatePool>;
 
 /**
  * LM is a thin wrapper for laguage models. We abstrct several common methods
@@ -63,6 +76,17 @@ class LM {
   /* Initialize or reset language model */
   virtual LMStatePtr start(bool startWithNothing) = 0;
 
+  /**
+   * Initialize or reset language model, allocating the states of the new
+   * sentence from `pool`. Language models which don't support pooled states
+   * ignore the pool.
+   */
+  virtual LMStatePtr start(
+      bool startWithNothing,
+      const LMStatePoolPtr& /* pool */) {
+    return start(startWithNothing);
+  }
+
   /**
    * Query the language model given input language model state and a specific
    * token, return a new language model state and score.
@@ -71,6 +95,25 @@ class LM {
       const LMStatePtr& state,
       const int usrTokenIdx) = 0;
 
+  /**
+   * Query the language model for `n` (state, token) pairs at once, storing the
+   * new state and score of query i into outStates[i] and scores[i]. This is
+   * equivalent to calling `score()` for each query in order, which the
+   * default implementation does.
+   */
+  virtual void scoreBatch(
+      const LMStatePtr* states,
+      const int* usrTokenIdx,
+      int n,
+      LMStatePtr* outStates,
+      float* scores) {
+    for (int i = 0; i < n; i++) {
+      auto stateScore = score(states[i], usrTokenIdx[i]);
+      outStates[i] = std::move(stateScore.first);
+      scores[i] = stateScore.second;
+    }
+  }
+
   /* Query the language model and finish decoding. */
   virtual std::pair<LMStatePtr, float> finish(const LMStatePtr& state) = 0;
 
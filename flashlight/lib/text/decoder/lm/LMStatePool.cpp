@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+
+#include <algorithm>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+constexpr size_t LMStatePool::kDefaultMaxLinks;
+constexpr size_t LMStatePool::kBlockAlign;
+constexpr size_t LMStatePool::kSlabSize;
+
+LMStatePool::LMStatePool(size_t maxLinks)
+    : slabPos_(nullptr),
+      slabLeft_(0),
+      nextId_(1),
+      maxLinks_(maxLinks),
+      lruHead_(-1),
+      lruTail_(-1),
+      nLinks_(0),
+      stats_() {}
+
+LMStatePool::~LMStatePool() = default;
+
+/* ===================== Arena ===================== */
+
+void* LMStatePool::allocate(size_t size) {
+  size_t nUnits = (size + kBlockAlign - 1) / kBlockAlign;
+  if (nUnits < freeBlocks_.size() && freeBlocks_[nUnits]) {
+    void* block = freeBlocks_[nUnits];
+    freeBlocks_[nUnits] = *static_cast<void**>(block);
+    return block;
+  }
+
+  size_t blockSize = nUnits * kBlockAlign;
+  if (blockSize > slabLeft_) {
+    size_t slabSize = std::max(kSlabSize, blockSize);
+    slabs_.emplace_back(new char[slabSize]);
+    slabPos_ = slabs_.back().get();
+    slabLeft_ = slabSize;
+    stats_.nBytes += slabSize;
+  }
+  void* block = slabPos_;
+  slabPos_ += blockSize;
+  slabLeft_ -= blockSize;
+  return block;
+}
+
+void LMStatePool::deallocate(void* ptr, size_t size) {
+  size_t nUnits = (size + kBlockAlign - 1) / kBlockAlign;
+  if (nUnits >= freeBlocks_.size()) {
+    freeBlocks_.resize(nUnits + 1, nullptr);
+  }
+  *static_cast<void**>(ptr) = freeBlocks_[nUnits];
+  freeBlocks_[nUnits] = ptr;
+}
+
+/* ===================== Handles ===================== */
+
+int LMStatePool::acquireHandle() {
+  if (!freeHandles_.empty()) {
+    int handle = freeHandles_.back();
+    freeHandles_.pop_back();
+    return handle;
+  }
+  slots_.emplace_back();
+  return slots_.size() - 1;
+}
+
+void LMStatePool::releaseHandle(int handle) {
+  // The link to the state can be evicted from now on
+  int link = slots_[handle].link;
+  if (link >= 0 && links_[link].childHandle == handle &&
+      links_[link].childId == slots_[handle].id) {
+    links_[link].childHandle = -1;
+    lruPushFront(link);
+  }
+  slots_[handle].state.reset();
+  slots_[handle].id = 0;
+  slots_[handle].link = -1;
+  freeHandles_.push_back(handle);
+  --stats_.nLiveStates;
+}
+
+/* ===================== Child links ===================== */
+
+size_t LMStatePool::bucketOf(uint64_t parentId, int usrIdx) const {
+  uint64_t h = parentId * 0x9E3779B97F4A7C15ULL ^
+      static_cast<uint64_t>(static_cast<uint32_t>(usrIdx)) *
+          0xC2B2AE3D27D4EB4FULL;
+  h ^= h >> 29;
+  return h & (buckets_.size() - 1);
+}
+
+int LMStatePool::findLink(uint64_t parentId, int usrIdx) const {
+  if (buckets_.empty()) {
+    return -1;
+  }
+  for (int link = buckets_[bucketOf(parentId, usrIdx)]; link >= 0;
+       link = links_[link].hashNext) {
+    if (links_[link].parentId == parentId && links_[link].usrIdx == usrIdx) {
+      return link;
+    }
+  }
+  return -1;
+}
+
+int LMStatePool::addLink(uint64_t parentId, int usrIdx) {
+  if (maxLinks_ == 0) {
+    return -1;
+  }
+
+  int link;
+  if (links_.size() < maxLinks_ || lruTail_ < 0) {
+    // Grow the table, beyond `maxLinks_` if all the children are alive
+    if (links_.size() + 1 > buckets_.size()) {
+      rehash(std::max<size_t>(buckets_.size() * 2, 1024));
+    }
+    link = links_.size();
+    links_.emplace_back();
+  } else {
+    // Evict the link of the child which died first
+    link = lruTail_;
+    lruUnlink(link);
+    int* prev = &buckets_[bucketOf(links_[link].parentId, links_[link].usrIdx)];
+    while (*prev != link) {
+      prev = &links_[*prev].hashNext;
+    }
+    *prev = links_[link].hashNext;
+    --nLinks_;
+    ++stats_.nEvictedLinks;
+  }
+
+  Link& entry = links_[link];
+  entry.parentId = parentId;
+  entry.usrIdx = usrIdx;
+  entry.childHandle = -1;
+  entry.childId = 0;
+  size_t bucket = bucketOf(parentId, usrIdx);
+  entry.hashNext = buckets_[bucket];
+  buckets_[bucket] = link;
+  ++nLinks_;
+  return link;
+}
+
+void LMStatePool::lruUnlink(int link) {
+  Link& entry = links_[link];
+  if (entry.lruPrev >= 0) {
+    links_[entry.lruPrev].lruNext = entry.lruNext;
+  } else {
+    lruHead_ = entry.lruNext;
+  }
+  if (entry.lruNext >= 0) {
+    links_[entry.lruNext].lruPrev = entry.lruPrev;
+  } else {
+    lruTail_ = entry.lruPrev;
+  }
+}
+
+void LMStatePool::lruPushFront(int link) {
+  Link& entry = links_[link];
+  entry.lruPrev = -1;
+  entry.lruNext = lruHead_;
+  if (lruHead_ >= 0) {
+    links_[lruHead_].lruPrev = link;
+  } else {
+    lruTail_ = link;
+  }
+  lruHead_ = link;
+}
+
+void LMStatePool::rehash(size_t nBuckets) {
+  buckets_.assign(nBuckets, -1);
+  for (int link = 0; link < links_.size(); ++link) {
+    size_t bucket = bucketOf(links_[link].parentId, links_[link].usrIdx);
+    links_[link].hashNext = buckets_[bucket];
+    buckets_[bucket] = link;
+  }
+}
+
+void LMStatePool::reset() {
+  // Keep the allocated memory of the link table
+  links_.clear();
+  for (auto& slot : slots_) {
+    slot.link = -1;
+  }
+  std::fill(buckets_.begin(), buckets_.end(), -1);
+  lruHead_ = -1;
+  lruTail_ = -1;
+  nLinks_ = 0;
+
+  stats_.nPeakLiveStates = stats_.nLiveStates;
+  stats_.nCreatedStates = 0;
+  stats_.nLinkHits = 0;
+  stats_.nLinkMisses = 0;
+  stats_.nEvictedLinks = 0;
+}
+
+LMStatePoolStats LMStatePool::getStats() const {
+  LMStatePoolStats stats = stats_;
+  stats.nLinks = nLinks_;
+  stats.nBytes += slots_.capacity() * sizeof(Slot) +
+      freeHandles_.capacity() * sizeof(int) +
+      links_.capacity() * sizeof(Link) + buckets_.capacity() * sizeof(int);
+  return stats;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/lm/LM.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * Memory statistics of an LMStatePool. Counters are reset with `reset()`,
+ * except the ones describing the current content of the pool.
+ */
+struct LMStatePoolStats {
+  size_t nLiveStates; // Number of states currently alive
+  size_t nPeakLiveStates; // Maximum number of states alive at the same time
+  size_t nCreatedStates; // Number of states created
+  size_t nLinks; // Number of child links currently stored
+  size_t nLinkHits; // Child lookups which returned an existing state
+  size_t nLinkMisses; // Child lookups which created a new state
+  size_t nEvictedLinks; // Child links dropped to stay below the capacity
+  size_t nBytes; // Memory reserved by the pool
+};
+
+/**
+ * LMStatePool is an arena allocator for language model states, together with
+ * a bounded table of child links (state, token) -> state.
+ *
+ * States are allocated from slabs of fixed size blocks which are recycled
+ * through free lists, and are identified by integer handles in the pool. Child
+ * links do not own the states: a state lives as long as some hypothesis
+ * references it, and the links of dead states are reused. When the table holds
+ * `maxLinks` links, the link whose child died first is evicted. The links of
+ * live children are never evicted, so that a parent always returns the same
+ * child state while it is alive (decoders merge hypotheses by LM state): the
+ * table only grows beyond `maxLinks` if more children than that are alive.
+ * Eviction only means that the same child may be created again if requested
+ * later from the same parent. Once the pool has grown to the size needed for
+ * the beam, decoding does not allocate memory for LM states anymore.
+ *
+ * The pool must be owned by a shared_ptr: the states allocated from it keep it
+ * alive. It is not thread-safe, so each decoder uses its own pool.
+ */
+class LMStatePool : public std::enable_shared_from_this<LMStatePool> {
+ public:
+  static constexpr size_t kDefaultMaxLinks = 1 << 18;
+
+  explicit LMStatePool(size_t maxLinks = kDefaultMaxLinks);
+
+  ~LMStatePool();
+
+  LMStatePool(const LMStatePool&) = delete;
+  LMStatePool& operator=(const LMStatePool&) = delete;
+
+  /* Allocate a new state of type T (derived from LMState) in the pool */
+  template <class T, class... Args>
+  std::shared_ptr<T> make(Args&&... args);
+
+  /**
+   * Get the child state of `parent` for the token `usrIdx`: return the state
+   * linked previously if it is still alive, otherwise create a new one.
+   */
+  template <class T>
+  std::shared_ptr<T> child(const LMState* parent, int usrIdx);
+
+  /* Drop all the child links and reset the counters (live states are kept) */
+  void reset();
+
+  LMStatePoolStats getStats() const;
+
+  size_t getMaxLinks() const {
+    return maxLinks_;
+  }
+
+ private:
+  // Allocator of the shared_ptr control blocks, which keeps the pool alive
+  template <class U>
+  struct Allocator {
+    using value_type = U;
+
+    std::shared_ptr<LMStatePool> pool;
+
+    explicit Allocator(std::shared_ptr<LMStatePool> pool)
+        : pool(std::move(pool)) {}
+    template <class V>
+    Allocator(const Allocator<V>& other) : pool(other.pool) {}
+
+    U* allocate(size_t n) {
+      return static_cast<U*>(pool->allocate(n * sizeof(U)));
+    }
+    void deallocate(U* ptr, size_t n) {
+      pool->deallocate(ptr, n * sizeof(U));
+    }
+    template <class V>
+    bool operator==(const Allocator<V>& other) const {
+      return pool == other.pool;
+    }
+    template <class V>
+    bool operator!=(const Allocator<V>& other) const {
+      return pool != other.pool;
+    }
+  };
+
+  // Deleter of the states, called while the control block (and thus the
+  // pool) is still alive
+  template <class T>
+  struct Deleter {
+    LMStatePool* pool;
+
+    void operator()(T* state) const {
+      int handle = state->handle;
+      state->~T();
+      pool->deallocate(state, sizeof(T));
+      pool->releaseHandle(handle);
+    }
+  };
+
+  struct Slot {
+    std::weak_ptr<LMState> state;
+    uint64_t id; // 0 if the slot is free
+    int link; // Link to the state from its parent, -1 if none
+  };
+
+  // A link is either pinned by its live child, or in the LRU list
+  struct Link {
+    uint64_t parentId;
+    int usrIdx;
+    int childHandle; // -1 if the child is dead
+    uint64_t childId;
+    int hashNext; // Next link in the same bucket
+    int lruPrev;
+    int lruNext;
+  };
+
+  static constexpr size_t kBlockAlign = 16;
+  static constexpr size_t kSlabSize = 1 << 16;
+
+  void* allocate(size_t size);
+  void deallocate(void* ptr, size_t size);
+
+  int acquireHandle();
+  void releaseHandle(int handle);
+
+  size_t bucketOf(uint64_t parentId, int usrIdx) const;
+  int findLink(uint64_t parentId, int usrIdx) const;
+  int addLink(uint64_t parentId, int usrIdx);
+  void lruUnlink(int link);
+  void lruPushFront(int link);
+  void rehash(size_t nBuckets);
+
+  // Arena of blocks; free lists are indexed by the block size / kBlockAlign
+  std::vector<std::unique_ptr<char[]>> slabs_;
+  char* slabPos_;
+  size_t slabLeft_;
+  std::vector<void*> freeBlocks_;
+
+  // Integer handles of the states
+  std::vector<Slot> slots_;
+  std::vector<int> freeHandles_;
+  uint64_t nextId_;
+
+  // Child links, chained in hash buckets. The links of dead children are also
+  // chained in a LRU list, by time of death
+  size_t maxLinks_;
+  std::vector<Link> links_;
+  std::vector<int> buckets_;
+  int lruHead_;
+  int lruTail_;
+  size_t nLinks_;
+
+  LMStatePoolStats stats_;
+};
+
+template <class T, class... Args>
+std::shared_ptr<T> LMStatePool::make(Args&&... args) {
+  void* mem = allocate(sizeof(T));
+  T* state;
+  try {
+    state = new (mem) T(std::forward<Args>(args)...);
+  } catch (...) {
+    deallocate(mem, sizeof(T));
+    throw;
+  }
+  int handle = acquireHandle();
+  state->pool = this;
+  state->handle = handle;
+  state->id = nextId_++;
+  ++stats_.nCreatedStates;
+  ++stats_.nLiveStates;
+  if (stats_.nLiveStates > stats_.nPeakLiveStates) {
+    stats_.nPeakLiveStates = stats_.nLiveStates;
+  }
+
+  std::shared_ptr<T> ptr(
+      state, Deleter<T>{this}, Allocator<T>(shared_from_this()));
+  slots_[handle].state = ptr;
+  slots_[handle].id = state->id;
+  slots_[handle].link = -1;
+  return ptr;
+}
+
+template <class T>
+std::shared_ptr<T> LMStatePool::child(const LMState* parent, int usrIdx) {
+  if (parent->pool != this) {
+    throw std::invalid_argument(
+        "[LMStatePool] Parent state is not allocated from this pool");
+  }
+  int link = findLink(parent->id, usrIdx);
+  if (link >= 0 && links_[link].childHandle >= 0) {
+    auto state = slots_[links_[link].childHandle].state.lock();
+    if (state) {
+      ++stats_.nLinkHits;
+      return std::static_pointer_cast<T>(state);
+    }
+  }
+
+  ++stats_.nLinkMisses;
+  auto state = make<T>();
+  if (link < 0) {
+    link = addLink(parent->id, usrIdx);
+  } else if (links_[link].childHandle < 0) {
+    // The linked state is dead, reuse the link
+    lruUnlink(link);
+  }
+  if (link >= 0) {
+    links_[link].childHandle = state->handle;
+    links_[link].childId = state->id;
+    slots_[state->handle].link = link;
+  }
+  return state;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
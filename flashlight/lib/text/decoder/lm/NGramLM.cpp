@@ -0,0 +1,863 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/lm/NGramLM.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/Utils.h"
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kNGramModelMagic[8] = {'F', 'L', 'N', 'G', 'R', 'A', 'M', '\0'};
+constexpr int kNGramModelVersion = 2;
+constexpr const char* kArpaBosToken = "<s>";
+// Probability of <unk> when the ARPA file has none, as in KenLM
+constexpr float kDefaultUnkProb = -100;
+// Iterations of Lloyd's algorithm fitting the quantization codebooks
+constexpr int kQuantizationIterations = 10;
+
+struct NGramModelHeader {
+  char magic[8];
+  int version;
+  int order;
+  int vocabSize;
+  int probBits;
+  int backoffBits;
+  int unk;
+  int bos;
+  int eos;
+  uint64_t vocabBytes;
+  uint64_t counts[kNGramLMMaxOrder];
+  uint64_t fingerprint;
+};
+
+NGramModelHeader
+readHeader(const char* data, size_t size, const std::string& path) {
+  NGramModelHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("[NGramModel] Invalid model file: " + path);
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(
+          header.magic, kNGramModelMagic, sizeof(kNGramModelMagic)) != 0 ||
+      header.version != kNGramModelVersion) {
+    throw std::runtime_error(
+        "[NGramModel] Invalid model file (wrong magic or version): " + path);
+  }
+  return header;
+}
+
+// Sections are padded to 8 bytes so that they stay aligned in mapped files
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void append(std::vector<char>& buffer, const void* data, size_t size) {
+  size_t pos = buffer.size();
+  buffer.resize(pos + padded(size));
+  if (size > 0) {
+    std::memcpy(buffer.data() + pos, data, size);
+  }
+}
+
+size_t valuesSize(uint64_t count, int bits) {
+  return count * (bits / 8);
+}
+
+size_t codebookSize(int bits) {
+  return bits < 32 ? (static_cast<size_t>(1) << bits) * sizeof(float) : 0;
+}
+
+/**
+ * Codebook of 2^bits sorted values representing `values`: the exact values if
+ * there are few enough distinct ones, otherwise the centers found by Lloyd's
+ * algorithm (1D k-means) starting from bins holding the same number of values.
+ */
+std::vector<float> buildCodebook(std::vector<float> values, int bits) {
+  size_t nBins = static_cast<size_t>(1) << bits;
+  std::sort(values.begin(), values.end());
+  std::vector<float> distinct(values);
+  distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+  std::vector<float> codebook;
+  if (distinct.size() <= nBins) {
+    codebook = std::move(distinct);
+  } else {
+    for (size_t b = 0; b < nBins; ++b) {
+      size_t begin = b * values.size() / nBins;
+      size_t end = (b + 1) * values.size() / nBins;
+      double sum = 0;
+      for (size_t i = begin; i < end; ++i) {
+        sum += values[i];
+      }
+      codebook.push_back(end > begin ? sum / (end - begin) : values[begin]);
+    }
+    // Values are sorted, so each center gets a contiguous range of them
+    for (int iter = 0; iter < kQuantizationIterations; ++iter) {
+      std::vector<double> sums(nBins, 0);
+      std::vector<size_t> counts(nBins, 0);
+      size_t bin = 0;
+      for (float value : values) {
+        while (bin + 1 < nBins &&
+               std::abs(codebook[bin + 1] - value) <=
+                   std::abs(codebook[bin] - value)) {
+          ++bin;
+        }
+        sums[bin] += value;
+        ++counts[bin];
+      }
+      for (size_t b = 0; b < nBins; ++b) {
+        if (counts[b] > 0) {
+          codebook[b] = sums[b] / counts[b];
+        }
+      }
+      std::sort(codebook.begin(), codebook.end());
+    }
+  }
+  codebook.resize(nBins, codebook.empty() ? 0 : codebook.back());
+  return codebook;
+}
+
+// Index of the codebook value closest to `value`
+size_t encode(const std::vector<float>& codebook, float value) {
+  auto it = std::lower_bound(codebook.begin(), codebook.end(), value);
+  if (it == codebook.end()) {
+    return codebook.size() - 1;
+  }
+  if (it != codebook.begin() && value - *(it - 1) < *it - value) {
+    --it;
+  }
+  return it - codebook.begin();
+}
+
+void appendValues(
+    std::vector<char>& buffer,
+    const std::vector<float>& values,
+    int bits) {
+  if (bits == 32) {
+    append(buffer, values.data(), values.size() * sizeof(float));
+    return;
+  }
+  auto codebook = buildCodebook(values, bits);
+  append(buffer, codebook.data(), codebook.size() * sizeof(float));
+  if (bits == 8) {
+    std::vector<uint8_t> codes(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      codes[i] = encode(codebook, values[i]);
+    }
+    append(buffer, codes.data(), codes.size());
+  } else {
+    std::vector<uint16_t> codes(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      codes[i] = encode(codebook, values[i]);
+    }
+    append(buffer, codes.data(), codes.size() * sizeof(uint16_t));
+  }
+}
+
+// N-grams of one order read from an ARPA file, in file order
+struct ArpaNGrams {
+  std::vector<int> words; // n words per n-gram
+  std::vector<float> probs;
+  std::vector<float> backoffs;
+
+  size_t size() const {
+    return probs.size();
+  }
+};
+
+struct WordsHash {
+  size_t operator()(const std::vector<int>& words) const {
+    size_t hash = words.size();
+    for (int word : words) {
+      hash = hashCombine(hash, word);
+    }
+    return hash;
+  }
+};
+
+using NGramIndex = std::unordered_map<std::vector<int>, size_t, WordsHash>;
+
+// Split `line` into the fields separated by spaces or tabs
+void splitFields(const std::string& line, std::vector<std::string>& fields) {
+  fields.clear();
+  size_t pos = 0;
+  while (pos < line.size()) {
+    size_t begin = line.find_first_not_of(" \t\r", pos);
+    if (begin == std::string::npos) {
+      break;
+    }
+    size_t end = line.find_first_of(" \t\r", begin);
+    if (end == std::string::npos) {
+      end = line.size();
+    }
+    fields.emplace_back(line, begin, end - begin);
+    pos = end;
+  }
+}
+
+float parseFloat(const std::string& field, const std::string& path) {
+  try {
+    return std::stof(field);
+  } catch (const std::exception&) {
+    throw std::runtime_error(
+        "[NGramModel] Invalid number '" + field + "' in ARPA file: " + path);
+  }
+}
+
+} // namespace
+
+std::shared_ptr<NGramModel> NGramModel::fromArpa(
+    const std::string& path,
+    int probBits,
+    int backoffBits) {
+  for (int bits : {probBits, backoffBits}) {
+    if (bits != 8 && bits != 16 && bits != 32) {
+      throw std::invalid_argument(
+          "[NGramModel] Quantization bits must be 8, 16 or 32, got " +
+          std::to_string(bits));
+    }
+  }
+
+  /* 1. Read the n-grams */
+  auto in = createInputStream(path);
+  std::vector<std::string> vocab;
+  std::unordered_map<std::string, int> vocabIndex;
+  std::vector<uint64_t> declaredCounts;
+  std::vector<ArpaNGrams> ngrams;
+  std::string line;
+  std::vector<std::string> fields;
+  // Order of the current n-gram section, 0 for the counts, -1 before them
+  int section = -1;
+  bool ended = false;
+  while (std::getline(in, line)) {
+    splitFields(line, fields);
+    if (fields.empty()) {
+      continue;
+    }
+    if (fields[0] == "\\data\\") {
+      section = 0;
+      continue;
+    }
+    if (fields[0] == "\\end\\") {
+      ended = true;
+      break;
+    }
+    if (fields[0][0] == '\\') {
+      int n = 0;
+      if (std::sscanf(fields[0].c_str(), "\\%d-grams:", &n) != 1 ||
+          n != ngrams.size() + 1 || n > declaredCounts.size()) {
+        throw std::runtime_error(
+            "[NGramModel] Unexpected section '" + fields[0] +
+            "' in ARPA file: " + path);
+      }
+      section = n;
+      ngrams.emplace_back();
+      continue;
+    }
+    if (section < 0) {
+      continue;
+    }
+    if (section == 0) {
+      unsigned long long count = 0;
+      int n = 0;
+      if (fields[0] == "ngram" && fields.size() == 2 &&
+          std::sscanf(fields[1].c_str(), "%d=%llu", &n, &count) == 2 &&
+          n == declaredCounts.size() + 1) {
+        declaredCounts.push_back(count);
+        continue;
+      }
+      throw std::runtime_error(
+          "[NGramModel] Invalid line '" + line + "' in ARPA file: " + path);
+    }
+
+    int n = section;
+    if (fields.size() != n + 1 && fields.size() != n + 2) {
+      throw std::runtime_error(
+          "[NGramModel] Invalid " + std::to_string(n) + "-gram '" + line +
+          "' in ARPA file: " + path);
+    }
+    auto& order = ngrams[n - 1];
+    order.probs.push_back(parseFloat(fields[0], path));
+    order.backoffs.push_back(
+        fields.size() == n + 2 ? parseFloat(fields[n + 1], path) : 0);
+    for (int i = 1; i <= n; ++i) {
+      if (n == 1) {
+        if (!vocabIndex.emplace(fields[i], vocab.size()).second) {
+          throw std::runtime_error(
+              "[NGramModel] Duplicate unigram '" + fields[i] +
+              "' in ARPA file: " + path);
+        }
+        vocab.push_back(fields[i]);
+      }
+      auto word = vocabIndex.find(fields[i]);
+      if (word == vocabIndex.end()) {
+        throw std::runtime_error(
+            "[NGramModel] Word '" + fields[i] +
+            "' is not a unigram in ARPA file: " + path);
+      }
+      order.words.push_back(word->second);
+    }
+  }
+
+  if (!ended || ngrams.empty() || ngrams.size() != declaredCounts.size()) {
+    throw std::runtime_error("[NGramModel] Truncated ARPA file: " + path);
+  }
+  if (ngrams.size() > kNGramLMMaxOrder) {
+    throw std::runtime_error(
+        "[NGramModel] Order " + std::to_string(ngrams.size()) +
+        " is larger than the maximum order " +
+        std::to_string(kNGramLMMaxOrder) + ": " + path);
+  }
+  for (size_t n = 0; n < ngrams.size(); ++n) {
+    if (ngrams[n].size() != declaredCounts[n]) {
+      throw std::runtime_error(
+          "[NGramModel] Wrong number of " + std::to_string(n + 1) +
+          "-grams in ARPA file: " + path);
+    }
+  }
+  if (vocabIndex.find(kUnkToken) == vocabIndex.end()) {
+    vocabIndex.emplace(kUnkToken, vocab.size());
+    vocab.push_back(kUnkToken);
+    ngrams[0].words.push_back(vocab.size() - 1);
+    ngrams[0].probs.push_back(kDefaultUnkProb);
+    ngrams[0].backoffs.push_back(0);
+  }
+  for (const char* token : {kArpaBosToken, kEosToken}) {
+    if (vocabIndex.find(token) == vocabIndex.end()) {
+      throw std::runtime_error(
+          std::string("[NGramModel] Missing unigram ") + token +
+          " in ARPA file: " + path);
+    }
+  }
+  const int order = ngrams.size();
+
+  /* 2. Add the missing suffixes and prefixes, from the highest order down */
+  std::vector<NGramIndex> indices(order + 1);
+  for (int n = 2; n <= order; ++n) {
+    const auto& words = ngrams[n - 1].words;
+    for (size_t i = 0; i < ngrams[n - 1].size(); ++i) {
+      std::vector<int> key(words.begin() + i * n, words.begin() + (i + 1) * n);
+      if (!indices[n].emplace(std::move(key), i).second) {
+        throw std::runtime_error(
+            "[NGramModel] Duplicate " + std::to_string(n) +
+            "-gram in ARPA file: " + path);
+      }
+    }
+  }
+  // Find an n-gram (given by its n words) in file order, -1 if it is missing
+  auto find = [&](int n, const int* words) -> int64_t {
+    if (n == 1) {
+      return words[0];
+    }
+    auto it = indices[n].find(std::vector<int>(words, words + n));
+    return it == indices[n].end() ? -1 : static_cast<int64_t>(it->second);
+  };
+  std::vector<std::vector<size_t>> added(order + 1);
+  for (int n = order; n > 2; --n) {
+    auto& lower = ngrams[n - 2];
+    for (size_t i = 0; i < ngrams[n - 1].size(); ++i) {
+      const int* words = ngrams[n - 1].words.data() + i * n;
+      // The suffix is needed by the trie, and the prefix by the queries,
+      // whose contexts only keep n-grams
+      for (const int* ngram : {words + 1, words}) {
+        if (find(n - 1, ngram) < 0) {
+          indices[n - 1].emplace(
+              std::vector<int>(ngram, ngram + n - 1), lower.size());
+          added[n - 1].push_back(lower.size());
+          lower.words.insert(lower.words.end(), ngram, ngram + n - 1);
+          lower.probs.push_back(0);
+          lower.backoffs.push_back(0);
+        }
+      }
+    }
+  }
+  // Their probability is the one given by backoff, from the lowest order up:
+  // P(w_n | w_1..w_n-1) = P(w_n | w_2..w_n-1) + backoff(w_1..w_n-1)
+  for (int n = 2; n < order; ++n) {
+    auto& ngramsN = ngrams[n - 1];
+    for (size_t i : added[n]) {
+      const int* words = ngramsN.words.data() + i * n;
+      float prob = ngrams[n - 2].probs[find(n - 1, words + 1)];
+      int64_t context = find(n - 1, words);
+      if (context >= 0) {
+        prob += ngrams[n - 2].backoffs[context];
+      }
+      ngramsN.probs[i] = prob;
+    }
+  }
+
+  /* 3. Sort the n-grams of each order by (suffix, first word) */
+  std::shared_ptr<NGramModel> model(new NGramModel());
+  model->order_ = order;
+  model->vocabSize_ = vocab.size();
+  model->vocabBytes_ = 0;
+  for (const auto& word : vocab) {
+    model->vocabBytes_ += word.size();
+  }
+  model->probBits_ = probBits;
+  model->backoffBits_ = backoffBits;
+  model->unk_ = vocabIndex[kUnkToken];
+  model->bos_ = vocabIndex[kArpaBosToken];
+  model->eos_ = vocabIndex[kEosToken];
+  model->orders_.resize(order);
+  for (int n = 1; n <= order; ++n) {
+    model->orders_[n - 1].count = ngrams[n - 1].size();
+    if (ngrams[n - 1].size() >= std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error(
+          "[NGramModel] Too many " + std::to_string(n) +
+          "-grams in ARPA file: " + path);
+    }
+  }
+  size_t dataSize = 0;
+  for (size_t sectionSize : model->sectionSizes()) {
+    dataSize += padded(sectionSize);
+  }
+  auto& buffer = model->buffer_;
+  buffer.reserve(dataSize);
+
+  std::vector<uint32_t> offsets{0};
+  std::string chars;
+  for (const auto& word : vocab) {
+    chars += word;
+    offsets.push_back(chars.size());
+  }
+  std::vector<uint32_t> sorted(vocab.size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  std::sort(sorted.begin(), sorted.end(), [&vocab](uint32_t a, uint32_t b) {
+    return vocab[a] < vocab[b];
+  });
+  append(buffer, offsets.data(), offsets.size() * sizeof(uint32_t));
+  append(buffer, chars.data(), chars.size());
+  append(buffer, sorted.data(), sorted.size() * sizeof(uint32_t));
+
+  // Position of each n-gram of the previous order, by file order
+  std::vector<uint32_t> prevPositions(vocab.size());
+  std::iota(prevPositions.begin(), prevPositions.end(), 0);
+  std::vector<uint32_t> parents;
+  for (int n = 1; n <= order; ++n) {
+    const auto& ngramsN = ngrams[n - 1];
+    size_t count = ngramsN.size();
+    std::vector<uint32_t> positions(count);
+    std::vector<uint32_t> firstWords(count);
+    if (n == 1) {
+      std::iota(positions.begin(), positions.end(), 0);
+    } else {
+      parents.resize(count);
+      for (size_t i = 0; i < count; ++i) {
+        parents[i] = prevPositions[find(n - 1, &ngramsN.words[i * n + 1])];
+      }
+      std::vector<uint32_t> perm(count);
+      std::iota(perm.begin(), perm.end(), 0);
+      std::sort(perm.begin(), perm.end(), [&](uint32_t a, uint32_t b) {
+        return std::make_pair(parents[a], ngramsN.words[a * n]) <
+            std::make_pair(parents[b], ngramsN.words[b * n]);
+      });
+      for (size_t i = 0; i < count; ++i) {
+        positions[perm[i]] = i;
+        firstWords[i] = ngramsN.words[perm[i] * n];
+      }
+      append(buffer, firstWords.data(), count * sizeof(uint32_t));
+    }
+
+    std::vector<float> probs(count);
+    std::vector<float> backoffs(count);
+    for (size_t i = 0; i < count; ++i) {
+      probs[positions[i]] = ngramsN.probs[i];
+      backoffs[positions[i]] = ngramsN.backoffs[i];
+    }
+    if (n < order) {
+      // Extensions of each n-gram, from the parents of the next order
+      const auto& next = ngrams[n];
+      std::vector<uint32_t> childBegin(count + 1, 0);
+      for (size_t i = 0; i < next.size(); ++i) {
+        int64_t suffix = find(n, &next.words[i * (n + 1) + 1]);
+        ++childBegin[positions[suffix] + 1];
+      }
+      std::partial_sum(
+          childBegin.begin(), childBegin.end(), childBegin.begin());
+      append(buffer, childBegin.data(), childBegin.size() * sizeof(uint32_t));
+    }
+    appendValues(buffer, probs, probBits);
+    if (n < order) {
+      appendValues(buffer, backoffs, backoffBits);
+    }
+    prevPositions.swap(positions);
+  }
+  if (buffer.size() != dataSize) {
+    throw std::logic_error("[NGramModel] Wrong size of the model data");
+  }
+
+  model->setPointers(buffer.data());
+  return model;
+}
+
+std::vector<size_t> NGramModel::sectionSizes() const {
+  std::vector<size_t> sizes{
+      (vocabSize_ + 1) * sizeof(uint32_t),
+      vocabBytes_,
+      vocabSize_ * sizeof(uint32_t)};
+  for (int n = 1; n <= order_; ++n) {
+    uint64_t count = orders_[n - 1].count;
+    if (n > 1) {
+      sizes.push_back(count * sizeof(uint32_t));
+    }
+    if (n < order_) {
+      sizes.push_back((count + 1) * sizeof(uint32_t));
+    }
+    if (probBits_ < 32) {
+      sizes.push_back(codebookSize(probBits_));
+    }
+    sizes.push_back(valuesSize(count, probBits_));
+    if (n < order_) {
+      if (backoffBits_ < 32) {
+        sizes.push_back(codebookSize(backoffBits_));
+      }
+      sizes.push_back(valuesSize(count, backoffBits_));
+    }
+  }
+  return sizes;
+}
+
+void NGramModel::setPointers(const char* data) {
+  auto sizes = sectionSizes();
+  size_t section = 0;
+  auto next = [&]() {
+    const char* ptr = data;
+    data += padded(sizes[section++]);
+    return ptr;
+  };
+  auto nextValues = [&](int bits) {
+    Values values;
+    values.bits = bits;
+    values.codebook =
+        bits < 32 ? reinterpret_cast<const float*>(next()) : nullptr;
+    values.codes = reinterpret_cast<const uint8_t*>(next());
+    return values;
+  };
+
+  vocabOffsets_ = reinterpret_cast<const uint32_t*>(next());
+  vocabChars_ = next();
+  vocabSorted_ = reinterpret_cast<const uint32_t*>(next());
+  for (int n = 1; n <= order_; ++n) {
+    Order& order = orders_[n - 1];
+    order.words = n > 1 ? reinterpret_cast<const uint32_t*>(next()) : nullptr;
+    order.childBegin =
+        n < order_ ? reinterpret_cast<const uint32_t*>(next()) : nullptr;
+    order.probs = nextValues(probBits_);
+    order.backoffs = n < order_ ? nextValues(backoffBits_) : Values{};
+  }
+}
+
+std::shared_ptr<NGramModel> NGramModel::load(
+    const std::string& path,
+    uint64_t fingerprint /* = 0 */) {
+  std::shared_ptr<NGramModel> model(new NGramModel());
+  model->file_ = std::make_unique<MemoryMappedFile>(path);
+  const char* data = model->file_->data();
+  size_t size = model->file_->size();
+
+  auto header = readHeader(data, size, path);
+  if (header.fingerprint != fingerprint) {
+    throw std::runtime_error(
+        "[NGramModel] Model file was built from other inputs: " + path);
+  }
+  auto validBits = [](int bits) {
+    return bits == 8 || bits == 16 || bits == 32;
+  };
+  if (header.order < 1 || header.order > kNGramLMMaxOrder ||
+      header.vocabSize < 1 || !validBits(header.probBits) ||
+      !validBits(header.backoffBits) || header.unk < 0 ||
+      header.unk >= header.vocabSize || header.bos < 0 ||
+      header.bos >= header.vocabSize || header.eos < 0 ||
+      header.eos >= header.vocabSize ||
+      header.counts[0] != header.vocabSize) {
+    throw std::runtime_error("[NGramModel] Invalid model file: " + path);
+  }
+
+  model->order_ = header.order;
+  model->vocabSize_ = header.vocabSize;
+  model->vocabBytes_ = header.vocabBytes;
+  model->probBits_ = header.probBits;
+  model->backoffBits_ = header.backoffBits;
+  model->unk_ = header.unk;
+  model->bos_ = header.bos;
+  model->eos_ = header.eos;
+  model->orders_.resize(header.order);
+  for (int n = 1; n <= header.order; ++n) {
+    model->orders_[n - 1].count = header.counts[n - 1];
+  }
+
+  size_t expectedSize = sizeof(header);
+  for (size_t sectionSize : model->sectionSizes()) {
+    expectedSize += padded(sectionSize);
+  }
+  if (size != expectedSize) {
+    throw std::runtime_error("[NGramModel] Truncated model file: " + path);
+  }
+  model->setPointers(data + sizeof(header));
+  model->validate(path);
+  return model;
+}
+
+void NGramModel::validate(const std::string& path) const {
+  auto invalid = [&path](const std::string& what) {
+    return std::runtime_error(
+        "[NGramModel] Invalid " + what + " in model file: " + path);
+  };
+  const uint32_t vocabSize = vocabSize_;
+  if (vocabOffsets_[0] != 0 || vocabOffsets_[vocabSize_] != vocabBytes_) {
+    throw invalid("vocabulary");
+  }
+  for (int i = 0; i < vocabSize_; ++i) {
+    if (vocabOffsets_[i] > vocabOffsets_[i + 1] ||
+        vocabSorted_[i] >= vocabSize) {
+      throw invalid("vocabulary");
+    }
+  }
+  for (int n = 1; n <= order_; ++n) {
+    const Order& order = orders_[n - 1];
+    if (n > 1) {
+      for (uint64_t i = 0; i < order.count; ++i) {
+        if (order.words[i] >= vocabSize) {
+          throw invalid(std::to_string(n) + "-gram " + std::to_string(i));
+        }
+      }
+    }
+    if (n == order_) {
+      continue;
+    }
+    // The extensions of the n-grams are consecutive ranges covering the
+    // n-grams of order n + 1, each sorted by first word
+    const Order& child = orders_[n];
+    if (order.childBegin[0] != 0 ||
+        order.childBegin[order.count] != child.count) {
+      throw invalid(std::to_string(n) + "-gram extensions");
+    }
+    for (uint64_t i = 0; i < order.count; ++i) {
+      uint32_t begin = order.childBegin[i];
+      uint32_t end = order.childBegin[i + 1];
+      if (begin > end) {
+        throw invalid(std::to_string(n) + "-gram extensions");
+      }
+      for (uint32_t j = begin + 1; j < end; ++j) {
+        if (child.words[j - 1] >= child.words[j]) {
+          throw invalid(std::to_string(n) + "-gram extensions");
+        }
+      }
+    }
+  }
+}
+
+uint64_t NGramModel::loadFingerprint(const std::string& path) {
+  NGramModelHeader header;
+  auto in = createInputStream(path);
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  return readHeader(
+             reinterpret_cast<const char*>(&header), in.gcount(), path)
+      .fingerprint;
+}
+
+void NGramModel::save(const std::string& path, uint64_t fingerprint /* = 0 */)
+    const {
+  NGramModelHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kNGramModelMagic, sizeof(kNGramModelMagic));
+  header.version = kNGramModelVersion;
+  header.order = order_;
+  header.vocabSize = vocabSize_;
+  header.probBits = probBits_;
+  header.backoffBits = backoffBits_;
+  header.unk = unk_;
+  header.bos = bos_;
+  header.eos = eos_;
+  header.vocabBytes = vocabBytes_;
+  for (int n = 1; n <= order_; ++n) {
+    header.counts[n - 1] = orders_[n - 1].count;
+  }
+  header.fingerprint = fingerprint;
+
+  size_t dataSize = 0;
+  for (size_t sectionSize : sectionSizes()) {
+    dataSize += padded(sectionSize);
+  }
+  const char* data = file_ ? file_->data() + sizeof(header) : buffer_.data();
+
+  auto out = createOutputStream(path, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(data, dataSize);
+  if (!out.good()) {
+    throw std::runtime_error("[NGramModel] Failed to write model to: " + path);
+  }
+}
+
+int NGramModel::compareWord(int index, const std::string& word) const {
+  const char* chars = vocabChars_ + vocabOffsets_[index];
+  size_t length = vocabOffsets_[index + 1] - vocabOffsets_[index];
+  return -word.compare(0, word.size(), chars, length);
+}
+
+int NGramModel::index(const std::string& word) const {
+  const uint32_t* end = vocabSorted_ + vocabSize_;
+  const uint32_t* it = std::lower_bound(
+      vocabSorted_, end, word, [this](uint32_t index, const std::string& w) {
+        return compareWord(index, w) < 0;
+      });
+  if (it == end || compareWord(*it, word) != 0) {
+    return unk_;
+  }
+  return *it;
+}
+
+std::string NGramModel::word(int index) const {
+  if (index < 0 || index >= vocabSize_) {
+    throw std::out_of_range(
+        "[NGramModel] Invalid word index: " + std::to_string(index));
+  }
+  return std::string(
+      vocabChars_ + vocabOffsets_[index],
+      vocabOffsets_[index + 1] - vocabOffsets_[index]);
+}
+
+void NGramModel::beginSentence(NGramContext& context) const {
+  context.length = order_ > 1 ? 1 : 0;
+  context.words[0] = bos_;
+  context.backoffs[0] = order_ > 1 ? orders_[0].backoffs[bos_] : 0;
+}
+
+float NGramModel::score(
+    const NGramContext& context,
+    int word,
+    NGramContext& outContext) const {
+  // Walk down the reversed trie from the unigram of `word` through the words
+  // of the context, up to the longest n-gram of the model
+  uint64_t node = word;
+  float prob = orders_[0].probs[node];
+  int matched = 1;
+  outContext.words[0] = word;
+  if (order_ > 1) {
+    outContext.backoffs[0] = orders_[0].backoffs[node];
+  }
+  for (int i = 0; i < context.length && matched < order_; ++i) {
+    const Order& parent = orders_[matched - 1];
+    const Order& child = orders_[matched];
+    const uint32_t* begin = child.words + parent.childBegin[node];
+    const uint32_t* end = child.words + parent.childBegin[node + 1];
+    uint32_t contextWord = context.words[i];
+    const uint32_t* it = std::lower_bound(begin, end, contextWord);
+    if (it == end || *it != contextWord) {
+      break;
+    }
+    node = it - child.words;
+    prob = child.probs[node];
+    if (matched < order_ - 1) {
+      outContext.words[matched] = contextWord;
+      outContext.backoffs[matched] = child.backoffs[node];
+    }
+    ++matched;
+  }
+  outContext.length = std::min(matched, order_ - 1);
+
+  // Back off from the contexts longer than the matched n-gram
+  for (int i = matched - 1; i < context.length; ++i) {
+    prob += context.backoffs[i];
+  }
+  return prob;
+}
+
+NGramLM::NGramLM(NGramModelPtr model, const Dictionary& usrTknDict)
+    : model_(std::move(model)) {
+  if (!model_) {
+    throw std::invalid_argument("[NGramLM] Model is null");
+  }
+
+  // Create index map
+  usrToLmIdxMap_.resize(usrTknDict.indexSize());
+  for (int i = 0; i < usrTknDict.indexSize(); i++) {
+    usrToLmIdxMap_[i] = model_->index(usrTknDict.getEntry(i));
+  }
+}
+
+LMStatePtr NGramLM::start(bool startWithNothing) {
+  return start(startWithNothing, std::make_shared<LMStatePool>());
+}
+
+LMStatePtr NGramLM::start(bool startWithNothing, const LMStatePoolPtr& pool) {
+  auto outState = pool->make<NGramLMState>();
+  if (!startWithNothing) {
+    model_->beginSentence(outState->context);
+  }
+  return outState;
+}
+
+std::pair<LMStatePtr, float> NGramLM::score(
+    const LMStatePtr& state,
+    const int usrTokenIdx) {
+  if (usrTokenIdx < 0 || usrTokenIdx >= usrToLmIdxMap_.size()) {
+    throw std::runtime_error(
+        "[NGramLM] Invalid user token index: " + std::to_string(usrTokenIdx));
+  }
+  auto inState = static_cast<NGramLMState*>(state.get());
+  auto outState = inState->pool
+      ? inState->pool->child<NGramLMState>(inState, usrTokenIdx)
+      : inState->child<NGramLMState>(usrTokenIdx);
+  float score = model_->score(
+      inState->context, usrToLmIdxMap_[usrTokenIdx], outState->context);
+  return std::make_pair(std::move(outState), score);
+}
+
+void NGramLM::scoreBatch(
+    const LMStatePtr* states,
+    const int* usrTokenIdx,
+    int n,
+    LMStatePtr* outStates,
+    float* scores) {
+  for (int i = 0; i < n; i++) {
+    if (usrTokenIdx[i] < 0 || usrTokenIdx[i] >= usrToLmIdxMap_.size()) {
+      throw std::runtime_error(
+          "[NGramLM] Invalid user token index: " +
+          std::to_string(usrTokenIdx[i]));
+    }
+    auto inState = static_cast<NGramLMState*>(states[i].get());
+    auto outState = inState->pool
+        ? inState->pool->child<NGramLMState>(inState, usrTokenIdx[i])
+        : inState->child<NGramLMState>(usrTokenIdx[i]);
+    scores[i] = model_->score(
+        inState->context, usrToLmIdxMap_[usrTokenIdx[i]], outState->context);
+    outStates[i] = std::move(outState);
+  }
+}
+
+std::pair<LMStatePtr, float> NGramLM::finish(const LMStatePtr& state) {
+  auto inState = static_cast<NGramLMState*>(state.get());
+  auto outState = inState->pool
+      ? inState->pool->child<NGramLMState>(inState, -1)
+      : inState->child<NGramLMState>(-1);
+  float score =
+      model_->score(inState->context, model_->eos(), outState->context);
+  return std::make_pair(std::move(outState), score);
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/text/decoder/lm/LM.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+constexpr int kNGramLMMaxOrder = 8;
+
+/**
+ * NGramContext is the context of an n-gram query: the (at most order - 1)
+ * previous words, most recent first, and the backoff of each suffix of the
+ * context, i.e. backoffs[i] is the backoff of (words[i], ..., words[0]).
+ */
+struct NGramContext {
+  int length = 0;
+  int words[kNGramLMMaxOrder - 1];
+  float backoffs[kNGramLMMaxOrder - 1];
+};
+
+/**
+ * NGramModel is a backoff n-gram language model read from an ARPA file, and
+ * stored as a reversed trie of sorted arrays: the n-grams of order n are
+ * grouped by their suffix of order n - 1 and sorted by their first word, so
+ * that extending the context of a query by one word is a binary search over a
+ * small contiguous range. N-grams whose suffix or prefix is missing from the
+ * ARPA file are added with the probability given by backoff.
+ *
+ * Probabilities and backoffs of each order can be quantized to 8 or 16 bits
+ * with a codebook fitted to their distribution (32 bits stores the exact
+ * values), which trades precision for memory. Scores are log10 probabilities,
+ * as in ARPA files and KenLM.
+ *
+ * A NGramModel can be saved to a binary file and loaded back with `load()`,
+ * which memory maps the file without copying it. The file stores a
+ * fingerprint given by the caller, of the ARPA file and options the model was
+ * built from, so that a stale file can be detected. The model is immutable,
+ * so it can be shared by the decoders of several threads.
+ */
+class NGramModel {
+ public:
+  /**
+   * Read an ARPA file, quantizing probabilities with `probBits` and backoffs
+   * with `backoffBits` bits (8, 16 or 32).
+   */
+  static std::shared_ptr<NGramModel>
+  fromArpa(const std::string& path, int probBits = 32, int backoffBits = 32);
+
+  /* Memory map a model previously written with `save()`. Throws if the file
+   * is invalid, or if its fingerprint is not `fingerprint`. */
+  static std::shared_ptr<NGramModel> load(
+      const std::string& path,
+      uint64_t fingerprint = 0);
+
+  /* Read the fingerprint a model file was saved with */
+  static uint64_t loadFingerprint(const std::string& path);
+
+  /* Serialize the model into a binary file which can be used with `load()` */
+  void save(const std::string& path, uint64_t fingerprint = 0) const;
+
+  int order() const {
+    return order_;
+  }
+
+  int vocabSize() const {
+    return vocabSize_;
+  }
+
+  /* Number of n-grams of order n (1 <= n <= order) */
+  uint64_t count(int n) const {
+    return orders_[n - 1].count;
+  }
+
+  /* Index of a word, or the index of <unk> if it is not in the vocabulary */
+  int index(const std::string& word) const;
+
+  /* Word of the vocabulary with a given index */
+  std::string word(int index) const;
+
+  int unk() const {
+    return unk_;
+  }
+
+  int bos() const {
+    return bos_;
+  }
+
+  int eos() const {
+    return eos_;
+  }
+
+  /* Context of the beginning of a sentence, i.e. <s> */
+  void beginSentence(NGramContext& context) const;
+
+  /**
+   * Return the log10 probability of `word` after `context` and store the
+   * context following `word` into `outContext`. Does not allocate memory.
+   */
+  float score(const NGramContext& context, int word, NGramContext& outContext)
+      const;
+
+ private:
+  // Quantized (8 or 16 bits) or raw (32 bits) values
+  struct Values {
+    const float* codebook;
+    const uint8_t* codes;
+    int bits;
+
+    float operator[](uint64_t i) const {
+      if (bits == 8) {
+        return codebook[codes[i]];
+      } else if (bits == 16) {
+        return codebook[reinterpret_cast<const uint16_t*>(codes)[i]];
+      }
+      return reinterpret_cast<const float*>(codes)[i];
+    }
+  };
+
+  // N-grams of one order. The n-gram i of order n is the first word words[i]
+  // (only for n > 1) followed by its suffix, whose extensions of order n + 1
+  // are [childBegin[i], childBegin[i + 1]) (only for n < order). Unigrams are
+  // indexed by word.
+  struct Order {
+    uint64_t count;
+    const uint32_t* words;
+    const uint32_t* childBegin;
+    Values probs;
+    Values backoffs;
+  };
+
+  NGramModel() = default;
+
+  // Sizes of the sections of the data following the header, in file order
+  std::vector<size_t> sectionSizes() const;
+
+  void setPointers(const char* data);
+
+  // Check that the offsets and word indices of a loaded model are in range
+  void validate(const std::string& path) const;
+
+  // Compare the word with a given index to `word` (as std::string::compare)
+  int compareWord(int index, const std::string& word) const;
+
+  int order_;
+  int vocabSize_;
+  uint64_t vocabBytes_;
+  int probBits_;
+  int backoffBits_;
+  int unk_;
+  int bos_;
+  int eos_;
+  std::vector<Order> orders_;
+
+  // Owned storage (for a model read from ARPA)
+  std::vector<char> buffer_;
+  // Mapped storage (for a loaded model)
+  std::unique_ptr<MemoryMappedFile> file_;
+
+  // Views on either owned or mapped storage. Word i is the range
+  // [vocabOffsets_[i], vocabOffsets_[i + 1]) of vocabChars_, and vocabSorted_
+  // holds the word indices sorted by word.
+  const uint32_t* vocabOffsets_;
+  const char* vocabChars_;
+  const uint32_t* vocabSorted_;
+};
+
+using NGramModelPtr = std::shared_ptr<const NGramModel>;
+
+/* NGramLMState is the context of a NGramLM query, stored inline */
+struct NGramLMState : LMState {
+  NGramContext context;
+};
+
+/**
+ * NGramLM extends LM with a NGramModel, which does not depend on any external
+ * toolkit. Queries use integer states stored inline in the (pooled) LM states
+ * and do not allocate memory. A model can be shared by several NGramLM, each
+ * mapping its own token dictionary to the vocabulary of the model.
+ */
+class NGramLM : public LM {
+ public:
+  NGramLM(NGramModelPtr model, const Dictionary& usrTknDict);
+
+  LMStatePtr start(bool startWithNothing) override;
+
+  LMStatePtr start(bool startWithNothing, const LMStatePoolPtr& pool)
+      override;
+
+  std::pair<LMStatePtr, float> score(
+      const LMStatePtr& state,
+      const int usrTokenIdx) override;
+
+  void scoreBatch(
+      const LMStatePtr* states,
+      const int* usrTokenIdx,
+      int n,
+      LMStatePtr* outStates,
+      float* scores) override;
+
+  std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
+
+  const NGramModelPtr& getModel() const {
+    return model_;
+  }
+
+ private:
+  NGramModelPtr model_;
+};
+
+using NGramLMPtr = std::shared_ptr<NGramLM>;
+} // namespace text
+} // namespace lib
+} // namespace fl
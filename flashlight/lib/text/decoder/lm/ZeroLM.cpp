@@ -9,18 +9,42 @@
 
 #include <stdexcept>
 
+#include "flashlight/lib/text/decoder/lm/LMStatePool.h"
+
 namespace fl {
 namespace lib {
 namespace text {
 
-LMStatePtr ZeroLM::start(bool /* unused */) {
-  return std::make_shared<LMState>();
+LMStatePtr ZeroLM::start(bool startWithNothing) {
+  return start(startWithNothing, std::make_shared<LMStatePool>());
+}
+
+LMStatePtr ZeroLM::start(bool /* unused */, const LMStatePoolPtr& pool) {
+  return pool->make<LMState>();
 }
 
 std::pair<LMStatePtr, float> ZeroLM::score(
     const LMStatePtr& state /* unused */,
     const int usrTokenIdx) {
-  return std::make_pair(state->child<LMState>(usrTokenIdx), 0.0);
+  auto outState = state->pool
+      ? state->pool->child<LMState>(state.get(), usrTokenIdx)
+      : state->child<LMState>(usrTokenIdx);
+  return std::make_pair(std::move(outState), 0.0);
+}
+
+void ZeroLM::scoreBatch(
+    const LMStatePtr* states,
+    const int* usrTokenIdx,
+    int n,
+    LMStatePtr* outStates,
+    float* scores) {
+  for (int i = 0; i < n; i++) {
+    LMState* state = states[i].get();
+    outStates[i] = state->pool
+        ? state->pool->child<LMState>(state, usrTokenIdx[i])
+        : state->child<LMState>(usrTokenIdx[i]);
+    scores[i] = 0;
+  }
 }
 
 std::pair<LMStatePtr, float> ZeroLM::finish(const LMStatePtr& state) {
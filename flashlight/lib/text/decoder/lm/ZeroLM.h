@@ -21,10 +21,20 @@ class ZeroLM : public LM {
  public:
   LMStatePtr start(bool startWithNothing) override;
 
+  LMStatePtr start(bool startWithNothing, const LMStatePoolPtr& pool)
+      override;
+
   std::pair<LMStatePtr, float> score(
       const LMStatePtr& state,
       const int usrTokenIdx) override;
 
+  void scoreBatch(
+      const LMStatePtr* states,
+      const int* usrTokenIdx,
+      int n,
+      LMStatePtr* outStates,
+      float* scores) override;
+
   std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
 };
 } // namespace text
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kBinaryLexiconMagic[8] =
+    {'F', 'L', 'L', 'E', 'X', 'I', 'C', 'N'};
+constexpr int kBinaryLexiconVersion = 1;
+
+struct BinaryLexiconHeader {
+  char magic[8];
+  int32_t version;
+  int32_t reserved;
+  uint64_t nSpellings;
+  uint64_t nSpellingTokens;
+};
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void writePadded(std::ostream& out, const void* data, size_t size) {
+  static const char kZeros[8] = {};
+  out.write(static_cast<const char*>(data), size);
+  out.write(kZeros, padded(size) - size);
+}
+
+} // namespace
+
+void BinaryLexicon::save(const LexiconMap& lexicon, const std::string& path) {
+  std::vector<std::string> words;
+  std::vector<std::string> tokens;
+  std::unordered_map<std::string, uint32_t> tokenIndices;
+  std::vector<uint64_t> spellingBegin{0};
+  std::vector<uint64_t> tokenBegin{0};
+  std::vector<uint32_t> spellingTokens;
+  for (const auto& it : lexicon) {
+    words.push_back(it.first);
+    for (const auto& spelling : it.second) {
+      for (const auto& token : spelling) {
+        auto tokenIndex = tokenIndices.emplace(token, tokens.size());
+        if (tokenIndex.second) {
+          tokens.push_back(token);
+        }
+        spellingTokens.push_back(tokenIndex.first->second);
+      }
+      tokenBegin.push_back(spellingTokens.size());
+    }
+    spellingBegin.push_back(tokenBegin.size() - 1);
+  }
+
+  BinaryLexiconHeader header;
+  std::memcpy(header.magic, kBinaryLexiconMagic, sizeof(kBinaryLexiconMagic));
+  header.version = kBinaryLexiconVersion;
+  header.reserved = 0;
+  header.nSpellings = tokenBegin.size() - 1;
+  header.nSpellingTokens = spellingTokens.size();
+
+  auto out = createOutputStream(path, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  StringTable(words).write(out);
+  StringTable(tokens).write(out);
+  writePadded(
+      out, spellingBegin.data(), spellingBegin.size() * sizeof(uint64_t));
+  writePadded(out, tokenBegin.data(), tokenBegin.size() * sizeof(uint64_t));
+  writePadded(
+      out, spellingTokens.data(), spellingTokens.size() * sizeof(uint32_t));
+  if (!out.good()) {
+    throw std::runtime_error(
+        "[BinaryLexicon] Failed to write lexicon to: " + path);
+  }
+}
+
+std::shared_ptr<BinaryLexicon> BinaryLexicon::load(const std::string& path) {
+  std::shared_ptr<BinaryLexicon> lexicon(new BinaryLexicon());
+  auto file = std::make_shared<MemoryMappedFile>(path);
+  const char* data = file->data();
+  size_t size = file->size();
+
+  BinaryLexiconHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("[BinaryLexicon] Invalid lexicon file: " + path);
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(
+          header.magic, kBinaryLexiconMagic, sizeof(kBinaryLexiconMagic)) !=
+          0 ||
+      header.version != kBinaryLexiconVersion) {
+    throw std::runtime_error(
+        "[BinaryLexicon] Invalid lexicon file (wrong magic or version): " +
+        path);
+  }
+  size_t offset = sizeof(header);
+  lexicon->words_ = std::make_shared<StringTable>(file, offset);
+  lexicon->tokens_ = std::make_shared<StringTable>(file, offset);
+  size_t left = size - offset;
+  size_t nWords = lexicon->words_->size();
+  if (header.nSpellings >= left / sizeof(uint64_t) ||
+      header.nSpellingTokens > left / sizeof(uint32_t) ||
+      left !=
+          padded((nWords + 1) * sizeof(uint64_t)) +
+              padded((header.nSpellings + 1) * sizeof(uint64_t)) +
+              padded(header.nSpellingTokens * sizeof(uint32_t))) {
+    throw std::runtime_error("[BinaryLexicon] Truncated lexicon file: " + path);
+  }
+
+  const char* ptr = data + offset;
+  lexicon->spellingBegin_ = reinterpret_cast<const uint64_t*>(ptr);
+  ptr += padded((nWords + 1) * sizeof(uint64_t));
+  lexicon->tokenBegin_ = reinterpret_cast<const uint64_t*>(ptr);
+  ptr += padded((header.nSpellings + 1) * sizeof(uint64_t));
+  lexicon->spellingTokens_ = reinterpret_cast<const uint32_t*>(ptr);
+
+  // The spellings of the words and the tokens of the spellings are
+  // consecutive ranges covering their arrays
+  auto checkRanges = [&path](const uint64_t* begin, size_t n, uint64_t end) {
+    if (begin[0] != 0 || begin[n] != end) {
+      throw std::runtime_error(
+          "[BinaryLexicon] Invalid lexicon file: " + path);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if (begin[i] > begin[i + 1]) {
+        throw std::runtime_error(
+            "[BinaryLexicon] Invalid lexicon file: " + path);
+      }
+    }
+  };
+  checkRanges(lexicon->spellingBegin_, nWords, header.nSpellings);
+  checkRanges(lexicon->tokenBegin_, header.nSpellings, header.nSpellingTokens);
+  size_t nTokens = lexicon->tokens_->size();
+  for (uint64_t i = 0; i < header.nSpellingTokens; ++i) {
+    if (lexicon->spellingTokens_[i] >= nTokens) {
+      throw std::runtime_error(
+          "[BinaryLexicon] Invalid token index in lexicon file: " + path);
+    }
+  }
+  lexicon->file_ = std::move(file);
+  return lexicon;
+}
+
+bool BinaryLexicon::isBinaryFile(const std::string& path) {
+  std::ifstream stream(path, std::ios::in | std::ios::binary);
+  char magic[sizeof(kBinaryLexiconMagic)];
+  if (!stream.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, kBinaryLexiconMagic, sizeof(magic)) == 0;
+}
+
+std::vector<std::string> BinaryLexicon::getSpelling(int word, int spelling)
+    const {
+  const uint32_t* spellingTokens = getSpellingTokens(word, spelling);
+  std::vector<std::string> tokens;
+  tokens.reserve(spellingSize(word, spelling));
+  for (size_t i = 0; i < spellingSize(word, spelling); ++i) {
+    tokens.push_back(tokens_->get(spellingTokens[i]));
+  }
+  return tokens;
+}
+
+LexiconMap BinaryLexicon::toLexiconMap(int maxWords) const {
+  LexiconMap lexicon;
+  for (int i = 0; i < size() && maxWords != lexicon.size(); ++i) {
+    auto& spellings = lexicon[words_->get(i)];
+    for (int j = 0; j < nSpellings(i); ++j) {
+      spellings.push_back(getSpelling(i, j));
+    }
+  }
+  lexicon[kUnkToken] = {};
+  return lexicon;
+}
+
+Dictionary createWordDict(const BinaryLexicon& lexicon) {
+  Dictionary dict(lexicon.getWords());
+  // As `loadWords()`, which adds the unknown word to the lexicon
+  if (!dict.contains(kUnkToken)) {
+    dict.addEntry(kUnkToken);
+  }
+  dict.setDefaultIndex(dict.getIndex(kUnkToken));
+  return dict;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
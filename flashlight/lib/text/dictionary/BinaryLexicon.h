@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/StringTable.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * BinaryLexicon is a read-only lexicon (the mapping of words to their
+ * spellings, see `loadWords()`) stored in a binary file which is memory
+ * mapped. Words and tokens are kept in string tables, and the spellings are
+ * contiguous arrays of token indices, so opening a lexicon does not parse
+ * or copy it and decoder processes share its pages.
+ *
+ * Words keep the order of the lexicon they were saved from, so that
+ * `createWordDict()` gives them the same indices.
+ */
+class BinaryLexicon {
+ public:
+  /* Serialize `lexicon` into a binary file which can be used with `load()` */
+  static void save(const LexiconMap& lexicon, const std::string& path);
+
+  /* Memory map a lexicon previously written with `save()`. Throws if the
+   * file is invalid. */
+  static std::shared_ptr<BinaryLexicon> load(const std::string& path);
+
+  /* Check if a file is a binary lexicon */
+  static bool isBinaryFile(const std::string& path);
+
+  /* Number of words */
+  size_t size() const {
+    return words_->size();
+  }
+
+  const std::shared_ptr<const StringTable>& getWords() const {
+    return words_;
+  }
+
+  /* Table of the tokens of the spellings */
+  const std::shared_ptr<const StringTable>& getTokens() const {
+    return tokens_;
+  }
+
+  /* Index of a word, or -1 if it is not in the lexicon */
+  int find(const std::string& word) const {
+    return words_->find(word);
+  }
+
+  int nSpellings(int word) const {
+    return spellingBegin_[word + 1] - spellingBegin_[word];
+  }
+
+  /**
+   * Token indices (in `getTokens()`) of the spelling `spelling` of the word
+   * `word`, of size `spellingSize(word, spelling)`
+   */
+  const uint32_t* getSpellingTokens(int word, int spelling) const {
+    return spellingTokens_ + tokenBegin_[spellingBegin_[word] + spelling];
+  }
+
+  size_t spellingSize(int word, int spelling) const {
+    uint64_t i = spellingBegin_[word] + spelling;
+    return tokenBegin_[i + 1] - tokenBegin_[i];
+  }
+
+  /* Copy of the spelling `spelling` of the word `word` */
+  std::vector<std::string> getSpelling(int word, int spelling) const;
+
+  /**
+   * Copy of the lexicon into a LexiconMap, for the consumers needing one,
+   * keeping at most `maxWords` words (all of them if negative) as
+   * `loadWords()`.
+   */
+  LexiconMap toLexiconMap(int maxWords = -1) const;
+
+ private:
+  BinaryLexicon() = default;
+
+  std::shared_ptr<const MemoryMappedFile> file_;
+  std::shared_ptr<const StringTable> words_;
+  std::shared_ptr<const StringTable> tokens_;
+  // The spellings of word i are [spellingBegin_[i], spellingBegin_[i + 1]),
+  // and the tokens of spelling j are [tokenBegin_[j], tokenBegin_[j + 1]) in
+  // spellingTokens_.
+  const uint64_t* spellingBegin_;
+  const uint64_t* tokenBegin_;
+  const uint32_t* spellingTokens_;
+};
+
+using BinaryLexiconPtr = std::shared_ptr<BinaryLexicon>;
+
+/**
+ * Dictionary of the words of a binary lexicon, with the unknown word as
+ * default index, viewing the words of the lexicon without copying them. The
+ * unknown word is added after the words if the lexicon does not have it.
+ */
+Dictionary createWordDict(const BinaryLexicon& lexicon);
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -5,8 +5,11 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <utility>
 
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
@@ -17,13 +20,183 @@ namespace fl {
 namespace lib {
 namespace text {
 
+namespace {
+
+constexpr char kDictionaryMagic[8] = {'F', 'L', 'D', 'I', 'C', 'T', '\0', '\0'};
+constexpr int kDictionaryVersion = 1;
+
+struct DictionaryHeader {
+  char magic[8];
+  int32_t version;
+  int32_t nIndices;
+};
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void writePadded(std::ostream& out, const void* data, size_t size) {
+  static const char kZeros[8] = {};
+  out.write(static_cast<const char*>(data), size);
+  out.write(kZeros, padded(size) - size);
+}
+
+} // namespace
+
+/**
+ * The binary format is a header, the table of the entries, the index of each
+ * entry and the entry returned by `getEntry()` for each index.
+ */
+struct Dictionary::BinaryStorage {
+  std::shared_ptr<const StringTable> entries;
+  std::shared_ptr<const MemoryMappedFile> file;
+  // nullptr if entry i has index i
+  const int32_t* indices = nullptr;
+  const int32_t* firstEntries = nullptr;
+  size_t nIndices = 0;
+
+  int index(int entry) const {
+    return indices ? indices[entry] : entry;
+  }
+
+  int firstEntry(int idx) const {
+    return firstEntries ? firstEntries[idx] : idx;
+  }
+};
+
 Dictionary::Dictionary(std::istream& stream) {
   createFromStream(stream);
 }
 
 Dictionary::Dictionary(const std::string& filename) {
-  std::ifstream stream = createInputStream(filename);
-  createFromStream(stream);
+  if (!isBinaryFile(filename)) {
+    std::ifstream stream = createInputStream(filename);
+    createFromStream(stream);
+    return;
+  }
+
+  auto storage = std::make_shared<BinaryStorage>();
+  storage->file = std::make_shared<MemoryMappedFile>(filename);
+  const char* data = storage->file->data();
+  size_t size = storage->file->size();
+  DictionaryHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("Truncated binary dictionary: " + filename);
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.version != kDictionaryVersion) {
+    throw std::runtime_error(
+        "Invalid binary dictionary (wrong version): " + filename);
+  }
+  size_t offset = sizeof(header);
+  storage->entries = std::make_shared<StringTable>(storage->file, offset);
+  size_t nEntries = storage->entries->size();
+  storage->nIndices = header.nIndices;
+  if (header.nIndices < 0 || storage->nIndices > nEntries ||
+      size != offset + padded(nEntries * sizeof(int32_t)) +
+              padded(storage->nIndices * sizeof(int32_t))) {
+    throw std::runtime_error("Truncated binary dictionary: " + filename);
+  }
+  storage->indices = reinterpret_cast<const int32_t*>(data + offset);
+  storage->firstEntries = reinterpret_cast<const int32_t*>(
+      data + offset + padded(nEntries * sizeof(int32_t)));
+  for (size_t i = 0; i < nEntries; ++i) {
+    if (storage->indices[i] < 0 || storage->indices[i] >= header.nIndices) {
+      throw std::runtime_error("Invalid binary dictionary: " + filename);
+    }
+  }
+  for (size_t idx = 0; idx < storage->nIndices; ++idx) {
+    if (storage->firstEntries[idx] < 0 ||
+        storage->firstEntries[idx] >= nEntries ||
+        storage->indices[storage->firstEntries[idx]] != idx) {
+      throw std::runtime_error("Invalid binary dictionary: " + filename);
+    }
+  }
+  binary_ = std::move(storage);
+}
+
+Dictionary::Dictionary(std::shared_ptr<const StringTable> entries) {
+  auto storage = std::make_shared<BinaryStorage>();
+  storage->nIndices = entries->size();
+  storage->entries = std::move(entries);
+  binary_ = std::move(storage);
+}
+
+bool Dictionary::isBinaryFile(const std::string& filename) {
+  std::ifstream stream(filename, std::ios::in | std::ios::binary);
+  DictionaryHeader header;
+  if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  return std::memcmp(
+             header.magic, kDictionaryMagic, sizeof(kDictionaryMagic)) == 0;
+}
+
+void Dictionary::saveBinary(const std::string& filename) const {
+  std::shared_ptr<const StringTable> entries;
+  std::vector<int32_t> indices;
+  std::vector<int32_t> firstEntries;
+  if (binary_) {
+    entries = binary_->entries;
+    for (int i = 0; i < entries->size(); ++i) {
+      indices.push_back(binary_->index(i));
+    }
+    for (int idx = 0; idx < binary_->nIndices; ++idx) {
+      firstEntries.push_back(binary_->firstEntry(idx));
+    }
+  } else {
+    if (!isContiguous()) {
+      throw std::runtime_error(
+          "Cannot save a dictionary whose indices are not contiguous");
+    }
+    // The entry of each index, then the other entries sorted
+    std::vector<std::string> strings;
+    for (int idx = 0; idx < indexSize(); ++idx) {
+      strings.push_back(idx2entry_.at(idx));
+      indices.push_back(idx);
+      firstEntries.push_back(idx);
+    }
+    std::vector<std::pair<std::string, int>> others;
+    for (const auto& tknidx : entry2idx_) {
+      if (idx2entry_.at(tknidx.second) != tknidx.first) {
+        others.push_back(tknidx);
+      }
+    }
+    std::sort(others.begin(), others.end());
+    for (const auto& tknidx : others) {
+      strings.push_back(tknidx.first);
+      indices.push_back(tknidx.second);
+    }
+    entries = std::make_shared<StringTable>(strings);
+  }
+
+  DictionaryHeader header;
+  std::memcpy(header.magic, kDictionaryMagic, sizeof(kDictionaryMagic));
+  header.version = kDictionaryVersion;
+  header.nIndices = firstEntries.size();
+
+  auto out = createOutputStream(filename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  entries->write(out);
+  writePadded(out, indices.data(), indices.size() * sizeof(int32_t));
+  writePadded(
+      out, firstEntries.data(), firstEntries.size() * sizeof(int32_t));
+  if (!out.good()) {
+    throw std::runtime_error("Failed to write dictionary to: " + filename);
+  }
+}
+
+void Dictionary::detachBinary() {
+  if (!binary_) {
+    return;
+  }
+  auto binary = std::move(binary_);
+  for (int i = 0; i < binary->entries->size(); ++i) {
+    entry2idx_[binary->entries->get(i)] = binary->index(i);
+  }
+  for (int idx = 0; idx < binary->nIndices; ++idx) {
+    idx2entry_[idx] = binary->entries->get(binary->firstEntry(idx));
+  }
 }
 
 void Dictionary::createFromStream(std::istream& stream) {
@@ -48,6 +221,7 @@ void Dictionary::createFromStream(std::istream& stream) {
 }
 
 void Dictionary::addEntry(const std::string& entry, int idx) {
+  detachBinary();
   if (entry2idx_.find(entry) != entry2idx_.end()) {
     throw std::invalid_argument(
         "Duplicate entry name in dictionary '" + entry + "'");
@@ -59,6 +233,7 @@ void Dictionary::addEntry(const std::string& entry, int idx) {
 }
 
 void Dictionary::addEntry(const std::string& entry) {
+  detachBinary();
   // Check if the entry already exists in the dictionary
   if (entry2idx_.find(entry) != entry2idx_.end()) {
     throw std::invalid_argument(
@@ -73,6 +248,13 @@ void Dictionary::addEntry(const std::string& entry) {
 }
 
 std::string Dictionary::getEntry(int idx) const {
+  if (binary_) {
+    if (idx < 0 || idx >= binary_->nIndices) {
+      throw std::invalid_argument(
+          "Unknown index in dictionary '" + std::to_string(idx) + "'");
+    }
+    return binary_->entries->get(binary_->firstEntry(idx));
+  }
   auto iter = idx2entry_.find(idx);
   if (iter == idx2entry_.end()) {
     throw std::invalid_argument(
@@ -86,19 +268,42 @@ void Dictionary::setDefaultIndex(int idx) {
 }
 
 int Dictionary::getIndex(const std::string& entry) const {
-  auto iter = entry2idx_.find(entry);
-  if (iter == entry2idx_.end()) {
-    if (defaultIndex_ < 0) {
-      throw std::invalid_argument(
-          "Unknown entry in dictionary: '" + entry + "'");
-    } else {
-      return defaultIndex_;
+  if (binary_) {
+    int i = binary_->entries->find(entry);
+    if (i >= 0) {
+      return binary_->index(i);
+    }
+  } else {
+    auto iter = entry2idx_.find(entry);
+    if (iter != entry2idx_.end()) {
+      return iter->second;
     }
   }
-  return iter->second;
+  if (defaultIndex_ < 0) {
+    throw std::invalid_argument("Unknown entry in dictionary: '" + entry + "'");
+  }
+  return defaultIndex_;
+}
+
+int Dictionary::getIndex(const char* entry, size_t length) const {
+  if (!binary_) {
+    return getIndex(std::string(entry, length));
+  }
+  int i = binary_->entries->find(entry, length);
+  if (i >= 0) {
+    return binary_->index(i);
+  }
+  if (defaultIndex_ < 0) {
+    throw std::invalid_argument(
+        "Unknown entry in dictionary: '" + std::string(entry, length) + "'");
+  }
+  return defaultIndex_;
 }
 
 bool Dictionary::contains(const std::string& entry) const {
+  if (binary_) {
+    return binary_->entries->find(entry) >= 0;
+  }
   auto iter = entry2idx_.find(entry);
   if (iter == entry2idx_.end()) {
     return false;
@@ -107,10 +312,16 @@ bool Dictionary::contains(const std::string& entry) const {
 }
 
 size_t Dictionary::entrySize() const {
+  if (binary_) {
+    return binary_->entries->size();
+  }
   return entry2idx_.size();
 }
 
 bool Dictionary::isContiguous() const {
+  if (binary_) {
+    return true; // Enforced by the binary format
+  }
   for (size_t i = 0; i < indexSize(); ++i) {
     if (idx2entry_.find(i) == idx2entry_.end()) {
       return false;
@@ -145,6 +356,9 @@ std::vector<std::string> Dictionary::mapIndicesToEntries(
 }
 
 size_t Dictionary::indexSize() const {
+  if (binary_) {
+    return binary_->nIndices;
+  }
   return idx2entry_.size();
 }
 } // namespace text
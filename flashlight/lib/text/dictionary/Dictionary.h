@@ -8,15 +8,23 @@
 #pragma once
 
 #include <istream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "flashlight/lib/text/dictionary/StringTable.h"
+
 namespace fl {
 namespace lib {
 namespace text {
 // A simple dictionary class which holds a bidirectional map
 // entry (strings) <--> integer indices. Not thread-safe !
+//
+// A dictionary can also be saved into a binary file with `saveBinary()`,
+// which the filename constructor memory maps instead of parsing it. Binary
+// dictionaries are looked up in place and shared by their copies; they are
+// only copied into maps if entries are added.
 class Dictionary {
  public:
   // Creates an empty dictionary
@@ -24,8 +32,19 @@ class Dictionary {
 
   explicit Dictionary(std::istream& stream);
 
+  // Reads a text dictionary, or memory maps a binary one
   explicit Dictionary(const std::string& filename);
 
+  // Creates a dictionary whose entry i has index i, viewing `entries` without
+  // copying them (e.g. the words of a memory mapped BinaryLexicon)
+  explicit Dictionary(std::shared_ptr<const StringTable> entries);
+
+  // Writes the dictionary, whose indices must be contiguous, in binary format
+  void saveBinary(const std::string& filename) const;
+
+  // Checks if a file is a binary dictionary
+  static bool isBinaryFile(const std::string& filename);
+
   size_t entrySize() const;
 
   size_t indexSize() const;
@@ -40,6 +59,10 @@ class Dictionary {
 
   int getIndex(const std::string& entry) const;
 
+  // Same for the `length` characters at `entry` (e.g. a token in a mapped
+  // file), which binary dictionaries look up without copying them
+  int getIndex(const char* entry, size_t length) const;
+
   bool contains(const std::string& entry) const;
 
   // checks if all the indices are contiguous
@@ -52,12 +75,20 @@ class Dictionary {
       const std::vector<int>& indices) const;
 
  private:
+  // Storage of a binary dictionary
+  struct BinaryStorage;
+
   // Creates a dictionary from an input stream
   void createFromStream(std::istream& stream);
 
+  // Copies the binary storage into the maps, before they are modified
+  void detachBinary();
+
   std::unordered_map<std::string, int> entry2idx_;
   std::unordered_map<int, std::string> idx2entry_;
   int defaultIndex_ = -1;
+  // Replaces the maps if set
+  std::shared_ptr<const BinaryStorage> binary_;
 };
 
 typedef std::unordered_map<int, Dictionary> DictionaryMap;
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/dictionary/StringTable.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+struct StringTableHeader {
+  uint64_t nStrings;
+  uint64_t nSlots;
+  uint64_t nChars;
+};
+
+size_t padded(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// FNV-1a, which does not depend on the platform
+uint64_t hashString(const char* data, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+void writePadded(std::ostream& out, const void* data, size_t size) {
+  static const char kZeros[8] = {};
+  out.write(static_cast<const char*>(data), size);
+  out.write(kZeros, padded(size) - size);
+}
+
+} // namespace
+
+StringTable::StringTable(const std::vector<std::string>& strings)
+    : nStrings_(strings.size()), nSlots_(1) {
+  if (nStrings_ >= std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("[StringTable] Too many strings");
+  }
+  while (nSlots_ < 2 * nStrings_) {
+    nSlots_ *= 2;
+  }
+  offsetBuf_.reserve(nStrings_ + 1);
+  offsetBuf_.push_back(0);
+  for (const auto& str : strings) {
+    charBuf_ += str;
+    offsetBuf_.push_back(charBuf_.size());
+  }
+  nChars_ = charBuf_.size();
+  offsets_ = offsetBuf_.data();
+  chars_ = charBuf_.data();
+
+  slotBuf_.assign(nSlots_, 0);
+  slots_ = slotBuf_.data();
+  for (uint32_t i = 0; i < nStrings_; ++i) {
+    uint64_t mask = nSlots_ - 1;
+    for (uint64_t slot = hashString(data(i), length(i)) & mask;;
+         slot = (slot + 1) & mask) {
+      uint32_t other = slotBuf_[slot];
+      if (other == 0) {
+        slotBuf_[slot] = i + 1;
+        break;
+      }
+      if (length(other - 1) == length(i) &&
+          std::memcmp(data(other - 1), data(i), length(i)) == 0) {
+        throw std::invalid_argument(
+            "[StringTable] Duplicate string '" + strings[i] + "'");
+      }
+    }
+  }
+}
+
+StringTable::StringTable(
+    std::shared_ptr<const MemoryMappedFile> file,
+    size_t& offset)
+    : file_(std::move(file)) {
+  const char* data = file_->data();
+  size_t size = file_->size();
+  StringTableHeader header;
+  if (offset % 8 != 0 || offset + sizeof(header) > size) {
+    throw std::runtime_error(
+        "[StringTable] Truncated string table in: " + file_->path());
+  }
+  std::memcpy(&header, data + offset, sizeof(header));
+  nStrings_ = header.nStrings;
+  nSlots_ = header.nSlots;
+  nChars_ = header.nChars;
+  // Sizes are checked one by one so that they cannot overflow
+  size_t left = size - offset - sizeof(header);
+  if (nStrings_ >= left / sizeof(uint64_t) || nSlots_ < 2 * nStrings_ ||
+      nSlots_ == 0 || (nSlots_ & (nSlots_ - 1)) != 0 ||
+      nSlots_ > left / sizeof(uint32_t) || nChars_ > left) {
+    throw std::runtime_error(
+        "[StringTable] Invalid string table in: " + file_->path());
+  }
+  size_t tableSize = sizeof(header) + (nStrings_ + 1) * sizeof(uint64_t) +
+      padded(nChars_) + padded(nSlots_ * sizeof(uint32_t));
+  if (offset + tableSize > size) {
+    throw std::runtime_error(
+        "[StringTable] Truncated string table in: " + file_->path());
+  }
+
+  const char* ptr = data + offset + sizeof(header);
+  offsets_ = reinterpret_cast<const uint64_t*>(ptr);
+  ptr += (nStrings_ + 1) * sizeof(uint64_t);
+  chars_ = ptr;
+  ptr += padded(nChars_);
+  slots_ = reinterpret_cast<const uint32_t*>(ptr);
+  if (offsets_[0] != 0 || offsets_[nStrings_] != nChars_) {
+    throw std::runtime_error(
+        "[StringTable] Invalid string table in: " + file_->path());
+  }
+  offset += tableSize;
+}
+
+void StringTable::write(std::ostream& out) const {
+  StringTableHeader header{nStrings_, nSlots_, nChars_};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(
+      reinterpret_cast<const char*>(offsets_),
+      (nStrings_ + 1) * sizeof(uint64_t));
+  writePadded(out, chars_, nChars_);
+  writePadded(out, slots_, nSlots_ * sizeof(uint32_t));
+}
+
+std::string StringTable::get(int i) const {
+  if (i < 0 || i >= nStrings_) {
+    throw std::out_of_range(
+        "[StringTable] Invalid string index: " + std::to_string(i));
+  }
+  return std::string(data(i), length(i));
+}
+
+int StringTable::find(const char* str, size_t size) const {
+  uint64_t mask = nSlots_ - 1;
+  for (uint64_t slot = hashString(str, size) & mask;;
+       slot = (slot + 1) & mask) {
+    uint32_t i = slots_[slot];
+    if (i == 0) {
+      return -1;
+    }
+    if (length(i - 1) == size && std::memcmp(data(i - 1), str, size) == 0) {
+      return i - 1;
+    }
+  }
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/MemoryMappedFile.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * StringTable is an immutable table of distinct strings, stored contiguously
+ * and indexed by an open-addressing hash table, so that a string is found
+ * without any allocation. It is the building block of the binary dictionary
+ * and lexicon formats: a table serialized with `write()` is used in place from
+ * a memory mapped file, without copying or parsing it.
+ */
+class StringTable {
+ public:
+  /* Build a table of distinct strings, string i having index i */
+  explicit StringTable(const std::vector<std::string>& strings);
+
+  /**
+   * View of a table written by `write()` at `offset` of a mapped file, which
+   * is kept alive by the table. `offset` is moved past the table.
+   */
+  StringTable(std::shared_ptr<const MemoryMappedFile> file, size_t& offset);
+
+  StringTable(const StringTable&) = delete;
+  StringTable& operator=(const StringTable&) = delete;
+
+  /* Serialize the table; its size is a multiple of 8 bytes */
+  void write(std::ostream& out) const;
+
+  size_t size() const {
+    return nStrings_;
+  }
+
+  /* Pointer to the (not null-terminated) characters of string i */
+  const char* data(int i) const {
+    return chars_ + offsets_[i];
+  }
+
+  size_t length(int i) const {
+    return offsets_[i + 1] - offsets_[i];
+  }
+
+  /* Copy of string i */
+  std::string get(int i) const;
+
+  /* Index of a string, or -1 if it is not in the table */
+  int find(const std::string& str) const {
+    return find(str.data(), str.size());
+  }
+
+  /* Same for the `size` characters at `str`, e.g. in a mapped file */
+  int find(const char* str, size_t size) const;
+
+ private:
+  uint64_t nStrings_;
+  uint64_t nSlots_; // A power of 2
+  uint64_t nChars_;
+
+  // Owned storage (for a built table)
+  std::vector<uint64_t> offsetBuf_;
+  std::string charBuf_;
+  std::vector<uint32_t> slotBuf_;
+  // Mapped storage (for a table viewed from a file)
+  std::shared_ptr<const MemoryMappedFile> file_;
+
+  // Views on either owned or mapped storage. String i is the range
+  // [offsets_[i], offsets_[i + 1]) of chars_, and slots_ holds the string
+  // indices plus one (0 for empty slots).
+  const uint64_t* offsets_;
+  const char* chars_;
+  const uint32_t* slots_;
+};
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -8,6 +8,7 @@
 #include "flashlight/lib/text/dictionary/Utils.h"
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/BinaryLexicon.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
 
 namespace fl {
@@ -24,6 +25,9 @@ Dictionary createWordDict(const LexiconMap& lexicon) {
 }
 
 LexiconMap loadWords(const std::string& filename, int maxWords) {
+  if (BinaryLexicon::isBinaryFile(filename)) {
+    return BinaryLexicon::load(filename)->toLexiconMap(maxWords);
+  }
   LexiconMap lexicon;
 
   std::string line;
@@ -22,6 +22,11 @@ using LexiconMap =
 
 Dictionary createWordDict(const LexiconMap& lexicon);
 
+/**
+ * Load a lexicon, each line of which is a word followed by one of its
+ * spellings, keeping at most `maxWords` words (all of them if negative). A
+ * BinaryLexicon file is also accepted.
+ */
 LexiconMap loadWords(const std::string& filename, int maxWords = -1);
 
 // split word into tokens abc -> {"a", "b", "c"}
@@ -7,10 +7,29 @@
 
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 
+#include <cstring>
+
 namespace fl {
 namespace lib {
 namespace text {
 
+namespace {
+
+// Each part ends at the end of the line which contains the beginning of the
+// next one. `skipLine(offset)` is the offset following the line which
+// contains `offset` (or the size of the text for the last line).
+template <typename SkipLine>
+std::pair<size_t, size_t>
+partRange(size_t size, int rank, int totalReaders, SkipLine skipLine) {
+  const size_t chunkSize = size / totalReaders;
+  size_t begin = rank > 0 ? skipLine(chunkSize * rank) : 0;
+  size_t end =
+      rank < totalReaders - 1 ? skipLine(chunkSize * (rank + 1)) : size;
+  return {begin, end};
+}
+
+} // namespace
+
 PartialFileReader::PartialFileReader(int rank, int totalReaders)
     : rank_(rank), totalReaders_(totalReaders) {
   if (rank_ < 0 || rank_ > totalReaders_) {
@@ -26,21 +45,36 @@ void PartialFileReader::loadFile(const std::string& filename) {
   stream_.seekg(0, stream_.end);
   const size_t fileSize = stream_.tellg();
 
-  // Select the ending point
-  end_ = fileSize;
-  const size_t chunkSize = fileSize / totalReaders_;
-  std::string line;
-  if (rank_ < totalReaders_ - 1) {
-    stream_.seekg(chunkSize * (rank_ + 1), std::ios::beg);
-    std::getline(stream_, line);
-    end_ = stream_.tellg();
-  }
+  // Select the starting and ending points
+  auto range = partRange(
+      fileSize, rank_, totalReaders_, [this, fileSize](size_t offset) {
+        std::string line;
+        stream_.clear();
+        stream_.seekg(offset, std::ios::beg);
+        std::getline(stream_, line);
+        return stream_.good() ? static_cast<size_t>(stream_.tellg())
+                              : fileSize;
+      });
+  end_ = range.second;
 
   // Set stream_ to its starting point
-  stream_.seekg(chunkSize * rank_, std::ios::beg);
-  if (rank_ > 0) {
-    std::getline(stream_, line);
-  }
+  stream_.clear();
+  stream_.seekg(range.first, std::ios::beg);
+}
+
+std::pair<size_t, size_t> PartialFileReader::getPartRange(
+    const char* data,
+    size_t size,
+    int rank,
+    int totalReaders) {
+  return partRange(size, rank, totalReaders, [data, size](size_t offset) {
+    if (offset >= size) {
+      return size;
+    }
+    auto newline = static_cast<const char*>(
+        std::memchr(data + offset, '\n', size - offset));
+    return newline ? static_cast<size_t>(newline - data + 1) : size;
+  });
 }
 
 size_t PartialFileReader::getPosition() {
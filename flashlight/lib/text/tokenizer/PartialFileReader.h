@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include "flashlight/lib/common/String.h"
@@ -48,6 +49,14 @@ class PartialFileReader {
 
   void loadFile(const std::string& filename);
 
+  /**
+   * Byte range [first, second) of the `rank`th of `totalReaders` parts of a
+   * text held in memory (e.g. a memory mapped file), split as `loadFile()`
+   * splits files.
+   */
+  static std::pair<size_t, size_t>
+  getPartRange(const char* data, size_t size, int rank, int totalReaders);
+
   size_t getPosition();
   bool hasNextLine();
 
@@ -8,6 +8,7 @@
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
 
 #include <algorithm>
+#include <cstring>
 #include <future>
 
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
@@ -18,6 +19,72 @@ namespace text {
 
 using TokenCountMap = std::unordered_map<std::string, size_t>;
 
+namespace {
+
+// A token viewed in place in a mapped file
+struct TokenView {
+  const char* data;
+  size_t length;
+
+  bool operator==(const TokenView& other) const {
+    return length == other.length &&
+        std::memcmp(data, other.data, length) == 0;
+  }
+};
+
+struct TokenViewHash {
+  size_t operator()(const TokenView& token) const {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < token.length; ++i) {
+      hash ^= static_cast<unsigned char>(token.data[i]);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+};
+
+using TokenViewCountMap = std::unordered_map<TokenView, size_t, TokenViewHash>;
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Splits [begin, end) into lines, and the lines into whitespace-separated
+// tokens as `tokenize()`. Calls `onToken(data, length)` for each token and
+// `onLine(lineEnd)` after each line, with the position following it.
+template <typename OnToken, typename OnLine>
+void scanLines(
+    const char* begin,
+    const char* end,
+    OnToken&& onToken,
+    OnLine&& onLine) {
+  const char* ptr = begin;
+  while (ptr < end) {
+    auto lineEnd =
+        static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+    if (!lineEnd) {
+      lineEnd = end;
+    }
+    while (ptr < lineEnd) {
+      while (ptr < lineEnd && isSpace(*ptr)) {
+        ++ptr;
+      }
+      const char* token = ptr;
+      while (ptr < lineEnd && !isSpace(*ptr)) {
+        ++ptr;
+      }
+      if (ptr > token) {
+        onToken(token, ptr - token);
+      }
+    }
+    ptr = lineEnd < end ? lineEnd + 1 : end;
+    onLine(ptr);
+  }
+}
+
+} // namespace
+
 std::vector<std::string> Tokenizer::tokenize(
     const std::string& sentence) const {
   return splitOnWhitespace(sentence, true);
@@ -27,33 +94,34 @@ void Tokenizer::countTokens(
     const std::string& filename,
     int numWorkers,
     bool generateMetaData) {
-  std::vector<TokenCountMap> subTokenCountMaps(numWorkers);
+  MemoryMappedFile file(filename);
+  std::vector<TokenViewCountMap> subTokenCountMaps(numWorkers);
   std::vector<TextFileMetaData> subTextFileMetaDatas(numWorkers);
   std::vector<std::future<int>> futures(numWorkers);
 
-  auto countPartialFile = [this, numWorkers](
-                              const std::string& filename,
+  auto countPartialFile = [&file, numWorkers](
                               int rank,
-                              TokenCountMap& tokenCountMap,
+                              TokenViewCountMap& tokenCountMap,
                               TextFileMetaData& fileMetaData,
                               bool generateMetaData) -> int {
-    PartialFileReader reader(rank, numWorkers);
-    reader.loadFile(filename);
+    auto range = PartialFileReader::getPartRange(
+        file.data(), file.size(), rank, numWorkers);
     int nSentences = 0;
-    while (reader.hasNextLine()) {
-      auto tokens = tokenize(reader.getLine());
-      for (const auto& token : tokens) {
-        if (tokenCountMap.find(token) == tokenCountMap.end()) {
-          tokenCountMap[token] = 0;
-        }
-        tokenCountMap[token]++;
-      }
-      if (generateMetaData) {
-        fileMetaData.push_back({reader.getPosition(), tokens.size()});
-      }
-      nSentences++;
-    }
-
+    int nTokens = 0;
+    scanLines(
+        file.data() + range.first,
+        file.data() + range.second,
+        [&](const char* token, size_t length) {
+          tokenCountMap[TokenView{token, length}]++;
+          nTokens++;
+        },
+        [&](const char* lineEnd) {
+          if (generateMetaData) {
+            fileMetaData.emplace_back(lineEnd - file.data(), nTokens);
+          }
+          nTokens = 0;
+          nSentences++;
+        });
     return nSentences;
   };
 
@@ -62,7 +130,6 @@ void Tokenizer::countTokens(
     futures[i] = std::async(
         std::launch::async,
         countPartialFile,
-        filename,
         i,
         std::ref(subTokenCountMaps[i]),
         std::ref(subTextFileMetaDatas[i]),
@@ -76,10 +143,8 @@ void Tokenizer::countTokens(
     totalSentences_ += futures[i].get();
     // Token counter
     for (const auto& item : subTokenCountMaps[i]) {
-      if (tokenCountMap.find(item.first) == tokenCountMap.end()) {
-        tokenCountMap[item.first] = 0;
-      }
-      tokenCountMap[item.first] += item.second;
+      tokenCountMap[std::string(item.first.data, item.first.length)] +=
+          item.second;
       totalTokens_ += item.second;
     }
     // File MetaDatas
@@ -125,6 +190,51 @@ void Tokenizer::pruneTokens(int maxTokens, int minAppearence) {
   tokenCountPairs_.resize(std::distance(tokenCountPairs_.begin(), end));
 }
 
+TokenizedText Tokenizer::indexTokens(
+    const MemoryMappedFile& file,
+    const Dictionary& dictionary,
+    int rank,
+    int totalParts) const {
+  auto range = PartialFileReader::getPartRange(
+      file.data(), file.size(), rank, totalParts);
+  TokenizedText text;
+  scanLines(
+      file.data() + range.first,
+      file.data() + range.second,
+      [&](const char* token, size_t length) {
+        text.tokens.push_back(dictionary.getIndex(token, length));
+      },
+      [&](const char* /* lineEnd */) {
+        text.sentenceOffsets.push_back(text.tokens.size());
+      });
+  return text;
+}
+
+TokenizedText Tokenizer::indexTokens(
+    const std::string& filename,
+    const Dictionary& dictionary,
+    int numWorkers) const {
+  MemoryMappedFile file(filename);
+  std::vector<std::future<TokenizedText>> futures(numWorkers);
+  for (int i = 0; i < numWorkers; ++i) {
+    futures[i] = std::async(std::launch::async, [&, i]() {
+      return indexTokens(file, dictionary, i, numWorkers);
+    });
+  }
+
+  TokenizedText text;
+  for (int i = 0; i < numWorkers; ++i) {
+    auto part = futures[i].get();
+    size_t offset = text.tokens.size();
+    text.tokens.insert(
+        text.tokens.end(), part.tokens.begin(), part.tokens.end());
+    for (size_t j = 1; j < part.sentenceOffsets.size(); ++j) {
+      text.sentenceOffsets.push_back(offset + part.sentenceOffsets[j]);
+    }
+  }
+  return text;
+}
+
 std::vector<TokenCountPair> Tokenizer::getDictionary() const {
   return tokenCountPairs_;
 }
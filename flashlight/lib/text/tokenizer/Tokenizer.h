@@ -11,6 +11,9 @@
 #include <unordered_map>
 #include <vector>
 
+#include "flashlight/lib/common/MemoryMappedFile.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
 namespace fl {
 namespace lib {
 namespace text {
@@ -21,6 +24,13 @@ namespace text {
 using TextFileMetaData = std::vector<std::pair<size_t, int>>;
 using TokenCountPair = std::pair<std::string, size_t>;
 
+// Token indices of the sentences of a text: sentence i is made of the tokens
+// [sentenceOffsets[i], sentenceOffsets[i + 1]).
+struct TokenizedText {
+  std::vector<int> tokens;
+  std::vector<size_t> sentenceOffsets{0};
+};
+
 /**
  * Tokenizer is designed to tokenize a given chunk of text.
  * It also supports to compute statistics of words in a given text dataset as
@@ -39,6 +49,14 @@ using TokenCountPair = std::pair<std::string, size_t>;
  * auto tokenCountPairs = tokenizer.getDictionary();
  * // Do something with the tokens
  *
+ * auto text = tokenizer.indexTokens(textFile, dictionary, nWorkers);
+ * // Do something with the token indices of the sentences
+ *
+ * Files are memory mapped and split between the workers as by
+ * PartialFileReader. Tokens are hashed and looked up in place, without being
+ * copied into strings, except the distinct tokens of `countTokens()` and the
+ * tokens of non-binary dictionaries which are too long to be stored inline.
+ *
  * -------------------------------
  *
  * This is still an early implementation, which only supports:
@@ -61,6 +79,19 @@ class Tokenizer {
       bool generateMetaData = false);
   void pruneTokens(int maxTokens = -1, int minAppearence = 0);
 
+  // Maps the tokens of the `rank`th of `totalParts` parts of a file to their
+  // indices in `dictionary`
+  TokenizedText indexTokens(
+      const MemoryMappedFile& file,
+      const Dictionary& dictionary,
+      int rank = 0,
+      int totalParts = 1) const;
+  // Same for a whole file, whose parts are processed by `numWorkers` threads
+  TokenizedText indexTokens(
+      const std::string& filename,
+      const Dictionary& dictionary,
+      int numWorkers = 1) const;
+
   std::vector<TokenCountPair> getDictionary() const;
   TextFileMetaData getTextFileMetaData() const;
 
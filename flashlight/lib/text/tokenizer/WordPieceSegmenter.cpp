@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/tokenizer/WordPieceSegmenter.h"
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "flashlight/lib/text/dictionary/Defines.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr size_t kNumCacheShards = 16;
+
+// Dictionary entries which are not pieces of words
+bool isSpecialToken(const std::string& token) {
+  return token == kUnkToken || token == kEosToken || token == kPadToken ||
+      token == kMaskToken;
+}
+
+int byteCode(char c) {
+  return static_cast<unsigned char>(c) + 1;
+}
+
+// Length of the UTF-8 sequence starting with byte `c`
+size_t utf8Length(char c) {
+  auto byte = static_cast<unsigned char>(c);
+  if (byte >= 0xF0) {
+    return 4;
+  } else if (byte >= 0xE0) {
+    return 3;
+  } else if (byte >= 0xC0) {
+    return 2;
+  }
+  return 1;
+}
+
+} // namespace
+
+DoubleArrayTrie::DoubleArrayTrie()
+    : base_(1, 0), check_(1, 0), value_(1, -1) {}
+
+DoubleArrayTrie::DoubleArrayTrie(
+    const std::vector<std::string>& keys,
+    const std::vector<int>& values)
+    : DoubleArrayTrie() {
+  if (keys.size() != values.size()) {
+    throw std::invalid_argument(
+        "[DoubleArrayTrie] Keys and values should have the same size");
+  }
+  std::vector<size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&keys](size_t lhs, size_t rhs) {
+    return keys[lhs] < keys[rhs];
+  });
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (keys[order[i]].empty() || values[order[i]] < 0 ||
+        (i > 0 && keys[order[i]] == keys[order[i - 1]])) {
+      throw std::invalid_argument(
+          "[DoubleArrayTrie] Invalid or duplicated key: '" + keys[order[i]] +
+          "'");
+    }
+  }
+
+  // Nodes are placed depth first. The keys [first, last) of `order` share the
+  // `depth` first bytes, which lead to `node`.
+  struct Range {
+    int32_t node;
+    size_t depth;
+    size_t first;
+    size_t last;
+  };
+  std::vector<Range> ranges{{0, 0, 0, order.size()}};
+  std::vector<int> codes;
+  std::vector<size_t> childFirst;
+  size_t firstFree = 1;
+  while (!ranges.empty()) {
+    Range range = ranges.back();
+    ranges.pop_back();
+    size_t i = range.first;
+    // The key ending at the node comes first in sorted order
+    if (i < range.last && keys[order[i]].size() == range.depth) {
+      value_[range.node] = values[order[i]];
+      ++i;
+    }
+    codes.clear();
+    childFirst.clear();
+    for (; i < range.last; ++i) {
+      int code = byteCode(keys[order[i]][range.depth]);
+      if (codes.empty() || codes.back() != code) {
+        codes.push_back(code);
+        childFirst.push_back(i);
+      }
+    }
+    if (codes.empty()) {
+      continue;
+    }
+    childFirst.push_back(range.last);
+
+    // The first base for which the slots of all the children are free
+    while (firstFree < check_.size() && check_[firstFree] >= 0) {
+      ++firstFree;
+    }
+    int32_t base = std::max<int64_t>(
+        static_cast<int64_t>(firstFree) - codes.front(), 0);
+    auto isFree = [this](size_t slot) {
+      return slot >= check_.size() || check_[slot] < 0;
+    };
+    while (!std::all_of(codes.begin(), codes.end(), [&](int code) {
+      return isFree(base + code);
+    })) {
+      ++base;
+    }
+    const size_t size = std::max<size_t>(base + codes.back() + 1, numSlots());
+    base_.resize(size, 0);
+    check_.resize(size, -1);
+    value_.resize(size, -1);
+
+    base_[range.node] = base;
+    for (size_t c = 0; c < codes.size(); ++c) {
+      check_[base + codes[c]] = range.node;
+    }
+    for (size_t c = 0; c < codes.size(); ++c) {
+      ranges.push_back(Range{
+          base + codes[c], range.depth + 1, childFirst[c], childFirst[c + 1]});
+    }
+  }
+}
+
+size_t DoubleArrayTrie::longestPrefix(
+    const char* str,
+    size_t size,
+    int* value) const {
+  size_t length = 0;
+  int32_t node = 0;
+  for (size_t i = 0; i < size; ++i) {
+    size_t next = static_cast<size_t>(base_[node]) + byteCode(str[i]);
+    if (next >= check_.size() || check_[next] != node) {
+      break;
+    }
+    node = next;
+    if (value_[node] >= 0) {
+      length = i + 1;
+      *value = value_[node];
+    }
+  }
+  return length;
+}
+
+// Least recently used entries of a part of the words
+struct WordPieceSegmenter::CacheShard {
+  struct Entry {
+    std::vector<int> indices;
+    bool isComplete;
+    std::list<const std::string*>::iterator lruPosition;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+  // Words of the entries, most recently used first
+  std::list<const std::string*> lru;
+};
+
+WordPieceSegmenter::WordPieceSegmenter(
+    const Dictionary& tokenDict,
+    size_t cacheSize /* = 100000 */) {
+  std::vector<std::string> tokens;
+  std::vector<int> indices;
+  for (int i = 0; i < tokenDict.indexSize(); ++i) {
+    auto token = tokenDict.getEntry(i);
+    if (!token.empty() && !isSpecialToken(token)) {
+      tokens.push_back(std::move(token));
+      indices.push_back(i);
+    }
+  }
+  trie_ = DoubleArrayTrie(tokens, indices);
+  createCache(cacheSize);
+}
+
+WordPieceSegmenter::WordPieceSegmenter(
+    const std::vector<std::string>& tokens,
+    const std::vector<int>& indices,
+    size_t cacheSize /* = 100000 */)
+    : trie_(tokens, indices) {
+  createCache(cacheSize);
+}
+
+void WordPieceSegmenter::createCache(size_t cacheSize) {
+  shardCapacity_ = (cacheSize + kNumCacheShards - 1) / kNumCacheShards;
+  if (cacheSize > 0) {
+    for (size_t i = 0; i < kNumCacheShards; ++i) {
+      cacheShards_.push_back(std::make_unique<CacheShard>());
+    }
+  }
+}
+
+WordPieceSegmenter::~WordPieceSegmenter() = default;
+
+bool WordPieceSegmenter::segment(
+    const std::string& word,
+    std::vector<int>& indices) const {
+  if (cacheShards_.empty()) {
+    return segmentUncached(word, indices);
+  }
+  auto& shard =
+      *cacheShards_[std::hash<std::string>()(word) % cacheShards_.size()];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(word);
+    if (it != shard.entries.end()) {
+      auto& entry = it->second;
+      shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPosition);
+      indices.insert(
+          indices.end(), entry.indices.begin(), entry.indices.end());
+      return entry.isComplete;
+    }
+  }
+
+  std::vector<int> wordIndices;
+  bool isComplete = segmentUncached(word, wordIndices);
+  indices.insert(indices.end(), wordIndices.begin(), wordIndices.end());
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto inserted = shard.entries.emplace(word, CacheShard::Entry());
+  if (inserted.second) {
+    auto& entry = inserted.first->second;
+    entry.indices = std::move(wordIndices);
+    entry.isComplete = isComplete;
+    shard.lru.push_front(&inserted.first->first);
+    entry.lruPosition = shard.lru.begin();
+    if (shard.entries.size() > shardCapacity_) {
+      auto evicted = shard.entries.find(*shard.lru.back());
+      shard.lru.pop_back();
+      shard.entries.erase(evicted);
+    }
+  }
+  return isComplete;
+}
+
+bool WordPieceSegmenter::segmentUncached(
+    const std::string& word,
+    std::vector<int>& indices) const {
+  bool isComplete = true;
+  size_t pos = 0;
+  while (pos < word.size()) {
+    int index;
+    size_t length =
+        trie_.longestPrefix(word.data() + pos, word.size() - pos, &index);
+    if (length > 0) {
+      indices.push_back(index);
+    } else {
+      // Skip the character
+      isComplete = false;
+      length = std::min(utf8Length(word[pos]), word.size() - pos);
+    }
+    pos += length;
+  }
+  return isComplete;
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * DoubleArrayTrie is an immutable trie of byte strings stored in two integer
+ * arrays: the child of node `s` for byte `c` is node `t = base[s] + c + 1` if
+ * `check[t] == s`. Following a byte is two array reads, without any hashing
+ * or pointer chasing.
+ */
+class DoubleArrayTrie {
+ public:
+  DoubleArrayTrie();
+
+  /* Build the trie of distinct `keys`, with non-negative `values` */
+  DoubleArrayTrie(
+      const std::vector<std::string>& keys,
+      const std::vector<int>& values);
+
+  /**
+   * Return the length of the longest key which is a prefix of [str, str +
+   * size) and set `value` to its value, or return 0 if there is none.
+   */
+  size_t longestPrefix(const char* str, size_t size, int* value) const;
+
+  /* Number of slots of the arrays */
+  size_t numSlots() const {
+    return check_.size();
+  }
+
+ private:
+  std::vector<int32_t> base_;
+  std::vector<int32_t> check_;
+  // Value of the key ending at each node, -1 if none
+  std::vector<int32_t> value_;
+};
+
+/**
+ * WordPieceSegmenter splits words into the tokens of a tokens set (word pieces
+ * or BPE units) by greedy longest match: the longest token which is a prefix
+ * of the remaining part of the word is taken until the word is consumed.
+ *
+ * The segmentation of the last `cacheSize` words is kept in a cache shared by
+ * all threads, split in shards locked independently, so that segmenting a
+ * word which was seen recently is a single hash lookup.
+ *
+ * Sample usage:
+ *
+ *   WordPieceSegmenter segmenter(tokenDict);
+ *   std::vector<int> indices;
+ *   for (word in words) {
+ *     if (!segmenter.segment("_" + word, indices)) {
+ *       // Some characters of the word are not in the tokens set
+ *     }
+ *   }
+ */
+class WordPieceSegmenter {
+ public:
+  /**
+   * Segment words into the entries of `tokenDict`, except the special tokens
+   * (<unk>, </s>, <pad> and <mask>)
+   */
+  explicit WordPieceSegmenter(
+      const Dictionary& tokenDict,
+      size_t cacheSize = 100000);
+
+  WordPieceSegmenter(
+      const std::vector<std::string>& tokens,
+      const std::vector<int>& indices,
+      size_t cacheSize = 100000);
+
+  ~WordPieceSegmenter();
+
+  /**
+   * Append the indices of the tokens of `word` to `indices`. The characters
+   * (UTF-8 sequences) which do not start any token are skipped, in which case
+   * false is returned.
+   */
+  bool segment(const std::string& word, std::vector<int>& indices) const;
+
+ private:
+  void createCache(size_t cacheSize);
+
+  bool segmentUncached(const std::string& word, std::vector<int>& indices)
+      const;
+
+  DoubleArrayTrie trie_;
+
+  struct CacheShard;
+  size_t shardCapacity_;
+  std::vector<std::unique_ptr<CacheShard>> cacheShards_;
+};
+
+} // namespace text
+} // namespace lib
+} // namespace fl